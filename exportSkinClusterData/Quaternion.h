@@ -0,0 +1,109 @@
+#ifndef QUATERNION_H
+#define QUATERNION_H
+
+#include "Vector.h"
+#include "Transform.h"
+
+// Quaternion Declarations
+struct Quaternion {
+	// Quaternion Public Methods
+	Quaternion() { v = Vector(0., 0., 0.); w = 1.f; }
+	Quaternion(const Vector &vv, float ww) : v(vv), w(ww) { }
+
+	Quaternion &operator+=(const Quaternion &q) {
+		v += q.v;
+		w += q.w;
+		return *this;
+	}
+	friend Quaternion operator+(const Quaternion &q1, const Quaternion &q2) {
+		Quaternion ret = q1;
+		return ret += q2;
+	}
+	Quaternion &operator-=(const Quaternion &q) {
+		v -= q.v;
+		w -= q.w;
+		return *this;
+	}
+	friend Quaternion operator-(const Quaternion &q1, const Quaternion &q2) {
+		Quaternion ret = q1;
+		return ret -= q2;
+	}
+	Quaternion &operator*=(float f) {
+		v *= f;
+		w *= f;
+		return *this;
+	}
+	Quaternion operator*(float f) const {
+		Quaternion ret = *this;
+		ret.v *= f;
+		ret.w *= f;
+		return ret;
+	}
+	Quaternion operator/(float f) const {
+		Quaternion ret = *this;
+		ret.v /= f;
+		ret.w /= f;
+		return ret;
+	}
+	// Hamilton product
+	friend Quaternion operator*(const Quaternion &q1, const Quaternion &q2) {
+		return Quaternion(q1.w * q2.v + q2.w * q1.v + Cross(q1.v, q2.v), q1.w * q2.w - Dot(q1.v, q2.v));
+	}
+
+	// rotation part of t, the linear part of t is assumed to be a rotation
+	Quaternion(const Transform &t);
+	Transform ToTransform() const;
+
+	Vector v;
+	float w;
+};
+
+
+Quaternion Slerp(float t, const Quaternion &q1, const Quaternion &q2);
+
+// Quaternion Inline Functions
+inline Quaternion operator*(float f, const Quaternion &q) {
+	return q * f;
+}
+
+
+inline float Dot(const Quaternion &q1, const Quaternion &q2) {
+	return Dot(q1.v, q2.v) + q1.w * q2.w;
+}
+
+
+inline Quaternion Normalize(const Quaternion &q) {
+	return q / sqrtf(Dot(q, q));
+}
+
+
+inline Quaternion Conjugate(const Quaternion &q) {
+	return Quaternion(-q.v, q.w);
+}
+
+
+// DualQuaternion Declarations
+// rigid transform, rotation q0 and translation t with qe = 0.5 * ( t, 0 ) * q0
+struct DualQuaternion {
+	DualQuaternion() { qe = Quaternion(Vector(0., 0., 0.), 0.f); }
+	DualQuaternion(const Quaternion &rot, const Quaternion &dual) : q0(rot), qe(dual) { }
+
+	// the scale of the linear part of t is removed first
+	DualQuaternion(const Transform &t);
+	Transform ToTransform() const;
+
+	Vector Translation() const {
+		Quaternion t = 2.f * (qe * Conjugate(q0));
+		return t.v;
+	}
+
+	Quaternion q0, qe;
+};
+
+
+inline DualQuaternion Normalize(const DualQuaternion &dq) {
+	float len = sqrtf(Dot(dq.q0, dq.q0));
+	return DualQuaternion(dq.q0 / len, dq.qe / len);
+}
+
+#endif
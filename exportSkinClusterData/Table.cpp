@@ -1,56 +1,292 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
 #include "Table.h"
 
-void meshTableFactory::meshInit(MItMeshVertex & vertexIter){
-	_mTable->pointPosTable.reserve(_numElems * vertexIter.count());
+void meshTableFactory::meshInit(const meshData & mesh){
+	unsigned int nPoints = mesh._numPoints;
+	_mTable->pointPosTable.reserve(_numElems * nPoints);
+	_mTable->pointIdxTable.reserve(nPoints);
 
-	unsigned int offset = 0;
-	for ( /* nothing */ ; !vertexIter.isDone(); vertexIter.next()) {
+	for (unsigned int i = 0; i < nPoints; i++) {
 		// push point idx
-		_mTable->pointIdxTable.push_back(vertexIter.index());
-		
+		_mTable->pointIdxTable.push_back(i);
+
 		// push point positions
-		MPoint pos = vertexIter.position();
-		for(unsigned int i = 0; i < 3; i++){
-			_mTable->pointPosTable.push_back(pos[i]);
+		const float * pos = &mesh._posPtr[i * 3];
+		for(unsigned int j = 0; j < 3; j++){
+			_mTable->pointPosTable.push_back(pos[j]);
 		}
 		_mTable->pointPosTable.push_back(0.0f);
+	}
+	_weights = &mesh._weights;
+
+	for (unsigned int j = 0; j < mesh._numInfluences; j++)
+		_jointIdxTable.push_back(mesh._jointIdxPtr[j]);
+}
+
 
-		// push adj points
-		MIntArray edges;
-		vertexIter.getConnectedEdges(edges);
-		std::size_t numEdges = edges.length();
-		_mTable->offsetTable.push_back(offset);
-
-		for (unsigned int i = 0; i < numEdges; i++)
-		{
-			int oppVert = -1;
-			vertexIter.getOppositeVertex(oppVert, edges[i]);
-			_mTable->adjPtIdxTable.push_back(oppVert);
+bool getPointOrder(const char * name, pointOrder & order){
+	if (strcmp(name, "maya") == 0)
+		order = ORDER_MAYA;
+	else if (strcmp(name, "rcm") == 0)
+		order = ORDER_RCM;
+	else if (strcmp(name, "morton") == 0)
+		order = ORDER_MORTON;
+	else
+		return false;
+	return true;
+}
+
+
+// new point -> old point, breadth first from a low degree point of each connected part, reversed
+static void rcmOrder(const meshTable & mTable, std::vector<unsigned int> & order){
+	std::size_t nPoints = mTable.pointIdxTable.size();
+	const tableArray<unsigned int> & offsets = mTable.offsetTable;
+	std::vector<unsigned int> byDegree(nPoints);
+	for (std::size_t i = 0; i < nPoints; i++)
+		byDegree[i] = (unsigned int)i;
+	std::stable_sort(byDegree.begin(), byDegree.end(), [&](unsigned int a, unsigned int b){
+		return offsets[a + 1] - offsets[a] < offsets[b + 1] - offsets[b];
+	});
+
+	std::vector<char> visited(nPoints, 0);
+	std::vector<unsigned int> adj;
+	order.clear();
+	order.reserve(nPoints);
+	for (std::size_t s = 0; s < nPoints; s++){
+		if (visited[byDegree[s]])
+			continue;
+		std::size_t head = order.size();
+		order.push_back(byDegree[s]);
+		visited[byDegree[s]] = 1;
+		for (; head < order.size(); head++){
+			unsigned int p = order[head];
+			adj.assign(mTable.adjPtIdxTable.begin() + offsets[p], mTable.adjPtIdxTable.begin() + offsets[p + 1]);
+			std::stable_sort(adj.begin(), adj.end(), [&](unsigned int a, unsigned int b){
+				return offsets[a + 1] - offsets[a] < offsets[b + 1] - offsets[b];
+			});
+			for (std::size_t k = 0; k < adj.size(); k++){
+				if (!visited[adj[k]]){
+					visited[adj[k]] = 1;
+					order.push_back(adj[k]);
+				}
+			}
 		}
-		offset += numEdges;
 	}
+	std::reverse(order.begin(), order.end());
+}
+
+
+// spread the 10 low bits of v to every third bit
+static inline unsigned int spreadBits(unsigned int v){
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
 }
 
-template<class computeController>
-void meshTableFactory::processWeights(){
-	// reorder joints' weights for each vertex
+
+// new point -> old point, sorted by the morton code of the position quantized over the mesh bbox
+static void mortonOrder(const meshTable & mTable, std::vector<unsigned int> & order){
+	std::size_t nPoints = mTable.pointIdxTable.size();
+	const unsigned int numElems = mTable._numElems;
+	float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+	for (std::size_t i = 0; i < nPoints; i++){
+		for (unsigned int a = 0; a < 3; a++){
+			lo[a] = std::min(lo[a], mTable.pointPosTable[i * numElems + a]);
+			hi[a] = std::max(hi[a], mTable.pointPosTable[i * numElems + a]);
+		}
+	}
+	float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+	float scale = extent > 0.0f ? 1023.0f / extent : 0.0f;
+
+	std::vector<std::pair<unsigned int, unsigned int>> codes(nPoints);
+	for (std::size_t i = 0; i < nPoints; i++){
+		unsigned int code = 0;
+		for (unsigned int a = 0; a < 3; a++)
+			code |= spreadBits((unsigned int)((mTable.pointPosTable[i * numElems + a] - lo[a]) * scale)) << a;
+		codes[i] = std::make_pair(code, (unsigned int)i);
+	}
+	std::sort(codes.begin(), codes.end());
+
+	order.resize(nPoints);
+	for (std::size_t i = 0; i < nPoints; i++)
+		order[i] = codes[i].second;
+}
 
 
-	// regroup/reorder the vertex index table by vertex' joint index
-	// assign value to ptJointIdxTable
+void meshTableFactory::reorder(pointOrder pOrder){
+	if (pOrder == ORDER_MAYA)
+		return;
 
+	const meshTable & mTable = *_mTable;
+	std::vector<unsigned int> order;
+	if (pOrder == ORDER_RCM)
+		rcmOrder(mTable, order);
+	else
+		mortonOrder(mTable, order);
+	permute(order);
 }
 
-template<class computeController>
-void jointsTableFactory::addJointTable(MItMeshPolygon & faceIter, std::vector<unsigned int> & faceIdxs, std::vector<double> & faceAreas, computeController & controller){
-	// TODO sort the area-face_index pair by area
 
-	// loop through all the triangles and get cdf 
+void meshTableFactory::permute(const std::vector<unsigned int> & order){
+	meshTable & mTable = *_mTable;
+	std::size_t nPoints = mTable.pointIdxTable.size();
+	std::vector<unsigned int> newIdx(nPoints);
+	for (std::size_t i = 0; i < nPoints; i++)
+		newIdx[order[i]] = (unsigned int)i;
 
-	// inverse cdf 
+	// point tables
+	tableArray<float> pointPosTable;
+	tableArray<unsigned int> pointIdxTable, ptJointIdxTable;
+	pointPosTable.resize(mTable.pointPosTable.size());
+	pointIdxTable.resize(nPoints);
+	ptJointIdxTable.resize(mTable.ptJointIdxTable.size());
+	for (std::size_t i = 0; i < nPoints; i++){
+		std::copy(&mTable.pointPosTable[order[i] * _numElems], &mTable.pointPosTable[order[i] * _numElems] + _numElems,
+			&pointPosTable[i * _numElems]);
+		pointIdxTable[i] = mTable.pointIdxTable[order[i]];
+		if (!ptJointIdxTable.empty())
+			ptJointIdxTable[i] = mTable.ptJointIdxTable[order[i]];
+	}
 
-	// convert to array 
+	// faces around each point, the face indices stay maya ones
+	tableArray<unsigned int> faceOffsetTable, adjFaceIdxTable;
+	if (mTable.faceOffsetTable.size() == nPoints + 1){
+		faceOffsetTable.resize(nPoints + 1);
+		adjFaceIdxTable.reserve(mTable.adjFaceIdxTable.size());
+		for (std::size_t i = 0; i < nPoints; i++){
+			faceOffsetTable[i] = (unsigned int)adjFaceIdxTable.size();
+			adjFaceIdxTable.insert(adjFaceIdxTable.end(), mTable.adjFaceIdxTable.begin() + mTable.faceOffsetTable[order[i]],
+				mTable.adjFaceIdxTable.begin() + mTable.faceOffsetTable[order[i] + 1]);
+		}
+		faceOffsetTable[nPoints] = (unsigned int)adjFaceIdxTable.size();
+	}
 
-	// random sampling points on triangles, total sample number = sample/perJointMesh  *  joints;
+	// adjacency, the adj points of a point stay sorted by index
+	tableArray<unsigned int> offsetTable, adjPtIdxTable;
+	tableArray<float> relaxWeightTable;
+	offsetTable.resize(nPoints + 1);
+	adjPtIdxTable.resize(mTable.adjPtIdxTable.size());
+	relaxWeightTable.resize(mTable.relaxWeightTable.size());
+	std::vector<std::pair<unsigned int, float>> adj;
+	unsigned int offset = 0;
+	for (std::size_t i = 0; i < nPoints; i++){
+		unsigned int p = order[i];
+		adj.clear();
+		for (unsigned int k = mTable.offsetTable[p]; k < mTable.offsetTable[p + 1]; k++)
+			adj.push_back(std::make_pair(newIdx[mTable.adjPtIdxTable[k]], mTable.relaxWeightTable[k]));
+		std::sort(adj.begin(), adj.end());
+
+		offsetTable[i] = offset;
+		for (std::size_t k = 0; k < adj.size(); k++, offset++){
+			adjPtIdxTable[offset] = adj[k].first;
+			relaxWeightTable[offset] = adj[k].second;
+		}
+	}
+	offsetTable[nPoints] = offset;
 
-}
\ No newline at end of file
+	mTable.pointPosTable.swap(pointPosTable);
+	mTable.pointIdxTable.swap(pointIdxTable);
+	mTable.ptJointIdxTable.swap(ptJointIdxTable);
+	mTable.offsetTable.swap(offsetTable);
+	mTable.adjPtIdxTable.swap(adjPtIdxTable);
+	mTable.relaxWeightTable.swap(relaxWeightTable);
+	mTable.faceOffsetTable.swap(faceOffsetTable);
+	mTable.adjFaceIdxTable.swap(adjFaceIdxTable);
+}
+
+
+jointsTableFactory::jTablePtr jointsTableFactory::getOrCreate(unsigned int jointIdx){
+	for (std::size_t i = 0; i < _jTableList.size(); i++){
+		if (_jTableList[i]->jointIdx == jointIdx)
+			return _jTableList[i];
+	}
+	jTablePtr jTable = std::make_shared<jointTable>(jointIdx);
+	_jTableList.push_back(jTable);
+	return jTable;
+}
+
+
+
+void jointsTableFactory::updateFaceStarts(const meshData & mesh){
+	if (_faceStartMesh == &mesh && _faceStarts.size() == mesh._numFaces)
+		return;
+	_faceStartMesh = &mesh;
+	_faceStarts.resize(mesh._numFaces);
+	unsigned int start = 0;
+	for (unsigned int f = 0; f < mesh._numFaces; f++){
+		_faceStarts[f] = start;
+		start += mesh._faceSizePtr[f];
+	}
+}
+
+
+void jointsTableFactory::sampleFace(const meshData & mesh, unsigned int face, double area, float u1, float u2, float u3, float * pos, float * normal) const{
+	unsigned int faceSize = mesh._faceSizePtr[face];
+	const int * verts = &mesh._neighbourPtr[_faceStarts[face]];
+	const float * p0 = &mesh._posPtr[verts[0] * 3];
+
+	// triangle of the fan, the last one takes what the rounding leaves
+	double target = u1 * area;
+	Vector e1, e2, cross;
+	for (unsigned int k = 1; k + 1 < faceSize; k++){
+		const float * p1 = &mesh._posPtr[verts[k] * 3];
+		const float * p2 = &mesh._posPtr[verts[k + 1] * 3];
+		e1 = Vector(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+		e2 = Vector(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+		cross = Cross(e1, e2);
+		target -= 0.5 * cross.Length();
+		if (target < 0.0)
+			break;
+	}
+
+	// uniform barycentric coordinates
+	float r = sqrtf(u2);
+	float b1 = r * (1.0f - u3), b2 = r * u3;
+	pos[0] = p0[0] + b1 * e1.x + b2 * e2.x;
+	pos[1] = p0[1] + b1 * e1.y + b2 * e2.y;
+	pos[2] = p0[2] + b1 * e1.z + b2 * e2.z;
+
+	float len = cross.Length();
+	float inv = len > 0.0f ? 1.0f / len : 0.0f;
+	normal[0] = cross.x * inv;
+	normal[1] = cross.y * inv;
+	normal[2] = cross.z * inv;
+}
+
+void jointTable::evalField(const Transform & toRest, const float * px, const float * py, const float * pz, unsigned int count,
+	float * f, float * gx, float * gy, float * gz) const{
+	if (grid){
+		grid->lookup(toRest, px, py, pz, count, f, gx, gy, gz);
+		return;
+	}
+	if (field.size() == 0){	// not fitted, outside everywhere
+		std::fill(f, f + count, 0.0f);
+		std::fill(gx, gx + count, 0.0f);
+		std::fill(gy, gy + count, 0.0f);
+		std::fill(gz, gz + count, 0.0f);
+		return;
+	}
+
+	// move the points to the rest pose a chunk at a time, no allocation
+	const unsigned int chunkSize = 256;
+	float rx[chunkSize], ry[chunkSize], rz[chunkSize];
+
+	// the gradient goes back to the current pose with the transpose of the linear part of toRest,
+	// which is the normal transform of its inverse
+	Transform toCurrent = Inverse(toRest);
+
+	for (unsigned int start = 0; start < count; start += chunkSize){
+		unsigned int n = std::min(chunkSize, count - start);
+		toRest.TransformPoints(px + start, py + start, pz + start, n, rx, ry, rz);
+
+		float * cf = f + start, * cgx = gx + start, * cgy = gy + start, * cgz = gz + start;
+		field.eval(rx, ry, rz, n, cf, cgx, cgy, cgz);
+
+		toCurrent.TransformNormals(cgx, cgy, cgz, n, cgx, cgy, cgz);
+	}
+}
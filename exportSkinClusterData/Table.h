@@ -5,31 +5,50 @@
 #ifndef TABLE_H
 #define TABLE_H
 
+#include <algorithm>
+#include <math.h>
 #include <vector>
 #include <memory>
 
-#include <maya/MItMeshVertex.h>
-#include <maya/MDoubleArray.h>
-#include <maya/MItMeshPolygon.h>
-
-#include "tree.h"
 #include "computeController.h"
+#include "parallelPrimitives.h"
+#include "tableArray.h"
 #include "Transform.h"
+#include "localCoord.h"
+#include "meshData.h"
+#include "hrbf.h"
+#include "fieldGrid.h"
+#include "skinTable.h"
+#include "surfaceSampler.h"
+
+// order of the points in the tables of a mesh
+enum pointOrder{
+	ORDER_MAYA = 0,		// maya vertex order
+	ORDER_RCM,			// reverse cuthill-mckee over the adjacency, adj points get close indices
+	ORDER_MORTON		// morton curve over the rest positions
+};
+
+// "maya", "rcm" or "morton"
+bool getPointOrder(const char * name, pointOrder & order);
+
 
 class meshTable{
 public:
-	meshTable(unsigned int numElems, unsigned int numJoints):
-	  _numElems(numElems), pointPosTable(std::vector<float>()), pointIdxTable(std::vector<unsigned int>()), 
-		  offsetTable(std::vector<unsigned int>()), adjPtIdxTable(std::vector<unsigned int>())
-	{};
+	meshTable(unsigned int numElems):_numElems(numElems){};
 
-	std::vector<float>		  pointPosTable;	// dynamic data, pos( x, y, z ) + original field value (w)
+	tableArray<float>		  pointPosTable;	// dynamic data, pos( x, y, z ) + original field value (w)
 
 	// static data
-	std::vector<unsigned int> pointIdxTable;	// point index to pointPosTable table, all the table below will count on this table
-	std::vector<unsigned int> offsetTable;		// point valence info offset in valence table
-	std::vector<unsigned int> adjPtIdxTable;	// adj point idxs table
-	std::vector<unsigned int> ptJointIdxTable;	// point' joint' index table
+	tableArray<unsigned int>  pointIdxTable;	// point index to pointPosTable table, all the table below will count on this table
+	tableArray<unsigned int>  offsetTable;		// point valence info offset in valence table, numPoints + 1 entries
+	tableArray<unsigned int>  adjPtIdxTable;	// adj point idxs table
+	tableArray<float>		  relaxWeightTable;	// relaxation weight of each adj point, the weights of a point sum to one
+	tableArray<unsigned int>  faceOffsetTable;	// first entry of each point in adjFaceIdxTable, numPoints + 1 entries
+	tableArray<unsigned int>  adjFaceIdxTable;	// faces around each point ( maya face indices ), increasing
+	tableArray<unsigned int>  ptJointIdxTable;	// point' joint' index table
+	tableArray<unsigned int>  jointOffsetTable;	// first point of each scene joint when the points are grouped by joint, numJoints + 1 entries,
+												// empty when they are not ( points assigned to other joints since )
+	skinTable				  skin;				// rest points and weights in table order, for the skinning pre-pass
 
 	int _numElems;								// point element size
 
@@ -38,53 +57,305 @@ public:
 
 class meshTableFactory{
 public:
-	meshTableFactory(unsigned int numJoints, unsigned int numElems = 4):_numJoints(numJoints), _numElems(numElems)
+	meshTableFactory(unsigned int numJoints, unsigned int numElems = 4):_numJoints(numJoints), _numElems(numElems), _weights(nullptr)
 	{
-		_mTable = std::make_shared<meshTable>(numElems, numJoints);
+		_mTable = std::make_shared<meshTable>(numElems);
 	}
 
-	void meshInit(MItMeshVertex & vertexIter); 
+	void meshInit(const meshData & mesh);
 
+	// adj points, their relaxation weights and the faces around each point, from the face-vertex list of the mesh.
+	// the edges and the face corners are radix sorted by point and the repeats dropped, in maya order
 	template<class computeController>
-	void processWeights(computeController & controller);
+	void buildAdjacency(const meshData & mesh, computeController & controller);
 
-	void addWeights(const MDoubleArray & wts){
-		for(unsigned int j = 0; j < _numJoints; j++)
-			_weightsTable.push_back(wts[j]);
-	}
+	// permute all the point tables together, pointIdxTable keeps the maya index of each point
+	void reorder(pointOrder order);
+
+	// group the points by joint, stable so a joint' points keep the order of reorder, and fill jointOffsetTable
+	template<class computeController>
+	void groupByJoint(unsigned int numJoints, computeController & controller);
+
+	// lay out the skinning table, after the reorder and the grouping
+	void skinInit(const meshData & mesh){ _mTable->skin.init(mesh, *_mTable, &_jointIdxTable[0]); }
+
+	// segment the points, a point belongs to the joint of its biggest weight. equal weights go to the joint of the
+	// lowest rank ( jointRanks by scene joint index, the flat position in the hierarchy puts parents first ),
+	// then to the lowest joint index, so the result does not depend on the influence order or the thread count
+	template<class computeController>
+	void processWeights(computeController & controller, const std::vector<int> * jointRanks = nullptr);
 
 	inline std::shared_ptr<meshTable> getMeshTable() { return _mTable;}
 
 	unsigned int _numJoints;
 	unsigned int _numElems;
-	std::vector<float> _weightsTable;		// joint weights table, which will be used to order the pointIdxTable.
+	const sparseWeights * _weights;			// weights of the mesh given to meshInit, which will be used to order the pointIdxTable.
+	std::vector<int> _jointIdxTable;		// influence index to the scene joint index
 
 private:
+	// the new point i is the old point order[i], in every point table
+	void permute(const std::vector<unsigned int> & order);
+
 	std::shared_ptr<meshTable> _mTable;
 };
 
 
 class jointTable{
 public:
+	jointTable(unsigned int idx = 0):sampleArea(0.0), jointIdx(idx){}
+
 	Matrix4x4 matrix;
 	localCoord coord;
-	std::vector<float> rbfPosParams;
-	std::vector<float> rbfNormalParams;
+	std::vector<float> samplePosTable;		// surface samples of the joint' partition at rest pose ( x, y, z )
+	std::vector<float> sampleNormalTable;	// face normal of each sample ( x, y, z )
+	double sampleArea;						// area of the faces the samples are drawn on
+	std::vector<float> rbfPosParams;		// hrbf center ( x, y, z ) + alpha, 4 floats per center
+	std::vector<float> rbfNormalParams;		// hrbf beta ( x, y, z ), 3 floats per center
+	hrbfField field;						// SoA copy of the params read by the field kernels
+	std::shared_ptr<fieldGrid> grid;		// baked field, evaluated instead of the hrbf when present
 	unsigned int jointIdx;
+
+	// compact field value and gradient at count points of the current pose stored SoA,
+	// toRest maps the current pose to the rest pose of the joint
+	void evalField(const Transform & toRest, const float * px, const float * py, const float * pz, unsigned int count,
+		float * f, float * gx, float * gy, float * gz) const;
 };
 
 
 class jointsTableFactory{
 public:
-	jointsTableFactory(unsigned int numJoints){ _jTableList.reserve(numJoints); }
+	typedef std::shared_ptr<jointTable> jTablePtr;
 
+	jointsTableFactory(unsigned int numJoints, unsigned int seed = 0):_seed(seed), _faceStartMesh(nullptr){ _jTableList.reserve(numJoints); }
+
+	// draw numSamples points uniformly over the faces of the mesh in the joint' partition, appended to the joint' samples.
+	// faceAreas is the area of each face of faceIdxs
+	template<class computeController>
+	void addJointTable(unsigned int jointIdx, const meshData & mesh, std::vector<unsigned int> & faceIdxs, std::vector<double> & faceAreas,
+		unsigned int numSamples, computeController & controller);
+
+	// the same for numSamples[k] points on the partition of joints[k], faceIdxs and faceAreas by joint. the joints in
+	// parallel, the samples of each one nested
 	template<class computeController>
-	void addJointTable(MItMeshPolygon & faceIter, std::vector<unsigned int> & faceIdxs, std::vector<double> & faceAreas, computeController & controller);
+	void addJointTables(const meshData & mesh, const std::vector<unsigned int> & joints, const std::vector<unsigned int> & numSamples,
+		std::vector<std::vector<unsigned int>> & faceIdxs, std::vector<std::vector<double>> & faceAreas, computeController & controller);
 
-	inline std::vector<jointTable *> getJointTable() { return _jTableList;}
+	// keep a well spread subset of the samples of each joint: no two closer than radius,
+	// or when radius is 0 the numCenters least crowded ones. 0 for both keeps all the samples
+	template<class computeController>
+	void selectCenters(unsigned int numCenters, float radius, computeController & controller);
+
+	inline std::vector<jTablePtr> getJointTable() { return _jTableList;}
 
 private:
-	std::vector<jointTable *> _jTableList;
+	jTablePtr getOrCreate(unsigned int jointIdx);
+	void updateFaceStarts(const meshData & mesh);
+	template<class computeController>
+	void drawSamples(jointTable & jTable, const meshData & mesh, std::vector<unsigned int> & faceIdxs, std::vector<double> & faceAreas,
+		unsigned int numSamples, computeController & controller);
+	// point of the face at uniform random numbers, a fan triangle is picked by area then a point in it
+	void sampleFace(const meshData & mesh, unsigned int face, double area, float u1, float u2, float u3, float * pos, float * normal) const;
+
+	std::vector<jTablePtr> _jTableList;
+	unsigned int _seed;
+	std::vector<unsigned int> _faceStarts;	// first vertex of each face of _faceStartMesh in its face-vertex list
+	const meshData * _faceStartMesh;
 };
 
-#endif
\ No newline at end of file
+
+template<class computeController>
+void meshTableFactory::buildAdjacency(const meshData & mesh, computeController & controller){
+	meshTable & mTable = *_mTable;
+	unsigned int nPoints = mesh._numPoints, nFaces = mesh._numFaces;
+	std::size_t nCorners = mesh._numFaceVerts;
+	const int * faceVerts = mesh._neighbourPtr.get();
+
+	// first corner of each face
+	std::vector<unsigned int> faceStarts(nFaces + 1, 0);
+	for (unsigned int f = 0; f < nFaces; f++)
+		faceStarts[f] = (unsigned int)mesh._faceSizePtr[f];
+	if (nFaces > 0)
+		exclusiveScan(&faceStarts[0], &faceStarts[0], nFaces + 1, controller);
+
+	// each face edge both ways, and each corner with its face
+	std::vector<unsigned int> edgeFrom(2 * nCorners), edgeTo(2 * nCorners), cornerPts(nCorners), cornerFaces(nCorners);
+	const std::size_t facesPerChunk = 4096;
+	controller.parallelRange(nFaces, facesPerChunk, [&](std::size_t begin, std::size_t end){
+		for (unsigned int f = (unsigned int)begin; f < end; f++){
+			unsigned int start = faceStarts[f], faceSize = faceStarts[f + 1] - start;
+			for (unsigned int k = 0; k < faceSize; k++){
+				unsigned int v0 = faceVerts[start + k], v1 = faceVerts[start + (k + 1) % faceSize];
+				edgeFrom[2 * (start + k)] = v0;
+				edgeTo[2 * (start + k)] = v1;
+				edgeFrom[2 * (start + k) + 1] = v1;
+				edgeTo[2 * (start + k) + 1] = v0;
+				cornerPts[start + k] = v0;
+				cornerFaces[start + k] = f;
+			}
+		}
+	});
+
+	// an edge shared by two faces is only kept once
+	if (nCorners > 0){
+		buildCsr(&edgeFrom[0], &edgeTo[0], 2 * nCorners, nPoints, nPoints, true, mTable.offsetTable, mTable.adjPtIdxTable, controller);
+		buildCsr(&cornerPts[0], &cornerFaces[0], nCorners, nPoints, nFaces, false, mTable.faceOffsetTable, mTable.adjFaceIdxTable, controller);
+	}
+	else {
+		mTable.offsetTable.assign(nPoints + 1, 0);
+		mTable.faceOffsetTable.assign(nPoints + 1, 0);
+	}
+
+	// relaxation weights, inverse rest edge length
+	mTable.relaxWeightTable.resize(mTable.adjPtIdxTable.size());
+	const std::size_t pointsPerChunk = 4096;
+	controller.parallelRange(nPoints, pointsPerChunk, [&](std::size_t begin, std::size_t end){
+		for (unsigned int i = (unsigned int)begin; i < end; i++){
+			const float * p = &mesh._posPtr[i * 3];
+			float sum = 0.0f;
+			for (unsigned int k = mTable.offsetTable[i]; k < mTable.offsetTable[i + 1]; k++){
+				const float * q = &mesh._posPtr[mTable.adjPtIdxTable[k] * 3];
+				float len = sqrtf((q[0] - p[0]) * (q[0] - p[0]) + (q[1] - p[1]) * (q[1] - p[1]) + (q[2] - p[2]) * (q[2] - p[2]));
+				mTable.relaxWeightTable[k] = 1.0f / std::max(len, 1e-6f);
+				sum += mTable.relaxWeightTable[k];
+			}
+			for (unsigned int k = mTable.offsetTable[i]; k < mTable.offsetTable[i + 1]; k++)
+				mTable.relaxWeightTable[k] /= sum;
+		}
+	});
+}
+
+
+template<class computeController>
+void meshTableFactory::processWeights(computeController & controller, const std::vector<int> * jointRanks){
+	std::size_t nPoints = _mTable->pointIdxTable.size();
+	_mTable->ptJointIdxTable.resize(nPoints);
+
+	// the slots are sorted by decreasing weight, the ties are the slots after the first one with the same weight
+	const std::size_t pointsPerChunk = 4096;
+	controller.parallelRange(nPoints, pointsPerChunk, [&](std::size_t begin, std::size_t end){
+		for (std::size_t i = begin; i < end; i++){
+			unsigned int point = _mTable->pointIdxTable[i];
+			float maxWeight = _weights->weight(point, 0);
+			int jointIdx = _jointIdxTable[_weights->influence(point, 0)];
+			for (unsigned int s = 1; s < _weights->numSlots() && maxWeight > 0.0f && _weights->weight(point, s) == maxWeight; s++){
+				int other = _jointIdxTable[_weights->influence(point, s)];
+				int rank = jointRanks ? (*jointRanks)[jointIdx] : 0, otherRank = jointRanks ? (*jointRanks)[other] : 0;
+				if (otherRank < rank || (otherRank == rank && other < jointIdx))
+					jointIdx = other;
+			}
+			_mTable->ptJointIdxTable[i] = jointIdx;
+		}
+	});
+
+}
+
+
+template<class computeController>
+void meshTableFactory::groupByJoint(unsigned int numJoints, computeController & controller){
+	meshTable & mTable = *_mTable;
+	std::size_t nPoints = mTable.ptJointIdxTable.size();
+
+	std::vector<unsigned int> keys(mTable.ptJointIdxTable.begin(), mTable.ptJointIdxTable.end()), order(nPoints);
+	for (std::size_t i = 0; i < nPoints; i++)
+		order[i] = (unsigned int)i;
+	if (nPoints > 0)
+		radixSort(&keys[0], &order[0], nPoints, controller, keyBitsOf(numJoints));
+	permute(order);
+
+	// the offsets are the exclusive scan of the joints' point counts
+	mTable.jointOffsetTable.assign(numJoints + 1, 0);
+	for (std::size_t i = 0; i < nPoints; i++)
+		mTable.jointOffsetTable[keys[i]]++;
+	exclusiveScan(&mTable.jointOffsetTable[0], &mTable.jointOffsetTable[0], numJoints + 1, controller);
+}
+
+
+template<class computeController>
+void jointsTableFactory::addJointTable(unsigned int jointIdx, const meshData & mesh, std::vector<unsigned int> & faceIdxs, std::vector<double> & faceAreas,
+	unsigned int numSamples, computeController & controller){
+	jTablePtr jTable = getOrCreate(jointIdx);
+	updateFaceStarts(mesh);
+	drawSamples(*jTable, mesh, faceIdxs, faceAreas, numSamples, controller);
+}
+
+
+template<class computeController>
+void jointsTableFactory::addJointTables(const meshData & mesh, const std::vector<unsigned int> & joints, const std::vector<unsigned int> & numSamples,
+	std::vector<std::vector<unsigned int>> & faceIdxs, std::vector<std::vector<double>> & faceAreas, computeController & controller){
+	// the tables are made first, in the order of the joints
+	std::vector<jTablePtr> tables(joints.size());
+	for (std::size_t k = 0; k < joints.size(); k++)
+		tables[k] = getOrCreate(joints[k]);
+	updateFaceStarts(mesh);
+
+	controller.parallelFor(joints.size(), [&](std::size_t k){
+		drawSamples(*tables[k], mesh, faceIdxs[joints[k]], faceAreas[joints[k]], numSamples[k], controller);
+	});
+}
+
+
+template<class computeController>
+void jointsTableFactory::drawSamples(jointTable & jTable, const meshData & mesh, std::vector<unsigned int> & faceIdxs, std::vector<double> & faceAreas,
+	unsigned int numSamples, computeController & controller){
+	// the faces are drawn with a probability proportional to their area, in O(1) each
+	aliasTable faceTable;
+	if (numSamples == 0 || faceIdxs.empty() || !faceTable.init(&faceAreas[0], (unsigned int)faceAreas.size()))
+		return;
+
+	for (std::size_t f = 0; f < faceAreas.size(); f++)
+		jTable.sampleArea += faceAreas[f];
+
+	std::size_t base = jTable.samplePosTable.size() / 3;
+	jTable.samplePosTable.resize((base + numSamples) * 3);
+	jTable.sampleNormalTable.resize((base + numSamples) * 3);
+	float * pos = &jTable.samplePosTable[base * 3];
+	float * normal = &jTable.sampleNormalTable[base * 3];
+
+	// the stream of a sample is keyed by the joint and the sample' index in the joint
+	counterRng rng(counterRng::mix(((uint64_t)_seed << 32) | jTable.jointIdx));
+	const std::size_t samplesPerChunk = 256;
+	controller.parallelRange(numSamples, samplesPerChunk, [&](std::size_t begin, std::size_t end){
+		for (std::size_t i = begin; i < end; i++){
+			uint64_t counter = (base + i) * 3;
+			float u[6];
+			rng.uniform2(counter, u[0], u[1]);
+			rng.uniform2(counter + 1, u[2], u[3]);
+			rng.uniform2(counter + 2, u[4], u[5]);
+
+			unsigned int f = faceTable.sample(u[0], u[1]);
+			sampleFace(mesh, faceIdxs[f], faceAreas[f], u[2], u[3], u[4], &pos[i * 3], &normal[i * 3]);
+		}
+	});
+}
+
+
+template<class computeController>
+void jointsTableFactory::selectCenters(unsigned int numCenters, float radius, computeController & controller){
+	if (numCenters == 0 && !(radius > 0.0f))
+		return;
+
+	controller.parallelFor(_jTableList.size(), [&](std::size_t t){
+		jointTable & jTable = *_jTableList[t];
+		unsigned int count = (unsigned int)(jTable.samplePosTable.size() / 3);
+		if (count == 0)
+			return;
+
+		std::vector<unsigned int> keep;
+		if (radius > 0.0f)
+			poissonDiskSelect(&jTable.samplePosTable[0], count, radius, keep);
+		else
+			eliminateSamples(&jTable.samplePosTable[0], count, numCenters, jTable.sampleArea, keep);
+
+		// kept in increasing order, compacted in place
+		for (std::size_t k = 0; k < keep.size(); k++){
+			for (unsigned int a = 0; a < 3; a++){
+				jTable.samplePosTable[k * 3 + a] = jTable.samplePosTable[keep[k] * 3 + a];
+				jTable.sampleNormalTable[k * 3 + a] = jTable.sampleNormalTable[keep[k] * 3 + a];
+			}
+		}
+		jTable.samplePosTable.resize(keep.size() * 3);
+		jTable.sampleNormalTable.resize(keep.size() * 3);
+	});
+}
+
+#endif
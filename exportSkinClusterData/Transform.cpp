@@ -1,7 +1,10 @@
-#include <stdio.h>		// memcpy
+#include <string.h>		// memcpy
 #include <utility>      // std::swap
 #include <iostream>		// cerr
-#include "transform.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+#include "Transform.h"
+#include "simd.h"
 
 Matrix4x4::Matrix4x4(float mat[4][4]) {
 	memcpy(m, mat, 16*sizeof(float));
@@ -27,7 +30,8 @@ Matrix4x4 Transpose(const Matrix4x4 &m) {
 }
 
 
-Matrix4x4 Inverse(const Matrix4x4 &m) {
+// pivoting inverse, kept for the matrices the block inverse can not handle
+Matrix4x4 GaussJordanInverse(const Matrix4x4 &m) {
 	int indxc[4], indxr[4];
 	int ipiv[4] = { 0, 0, 0, 0 };
 	float minv[4][4];
@@ -89,6 +93,122 @@ Matrix4x4 Inverse(const Matrix4x4 &m) {
 }
 
 
+// shuffles of the sse block inverse, a 2x2 matrix is held row major in one register
+#define SHUFFLE_MASK(x, y, z, w)	((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define SWIZZLE(v, x, y, z, w)		_mm_shuffle_ps(v, v, SHUFFLE_MASK(x, y, z, w))
+#define SHUFFLE(a, b, x, y, z, w)	_mm_shuffle_ps(a, b, SHUFFLE_MASK(x, y, z, w))
+
+// a * b
+static inline __m128 mat2Mul(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// adjugate( a ) * b
+static inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// a * adjugate( b )
+static inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+
+Matrix4x4 Inverse(const Matrix4x4 &m) {
+	if (m.IsAffine())
+		return AffineInverse(m);
+
+	// block inverse of | A B |, every block is a 2x2 matrix
+	//                  | C D |
+	__m128 r0 = _mm_loadu_ps(m.m[0]), r1 = _mm_loadu_ps(m.m[1]);
+	__m128 r2 = _mm_loadu_ps(m.m[2]), r3 = _mm_loadu_ps(m.m[3]);
+	__m128 A = _mm_movelh_ps(r0, r1), B = _mm_movehl_ps(r1, r0);
+	__m128 C = _mm_movelh_ps(r2, r3), D = _mm_movehl_ps(r3, r2);
+
+	// ( |A|, |B|, |C|, |D| )
+	__m128 detSub = _mm_sub_ps(_mm_mul_ps(SHUFFLE(r0, r2, 0, 2, 0, 2), SHUFFLE(r1, r3, 1, 3, 1, 3)),
+		_mm_mul_ps(SHUFFLE(r0, r2, 1, 3, 1, 3), SHUFFLE(r1, r3, 0, 2, 0, 2)));
+	__m128 detA = SWIZZLE(detSub, 0, 0, 0, 0), detB = SWIZZLE(detSub, 1, 1, 1, 1);
+	__m128 detC = SWIZZLE(detSub, 2, 2, 2, 2), detD = SWIZZLE(detSub, 3, 3, 3, 3);
+
+	__m128 DC = mat2AdjMul(D, C);
+	__m128 AB = mat2AdjMul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), mat2Mul(B, DC));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), mat2Mul(C, AB));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), mat2MulAdj(D, AB));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), mat2MulAdj(A, DC));
+
+	// |M| = |A||D| + |B||C| - tr( adj( A ) B adj( D ) C )
+	__m128 tr = _mm_mul_ps(AB, SWIZZLE(DC, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 1, 0, 3, 2));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 2, 3, 0, 1));
+	__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+	float det = _mm_cvtss_f32(detM);
+	float scale = fabsf(m.m[0][0]) + fabsf(m.m[1][1]) + fabsf(m.m[2][2]) + fabsf(m.m[3][3]);
+	if (!(fabsf(det) > 1e-6f * scale * scale * scale * scale))
+		return GaussJordanInverse(m);
+
+	__m128 rDet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+	X = _mm_mul_ps(X, rDet);
+	Y = _mm_mul_ps(Y, rDet);
+	Z = _mm_mul_ps(Z, rDet);
+	W = _mm_mul_ps(W, rDet);
+
+	// the adjugate of each block, stored as rows
+	Matrix4x4 r;
+	_mm_storeu_ps(r.m[0], SHUFFLE(X, Y, 3, 1, 3, 1));
+	_mm_storeu_ps(r.m[1], SHUFFLE(X, Y, 2, 0, 2, 0));
+	_mm_storeu_ps(r.m[2], SHUFFLE(Z, W, 3, 1, 3, 1));
+	_mm_storeu_ps(r.m[3], SHUFFLE(Z, W, 2, 0, 2, 0));
+	return r;
+}
+
+
+static inline __m128 cross3(__m128 a, __m128 b) {
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 1, 2, 0, 3)), _mm_mul_ps(SWIZZLE(a, 1, 2, 0, 3), b));
+	return SWIZZLE(c, 1, 2, 0, 3);
+}
+
+
+Matrix4x4 AffineInverse(const Matrix4x4 &m) {
+	// | L t |^-1 = | L^-1  -L^-1 t |, the rows of L^-1 are the cross products of the columns of L over |L|
+	// | 0 1 |      | 0      1      |
+	__m128 c0 = _mm_setr_ps(m.m[0][0], m.m[1][0], m.m[2][0], 0.f);
+	__m128 c1 = _mm_setr_ps(m.m[0][1], m.m[1][1], m.m[2][1], 0.f);
+	__m128 c2 = _mm_setr_ps(m.m[0][2], m.m[1][2], m.m[2][2], 0.f);
+	__m128 i0 = cross3(c1, c2), i1 = cross3(c2, c0), i2 = cross3(c0, c1);
+
+	__m128 d = _mm_mul_ps(c0, i0);
+	float det = _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(d, SWIZZLE(d, 1, 1, 1, 1)), SWIZZLE(d, 2, 2, 2, 2)));
+	float scale = fabsf(m.m[0][0]) + fabsf(m.m[1][1]) + fabsf(m.m[2][2]);
+	if (!(fabsf(det) > 1e-6f * scale * scale * scale))
+		return GaussJordanInverse(m);
+
+	__m128 rDet = _mm_set1_ps(1.f / det);
+	i0 = _mm_mul_ps(i0, rDet);
+	i1 = _mm_mul_ps(i1, rDet);
+	i2 = _mm_mul_ps(i2, rDet);
+
+	// -L^-1 t, as a combination of the columns of L^-1
+	__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.m[0][3]), SHUFFLE(_mm_unpacklo_ps(i0, i1), i2, 0, 1, 0, 3)),
+		_mm_mul_ps(_mm_set1_ps(m.m[1][3]), SHUFFLE(_mm_unpacklo_ps(i0, i1), i2, 2, 3, 1, 3))),
+		_mm_mul_ps(_mm_set1_ps(m.m[2][3]), SHUFFLE(_mm_unpackhi_ps(i0, i1), i2, 0, 1, 2, 3)));
+	float nt[4];
+	_mm_storeu_ps(nt, _mm_sub_ps(_mm_setzero_ps(), t));
+
+	Matrix4x4 r;
+	_mm_storeu_ps(r.m[0], i0);
+	_mm_storeu_ps(r.m[1], i1);
+	_mm_storeu_ps(r.m[2], i2);
+	r.m[0][3] = nt[0];
+	r.m[1][3] = nt[1];
+	r.m[2][3] = nt[2];
+	r.m[3][0] = 0.f; r.m[3][1] = 0.f; r.m[3][2] = 0.f; r.m[3][3] = 1.f;
+	return r;
+}
+
+
 Transform Translate(const Vector &delta) {
 	Matrix4x4 m(1, 0, 0, delta.x,
 		0, 1, 0, delta.y,
@@ -121,3 +241,161 @@ Transform Transform::operator*(const Transform &t2) const {
 	Matrix4x4 m2 = Matrix4x4::Mul(t2.mInv, mInv);
 	return Transform(m1, m2);
 }
+
+
+// batch kernels, out = rows * ( x, y, z, translate ), divided by the w row when it is not ( 0, 0, 0, 1 )
+struct soaRows {
+	float r[4][4];
+	float translate;	// 1 for points, 0 for vectors and normals
+	bool divide;
+};
+
+static void transformScalar(const soaRows & t, const float *x, const float *y, const float *z, unsigned int start, unsigned int count,
+	float *ox, float *oy, float *oz) {
+	for (unsigned int i = start; i < count; ++i) {
+		float px = x[i], py = y[i], pz = z[i];
+		float rx = t.r[0][0] * px + t.r[0][1] * py + t.r[0][2] * pz + t.r[0][3] * t.translate;
+		float ry = t.r[1][0] * px + t.r[1][1] * py + t.r[1][2] * pz + t.r[1][3] * t.translate;
+		float rz = t.r[2][0] * px + t.r[2][1] * py + t.r[2][2] * pz + t.r[2][3] * t.translate;
+		if (t.divide) {
+			float w = t.r[3][0] * px + t.r[3][1] * py + t.r[3][2] * pz + t.r[3][3];
+			if (w != 1.f) {
+				float invW = 1.f / w;
+				rx *= invW; ry *= invW; rz *= invW;
+			}
+		}
+		ox[i] = rx; oy[i] = ry; oz[i] = rz;
+	}
+}
+
+
+static unsigned int transformSse(const soaRows & t, const float *x, const float *y, const float *z, unsigned int count,
+	float *ox, float *oy, float *oz) {
+	__m128 m[4][4];
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c)
+			m[r][c] = _mm_set1_ps(c == 3 && r < 3 ? t.r[r][c] * t.translate : t.r[r][c]);
+	}
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+		__m128 o[3];
+		for (int r = 0; r < 3; ++r)
+			o[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r][0], px), _mm_mul_ps(m[r][1], py)), _mm_add_ps(_mm_mul_ps(m[r][2], pz), m[r][3]));
+		if (t.divide) {
+			__m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3][0], px), _mm_mul_ps(m[3][1], py)), _mm_add_ps(_mm_mul_ps(m[3][2], pz), m[3][3]));
+			__m128 invW = _mm_div_ps(_mm_set1_ps(1.f), w);
+			for (int r = 0; r < 3; ++r)
+				o[r] = _mm_mul_ps(o[r], invW);
+		}
+		_mm_storeu_ps(ox + i, o[0]);
+		_mm_storeu_ps(oy + i, o[1]);
+		_mm_storeu_ps(oz + i, o[2]);
+	}
+	return i;
+}
+
+
+SIMD_TARGET_AVX2 static unsigned int transformAvx2(const soaRows & t, const float *x, const float *y, const float *z, unsigned int count,
+	float *ox, float *oy, float *oz) {
+	__m256 m[4][4];
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c)
+			m[r][c] = _mm256_set1_ps(c == 3 && r < 3 ? t.r[r][c] * t.translate : t.r[r][c]);
+	}
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+		__m256 o[3];
+		for (int r = 0; r < 3; ++r)
+			o[r] = _mm256_fmadd_ps(m[r][0], px, _mm256_fmadd_ps(m[r][1], py, _mm256_fmadd_ps(m[r][2], pz, m[r][3])));
+		if (t.divide) {
+			__m256 w = _mm256_fmadd_ps(m[3][0], px, _mm256_fmadd_ps(m[3][1], py, _mm256_fmadd_ps(m[3][2], pz, m[3][3])));
+			__m256 invW = _mm256_div_ps(_mm256_set1_ps(1.f), w);
+			for (int r = 0; r < 3; ++r)
+				o[r] = _mm256_mul_ps(o[r], invW);
+		}
+		_mm256_storeu_ps(ox + i, o[0]);
+		_mm256_storeu_ps(oy + i, o[1]);
+		_mm256_storeu_ps(oz + i, o[2]);
+	}
+	return i;
+}
+
+
+SIMD_TARGET_AVX512 static unsigned int transformAvx512(const soaRows & t, const float *x, const float *y, const float *z, unsigned int count,
+	float *ox, float *oy, float *oz) {
+	__m512 m[4][4];
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c)
+			m[r][c] = _mm512_set1_ps(c == 3 && r < 3 ? t.r[r][c] * t.translate : t.r[r][c]);
+	}
+	unsigned int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m512 px = _mm512_loadu_ps(x + i), py = _mm512_loadu_ps(y + i), pz = _mm512_loadu_ps(z + i);
+		__m512 o[3];
+		for (int r = 0; r < 3; ++r)
+			o[r] = _mm512_fmadd_ps(m[r][0], px, _mm512_fmadd_ps(m[r][1], py, _mm512_fmadd_ps(m[r][2], pz, m[r][3])));
+		if (t.divide) {
+			__m512 w = _mm512_fmadd_ps(m[3][0], px, _mm512_fmadd_ps(m[3][1], py, _mm512_fmadd_ps(m[3][2], pz, m[3][3])));
+			__m512 invW = _mm512_div_ps(_mm512_set1_ps(1.f), w);
+			for (int r = 0; r < 3; ++r)
+				o[r] = _mm512_mul_ps(o[r], invW);
+		}
+		_mm512_storeu_ps(ox + i, o[0]);
+		_mm512_storeu_ps(oy + i, o[1]);
+		_mm512_storeu_ps(oz + i, o[2]);
+	}
+	return i;
+}
+
+
+typedef unsigned int (*transformFn)(const soaRows &, const float *, const float *, const float *, unsigned int, float *, float *, float *);
+
+static transformFn selectTransform() {
+	switch (getSimdLevel()) {
+	case SIMD_AVX512:	return transformAvx512;
+	case SIMD_AVX2:		return transformAvx2;
+	case SIMD_SSE4:		return transformSse;
+	default:			return nullptr;
+	}
+}
+
+
+static void transformBatch(const soaRows & t, const float *x, const float *y, const float *z, unsigned int count,
+	float *ox, float *oy, float *oz) {
+	const transformFn fn = selectTransform();
+	unsigned int done = fn ? fn(t, x, y, z, count, ox, oy, oz) : 0;
+	transformScalar(t, x, y, z, done, count, ox, oy, oz);
+}
+
+
+void Transform::TransformPoints(const float *x, const float *y, const float *z, unsigned int count,
+	float *ox, float *oy, float *oz) const {
+	soaRows t;
+	memcpy(t.r, m.m, 16 * sizeof(float));
+	t.translate = 1.f;
+	t.divide = !m.IsAffine();
+	transformBatch(t, x, y, z, count, ox, oy, oz);
+}
+
+
+void Transform::TransformVectors(const float *x, const float *y, const float *z, unsigned int count,
+	float *ox, float *oy, float *oz) const {
+	soaRows t;
+	memcpy(t.r, m.m, 16 * sizeof(float));
+	t.translate = 0.f;
+	t.divide = false;
+	transformBatch(t, x, y, z, count, ox, oy, oz);
+}
+
+
+void Transform::TransformNormals(const float *x, const float *y, const float *z, unsigned int count,
+	float *ox, float *oy, float *oz) const {
+	soaRows t;
+	Matrix4x4 invT = Transpose(mInv);
+	memcpy(t.r, invT.m, 16 * sizeof(float));
+	t.translate = 0.f;
+	t.divide = false;
+	transformBatch(t, x, y, z, count, ox, oy, oz);
+}
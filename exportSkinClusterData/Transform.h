@@ -1,7 +1,8 @@
 #ifndef TRANSFORM_H
 #define TRANSFORM_H
 
-#include "vector.h"
+#include <xmmintrin.h>
+#include "Vector.h"
 
 // Matrix4x4 Declarations
 class Matrix4x4 {
@@ -35,18 +36,35 @@ public:
 		return false;
 	}
 
+	// sse, each row of the result is a combination of the rows of m2
 	static Matrix4x4 Mul(const Matrix4x4 &m1, const Matrix4x4 &m2) {
 		Matrix4x4 r;
-		for (int i = 0; i < 4; ++i)
-			for (int j = 0; j < 4; ++j)
-				r.m[i][j] = m1.m[i][0] * m2.m[0][j] +
-				m1.m[i][1] * m2.m[1][j] +
-				m1.m[i][2] * m2.m[2][j] +
-				m1.m[i][3] * m2.m[3][j];
+		Mul(&m1.m[0][0], &m2.m[0][0], &r.m[0][0]);
 		return r;
 	}
-	
+
+	// the same on 16 floats row major, r may not alias m1 or m2
+	static void Mul(const float *m1, const float *m2, float *r) {
+		__m128 b0 = _mm_loadu_ps(m2), b1 = _mm_loadu_ps(m2 + 4);
+		__m128 b2 = _mm_loadu_ps(m2 + 8), b3 = _mm_loadu_ps(m2 + 12);
+		for (int i = 0; i < 4; ++i) {
+			__m128 row = _mm_mul_ps(_mm_set1_ps(m1[i * 4]), b0);
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1[i * 4 + 1]), b1));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1[i * 4 + 2]), b2));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1[i * 4 + 3]), b3));
+			_mm_storeu_ps(r + i * 4, row);
+		}
+	}
+
+	// last row ( 0, 0, 0, 1 )
+	bool IsAffine() const {
+		return m[3][0] == 0.f && m[3][1] == 0.f && m[3][2] == 0.f && m[3][3] == 1.f;
+	}
+
+	// affine matrices take AffineInverse, the others an sse block inverse, singular ones gauss-jordan
 	friend Matrix4x4 Inverse(const Matrix4x4 &);
+	friend Matrix4x4 AffineInverse(const Matrix4x4 &);
+	friend Matrix4x4 GaussJordanInverse(const Matrix4x4 &);	// pivoting, the reference of the other two
 	friend Matrix4x4 Transpose(const Matrix4x4 &);
 
 	float m[4][4];
@@ -133,6 +151,15 @@ public:
 	inline void operator()(const Normal &, Normal *nt) const;
 	Transform operator*(const Transform &t2) const;
 
+	// batch transforms of count points, vectors or normals stored SoA, the outputs may be the inputs.
+	// affine transforms skip the homogeneous divide of the points
+	void TransformPoints(const float *x, const float *y, const float *z, unsigned int count,
+		float *ox, float *oy, float *oz) const;
+	void TransformVectors(const float *x, const float *y, const float *z, unsigned int count,
+		float *ox, float *oy, float *oz) const;
+	void TransformNormals(const float *x, const float *y, const float *z, unsigned int count,
+		float *ox, float *oy, float *oz) const;
+
 private:
 	// Transform Private Data
 	Matrix4x4 m, mInv;
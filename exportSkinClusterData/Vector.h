@@ -302,4 +302,49 @@ public:
 	float x, y, z;
 };
 
+
+// Geometry Inline Functions
+inline Vector::Vector(const Point &p)
+	: x(p.x), y(p.y), z(p.z) {
+		Assert(!HasNaNs());
+}
+
+
+inline Vector::Vector(const Normal &n)
+	: x(n.x), y(n.y), z(n.z) {
+		Assert(!n.HasNaNs());
+}
+
+
+inline Vector operator*(float f, const Vector &v) { return v*f; }
+
+
+inline float Dot(const Vector &v1, const Vector &v2) {
+	Assert(!v1.HasNaNs() && !v2.HasNaNs());
+	return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+}
+
+
+inline Vector Cross(const Vector &v1, const Vector &v2) {
+	Assert(!v1.HasNaNs() && !v2.HasNaNs());
+	double v1x = v1.x, v1y = v1.y, v1z = v1.z;
+	double v2x = v2.x, v2y = v2.y, v2z = v2.z;
+	return Vector(float((v1y * v2z) - (v1z * v2y)),
+		float((v1z * v2x) - (v1x * v2z)),
+		float((v1x * v2y) - (v1y * v2x)));
+}
+
+
+inline Vector Normalize(const Vector &v) { return v / v.Length(); }
+
+
+inline float Distance(const Point &p1, const Point &p2) {
+	return (p1 - p2).Length();
+}
+
+
+inline float DistanceSquared(const Point &p1, const Point &p2) {
+	return (p1 - p2).LengthSquared();
+}
+
 #endif
\ No newline at end of file
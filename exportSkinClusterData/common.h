@@ -24,6 +24,7 @@
 #include <maya/MItMeshPolygon.h>
 #include <maya/MFnMesh.h>
 #include <maya/MMatrix.h>
+#include <maya/MPlug.h>
 
 //#include <limits>       // std::numeric_limits
 
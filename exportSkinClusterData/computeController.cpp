@@ -0,0 +1,351 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "computeController.h"
+
+typedef void (*itemFunc)(void * body, std::size_t begin, std::size_t end);
+typedef std::vector<unsigned char, alignedAllocator<unsigned char>> scratchBuffer;
+
+static thread_local unsigned int	workerOfThread = 0;		// index in the pool, 0 for the other threads
+static thread_local scratchBuffer	scratchOfThread;
+
+
+// the items left of a worker' share, [begin, end) packed in one word so the owner taking from the front and the
+// thieves taking the back half both update it with one compare and swap. a cache line each
+class workerShare{
+public:
+	static inline uint64_t pack(std::size_t begin, std::size_t end){ return ((uint64_t)begin << 32) | (uint64_t)end; }
+	static inline std::size_t begin(uint64_t range){ return (std::size_t)(range >> 32); }
+	static inline std::size_t end(uint64_t range){ return (std::size_t)(range & 0xffffffffu); }
+
+	std::atomic<uint64_t>	range;
+	unsigned char			pad[SIMD_ALIGN - sizeof(std::atomic<uint64_t>)];
+};
+
+
+// a parallelFor or parallelRange handed to the pool, on the stack of the calling thread
+class poolJob{
+public:
+	static const std::size_t maxItems = 0xffffffffu;	// of a job, a bigger call is a few jobs
+
+	// a thread takes part in the jobs of fewer workers than its index only when it made them
+	inline bool takesPart(unsigned int w) const { return w < numShares && (w < numWorkers || w == owner); }
+
+	itemFunc		func;
+	void *			body;
+	std::size_t		first;			// item of the call at the share begin 0
+	std::size_t		grain;			// items taken at a time, the shares are split at its multiples
+	unsigned int	numWorkers;
+	unsigned int	owner;			// the thread which made it
+	unsigned int	numShares;
+	std::unique_ptr<workerShare[]>	shares;		// by thread index
+	std::atomic<std::size_t>		remaining;	// items not done yet
+};
+
+
+// a job the idle threads see, users counts the threads looking at it so the owner knows when it may leave
+class jobSlot{
+public:
+	std::atomic<poolJob *>		job;
+	std::atomic<unsigned int>	users;
+	unsigned char				pad[SIMD_ALIGN - sizeof(std::atomic<poolJob *>) - sizeof(std::atomic<unsigned int>)];
+};
+
+
+class workerPool{
+public:
+	static const unsigned int maxJobs = 256;	// running at once, the jobs nested deeper run on their thread
+	static const unsigned int spinRounds = 64;	// an idle thread looks for work this many times before sleeping
+
+	workerPool():_numThreads(0), _slotEnd(0), _generation(0), _sleeping(0), _stop(false){
+		for (unsigned int s = 0; s < maxJobs; s++){
+			_slots[s].job.store(nullptr, std::memory_order_relaxed);
+			_slots[s].users.store(0, std::memory_order_relaxed);
+		}
+	}
+	~workerPool(){ stop(); }
+
+	// threads 1 to numWorkers - 1
+	void reserve(unsigned int numWorkers){
+		std::lock_guard<std::mutex> lock(_mutex);
+		while (_threads.size() + 1 < numWorkers){
+			unsigned int index = (unsigned int)_threads.size() + 1;
+			_threads.push_back(std::thread(&workerPool::threadMain, this, index));
+			_numThreads.store((unsigned int)_threads.size(), std::memory_order_release);
+		}
+	}
+
+	bool run(std::size_t count, std::size_t grain, unsigned int numWorkers, itemFunc func, void * body){
+		unsigned int maxWorkers = _numThreads.load(std::memory_order_acquire) + 1;
+		numWorkers = numWorkers < maxWorkers ? numWorkers : maxWorkers;
+		if (numWorkers <= 1)
+			return false;
+
+		std::size_t piece = poolJob::maxItems / grain * grain;
+		for (std::size_t first = 0; first < count; first += piece)
+			runJob(first, count - first < piece ? count - first : piece, grain, numWorkers, func, body);
+		return true;
+	}
+
+	void stop(){
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop.store(true);
+		}
+		_wake.notify_all();
+		for (std::size_t t = 0; t < _threads.size(); t++)
+			_threads[t].join();
+		_threads.clear();
+		_numThreads.store(0);
+		_stop.store(false);
+	}
+
+private:
+	void runJob(std::size_t first, std::size_t count, std::size_t grain, unsigned int numWorkers, itemFunc func, void * body){
+		unsigned int self = workerOfThread;
+		poolJob job;
+		job.func		= func;
+		job.body		= body;
+		job.first		= first;
+		job.grain		= grain;
+		job.numWorkers	= numWorkers;
+		job.owner		= self;
+		job.numShares	= numWorkers > self ? numWorkers : self + 1;
+		job.shares.reset(new workerShare[job.numShares]);
+		for (unsigned int w = 0; w < job.numShares; w++)
+			job.shares[w].range.store(0, std::memory_order_relaxed);
+		job.remaining.store(count, std::memory_order_relaxed);
+
+		// a call from outside of the pool is shared out between the workers as they all start idle, a nested
+		// one is left to the stealing of the threads done with their own work
+		if (self == 0){
+			for (unsigned int w = 0; w < numWorkers; w++){
+				std::size_t begin = count * w / numWorkers / grain * grain, end = count * (w + 1) / numWorkers / grain * grain;
+				job.shares[w].range.store(workerShare::pack(begin, w + 1 < numWorkers ? end : count), std::memory_order_relaxed);
+			}
+		}
+		else
+			job.shares[self].range.store(workerShare::pack(0, count), std::memory_order_relaxed);
+
+		jobSlot * slot = publish(&job);
+
+		// the own job first, then the others while the last items of it are run by other threads
+		while (job.remaining.load(std::memory_order_acquire) != 0){
+			if (workOn(job, self))
+				continue;
+			if (self == 0 || !helpOnce(self))
+				std::this_thread::yield();
+		}
+
+		// the threads still looking at the job are waited for, it leaves the stack after. sequentially consistent
+		// with the users of helpOnce: either a thread counted itself before the job left the slot, or it sees it gone
+		if (slot){
+			slot->job.store(nullptr);
+			while (slot->users.load() != 0)
+				std::this_thread::yield();
+		}
+	}
+
+	// the job in a free slot, and the sleeping threads woken up. null when every slot is taken, the job is run
+	// by its thread alone
+	jobSlot * publish(poolJob * job){
+		for (unsigned int s = 0; s < maxJobs; s++){
+			poolJob * empty = nullptr;
+			if (_slots[s].job.load(std::memory_order_relaxed) != nullptr || _slots[s].users.load(std::memory_order_relaxed) != 0 ||
+				!_slots[s].job.compare_exchange_strong(empty, job, std::memory_order_acq_rel))
+				continue;
+
+			unsigned int end = _slotEnd.load(std::memory_order_relaxed);
+			while (end < s + 1 && !_slotEnd.compare_exchange_weak(end, s + 1, std::memory_order_acq_rel));
+
+			_generation.fetch_add(1);
+			if (_sleeping.load() > 0){
+				{ std::lock_guard<std::mutex> lock(_mutex); }
+				_wake.notify_all();
+			}
+			return &_slots[s];
+		}
+		return nullptr;
+	}
+
+	void threadMain(unsigned int index){
+		workerOfThread = index;
+		unsigned int rounds = 0;
+		while (!_stop.load(std::memory_order_relaxed)){
+			uint64_t generation = _generation.load();
+			if (helpOnce(index)){
+				rounds = 0;
+				continue;
+			}
+			if (++rounds < spinRounds){
+				std::this_thread::yield();
+				continue;
+			}
+
+			// no job was published since the last look, until one is
+			std::unique_lock<std::mutex> lock(_mutex);
+			_sleeping.fetch_add(1);
+			_wake.wait(lock, [&](){ return _stop.load() || _generation.load() != generation; });
+			_sleeping.fetch_sub(1);
+			rounds = 0;
+		}
+	}
+
+	// one chunk of any job the thread takes part in
+	bool helpOnce(unsigned int w){
+		unsigned int end = _slotEnd.load(std::memory_order_acquire);
+		for (unsigned int s = 0; s < end; s++){
+			jobSlot & slot = _slots[s];
+			if (slot.job.load(std::memory_order_relaxed) == nullptr)
+				continue;
+			slot.users.fetch_add(1);
+			poolJob * job = slot.job.load();
+			bool worked = job && job->takesPart(w) && workOn(*job, w);
+			slot.users.fetch_sub(1, std::memory_order_release);
+			if (worked)
+				return true;
+		}
+		return false;
+	}
+
+	// one chunk of the job from the front of the own share, stolen first when it is empty. false when every share is
+	static bool workOn(poolJob & job, unsigned int w){
+		std::atomic<uint64_t> & own = job.shares[w].range;
+		for (;;){
+			uint64_t range = own.load(std::memory_order_acquire);
+			std::size_t begin = workerShare::begin(range), end = workerShare::end(range);
+			if (begin >= end){
+				if (!steal(job, w))
+					return false;
+				continue;
+			}
+			std::size_t stop = begin + job.grain < end ? begin + job.grain : end;
+			if (!own.compare_exchange_weak(range, workerShare::pack(stop, end), std::memory_order_acq_rel))
+				continue;
+			job.func(job.body, job.first + begin, job.first + stop);
+			job.remaining.fetch_sub(stop - begin, std::memory_order_acq_rel);
+			return true;
+		}
+	}
+
+	// the back half of the share of another worker, split at a multiple of the grain, into the empty own share
+	static bool steal(poolJob & job, unsigned int w){
+		for (unsigned int k = 1; k < job.numShares; k++){
+			std::atomic<uint64_t> & victim = job.shares[(w + k) % job.numShares].range;
+			uint64_t range = victim.load(std::memory_order_acquire);
+			while (workerShare::begin(range) < workerShare::end(range)){
+				std::size_t begin = workerShare::begin(range), end = workerShare::end(range);
+				std::size_t mid = begin + (end - begin) / 2 / job.grain * job.grain;
+				if (victim.compare_exchange_weak(range, workerShare::pack(begin, mid), std::memory_order_acq_rel)){
+					job.shares[w].range.store(workerShare::pack(mid, end), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	std::mutex					_mutex;
+	std::condition_variable		_wake;
+	std::vector<std::thread>	_threads;
+	std::atomic<unsigned int>	_numThreads;
+	jobSlot						_slots[maxJobs];
+	std::atomic<unsigned int>	_slotEnd;		// past the last slot ever used
+	std::atomic<uint64_t>		_generation;	// of the last job published, a sleeping thread wakes up when it changes
+	std::atomic<unsigned int>	_sleeping;
+	std::atomic<bool>			_stop;
+};
+
+
+static workerPool & getPool(){
+	static workerPool pool;
+	return pool;
+}
+
+
+void * computeController::scratchBytes(std::size_t size){
+	if (scratchOfThread.size() < size)
+		scratchOfThread.resize(size);
+	return scratchOfThread.data();
+}
+
+
+threadController::threadController(unsigned int numThreads, bool deterministic):_numThreads(numThreads), _deterministic(deterministic){
+	if (_numThreads == 0)
+		_numThreads = std::thread::hardware_concurrency();
+	if (_numThreads == 0)
+		_numThreads = 1;
+	getPool().reserve(_numThreads);
+}
+
+
+unsigned int threadController::workerIndex(){
+	return workerOfThread;
+}
+
+
+void threadController::stopPool(){
+	getPool().stop();
+}
+
+
+bool threadController::run(std::size_t count, std::size_t grain, unsigned int numWorkers, rangeFunc func, void * body){
+	return getPool().run(count, grain, numWorkers, func, body);
+}
+
+
+static unsigned int lanesOf(simdLevel level){
+	switch (level){
+	case SIMD_SSE4:		return 4;
+	case SIMD_AVX2:		return 8;
+	case SIMD_AVX512:	return 16;
+	default:			return 1;
+	}
+}
+
+
+simdController::simdController(unsigned int numThreads, bool deterministic):threadController(numThreads, deterministic),
+	_laneWidth(lanesOf(getSimdLevel())){}
+
+
+static controllerSettings initControllerSettings(){
+	controllerSettings settings;
+	const char * env = getenv("IMPLICIT_SKINNING_CONTROLLER");
+	if (env)
+		getControllerKind(env, settings.kind);
+	return settings;
+}
+
+
+controllerSettings & getControllerSettings(){
+	static controllerSettings settings = initControllerSettings();
+	return settings;
+}
+
+
+bool getControllerKind(const char * name, controllerKind & kind){
+	if (strcmp(name, "serial") == 0)
+		kind = CONTROLLER_SERIAL;
+	else if (strcmp(name, "pool") == 0)
+		kind = CONTROLLER_POOL;
+	else if (strcmp(name, "simd") == 0)
+		kind = CONTROLLER_SIMD;
+	else
+		return false;
+	return true;
+}
+
+
+const char * getControllerKindName(controllerKind kind){
+	switch (kind){
+	case CONTROLLER_SERIAL:	return "serial";
+	case CONTROLLER_SIMD:	return "simd";
+	default:				return "pool";
+	}
+}
@@ -5,13 +5,228 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
-// abstract class
+#include <cstddef>
+#include <vector>
+
+#include "simd.h"
+
+// the prep and deform stages are templated on a controller, which spreads their work:
+//   numWorkers()		threads the work is spread over
+//   laneWidth()		floats of a simd register, parallelRange chunks are multiples of it
+//   deterministic()	parallelReduce gives the same bits whatever the number of workers and the scheduling
+//   parallelFor(count, body(i))					each i of [0, count) once, in any order
+//   parallelRange(count, grain, body(begin, end))	[0, count) in chunks of at least grain items ( rounded to the lanes ),
+//													0 picks the grain of the number of workers
+//   parallelReduce(count, init, map(i), combine(a, b))	init combined with map(i) of every i, combine associative
+//   scratch<T>(count)	aligned buffer of the calling thread, kept until its next scratch call, so not across a nested call
+// the scans and the radix sort of parallelPrimitives.h work over any controller, their blocks are fixed so they are
+// always deterministic. the derived classes hide the methods instead of overriding them, nothing is virtual
+
+
+// runs the work serially on the calling thread, the reference of the other controllers
 class computeController{
+public:
+	inline unsigned int numWorkers() const { return 1; }
+	inline unsigned int laneWidth() const { return 1; }
+	inline bool deterministic() const { return true; }
+
+	// call body(i) for each i in [0, count)
+	template<class Body>
+	void parallelFor(std::size_t count, const Body & body){
+		for (std::size_t i = 0; i < count; i++)
+			body(i);
+	}
+
+	template<class Body>
+	void parallelRange(std::size_t count, std::size_t grain, const Body & body){
+		grain = grain > 0 ? grain : count;
+		for (std::size_t start = 0; start < count; start += grain)
+			body(start, start + grain < count ? start + grain : count);
+	}
+
+	template<class T, class Map, class Combine>
+	T parallelReduce(std::size_t count, T init, const Map & map, const Combine & combine){
+		for (std::size_t i = 0; i < count; i++)
+			init = combine(init, map(i));
+		return init;
+	}
+
+	template<class T>
+	T * scratch(std::size_t count){
+		return static_cast<T *>(scratchBytes(count * sizeof(T)));
+	}
+
+protected:
+	static void * scratchBytes(std::size_t size);
+};
+
+
+// work stealing scheduler over a pool of threads kept between the calls, the calling thread is one of the workers.
+// a call is a job of items, each worker takes a chunk of grain items at a time from the front of its share and,
+// done with it, steals the back half of the share of another worker. so a big range is split as long as there
+// are idle workers and items of uneven cost are balanced. a parallelFor from inside a body is a job of its own
+// the idle threads steal from as well: the joints of a stage run in parallel, and the chunks of a big joint are
+// spread over the threads done with the small ones. a thread waiting for its job to finish runs the items of the
+// other jobs meanwhile, a thread outside of the pool only runs the items of its own jobs
+class threadController : public computeController{
+public:
+	threadController(unsigned int numThreads = 0, bool deterministic = false);
+
+	inline unsigned int numWorkers() const { return _numThreads; }
+	inline bool deterministic() const { return _deterministic; }
+
+	template<class Body>
+	void parallelFor(std::size_t count, const Body & body){
+		if (_numThreads <= 1 || count <= 1 || !run(count, 1, _numThreads, &callBody<Body>, (void *)&body))
+			computeController::parallelFor(count, body);
+	}
+
+	template<class Body>
+	void parallelRange(std::size_t count, std::size_t grain, const Body & body){
+		grain = grain > 0 ? grain : autoGrain(count);
+		if (_numThreads <= 1 || count <= grain || !run(count, grain, _numThreads, &callRange<Body>, (void *)&body))
+			computeController::parallelRange(count, grain, body);
+	}
+
+	// deterministic, blocks of reduceBlockSize items combined in order. otherwise one running value for each
+	// worker, the items of a worker depend on the stealing
+	template<class T, class Map, class Combine>
+	T parallelReduce(std::size_t count, T init, const Map & map, const Combine & combine){
+		std::vector<T> partials;
+		std::vector<unsigned char> used;
+		if (_deterministic){
+			std::size_t numBlocks = (count + reduceBlockSize - 1) / reduceBlockSize;
+			partials.resize(numBlocks, init);
+			parallelFor(numBlocks, [&](std::size_t b){
+				std::size_t end = (b + 1) * reduceBlockSize < count ? (b + 1) * reduceBlockSize : count;
+				T value = map(b * reduceBlockSize);
+				for (std::size_t i = b * reduceBlockSize + 1; i < end; i++)
+					value = combine(value, map(i));
+				partials[b] = value;
+			});
+			used.assign(numBlocks, 1);
+		}
+		else{
+			partials.resize(_numThreads, init);
+			used.assign(_numThreads, 0);
+			parallelFor(count, [&](std::size_t i){
+				// map first, a thread waiting in a nested call of map runs the other items of this call
+				T value = map(i);
+				unsigned int w = workerSlot();
+				partials[w] = used[w] ? combine(partials[w], value) : value;
+				used[w] = 1;
+			});
+		}
+		for (std::size_t p = 0; p < partials.size(); p++){
+			if (used[p])
+				init = combine(init, partials[p]);
+		}
+		return init;
+	}
+
+	// index of the calling thread in the pool, 0 for the other threads. the workers of a job of n workers are the
+	// threads 1 to n - 1 of the pool and the calling thread
+	static unsigned int workerIndex();
+
+	// stop the threads of the pool, before unloading the plugin, no job may be running. the next job starts them again
+	static void stopPool();
+
+	static const std::size_t reduceBlockSize = 1024;
 
+protected:
+	typedef void (*rangeFunc)(void * body, std::size_t begin, std::size_t end);
+
+	template<class Body>
+	static void callBody(void * body, std::size_t begin, std::size_t end){
+		const Body & b = *(const Body *)body;
+		for (std::size_t i = begin; i < end; i++)
+			b(i);
+	}
+
+	template<class Body>
+	static void callRange(void * body, std::size_t begin, std::size_t end){
+		(*(const Body *)body)(begin, end);
+	}
+
+	// a few chunks for each worker, enough to balance them
+	inline std::size_t autoGrain(std::size_t count) const {
+		std::size_t grain = count / (8 * (std::size_t)_numThreads);
+		return grain > 0 ? grain : 1;
+	}
+
+	// func over the chunks of [0, count) on numWorkers workers of the pool, false when it has to run on the calling thread
+	static bool run(std::size_t count, std::size_t grain, unsigned int numWorkers, rangeFunc func, void * body);
+
+	// a worker beyond the workers of this controller is in the parallelFor of another one and runs this one serially
+	inline unsigned int workerSlot() const {
+		unsigned int w = workerIndex();
+		return w < _numThreads ? w : 0;
+	}
+
+	unsigned int	_numThreads;
+	bool			_deterministic;
 };
 
 
-// TODO need concrete derived class
+// the thread pool with chunks cut for the simd kernels: a parallelRange chunk is a multiple of the register width
+// and of a cache line of floats, so only the last chunk has a scalar tail and no two chunks write the same line
+class simdController : public threadController{
+public:
+	simdController(unsigned int numThreads = 0, bool deterministic = false);
+
+	inline unsigned int laneWidth() const { return _laneWidth; }
+
+	template<class Body>
+	void parallelRange(std::size_t count, std::size_t grain, const Body & body){
+		std::size_t align = _laneWidth > SIMD_ALIGN / sizeof(float) ? _laneWidth : SIMD_ALIGN / sizeof(float);
+		grain = grain > 0 ? grain : autoGrain(count);
+		threadController::parallelRange(count, (grain + align - 1) / align * align, body);
+	}
+
+private:
+	unsigned int	_laneWidth;
+};
 
 
-#endif
\ No newline at end of file
+// the controller the stages of sceneData and rbfDeformer run on, so each one is benchmarked under each
+// controller without rebuilding. by default the one of the IMPLICIT_SKINNING_CONTROLLER environment
+// variable ( serial, pool, simd ), pool otherwise
+enum controllerKind{
+	CONTROLLER_SERIAL = 0,	// computeController
+	CONTROLLER_POOL,		// threadController
+	CONTROLLER_SIMD			// simdController
+};
+
+class controllerSettings{
+public:
+	controllerSettings():kind(CONTROLLER_POOL), numThreads(0), deterministic(false){}
+
+	controllerKind	kind;
+	unsigned int	numThreads;		// 0 is one for each core
+	bool			deterministic;
+};
+
+controllerSettings & getControllerSettings();
+bool getControllerKind(const char * name, controllerKind & kind);
+const char * getControllerKindName(controllerKind kind);
+
+// task(controller) with a controller of the settings, task is generic over the controller type
+template<class Task>
+void withController(const Task & task){
+	const controllerSettings & settings = getControllerSettings();
+	if (settings.kind == CONTROLLER_SERIAL){
+		computeController controller;
+		task(controller);
+	}
+	else if (settings.kind == CONTROLLER_SIMD){
+		simdController controller(settings.numThreads, settings.deterministic);
+		task(controller);
+	}
+	else{
+		threadController controller(settings.numThreads, settings.deterministic);
+		task(controller);
+	}
+}
+
+
+#endif
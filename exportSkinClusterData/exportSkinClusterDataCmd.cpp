@@ -177,6 +177,11 @@ MStatus exportSkinClusterData::doIt( const MArgList& args )
 			#ifdef _DEBUG
 				tree->traverse(tree->root, printOp(file));
 			#endif
+
+			// node and depth of each influence, looked up for every face
+			std::vector<nodeDepth> jointNodes;
+			tree->indexNodes(jointNodes);
+			jointNodes.resize(std::max((std::size_t)nInfs, jointNodes.size()), std::make_pair(std::shared_ptr<binaryTreeNode>(), 0u));
 			
 
 			// loop through the geometries affected by this cluster
@@ -248,22 +253,12 @@ MStatus exportSkinClusterData::doIt( const MArgList& args )
 								maxIndex2 = j;
 							}
 						}
-						std::shared_ptr<binaryTreeNode> result1, result2;
-						if (max1 == max2){
-							unsigned int level1 = 0, level2 = 0;
-							tree->find(tree->root, findLevelOp(maxIndex1), level1, result1);
-							tree->find(tree->root, findLevelOp(maxIndex1), level2, result2);
-							if (level1 > level2){ // max1' level is higher than max2's 
-								resultIndex = maxIndex2;
-								maxEffectJoint = result2;
-							}
-						}
-						else {
-							resultIndex = maxIndex1;
-							unsigned int level1 = 0;
-							tree->find(tree->root, findLevelOp(maxIndex1), level1, result1);
-							maxEffectJoint = result1;
-						}
+						// equal weights go to the joint closer to the root, then to the lower influence index
+						resultIndex = maxIndex1;
+						if (max1 == max2 && (jointNodes[maxIndex1].second > jointNodes[maxIndex2].second ||
+							(jointNodes[maxIndex1].second == jointNodes[maxIndex2].second && maxIndex2 < maxIndex1)))
+							resultIndex = maxIndex2;
+						maxEffectJoint = jointNodes[resultIndex].first;
 					}else{ // current vertex has only one influence joints
 						maxEffectJoint = tree->root->child;
 					}
@@ -0,0 +1,161 @@
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "fieldGrid.h"
+
+float fieldGrid::layout(const hrbfField & field, const localCoord & coord, unsigned int resolution, Vector & lo){
+	if (resolution < 2)
+		resolution = 2;
+
+	// the grid covers the partition and the support of the field around it
+	float margin = field.radius();
+	lo = coord.bbox.first - Vector(margin, margin, margin);
+	Vector hi = coord.bbox.second + Vector(margin, margin, margin);
+	Vector extent = hi - lo;
+	float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	float h = maxExtent > 0.0f ? maxExtent / (resolution - 1) : 1.0f;
+
+	const Vector axes[3] = { coord._axisX, coord._axisY, coord._axisZ };
+	Vector center(coord._center);
+	for (unsigned int a = 0; a < 3; a++){
+		_res[a] = std::max(2u, (unsigned int)ceilf(extent[a] / h) + 1);
+		for (unsigned int k = 0; k < 3; k++)
+			_toGrid[a][k] = axes[a][k] / h;
+		_toGrid[a][3] = (-Dot(center, axes[a]) - lo[a]) / h;
+	}
+
+	_nodes.assign((std::size_t)_res[0] * _res[1] * _res[2] * 4, 0.0f);
+	return h;
+}
+
+
+void fieldGrid::bakeRows(const hrbfField & field, const localCoord & coord, const Vector & lo, float h,
+	std::size_t rowBegin, std::size_t rowEnd, float * buffer){
+	const Vector axes[3] = { coord._axisX, coord._axisY, coord._axisZ };
+	Vector center(coord._center);
+	unsigned int nx = _res[0], ny = _res[1];
+
+	// evaluate the field one row of nodes at a time
+	std::size_t rowFloats = (nx + SIMD_ALIGN / sizeof(float) - 1) / (SIMD_ALIGN / sizeof(float)) * (SIMD_ALIGN / sizeof(float));
+	float * px = buffer, * py = px + rowFloats, * pz = py + rowFloats;
+	float * f = pz + rowFloats, * gx = f + rowFloats, * gy = gx + rowFloats, * gz = gy + rowFloats;
+	for (std::size_t row = rowBegin; row < rowEnd; row++){
+		unsigned int j = (unsigned int)(row % ny), k = (unsigned int)(row / ny);
+		Vector rowStart = center + axes[0] * lo.x + axes[1] * (lo.y + j * h) + axes[2] * (lo.z + k * h);
+		for (unsigned int i = 0; i < nx; i++){
+			Vector p = rowStart + axes[0] * (i * h);
+			px[i] = p.x; py[i] = p.y; pz[i] = p.z;
+		}
+		field.eval(px, py, pz, nx, f, gx, gy, gz);
+
+		float * node = &_nodes[row * nx * 4];
+		for (unsigned int i = 0; i < nx; i++, node += 4){
+			node[0] = f[i]; node[1] = gx[i]; node[2] = gy[i]; node[3] = gz[i];
+		}
+	}
+}
+
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t){
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+
+void fieldGrid::toNodes(const Transform & toRest, float m[3][4]) const{
+	const Matrix4x4 & rest = toRest.GetMatrix();
+	for (unsigned int a = 0; a < 3; a++){
+		for (unsigned int c = 0; c < 4; c++){
+			m[a][c] = _toGrid[a][0] * rest.m[0][c] + _toGrid[a][1] * rest.m[1][c] + _toGrid[a][2] * rest.m[2][c];
+		}
+		m[a][3] += _toGrid[a][3];
+	}
+}
+
+
+void fieldGrid::lookup(const Transform & toRest, const float * px, const float * py, const float * pz, unsigned int count,
+	float * f, float * gx, float * gy, float * gz) const{
+	// compose the current pose -> rest pose -> grid affine maps, so each point is transformed once
+	const Matrix4x4 & rest = toRest.GetMatrix();
+	float m[3][4];
+	toNodes(toRest, m);
+
+	const float maxU = (float)(_res[0] - 1), maxV = (float)(_res[1] - 1), maxW = (float)(_res[2] - 1);
+	const std::size_t sx = 4, sy = 4 * (std::size_t)_res[0], sz = sy * _res[1];
+
+	for (unsigned int i = 0; i < count; i++){
+		float x = px[i], y = py[i], z = pz[i];
+		float u = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+		float v = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+		float w = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+
+		// a point outside is looked up on the box
+		float cu = std::min(std::max(u, 0.0f), maxU);
+		float cv = std::min(std::max(v, 0.0f), maxV);
+		float cw = std::min(std::max(w, 0.0f), maxW);
+
+		unsigned int i0 = std::min((unsigned int)cu, _res[0] - 2);
+		unsigned int j0 = std::min((unsigned int)cv, _res[1] - 2);
+		unsigned int k0 = std::min((unsigned int)cw, _res[2] - 2);
+		__m128 tu = _mm_set1_ps(cu - i0), tv = _mm_set1_ps(cv - j0), tw = _mm_set1_ps(cw - k0);
+
+		// value and gradient of the 8 corners are interpolated together
+		const float * n = &_nodes[k0 * sz + j0 * sy + i0 * sx];
+		__m128 c00 = lerp4(_mm_load_ps(n),				_mm_load_ps(n + sx),			tu);
+		__m128 c10 = lerp4(_mm_load_ps(n + sy),			_mm_load_ps(n + sy + sx),		tu);
+		__m128 c01 = lerp4(_mm_load_ps(n + sz),			_mm_load_ps(n + sz + sx),		tu);
+		__m128 c11 = lerp4(_mm_load_ps(n + sz + sy),	_mm_load_ps(n + sz + sy + sx),	tu);
+		__m128 c = lerp4(lerp4(c00, c10, tv), lerp4(c01, c11, tv), tw);
+
+		float out[4];
+		_mm_storeu_ps(out, c);
+
+		// outside, the field drops by one over a node spacing away from the box, its gradient the one of that distance
+		// in node units: the projection pulls the point back instead of finding a flat field there, and the union
+		// with a field the point is inside ignores it
+		float du = cu - u, dv = cv - v, dw = cw - w;
+		float d2 = du * du + dv * dv + dw * dw;
+		if (d2 > 0.0f){
+			float dist = sqrtf(d2);
+			out[0] -= dist;
+			for (unsigned int k = 0; k < 3; k++)
+				out[k + 1] += (du * _toGrid[0][k] + dv * _toGrid[1][k] + dw * _toGrid[2][k]) / dist;
+		}
+
+		// the gradient goes back to the current pose with the transpose of the linear part
+		f[i]  = out[0];
+		gx[i] = rest.m[0][0] * out[1] + rest.m[1][0] * out[2] + rest.m[2][0] * out[3];
+		gy[i] = rest.m[0][1] * out[1] + rest.m[1][1] * out[2] + rest.m[2][1] * out[3];
+		gz[i] = rest.m[0][2] * out[1] + rest.m[1][2] * out[2] + rest.m[2][2] * out[3];
+	}
+}
+
+
+bool fieldGrid::clamp(const Transform & toRest, float * pos) const{
+	float m[3][4];
+	toNodes(toRest, m);
+
+	const float maxNode[3] = { (float)(_res[0] - 1), (float)(_res[1] - 1), (float)(_res[2] - 1) };
+	float node[3];
+	bool outside = false;
+	for (unsigned int a = 0; a < 3; a++){
+		float u = m[a][0] * pos[0] + m[a][1] * pos[1] + m[a][2] * pos[2] + m[a][3];
+		node[a] = std::min(std::max(u, 0.0f), maxNode[a]);
+		outside = outside || node[a] != u;
+	}
+	if (!outside)
+		return false;
+
+	// the rows of _toGrid are the local axes over the spacing, back to the rest pose then to the current pose
+	const float h = spacing(), h2 = h * h;
+	float rest[3];
+	for (unsigned int k = 0; k < 3; k++){
+		rest[k] = 0.0f;
+		for (unsigned int a = 0; a < 3; a++)
+			rest[k] += (node[a] - _toGrid[a][3]) * h2 * _toGrid[a][k];
+	}
+	const Matrix4x4 & toCurrent = toRest.GetInverseMatrix();
+	for (unsigned int r = 0; r < 3; r++)
+		pos[r] = toCurrent.m[r][0] * rest[0] + toCurrent.m[r][1] * rest[1] + toCurrent.m[r][2] * rest[2] + toCurrent.m[r][3];
+	return true;
+}
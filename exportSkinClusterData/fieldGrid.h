@@ -0,0 +1,68 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef FIELDGRID_H
+#define FIELDGRID_H
+
+#include <math.h>
+
+#include "simd.h"
+#include "hrbf.h"
+#include "localCoord.h"
+#include "Transform.h"
+
+// compact field of one joint and its gradient sampled on a grid aligned to the joint' local coord,
+// replaces the evaluation of all the hrbf centers by one trilinear lookup
+class fieldGrid{
+public:
+	fieldGrid(){ _res[0] = _res[1] = _res[2] = 0; }
+
+	// sample the field on the nodes of a grid covering the local coord bbox grown by the field radius,
+	// resolution is the number of nodes along the longest axis. the rows of nodes are spread over the controller
+	template<class computeController>
+	void bake(const hrbfField & field, const localCoord & coord, unsigned int resolution, computeController & controller);
+
+	// value and gradient at count points stored SoA, toRest maps the points to the rest pose of the joint
+	// and the gradients are mapped back. outside the grid the field goes on from the closest point of the box,
+	// decreasing by one over a node spacing away from it
+	void lookup(const Transform & toRest, const float * px, const float * py, const float * pz, unsigned int count,
+		float * f, float * gx, float * gy, float * gz) const;
+
+	// move a point of the current pose outside the grid to the closest point of the box, returns false when it was inside
+	bool clamp(const Transform & toRest, float * pos) const;
+
+	// distance between two nodes, in the rest pose
+	inline float spacing() const {
+		return 1.0f / sqrtf(_toGrid[0][0] * _toGrid[0][0] + _toGrid[0][1] * _toGrid[0][1] + _toGrid[0][2] * _toGrid[0][2]);
+	}
+
+	inline std::size_t memorySize() const { return _nodes.size() * sizeof(float); }
+	inline std::size_t numNodes() const { return _nodes.size() / 4; }
+
+	float			_toGrid[3][4];	// rest pose world space to continuous node coordinates
+	unsigned int	_res[3];
+	tableArray<float>	_nodes;			// value + gradient ( x, y, z ) of each node, x fastest
+
+private:
+	// current pose to continuous node coordinates, the rest pose map of toRest followed by _toGrid
+	void toNodes(const Transform & toRest, float m[3][4]) const;
+	// _toGrid, _res and _nodes of the grid, returns the node spacing and the low corner in the local coord
+	float layout(const hrbfField & field, const localCoord & coord, unsigned int resolution, Vector & lo);
+	// the nodes of the rows ( j + k * ny ) [rowBegin, rowEnd), buffer holds 7 rows of points and values
+	void bakeRows(const hrbfField & field, const localCoord & coord, const Vector & lo, float h,
+		std::size_t rowBegin, std::size_t rowEnd, float * buffer);
+};
+
+
+template<class computeController>
+void fieldGrid::bake(const hrbfField & field, const localCoord & coord, unsigned int resolution, computeController & controller){
+	Vector lo;
+	float h = layout(field, coord, resolution, lo);
+	std::size_t rowFloats = (_res[0] + SIMD_ALIGN / sizeof(float) - 1) / (SIMD_ALIGN / sizeof(float)) * (SIMD_ALIGN / sizeof(float));
+	controller.parallelRange((std::size_t)_res[1] * _res[2], 1, [&](std::size_t rowBegin, std::size_t rowEnd){
+		bakeRows(field, coord, lo, h, rowBegin, rowEnd, controller.template scratch<float>(7 * rowFloats));
+	});
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include <math.h>
+#include <algorithm>
+
+#include "fieldProjector.h"
+#include "sceneData.h"
+
+const unsigned int fieldProjector::chunkSize;
+
+void fieldProjector::init(){
+	// joint table of each scene joint, if it has one
+	std::vector<int> tableOf(sceneData::_jointNum, -1);
+	for (std::size_t i = 0; i < sceneData::_jointTables.size(); i++){
+		unsigned int jointIdx = sceneData::_jointTables[i]->jointIdx;
+		if (jointIdx < tableOf.size())
+			tableOf[jointIdx] = (int)i;
+	}
+
+	_jointSets.resize(sceneData::_jointNum);
+	for (std::size_t j = 0; j < _jointSets.size(); j++)
+		_jointSets[j].clear();
+
+	// a joint composes its own field, its parent' and its children'
+	std::list<sceneData::jointPtr>::const_iterator iter = sceneData::_joints.begin();
+	for (; iter != sceneData::_joints.end(); iter++){
+		int jointIdx = (*iter)->_index, parentIdx = (*iter)->_parentPos;
+		if (tableOf[jointIdx] >= 0)
+			_jointSets[jointIdx].push_back(tableOf[jointIdx]);
+		if (parentIdx >= 0){
+			if (tableOf[parentIdx] >= 0)
+				_jointSets[jointIdx].push_back(tableOf[parentIdx]);
+			if (tableOf[jointIdx] >= 0)
+				_jointSets[parentIdx].push_back(tableOf[jointIdx]);
+		}
+	}
+
+	// a point of a baked joint is kept in the grid of the joint
+	_gridTables.assign(_jointSets.size(), -1);
+	for (std::size_t j = 0; j < tableOf.size(); j++){
+		if (tableOf[j] >= 0 && sceneData::_jointTables[tableOf[j]]->grid)
+			_gridTables[j] = tableOf[j];
+	}
+
+	_stepBounds.assign(_jointSets.size(), 0.0f);
+	for (std::size_t j = 0; j < _jointSets.size(); j++){
+		for (std::size_t t = 0; t < _jointSets[j].size(); t++){
+			float radius = sceneData::_jointTables[_jointSets[j][t]]->field.radius();
+			if (t == 0 || radius < _stepBounds[j])
+				_stepBounds[j] = radius;
+		}
+	}
+}
+
+
+void fieldProjector::evalComposed(unsigned int jointIdx, const std::vector<Transform> & toRest, const float * px, const float * py, const float * pz,
+	unsigned int count, float * f, float * gx, float * gy, float * gz) const{
+	const std::vector<unsigned int> & tables = _jointSets[jointIdx];
+	if (tables.empty()){
+		std::fill(f, f + count, 0.0f);
+		std::fill(gx, gx + count, 0.0f);
+		std::fill(gy, gy + count, 0.0f);
+		std::fill(gz, gz + count, 0.0f);
+		return;
+	}
+
+	const unsigned int tableIdx = tables[0];
+	sceneData::_jointTables[tableIdx]->evalField(toRest[tableIdx], px, py, pz, count, f, gx, gy, gz);
+
+	// union of the other fields, the gradient is the one of the biggest field
+	float tf[chunkSize], tgx[chunkSize], tgy[chunkSize], tgz[chunkSize];
+	for (std::size_t t = 1; t < tables.size(); t++){
+		const jointTable & jTable = *sceneData::_jointTables[tables[t]];
+		const Transform & rest = toRest[tables[t]];
+		for (unsigned int start = 0; start < count; start += chunkSize){
+			unsigned int n = std::min(chunkSize, count - start);
+			jTable.evalField(rest, px + start, py + start, pz + start, n, tf, tgx, tgy, tgz);
+			for (unsigned int i = 0; i < n; i++){
+				if (tf[i] > f[start + i]){
+					f[start + i] = tf[i];
+					gx[start + i] = tgx[i];
+					gy[start + i] = tgy[i];
+					gz[start + i] = tgz[i];
+				}
+			}
+		}
+	}
+}
+
+
+void fieldProjector::sampleIso(meshTable & mTable, const std::vector<unsigned char> * jointMask){
+	groupByJoint(mTable);
+
+	std::vector<Transform> identity(sceneData::_jointTables.size());
+	float px[chunkSize], py[chunkSize], pz[chunkSize], f[chunkSize], gx[chunkSize], gy[chunkSize], gz[chunkSize];
+	const unsigned int numElems = mTable._numElems;
+	const skinTable & skin = mTable.skin;
+
+	for (std::size_t j = 0; j + 1 < _jointStart.size(); j++){
+		if (jointMask && !(*jointMask)[j])
+			continue;
+		for (unsigned int start = _jointStart[j]; start < _jointStart[j + 1]; start += chunkSize){
+			unsigned int n = std::min(chunkSize, _jointStart[j + 1] - start);
+			// the rest positions, pointPosTable holds the last deformed pose once the mesh is deformed
+			for (unsigned int i = 0; i < n; i++){
+				unsigned int point = _active[start + i];
+				px[i] = skin._restX[point]; py[i] = skin._restY[point]; pz[i] = skin._restZ[point];
+			}
+			evalComposed((unsigned int)j, identity, px, py, pz, n, f, gx, gy, gz);
+			for (unsigned int i = 0; i < n; i++)
+				mTable.pointPosTable[_active[start + i] * numElems + 3] = f[i];
+		}
+	}
+}
+
+
+void fieldProjector::groupByJoint(const meshTable & mTable){
+	std::size_t nPoints = mTable.ptJointIdxTable.size();
+	if (mTable.jointOffsetTable.size() == _jointSets.size() + 1){
+		// grouped at prep
+		_jointStart.assign(mTable.jointOffsetTable.begin(), mTable.jointOffsetTable.end());
+		_active.resize(nPoints);
+		for (std::size_t i = 0; i < nPoints; i++)
+			_active[i] = (unsigned int)i;
+		_numActive = nPoints;
+		return;
+	}
+
+	// counting sort of the points by joint, stable so the points of a joint stay in table order
+	_jointStart.assign(_jointSets.size() + 1, 0);
+	for (std::size_t i = 0; i < nPoints; i++)
+		_jointStart[mTable.ptJointIdxTable[i] + 1]++;
+	for (std::size_t j = 1; j < _jointStart.size(); j++)
+		_jointStart[j] += _jointStart[j - 1];
+
+	_active.resize(nPoints);
+	_next.assign(_jointStart.begin(), _jointStart.end() - 1);	// insert position of each joint
+	for (std::size_t i = 0; i < nPoints; i++)
+		_active[_next[mTable.ptJointIdxTable[i]]++] = (unsigned int)i;
+	_numActive = nPoints;
+}
+
+
+void fieldProjector::stepChunk(meshTable & mTable, const std::vector<Transform> & toRest, const projectParams & params,
+	unsigned int iteration, std::size_t chunk){
+	const std::size_t start = chunk * chunkSize;
+	const unsigned int n = (unsigned int)std::min<std::size_t>(chunkSize, _numActive - start);
+	const unsigned int * points = &_active[start];
+	unsigned int * survivors = &_next[start];
+	const unsigned int numElems = mTable._numElems;
+	const float cosStop = cosf(params.stopAngle * 3.14159265f / 180.0f);
+	const float maxStep = std::max(params.maxStep, 0.0f);
+
+	float px[chunkSize], py[chunkSize], pz[chunkSize], f[chunkSize], gx[chunkSize], gy[chunkSize], gz[chunkSize];
+	for (unsigned int i = 0; i < n; i++){
+		const float * pos = &mTable.pointPosTable[points[i] * numElems];
+		px[i] = pos[0]; py[i] = pos[1]; pz[i] = pos[2];
+	}
+
+	// the chunk is a few runs of points of the same joint, each run shares its composed field
+	for (unsigned int runStart = 0; runStart < n; ){
+		unsigned int jointIdx = mTable.ptJointIdxTable[points[runStart]];
+		unsigned int runEnd = runStart + 1;
+		while (runEnd < n && mTable.ptJointIdxTable[points[runEnd]] == jointIdx)
+			runEnd++;
+		evalComposed(jointIdx, toRest, px + runStart, py + runStart, pz + runStart, runEnd - runStart,
+			f + runStart, gx + runStart, gy + runStart, gz + runStart);
+		runStart = runEnd;
+	}
+
+	unsigned int numSurvivors = 0;
+	for (unsigned int i = 0; i < n; i++){
+		unsigned int point = points[i];
+		float * pos = &mTable.pointPosTable[point * numElems];
+		float * prev = &_prevGrad[point * 3];
+
+		float d = pos[3] - f[i];
+		if (iteration == 0)
+			_deviation[point] = fabsf(d);
+
+		// the gradient turned too much: the point hit the surface of another field
+		float g2 = gx[i] * gx[i] + gy[i] * gy[i] + gz[i] * gz[i];
+		if (iteration > 0){
+			float p2 = prev[0] * prev[0] + prev[1] * prev[1] + prev[2] * prev[2];
+			float dot = gx[i] * prev[0] + gy[i] * prev[1] + gz[i] * prev[2];
+			if (dot < cosStop * sqrtf(g2 * p2))
+				continue;
+		}
+		prev[0] = gx[i]; prev[1] = gy[i]; prev[2] = gz[i];
+
+		// converged, or flat field
+		if (fabsf(d) < params.tolerance || g2 < 1e-12f)
+			continue;
+
+		// the surface is further than the field can be trusted to point at, the point stays where it is
+		unsigned int jointIdx = mTable.ptJointIdxTable[point];
+		if (fabsf(d) > maxStep * _stepBounds[jointIdx] * sqrtf(g2))
+			continue;
+
+		// so each step is shorter than stepScale * maxStep of the field radius
+		float s = params.stepScale * d / g2;
+		pos[0] = px[i] + s * gx[i];
+		pos[1] = py[i] + s * gy[i];
+		pos[2] = pz[i] + s * gz[i];
+		if (_gridTables[jointIdx] >= 0)
+			sceneData::_jointTables[_gridTables[jointIdx]]->grid->clamp(toRest[_gridTables[jointIdx]], pos);
+		survivors[numSurvivors++] = point;
+	}
+	_chunkCounts[chunk] = numSurvivors;
+}
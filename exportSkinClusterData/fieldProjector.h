@@ -0,0 +1,115 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef FIELDPROJECTOR_H
+#define FIELDPROJECTOR_H
+
+#include <vector>
+
+#include "computeController.h"
+#include "Table.h"
+#include "Transform.h"
+
+// user parameters of the newton projection
+class projectParams{
+public:
+	projectParams():maxIterations(20), tolerance(1e-3f), stepScale(0.35f), stopAngle(55.0f), maxStep(0.5f), relaxSweeps(2), relaxStrength(1.0f){}
+
+	unsigned int maxIterations;
+	float tolerance;		// a point is converged when its field value is this close to its iso value
+	float stepScale;		// fraction of the newton step taken each iteration
+	float stopAngle;		// degrees, a point stops when its gradient turns more than this ( contact with another field )
+	float maxStep;			// a point stops when its newton step is longer than this fraction of the field radius of its joint,
+							// where the field is too flat for its linear model to hold ( edge of the compact support )
+	unsigned int relaxSweeps;	// tangential relaxation sweeps between the two projections
+	float relaxStrength;	// scale of the relaxation step of a point, which also grows with how far the point was from its iso value
+};
+
+
+// marches the points of a mesh along the gradient of the composed joint fields back to their rest iso value.
+// the field of a point is the union ( max ) of the fields of its joint, the joint' parent and the joint' children
+class fieldProjector{
+public:
+	fieldProjector():_numActive(0){}
+
+	// build the set of joint tables composed for each scene joint, from sceneData
+	void init();
+
+	// composed field value and gradient at count points of the partition of the scene joint jointIdx,
+	// toRest holds the current to rest pose transform of each joint table
+	void evalComposed(unsigned int jointIdx, const std::vector<Transform> & toRest, const float * px, const float * py, const float * pz,
+		unsigned int count, float * f, float * gx, float * gy, float * gz) const;
+
+	// store the composed field value of each point at its rest position ( of the skin table ) in the w component
+	// of pointPosTable, with jointMask only for the points of the flagged scene joints
+	void sampleIso(meshTable & mTable, const std::vector<unsigned char> * jointMask = nullptr);
+
+	// project the points of pointPosTable, returns the number of newton steps taken over all the points
+	template<class computeController>
+	std::size_t project(meshTable & mTable, const std::vector<Transform> & toRest, const projectParams & params, computeController & controller);
+
+	// of each point of the last projected mesh: field gradient of its last step ( x, y, z ), and distance to its iso value before the first step
+	inline const std::vector<float> & gradients() const { return _prevGrad; }
+	inline const std::vector<float> & deviations() const { return _deviation; }
+
+private:
+	static const unsigned int chunkSize = 256;
+
+	void groupByJoint(const meshTable & mTable);
+	void stepChunk(meshTable & mTable, const std::vector<Transform> & toRest, const projectParams & params,
+		unsigned int iteration, std::size_t chunk);
+
+	std::vector<std::vector<unsigned int>> _jointSets;	// scene joint index -> joint table indices composed
+	std::vector<float>	_stepBounds;	// scene joint index -> smallest field radius of the joint tables composed
+	std::vector<int>	_gridTables;	// scene joint index -> its joint table when the field is baked, -1 otherwise
+
+	// scratch, kept from one frame to the next so the projection does not allocate
+	std::vector<unsigned int>	_jointStart;	// first entry of each joint in _active after groupByJoint
+	std::vector<unsigned int>	_active;		// points still moving, grouped by joint
+	std::vector<unsigned int>	_next;			// survivors of each chunk, at the chunk' offset
+	std::vector<unsigned int>	_chunkCounts;	// survivors of each chunk, then the chunk' offset in _active
+	std::vector<float>			_prevGrad;		// gradient of the last iteration of each point ( x, y, z )
+	std::vector<float>			_deviation;		// distance to the iso value of each point before the first step
+	std::size_t					_numActive;
+};
+
+
+template<class computeController>
+std::size_t fieldProjector::project(meshTable & mTable, const std::vector<Transform> & toRest, const projectParams & params, computeController & controller){
+	// every point starts active, grouped by joint so a chunk evaluates its fields over runs of points
+	groupByJoint(mTable);
+	_prevGrad.resize(mTable.pointIdxTable.size() * 3);
+	_deviation.resize(mTable.pointIdxTable.size());
+	_next.resize(_active.size());
+
+	std::size_t numSteps = 0;
+	for (unsigned int iter = 0; iter < params.maxIterations && _numActive > 0; iter++){
+		numSteps += _numActive;
+
+		std::size_t numChunks = (_numActive + chunkSize - 1) / chunkSize;
+		_chunkCounts.resize(numChunks);
+		controller.parallelFor(numChunks, [&](std::size_t c){
+			stepChunk(mTable, toRest, params, iter, c);
+		});
+
+		// compact the survivors of all the chunks to the front of the work list, the order is kept
+		std::size_t offset = 0;
+		for (std::size_t c = 0; c < numChunks; c++){
+			unsigned int count = _chunkCounts[c];
+			_chunkCounts[c] = (unsigned int)offset;
+			offset += count;
+		}
+		controller.parallelFor(numChunks, [&](std::size_t c){
+			std::size_t start = c * chunkSize;
+			std::size_t end = (c + 1 < numChunks) ? _chunkCounts[c + 1] : offset;
+			std::size_t count = end - _chunkCounts[c];
+			for (std::size_t i = 0; i < count; i++)
+				_active[_chunkCounts[c] + i] = _next[start + i];
+		});
+		_numActive = offset;
+	}
+	return numSteps;
+}
+
+#endif
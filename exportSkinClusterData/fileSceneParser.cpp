@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include "fileSceneParser.h"
+
+static bool readMatrix(std::istream & in, float m[4][4]){
+	for (unsigned int r = 0; r < 4; r++)
+		for (unsigned int c = 0; c < 4; c++)
+			if (!(in >> m[r][c]))
+				return false;
+	return true;
+}
+
+
+bool fileSceneParser::readFile(const std::string & fileName){
+	std::ifstream file(fileName.c_str());
+	if (!file){
+		std::cerr << "Could not open: " << fileName << "\n";
+		return false;
+	}
+
+	_joints.clear();
+	_meshes.clear();
+	_poses.clear();
+
+	std::string line;
+	unsigned int lineNum = 0;
+	while (std::getline(file, line)){
+		lineNum++;
+		std::istringstream in(line);
+		std::string key;
+		if (!(in >> key) || key[0] == '#')
+			continue;
+
+		bool ok = true;
+		if (key == "joint"){
+			jointRecord joint;
+			ok = (in >> joint.name >> joint.parentName) && readMatrix(in, joint.matrix);
+			if (joint.parentName == "-")
+				joint.parentName.clear();
+			_joints.push_back(joint);
+		}
+		else if (key == "mesh"){
+			meshRecord mesh;
+			mesh.method = SKIN_LINEAR;
+			unsigned int nPoints = 0, nFaces = 0, nInfs = 0;
+			ok = (in >> mesh.name >> nPoints >> nFaces >> nInfs) && nInfs > 0;
+			mesh.influences.reserve(nInfs);
+			mesh.points.reserve(nPoints * 3);
+			mesh.faceSizes.reserve(nFaces);
+			mesh.weightStart.reserve(nPoints + 1);
+			mesh.weightStart.push_back(0);
+			_meshes.push_back(mesh);
+		}
+		else if (key == "skinning"){
+			std::string method;
+			ok = !_meshes.empty() && (in >> method) && getSkinMethod(method.c_str(), _meshes.back().method);
+		}
+		else if (key == "influences" || key == "v" || key == "f" || key == "w"){
+			if (_meshes.empty()){
+				ok = false;
+			} else {
+				meshRecord & mesh = _meshes.back();
+				if (key == "influences"){
+					std::string name;
+					while (in >> name)
+						mesh.influences.push_back(name);
+				} else if (key == "v"){
+					float p[3];
+					ok = !!(in >> p[0] >> p[1] >> p[2]);
+					mesh.points.insert(mesh.points.end(), p, p + 3);
+				} else if (key == "f"){
+					int n = 0, idx = 0;
+					ok = (in >> n) && n >= 3;
+					for (int k = 0; ok && k < n; k++){
+						ok = (in >> idx) && idx >= 0;
+						mesh.faceVerts.push_back(idx);
+					}
+					mesh.faceSizes.push_back(n);
+				} else {
+					// only the non zero weights are kept
+					float wt = 0.0f;
+					for (std::size_t j = 0; ok && j < mesh.influences.size(); j++){
+						ok = !!(in >> wt);
+						if (ok && wt > 0.0f){
+							mesh.weightInfs.push_back((unsigned int)j);
+							mesh.weights.push_back(wt);
+						}
+					}
+					mesh.weightStart.push_back((unsigned int)mesh.weights.size());
+				}
+			}
+		}
+		else if (key == "pose"){
+			poseRecord pose;
+			ok = !!(in >> pose.frame);
+			_poses.push_back(pose);
+		}
+		else if (key == "p"){
+			jointRecord joint;
+			ok = !_poses.empty() && (in >> joint.name) && readMatrix(in, joint.matrix);
+			if (ok)
+				_poses.back().joints.push_back(joint);
+		}
+		else {
+			std::cerr << fileName << ":" << lineNum << ": unknown record '" << key << "'\n";
+			return false;
+		}
+
+		if (!ok){
+			std::cerr << fileName << ":" << lineNum << ": malformed '" << key << "' record\n";
+			return false;
+		}
+	}
+
+	// check the sizes of every mesh
+	for (std::size_t m = 0; m < _meshes.size(); m++){
+		const meshRecord & mesh = _meshes[m];
+		std::size_t nPoints = mesh.points.size() / 3;
+		bool ok = mesh.weightStart.size() == nPoints + 1;
+		for (std::size_t k = 0; ok && k < mesh.faceVerts.size(); k++)
+			ok = (std::size_t)mesh.faceVerts[k] < nPoints;
+		if (!ok){
+			std::cerr << fileName << ": mesh " << mesh.name << " has inconsistent points, faces or weights\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+bool fileSceneParser::insertJoint(sceneData * scene, std::size_t recordIdx, std::vector<char> & inserted){
+	if (inserted[recordIdx])
+		return true;
+	inserted[recordIdx] = 1;	// set before the parent is visited, so a cycle fails on the lookup below
+	const jointRecord & record = _joints[recordIdx];
+
+	int parentPos = -1;
+	if (!record.parentName.empty()){
+		std::size_t parentCode = getHashCode(record.parentName);
+		jointData * parent = scene->findJoint(parentCode);
+		if (!parent){	// parent joint does not exist in the list, insert its parent
+			for (std::size_t i = 0; i < _joints.size() && !parent; i++){
+				if (_joints[i].name == record.parentName && !inserted[i]){
+					if (!insertJoint(scene, i, inserted))
+						return false;
+					parent = scene->findJoint(parentCode);
+				}
+			}
+		}
+		if (!parent){
+			std::cerr << "Error: parent " << record.parentName << " of joint " << record.name << " not found.\n";
+			return false;
+		}
+		parentPos = parent->_index;
+	}
+
+	sceneData::jointPtr jData(new jointData());
+	jData->_index			= scene->_jointNum++;
+	jData->_parentPos		= parentPos;
+	jData->_name			= record.name;
+	jData->_hashCode		= getHashCode(record.name);
+	jData->_localTransform	= Transform(record.matrix);
+	scene->_joints.push_back(std::move(jData));
+	return true;
+}
+
+
+bool fileSceneParser::loadScene(sceneData * scene){
+	std::vector<char> inserted(_joints.size(), 0);
+	for (std::size_t i = 0; i < _joints.size(); i++){
+		if (!insertJoint(scene, i, inserted))
+			return false;
+	}
+
+	for (std::size_t m = 0; m < _meshes.size(); m++){
+		const meshRecord & record = _meshes[m];
+		sceneData::meshPtr mPtr(new meshData());
+		mPtr->_name				= record.name;
+		mPtr->_numPoints		= (unsigned int)(record.points.size() / 3);
+		mPtr->_numFaces			= (unsigned int)record.faceSizes.size();
+		mPtr->_numFaceVerts		= (unsigned int)record.faceVerts.size();
+		mPtr->_numInfluences	= (unsigned int)record.influences.size();
+		mPtr->_skinMethod		= record.method;
+
+		mPtr->_posPtr.reset(new float[record.points.size()]);
+		std::copy(record.points.begin(), record.points.end(), mPtr->_posPtr.get());
+
+		mPtr->_faceSizePtr.reset(new int[record.faceSizes.size()]);
+		std::copy(record.faceSizes.begin(), record.faceSizes.end(), mPtr->_faceSizePtr.get());
+
+		mPtr->_neighbourPtr.reset(new int[record.faceVerts.size()]);
+		std::copy(record.faceVerts.begin(), record.faceVerts.end(), mPtr->_neighbourPtr.get());
+
+		mPtr->_weights.init(mPtr->_numPoints, sceneData::_params.maxInfluences, sceneData::_params.quantizeWeights);
+		for (unsigned int i = 0; i < mPtr->_numPoints; i++){
+			unsigned int start = record.weightStart[i], count = record.weightStart[i + 1] - start;
+			if (count)
+				mPtr->_weights.setPoint(i, &record.weightInfs[start], &record.weights[start], count);
+		}
+
+		mPtr->_jointIdxPtr.reset(new int[record.influences.size()]);
+		for (std::size_t j = 0; j < record.influences.size(); j++){
+			jointData * jData = scene->findJoint(getHashCode(record.influences[j]));
+			if (!jData){
+				std::cerr << "Error: influence " << record.influences[j] << " of mesh " << record.name << " is not a joint.\n";
+				return false;
+			}
+			mPtr->_jointIdxPtr[j] = jData->_index;
+		}
+
+		scene->_meshes.push_back(std::move(mPtr));
+	}
+	return true;
+}
+
+
+bool fileSceneParser::loadPose(sceneData * scene){
+	// every joint starts from its rest matrix, the pose block overrides the listed ones
+	for (std::size_t i = 0; i < _joints.size(); i++){
+		jointData * jData = scene->findJoint(getHashCode(_joints[i].name));
+		if (jData)
+			jData->_localTransform = Transform(_joints[i].matrix);
+	}
+
+	for (std::size_t p = 0; p < _poses.size(); p++){
+		if (_poses[p].frame != _frame)
+			continue;
+		const std::vector<jointRecord> & joints = _poses[p].joints;
+		for (std::size_t i = 0; i < joints.size(); i++){
+			jointData * jData = scene->findJoint(getHashCode(joints[i].name));
+			if (!jData){
+				std::cerr << "Error: posed joint " << joints[i].name << " not found.\n";
+				return false;
+			}
+			jData->_localTransform = Transform(joints[i].matrix);
+		}
+	}
+	return true;
+}
+
+
+bool fileSceneParser::writeMeshes(const sceneData * scene){
+	if (_outPath.empty())
+		return true;
+
+	std::ostringstream fileName;
+	fileName << _outPath << "." << _frame << ".obj";
+	FILE * file = fopen(fileName.str().c_str(), "w");
+	if (!file){
+		std::cerr << "Could not open: " << fileName.str() << "\n";
+		return false;
+	}
+
+	// one object for each mesh, the points are written back in their original order
+	unsigned int vertexBase = 1;
+	std::list<sceneData::meshPtr>::const_iterator iter = scene->_meshes.begin();
+	for (std::size_t m = 0; iter != scene->_meshes.end(); iter++, m++){
+		const meshData & mesh = **iter;
+		const meshTable & mTable = *scene->_meshTables[m];
+
+		std::vector<float> points(mesh._numPoints * 3);
+		for (std::size_t i = 0; i < mTable.pointIdxTable.size(); i++){
+			const float * pos = &mTable.pointPosTable[i * mTable._numElems];
+			float * dst = &points[mTable.pointIdxTable[i] * 3];
+			dst[0] = pos[0]; dst[1] = pos[1]; dst[2] = pos[2];
+		}
+
+		fprintf(file, "o %s\n", mesh._name.c_str());
+		for (unsigned int i = 0; i < mesh._numPoints; i++)
+			fprintf(file, "v %f %f %f\n", points[i * 3], points[i * 3 + 1], points[i * 3 + 2]);
+
+		unsigned int faceStart = 0;
+		for (unsigned int f = 0; f < mesh._numFaces; f++){
+			fprintf(file, "f");
+			for (int k = 0; k < mesh._faceSizePtr[f]; k++)
+				fprintf(file, " %u", vertexBase + mesh._neighbourPtr[faceStart + k]);
+			fprintf(file, "\n");
+			faceStart += mesh._faceSizePtr[f];
+		}
+		vertexBase += mesh._numPoints;
+	}
+
+	fclose(file);
+	return true;
+}
+
+
+std::vector<int> fileSceneParser::getFrames() const{
+	std::vector<int> frames;
+	for (std::size_t p = 0; p < _poses.size(); p++)
+		frames.push_back(_poses[p].frame);
+	return frames;
+}
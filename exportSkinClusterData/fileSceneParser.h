@@ -0,0 +1,83 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef FILESCENEPARSER_H
+#define FILESCENEPARSER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "sceneSource.h"
+#include "sceneData.h"
+
+// scene source reading a plain text skeleton + mesh + weights file, used by the headless tools.
+// matrices are 16 floats, row major, applied to column vectors ( same as Transform ).
+//
+//	joint <name> <parent name | -> <local matrix>
+//	mesh <name> <numPoints> <numFaces> <numInfluences>
+//	influences <joint name> ...					numInfluences names
+//	v <x> <y> <z>								numPoints lines
+//	f <n> <i0> ... <in-1>						numFaces lines
+//	w <w0> ... <wnumInfluences-1>				numPoints lines
+//	skinning <linear | dualQuaternion>			optional, the skinning the projection starts from, linear by default
+//	pose <frame>
+//	p <joint name> <local matrix>				any joint not listed keeps its rest matrix
+//
+// lines starting with # are comments.
+class fileSceneParser : public sceneSource {
+public:
+	fileSceneParser():_frame(0), _outPath(){}
+
+	bool readFile(const std::string & fileName);
+
+	virtual bool loadScene(sceneData * scene);
+	virtual bool loadPose(sceneData * scene);
+	virtual bool writeMeshes(const sceneData * scene);
+
+	// frames listed by the pose blocks of the file, in file order
+	std::vector<int> getFrames() const;
+
+	void setFrame(int frame){ _frame = frame; }
+	void setOutPath(const std::string & outPath){ _outPath = outPath; }
+
+private:
+	struct jointRecord{
+		std::string	name;
+		std::string	parentName;
+		float		matrix[4][4];
+	};
+
+	struct meshRecord{
+		std::string					name;
+		std::vector<std::string>	influences;
+		std::vector<float>			points;
+		std::vector<int>			faceSizes;
+		std::vector<int>			faceVerts;
+		std::vector<unsigned int>	weightStart;	// first non zero weight of each point, numPoints + 1 entries
+		std::vector<unsigned int>	weightInfs;		// influence of each non zero weight
+		std::vector<float>			weights;		// non zero weights
+		skinMethod					method;
+	};
+
+	struct poseRecord{
+		int							frame;
+		std::vector<jointRecord>	joints;
+	};
+
+	static std::size_t getHashCode(const std::string & jointName){
+		static std::hash<std::string> string_hash;
+		return string_hash(jointName);
+	}
+
+	bool insertJoint(sceneData * scene, std::size_t recordIdx, std::vector<char> & inserted);
+
+	std::vector<jointRecord>	_joints;
+	std::vector<meshRecord>		_meshes;
+	std::vector<poseRecord>		_poses;
+	int							_frame;
+	std::string					_outPath;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#include "hrbf.h"
+
+typedef void (*hrbfBlockFn)(const hrbfField & h, const float * px, const float * py, const float * pz,
+	float * f, float * gx, float * gy, float * gz);
+
+typedef void (*hrbfEvalFn)(const hrbfField & h, const float * px, const float * py, const float * pz, unsigned int count,
+	float * f, float * gx, float * gy, float * gz);
+
+
+void hrbfField::init(const std::vector<float> & posParams, const std::vector<float> & normalParams, float radius){
+	_numCenters = (unsigned int)(posParams.size() / 4);
+	assert(normalParams.size() == _numCenters * 3);
+	_radius = radius;
+
+	_cx.resize(_numCenters); _cy.resize(_numCenters); _cz.resize(_numCenters);
+	_alpha.resize(_numCenters);
+	_bx.resize(_numCenters); _by.resize(_numCenters); _bz.resize(_numCenters);
+
+	for (unsigned int c = 0; c < _numCenters; c++){
+		_cx[c]		= posParams[c * 4];
+		_cy[c]		= posParams[c * 4 + 1];
+		_cz[c]		= posParams[c * 4 + 2];
+		_alpha[c]	= posParams[c * 4 + 3];
+		_bx[c]		= normalParams[c * 3];
+		_by[c]		= normalParams[c * 3 + 1];
+		_bz[c]		= normalParams[c * 3 + 2];
+	}
+}
+
+
+static void evalScalar(const hrbfField & h, const float * px, const float * py, const float * pz, unsigned int count,
+	float * f, float * gx, float * gy, float * gz){
+	for (unsigned int i = 0; i < count; i++){
+		float fv = 0.0f, ax = 0.0f, ay = 0.0f, az = 0.0f;
+		for (unsigned int c = 0; c < h._numCenters; c++){
+			float vx = px[i] - h._cx[c], vy = py[i] - h._cy[c], vz = pz[i] - h._cz[c];
+			float r2 = vx * vx + vy * vy + vz * vz;
+			float r = sqrtf(r2);
+			float invR = r2 > 0.0f ? 1.0f / r : 0.0f;
+			float dot = h._bx[c] * vx + h._by[c] * vy + h._bz[c] * vz;
+			fv += r * (h._alpha[c] * r2 - 3.0f * dot);
+
+			// grad = 3 * ( ( alpha * r - dot / r ) * v - r * beta )
+			float s = h._alpha[c] * r - dot * invR;
+			ax += s * vx - r * h._bx[c];
+			ay += s * vy - r * h._by[c];
+			az += s * vz - r * h._bz[c];
+		}
+		f[i] = fv;
+		gx[i] = 3.0f * ax;
+		gy[i] = 3.0f * ay;
+		gz[i] = 3.0f * az;
+	}
+}
+
+
+SIMD_TARGET_SSE4 static void blockSse4(const hrbfField & h, const float * px, const float * py, const float * pz,
+	float * f, float * gx, float * gy, float * gz){
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f);
+	__m128 x = _mm_loadu_ps(px), y = _mm_loadu_ps(py), z = _mm_loadu_ps(pz);
+	__m128 fv = zero, ax = zero, ay = zero, az = zero;
+
+	for (unsigned int c = 0; c < h._numCenters; c++){
+		__m128 bx = _mm_set1_ps(h._bx[c]), by = _mm_set1_ps(h._by[c]), bz = _mm_set1_ps(h._bz[c]);
+		__m128 alpha = _mm_set1_ps(h._alpha[c]);
+		__m128 vx = _mm_sub_ps(x, _mm_set1_ps(h._cx[c]));
+		__m128 vy = _mm_sub_ps(y, _mm_set1_ps(h._cy[c]));
+		__m128 vz = _mm_sub_ps(z, _mm_set1_ps(h._cz[c]));
+
+		__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+		__m128 r = _mm_sqrt_ps(r2);
+		__m128 invR = _mm_and_ps(_mm_div_ps(one, r), _mm_cmpgt_ps(r2, zero));
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, vx), _mm_mul_ps(by, vy)), _mm_mul_ps(bz, vz));
+
+		fv = _mm_add_ps(fv, _mm_mul_ps(r, _mm_sub_ps(_mm_mul_ps(alpha, r2), _mm_mul_ps(three, dot))));
+
+		__m128 s = _mm_sub_ps(_mm_mul_ps(alpha, r), _mm_mul_ps(dot, invR));
+		ax = _mm_add_ps(ax, _mm_sub_ps(_mm_mul_ps(s, vx), _mm_mul_ps(r, bx)));
+		ay = _mm_add_ps(ay, _mm_sub_ps(_mm_mul_ps(s, vy), _mm_mul_ps(r, by)));
+		az = _mm_add_ps(az, _mm_sub_ps(_mm_mul_ps(s, vz), _mm_mul_ps(r, bz)));
+	}
+
+	_mm_storeu_ps(f, fv);
+	_mm_storeu_ps(gx, _mm_mul_ps(three, ax));
+	_mm_storeu_ps(gy, _mm_mul_ps(three, ay));
+	_mm_storeu_ps(gz, _mm_mul_ps(three, az));
+}
+
+
+SIMD_TARGET_AVX2 static void blockAvx2(const hrbfField & h, const float * px, const float * py, const float * pz,
+	float * f, float * gx, float * gy, float * gz){
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), three = _mm256_set1_ps(3.0f);
+	__m256 x = _mm256_loadu_ps(px), y = _mm256_loadu_ps(py), z = _mm256_loadu_ps(pz);
+	__m256 fv = zero, ax = zero, ay = zero, az = zero;
+
+	for (unsigned int c = 0; c < h._numCenters; c++){
+		__m256 bx = _mm256_broadcast_ss(&h._bx[c]), by = _mm256_broadcast_ss(&h._by[c]), bz = _mm256_broadcast_ss(&h._bz[c]);
+		__m256 alpha = _mm256_broadcast_ss(&h._alpha[c]);
+		__m256 vx = _mm256_sub_ps(x, _mm256_broadcast_ss(&h._cx[c]));
+		__m256 vy = _mm256_sub_ps(y, _mm256_broadcast_ss(&h._cy[c]));
+		__m256 vz = _mm256_sub_ps(z, _mm256_broadcast_ss(&h._cz[c]));
+
+		__m256 r2 = _mm256_fmadd_ps(vz, vz, _mm256_fmadd_ps(vy, vy, _mm256_mul_ps(vx, vx)));
+		__m256 r = _mm256_sqrt_ps(r2);
+		__m256 invR = _mm256_and_ps(_mm256_div_ps(one, r), _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+		__m256 dot = _mm256_fmadd_ps(bz, vz, _mm256_fmadd_ps(by, vy, _mm256_mul_ps(bx, vx)));
+
+		fv = _mm256_fmadd_ps(r, _mm256_fmsub_ps(alpha, r2, _mm256_mul_ps(three, dot)), fv);
+
+		__m256 s = _mm256_fmsub_ps(alpha, r, _mm256_mul_ps(dot, invR));
+		ax = _mm256_add_ps(ax, _mm256_fmsub_ps(s, vx, _mm256_mul_ps(r, bx)));
+		ay = _mm256_add_ps(ay, _mm256_fmsub_ps(s, vy, _mm256_mul_ps(r, by)));
+		az = _mm256_add_ps(az, _mm256_fmsub_ps(s, vz, _mm256_mul_ps(r, bz)));
+	}
+
+	_mm256_storeu_ps(f, fv);
+	_mm256_storeu_ps(gx, _mm256_mul_ps(three, ax));
+	_mm256_storeu_ps(gy, _mm256_mul_ps(three, ay));
+	_mm256_storeu_ps(gz, _mm256_mul_ps(three, az));
+}
+
+
+SIMD_TARGET_AVX512 static void blockAvx512(const hrbfField & h, const float * px, const float * py, const float * pz,
+	float * f, float * gx, float * gy, float * gz){
+	const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f), three = _mm512_set1_ps(3.0f);
+	__m512 x = _mm512_loadu_ps(px), y = _mm512_loadu_ps(py), z = _mm512_loadu_ps(pz);
+	__m512 fv = zero, ax = zero, ay = zero, az = zero;
+
+	for (unsigned int c = 0; c < h._numCenters; c++){
+		__m512 bx = _mm512_set1_ps(h._bx[c]), by = _mm512_set1_ps(h._by[c]), bz = _mm512_set1_ps(h._bz[c]);
+		__m512 alpha = _mm512_set1_ps(h._alpha[c]);
+		__m512 vx = _mm512_sub_ps(x, _mm512_set1_ps(h._cx[c]));
+		__m512 vy = _mm512_sub_ps(y, _mm512_set1_ps(h._cy[c]));
+		__m512 vz = _mm512_sub_ps(z, _mm512_set1_ps(h._cz[c]));
+
+		__m512 r2 = _mm512_fmadd_ps(vz, vz, _mm512_fmadd_ps(vy, vy, _mm512_mul_ps(vx, vx)));
+		__m512 r = _mm512_sqrt_ps(r2);
+		__m512 invR = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ), one, r);
+		__m512 dot = _mm512_fmadd_ps(bz, vz, _mm512_fmadd_ps(by, vy, _mm512_mul_ps(bx, vx)));
+
+		fv = _mm512_fmadd_ps(r, _mm512_fmsub_ps(alpha, r2, _mm512_mul_ps(three, dot)), fv);
+
+		__m512 s = _mm512_fmsub_ps(alpha, r, _mm512_mul_ps(dot, invR));
+		ax = _mm512_add_ps(ax, _mm512_fmsub_ps(s, vx, _mm512_mul_ps(r, bx)));
+		ay = _mm512_add_ps(ay, _mm512_fmsub_ps(s, vy, _mm512_mul_ps(r, by)));
+		az = _mm512_add_ps(az, _mm512_fmsub_ps(s, vz, _mm512_mul_ps(r, bz)));
+	}
+
+	_mm512_storeu_ps(f, fv);
+	_mm512_storeu_ps(gx, _mm512_mul_ps(three, ax));
+	_mm512_storeu_ps(gy, _mm512_mul_ps(three, ay));
+	_mm512_storeu_ps(gz, _mm512_mul_ps(three, az));
+}
+
+
+// run the block kernel on every full block of W points, the tail is padded with its last point
+template <unsigned int W, hrbfBlockFn block>
+static void evalBlocks(const hrbfField & h, const float * px, const float * py, const float * pz, unsigned int count,
+	float * f, float * gx, float * gy, float * gz){
+	unsigned int i = 0;
+	for (; i + W <= count; i += W)
+		block(h, px + i, py + i, pz + i, f + i, gx + i, gy + i, gz + i);
+
+	unsigned int rest = count - i;
+	if (rest){
+		float tmp[7][W];
+		for (unsigned int k = 0; k < W; k++){
+			unsigned int src = i + (k < rest ? k : rest - 1);
+			tmp[0][k] = px[src]; tmp[1][k] = py[src]; tmp[2][k] = pz[src];
+		}
+		block(h, tmp[0], tmp[1], tmp[2], tmp[3], tmp[4], tmp[5], tmp[6]);
+		memcpy(f + i, tmp[3], rest * sizeof(float));
+		memcpy(gx + i, tmp[4], rest * sizeof(float));
+		memcpy(gy + i, tmp[5], rest * sizeof(float));
+		memcpy(gz + i, tmp[6], rest * sizeof(float));
+	}
+}
+
+
+static hrbfEvalFn selectEval(){
+	switch (getSimdLevel()){
+	case SIMD_AVX512:	return evalBlocks<16, blockAvx512>;
+	case SIMD_AVX2:		return evalBlocks<8, blockAvx2>;
+	case SIMD_SSE4:		return evalBlocks<4, blockSse4>;
+	default:			return evalScalar;
+	}
+}
+
+
+void hrbfField::evalRaw(const float * px, const float * py, const float * pz, unsigned int count,
+	float * f, float * gx, float * gy, float * gz) const{
+	const hrbfEvalFn evalFn = selectEval();
+	evalFn(*this, px, py, pz, count, f, gx, gy, gz);
+}
+
+
+void hrbfField::eval(const float * px, const float * py, const float * pz, unsigned int count,
+	float * f, float * gx, float * gy, float * gz) const{
+	evalRaw(px, py, pz, count, f, gx, gy, gz);
+
+	for (unsigned int i = 0; i < count; i++){
+		float dfScale;
+		f[i] = toField(f[i], _radius, dfScale);
+		gx[i] *= dfScale;
+		gy[i] *= dfScale;
+		gz[i] *= dfScale;
+	}
+}
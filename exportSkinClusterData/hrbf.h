@@ -0,0 +1,50 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef HRBF_H
+#define HRBF_H
+
+#include <vector>
+
+#include "simd.h"
+#include "tableArray.h"
+
+// hermite rbf of one joint with the phi(r) = r^3 kernel
+//	f(x) = sum_i alpha_i * |x - c_i|^3 - 3 * |x - c_i| * dot(beta_i, x - c_i)
+// the centers are kept SoA and cache line aligned, the kernel evaluates blocks of points against all of them.
+class hrbfField{
+public:
+	hrbfField():_numCenters(0), _radius(0.0f){}
+
+	// posParams ( x, y, z, alpha ) and normalParams ( beta x, y, z ) of each center, see jointTable
+	void init(const std::vector<float> & posParams, const std::vector<float> & normalParams, float radius);
+
+	// raw hrbf value and gradient of count points stored SoA
+	void evalRaw(const float * px, const float * py, const float * pz, unsigned int count,
+		float * f, float * gx, float * gy, float * gz) const;
+
+	// compact support field in [0, 1] with 0.5 on the surface, 1 inside, 0 further than radius outside
+	void eval(const float * px, const float * py, const float * pz, unsigned int count,
+		float * f, float * gx, float * gy, float * gz) const;
+
+	// remap one raw value and its gradient to the compact support field
+	static inline float toField(float f, float radius, float & dfScale){
+		if (f <= -radius){ dfScale = 0.0f; return 1.0f; }
+		if (f >= radius) { dfScale = 0.0f; return 0.0f; }
+		float t = f / radius, t2 = t * t;
+		dfScale = (-15.0f / 16.0f * t2 * t2 + 15.0f / 8.0f * t2 - 15.0f / 16.0f) / radius;
+		return ((-3.0f / 16.0f * t2 + 5.0f / 8.0f) * t2 - 15.0f / 16.0f) * t + 0.5f;
+	}
+
+	inline unsigned int size() const { return _numCenters; }
+	inline float radius() const { return _radius; }
+
+	tableArray<float>	_cx, _cy, _cz;		// centers
+	tableArray<float>	_alpha;
+	tableArray<float>	_bx, _by, _bz;		// beta
+	unsigned int	_numCenters;
+	float			_radius;			// support of the compact field
+};
+
+#endif
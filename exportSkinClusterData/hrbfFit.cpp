@@ -0,0 +1,89 @@
+#include <math.h>
+#include <chrono>
+
+#include <Eigen/Dense>
+
+#include "hrbfFit.h"
+
+// phi(r) = r^3, grad = 3 r v, hessian = 3 ( r I + v v^T / r )
+static void assemble(const std::vector<float> & centers, const std::vector<float> & normals, Eigen::MatrixXd & A, Eigen::VectorXd & b){
+	std::size_t n = centers.size() / 3;
+	A.resize(4 * n, 4 * n);
+	b.resize(4 * n);
+
+	for (std::size_t j = 0; j < n; j++){
+		b(4 * j) = 0.0;
+		for (unsigned int a = 0; a < 3; a++)
+			b(4 * j + 1 + a) = normals[j * 3 + a];
+
+		// row j: f( c_j ) and grad f( c_j ), column i: alpha_i and beta_i
+		for (std::size_t i = 0; i < n; i++){
+			double v[3] = { (double)centers[j * 3] - centers[i * 3], (double)centers[j * 3 + 1] - centers[i * 3 + 1],
+				(double)centers[j * 3 + 2] - centers[i * 3 + 2] };
+			double r2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+			double r = sqrt(r2);
+			double invR = r > 0.0 ? 1.0 / r : 0.0;
+
+			A(4 * j, 4 * i) = r2 * r;
+			for (unsigned int a = 0; a < 3; a++){
+				double g = 3.0 * r * v[a];
+				A(4 * j, 4 * i + 1 + a) = -g;
+				A(4 * j + 1 + a, 4 * i) = g;
+				for (unsigned int c = 0; c < 3; c++)
+					A(4 * j + 1 + a, 4 * i + 1 + c) = -3.0 * ((a == c ? r : 0.0) + v[a] * v[c] * invR);
+			}
+		}
+	}
+}
+
+
+static inline double relativeResidual(const Eigen::MatrixXd & A, const Eigen::VectorXd & x, const Eigen::VectorXd & b){
+	double bNorm = b.norm();
+	return (A * x - b).norm() / (bNorm > 0.0 ? bNorm : 1.0);
+}
+
+
+bool fitHrbf(const std::vector<float> & centers, const std::vector<float> & normals, double tolerance,
+	std::vector<float> & posParams, std::vector<float> & normalParams, hrbfFitReport & report){
+	typedef std::chrono::steady_clock fitClock;
+	fitClock::time_point start = fitClock::now();
+
+	std::size_t n = centers.size() / 3;
+	report = hrbfFitReport();
+	report.numCenters = (unsigned int)n;
+	posParams.clear();
+	normalParams.clear();
+	if (n == 0 || normals.size() != centers.size())
+		return false;
+
+	Eigen::MatrixXd A;
+	Eigen::VectorXd b;
+	assemble(centers, normals, A, b);
+
+	Eigen::VectorXd x = A.partialPivLu().solve(b);
+	report.residual = relativeResidual(A, x, b);
+	if (!(report.residual <= tolerance)){
+		// damping relative to the scale of the system, the centers get close to a least squares fit
+		Eigen::MatrixXd AtA = A.transpose() * A;
+		double lambda = 1e-10 * AtA.diagonal().maxCoeff();
+		AtA.diagonal().array() += (lambda > 0.0 ? lambda : 1e-10);
+		x = AtA.ldlt().solve(A.transpose() * b);
+		report.residual = relativeResidual(A, x, b);
+		report.regularized = true;
+	}
+
+	report.ok = x.allFinite();
+	if (report.ok){
+		posParams.resize(n * 4);
+		normalParams.resize(n * 3);
+		for (std::size_t i = 0; i < n; i++){
+			for (unsigned int a = 0; a < 3; a++){
+				posParams[i * 4 + a] = centers[i * 3 + a];
+				normalParams[i * 3 + a] = (float)x(4 * i + 1 + a);
+			}
+			posParams[i * 4 + 3] = (float)x(4 * i);
+		}
+	}
+	report.ms = std::chrono::duration<double, std::milli>(fitClock::now() - start).count();
+	return report.ok;
+}
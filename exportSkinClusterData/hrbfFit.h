@@ -0,0 +1,29 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef HRBFFIT_H
+#define HRBFFIT_H
+
+#include <vector>
+
+// outcome of the fit of one joint
+class hrbfFitReport{
+public:
+	hrbfFitReport():numCenters(0), ms(0.0), residual(0.0), regularized(false), ok(false){}
+
+	unsigned int numCenters;
+	double ms;				// assembly and solve time
+	double residual;		// |A x - b| / |b| of the hermite system
+	bool regularized;		// the lu solve failed, the damped least squares fallback was used
+	bool ok;
+};
+
+// solve the 4N x 4N hermite interpolation system of the hrbf ( see hrbfField ) so the field is 0 at each center
+// ( x, y, z ) with its unit normal as gradient. fills posParams ( x, y, z, alpha ) and normalParams ( beta x, y, z ).
+// the system is indefinite, it is solved by lu with partial pivoting, and when the lu residual is above tolerance
+// ( coincident centers, degenerate partitions ) by the damped normal equations ( A^T A + lambda I ) x = A^T b with ldlt
+bool fitHrbf(const std::vector<float> & centers, const std::vector<float> & normals, double tolerance,
+	std::vector<float> & posParams, std::vector<float> & normalParams, hrbfFitReport & report);
+
+#endif
@@ -0,0 +1,354 @@
+///////////////////////////////////////////////////////
+//
+// DESCRIPTION:  headless driver, runs implicitSkinningPrep
+//				 and rbfDeform on a scene file without maya
+//
+///////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include "sceneData.h"
+#include "fileSceneParser.h"
+#include "rbfDeformer.h"
+#include "sharedScene.h"
+
+#define MATCH(str, shortName, longName) \
+	((strcmp((str), (shortName)) == 0)||(strcmp((str), (longName)) == 0))
+
+typedef std::chrono::steady_clock	cliClock;
+
+static double elapsedMs(cliClock::time_point start){
+	return std::chrono::duration<double, std::milli>(cliClock::now() - start).count();
+}
+
+static void usage(){
+	fprintf(stderr,
+		"usage: implicitSkinningCli -w <name> [-cc <controller>] [-t <threads>] [-dt]\n"
+		"       implicitSkinningCli -f <scene file> [-o <output prefix>] [-s <start>] [-e <end>] [-g <resolution>] [-r <order>] [-k <influences>] [-q] [-m <method>] [-n <samples>] [-sd <seed>]\n"
+		"       [-c <centers>] [-cr <radius>] [-cd <cache dir>] [-cl <cache limit>] [-wb <buffer file>] [-rb <buffer file>]\n"
+		"       [-sm <name>] [-cc <controller>] [-t <threads>] [-dt] [-ed <mesh> <joint> <points>]\n"
+		"  -f/-file     skeleton + mesh + weights file, see fileSceneParser.h for the format\n"
+		"  -o/-out      write the deformed meshes of each frame to <output prefix>.<frame>.obj\n"
+		"  -s/-start    first pose frame to deform\n"
+		"  -e/-end      last pose frame to deform\n"
+		"  -g/-grid     bake the joint fields into grids of <resolution> nodes along the longest axis\n"
+		"  -r/-reorder  order of the points in the tables: maya, rcm or morton\n"
+		"  -k/-influences  weights kept for each point, 1 to 8\n"
+		"  -q/-quantize    store the kept weights in 16 bits\n"
+		"  -m/-method      skinning of every mesh before the projection: linear or dualQuaternion,\n"
+		"                  by default the one of each mesh in the file\n"
+		"  -n/-samples     surface samples drawn on the partition of each joint\n"
+		"  -sd/-seed       seed of the surface samples\n"
+		"  -c/-centers     hrbf centers kept of the samples of each joint, 0 keeps them all\n"
+		"  -cr/-centerRadius  keep the samples no closer than <radius> instead\n"
+		"  -cd/-cacheDir      load the prepared scene from <cache dir> when it is there, store it otherwise\n"
+		"  -cl/-cacheLimit    MB kept in the cache directory, the least recently used entries are removed first\n"
+		"  -wb/-writeBuffer   write the prepared tables to <buffer file>, for rbfDeform -b\n"
+		"  -rb/-readBuffer    map the prepared tables of <buffer file> instead of preparing the scene\n"
+		"  -sm/-sharedMemory  publish the prepared scene as <name> and let a worker deform the frames\n"
+		"  -w/-worker         deform the frames of the scene published as <name> until it is closed\n"
+		"  -cc/-controller    run the prep and deform stages serial, on the thread pool ( pool ) or on the thread pool\n"
+		"                     with chunks of the simd width ( simd )\n"
+		"  -t/-threads        workers of the thread pool, one for each core by default\n"
+		"  -dt/-deterministic the reductions give the same result whatever the number of threads\n"
+		"  -ed/-edit          after the prep, move the points of the mesh to the partition of the joint and redo\n"
+		"                     the joints touched only. points are maya indices, as 0,4,10-20\n");
+}
+
+static bool intArg(int argc, char ** argv, int & indx, int & res){
+	if (indx + 1 < argc){
+		indx++;
+		char * end = nullptr;
+		res = (int)strtol(argv[indx], &end, 10);
+		return *end == '\0';
+	}
+	return false;
+}
+
+// comma separated indices and ranges, as 0,4,10-20
+static bool indexListArg(const char * str, std::vector<unsigned int> & res){
+	res.clear();
+	while (*str){
+		char * end = nullptr;
+		unsigned long first = strtoul(str, &end, 10), last = first;
+		if (end == str)
+			return false;
+		if (*end == '-'){
+			str = end + 1;
+			last = strtoul(str, &end, 10);
+			if (end == str || last < first)
+				return false;
+		}
+		for (unsigned long i = first; i <= last; i++)
+			res.push_back((unsigned int)i);
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return false;
+		str = end;
+	}
+	return !res.empty();
+}
+
+// points of a mesh moved to the partition of a joint, see sceneData::assignPoints
+struct partitionEdit{
+	std::string					meshName;
+	std::string					jointName;
+	std::vector<unsigned int>	points;
+};
+
+static bool floatArg(int argc, char ** argv, int & indx, float & res){
+	if (indx + 1 < argc){
+		indx++;
+		char * end = nullptr;
+		res = strtof(argv[indx], &end);
+		return *end == '\0';
+	}
+	return false;
+}
+
+// deform worker of a host running with -sm, or rbfDeform -sm in maya, until the host closes the channel or exits
+static int runWorker(const std::string & name){
+	sharedScene channel;
+	cliClock::time_point start = cliClock::now();
+	if (!channel.attach(name)){
+		fprintf(stderr, "ERROR attaching to the shared scene %s\n", name.c_str());
+		return 1;
+	}
+	printf("attach %s: %u joints, %u meshes, %.3f ms\n", name.c_str(), sceneData::_jointNum, sceneData::_meshNum, elapsedMs(start));
+
+	rbfDeformer deformer;
+	int frame = 0;
+	while (!channel.closed()){
+		if (!channel.receivePose(frame)){
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+		start = cliClock::now();
+		if (!deformer.deform(channel)){
+			fprintf(stderr, "ERROR deforming frame %d\n", frame);
+			return 1;
+		}
+		printf("rbfDeform frame %d: %.3f ms, %lu projection steps\n", frame, elapsedMs(start), (unsigned long)deformer.numProjectionSteps());
+		fflush(stdout);
+	}
+	return 0;
+}
+
+
+// the pose of the frame to the worker and its points back, the cli waits for them where maya would not
+static bool deformShared(sharedScene & channel, fileSceneParser & parser, int frame){
+	const double timeoutMs = 30000.0;
+	if (!parser.loadPose(sceneData::getInstance()) || !channel.sendPose(frame))
+		return false;
+	cliClock::time_point start = cliClock::now();
+	int received = 0;
+	while (!channel.receivePoints(received) || received != frame){
+		if (elapsedMs(start) > timeoutMs)
+			return false;
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	return parser.writeMeshes(sceneData::getInstance());
+}
+
+
+int main(int argc, char ** argv){
+	std::string fileName, outPath, readBufferPath, sharedName, workerName;
+	std::vector<partitionEdit> edits;
+	int startFrame = 0, endFrame = -1;
+	int gridResolution = 0, maxInfluences = (int)sceneData::_params.maxInfluences;
+	int numSamples = (int)sceneData::_params.samplesPerJoint, seed = (int)sceneData::_params.sampleSeed;
+	int numCenters = (int)sceneData::_params.centersPerJoint, cacheLimit = 0, numThreads = 0;
+	bool rangeIsSet = false, methodIsSet = false;
+	skinMethod method = SKIN_LINEAR;
+
+	// parse the command arguments
+	for (int i = 1; i < argc; i++){
+		const char * arg = argv[i];
+		bool ok = true;
+		if (MATCH(arg, "-f", "-file") && i + 1 < argc)
+			fileName = argv[++i];
+		else if (MATCH(arg, "-o", "-out") && i + 1 < argc)
+			outPath = argv[++i];
+		else if (MATCH(arg, "-s", "-start"))
+			ok = rangeIsSet = intArg(argc, argv, i, startFrame);
+		else if (MATCH(arg, "-e", "-end"))
+			ok = rangeIsSet = intArg(argc, argv, i, endFrame);
+		else if (MATCH(arg, "-g", "-grid"))
+			ok = intArg(argc, argv, i, gridResolution) && gridResolution >= 0;
+		else if (MATCH(arg, "-r", "-reorder") && i + 1 < argc)
+			ok = getPointOrder(argv[++i], sceneData::_params.order);
+		else if (MATCH(arg, "-k", "-influences"))
+			ok = intArg(argc, argv, i, maxInfluences) && maxInfluences >= 1 && maxInfluences <= (int)sparseWeights::maxSlots;
+		else if (MATCH(arg, "-q", "-quantize"))
+			sceneData::_params.quantizeWeights = true;
+		else if (MATCH(arg, "-m", "-method") && i + 1 < argc)
+			ok = methodIsSet = getSkinMethod(argv[++i], method);
+		else if (MATCH(arg, "-n", "-samples"))
+			ok = intArg(argc, argv, i, numSamples) && numSamples >= 0;
+		else if (MATCH(arg, "-sd", "-seed"))
+			ok = intArg(argc, argv, i, seed);
+		else if (MATCH(arg, "-c", "-centers"))
+			ok = intArg(argc, argv, i, numCenters) && numCenters >= 0;
+		else if (MATCH(arg, "-cr", "-centerRadius"))
+			ok = floatArg(argc, argv, i, sceneData::_params.centerRadius) && sceneData::_params.centerRadius >= 0.0f;
+		else if (MATCH(arg, "-cd", "-cacheDir") && i + 1 < argc)
+			sceneData::_params.cacheDir = argv[++i];
+		else if (MATCH(arg, "-cl", "-cacheLimit"))
+			ok = intArg(argc, argv, i, cacheLimit) && cacheLimit >= 0;
+		else if (MATCH(arg, "-wb", "-writeBuffer") && i + 1 < argc)
+			sceneData::_params.bufferPath = argv[++i];
+		else if (MATCH(arg, "-rb", "-readBuffer") && i + 1 < argc)
+			readBufferPath = argv[++i];
+		else if (MATCH(arg, "-sm", "-sharedMemory") && i + 1 < argc)
+			sharedName = argv[++i];
+		else if (MATCH(arg, "-w", "-worker") && i + 1 < argc)
+			workerName = argv[++i];
+		else if (MATCH(arg, "-cc", "-controller") && i + 1 < argc)
+			ok = getControllerKind(argv[++i], getControllerSettings().kind);
+		else if (MATCH(arg, "-t", "-threads"))
+			ok = intArg(argc, argv, i, numThreads) && numThreads >= 0;
+		else if (MATCH(arg, "-dt", "-deterministic"))
+			getControllerSettings().deterministic = true;
+		else if (MATCH(arg, "-ed", "-edit") && i + 3 < argc){
+			partitionEdit edit;
+			edit.meshName = argv[++i];
+			edit.jointName = argv[++i];
+			ok = indexListArg(argv[++i], edit.points);
+			edits.push_back(edit);
+		}
+		else
+			ok = false;
+
+		if (!ok){
+			fprintf(stderr, "Unknown or incomplete argument '%s'\n", arg);
+			usage();
+			return 1;
+		}
+	}
+	getControllerSettings().numThreads = (unsigned int)numThreads;
+	if (!workerName.empty())
+		return runWorker(workerName);
+	if (fileName.empty()){
+		usage();
+		return 1;
+	}
+
+	sceneData::_params.gridResolution = (unsigned int)gridResolution;
+	sceneData::_params.maxInfluences = (unsigned int)maxInfluences;
+	sceneData::_params.samplesPerJoint = (unsigned int)numSamples;
+	sceneData::_params.sampleSeed = (unsigned int)seed;
+	sceneData::_params.centersPerJoint = (unsigned int)numCenters;
+	sceneData::_params.cacheLimit = (std::size_t)cacheLimit << 20;
+
+	fileSceneParser parser;
+	parser.setOutPath(outPath);
+
+	cliClock::time_point start = cliClock::now();
+	if (!parser.readFile(fileName))
+		return 1;
+	printf("read %s: %.3f ms\n", fileName.c_str(), elapsedMs(start));
+	printf("controller: %s\n", getControllerKindName(getControllerSettings().kind));
+
+	// implicitSkinningPrep
+	start = cliClock::now();
+	if (!sceneData::loadScene(parser)){
+		fprintf(stderr, "ERROR loading the scene\n");
+		return 1;
+	}
+	printf("load scene: %u joints, %u meshes, %.3f ms\n", sceneData::_jointNum, sceneData::_meshNum, elapsedMs(start));
+
+	if (methodIsSet){
+		std::list<sceneData::meshPtr>::iterator iter = sceneData::_meshes.begin();
+		for (; iter != sceneData::_meshes.end(); iter++)
+			(*iter)->_skinMethod = method;
+	}
+
+	// the tables of a buffer are used as they are, the prep parameters are the ones it was written with
+	start = cliClock::now();
+	if (!readBufferPath.empty()){
+		if (!sceneData::readFromBuffer(readBufferPath)){
+			fprintf(stderr, "ERROR mapping %s\n", readBufferPath.c_str());
+			return 1;
+		}
+		printf("map buffer: %.3f ms\n", elapsedMs(start));
+	}
+	else {
+		if (!sceneData::prepScene()){
+			fprintf(stderr, "ERROR preparing the scene\n");
+			return 1;
+		}
+		printf("prep scene: %.3f ms\n", elapsedMs(start));
+	}
+
+	// the partition edits, the way a user would regroup the points of a joint in maya
+	if (!edits.empty()){
+		start = cliClock::now();
+		for (std::size_t e = 0; e < edits.size(); e++){
+			int meshIdx = sceneData::findMesh(edits[e].meshName);
+			jointData * joint = sceneData::findJoint(edits[e].jointName);
+			if (meshIdx < 0 || !joint || !sceneData::assignPoints((std::size_t)meshIdx, edits[e].points, (unsigned int)joint->_index)){
+				fprintf(stderr, "ERROR assigning the points of %s to %s\n", edits[e].meshName.c_str(), edits[e].jointName.c_str());
+				return 1;
+			}
+		}
+		while (sceneData::modifyMeshNodeGroup())
+			sceneData::updateModified();
+		printf("edit partitions: %u edits, %.3f ms\n", (unsigned int)edits.size(), elapsedMs(start));
+	}
+
+	start = cliClock::now();
+	sceneData::fininalPrep();
+	sceneData::writeToBuffer();
+	printf("final prep: %.3f ms\n", elapsedMs(start));
+
+	sharedScene channel;
+	if (!sharedName.empty() && !channel.publish(sharedName)){
+		fprintf(stderr, "ERROR publishing the shared scene %s\n", sharedName.c_str());
+		return 1;
+	}
+
+	// rbfDeform, at rest pose if the file has no pose
+	std::vector<int> frames = parser.getFrames();
+	if (frames.empty())
+		frames.push_back(0);
+
+	rbfDeformer deformer;
+	double totalMs = 0.0;
+	unsigned int numFrames = 0;
+	for (std::size_t f = 0; f < frames.size(); f++){
+		if (rangeIsSet && (frames[f] < startFrame || (endFrame >= startFrame && frames[f] > endFrame)))
+			continue;
+
+		parser.setFrame(frames[f]);
+		start = cliClock::now();
+		if (channel.isOpen()){
+			if (!deformShared(channel, parser, frames[f])){
+				fprintf(stderr, "ERROR no points of the worker for frame %d\n", frames[f]);
+				return 1;
+			}
+			printf("shared frame %d: %.3f ms\n", frames[f], elapsedMs(start));
+			totalMs += elapsedMs(start);
+			numFrames++;
+			continue;
+		}
+		if (!deformer.deform(parser)){
+			fprintf(stderr, "ERROR deforming frame %d\n", frames[f]);
+			return 1;
+		}
+		double ms = elapsedMs(start);
+		printf("rbfDeform frame %d: %.3f ms, %lu projection steps\n", frames[f], ms, (unsigned long)deformer.numProjectionSteps());
+		totalMs += ms;
+		numFrames++;
+	}
+	if (numFrames)
+		printf("rbfDeform %u frames: %.3f ms average\n", numFrames, totalMs / numFrames);
+
+	return 0;
+}
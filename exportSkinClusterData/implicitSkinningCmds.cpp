@@ -5,15 +5,21 @@
 ///////////////////////////////////////////////////////
 
 //#include <maya/MItGeometry.h>
-//#include <maya/MFnSingleIndexedComponent.h>
+#include <maya/MFnSingleIndexedComponent.h>
 
 #include <maya/MFnPlugin.h>	// for plugin, should be include only once with the plugin file 
 
 #include "common.h"
 #include "mayaSceneParser.h"
 #include "sceneData.h"
+#include "rbfDeformer.h"
+#include "sharedScene.h"
+#include "logger.h"
 
 
+// scene published by implicitSkinningPrep -sm for a deform worker process, fed by rbfDeform -sm
+static sharedScene hostChannel;
+
 class implicitSkinningPrep : public MPxCommand
 {
 public:
@@ -31,14 +37,29 @@ private:
 	int			_startFrame;
 	int			_endFrame;
 	int			_byFrame;
+	int			_gridResolution;
+	pointOrder	_order;
+	int			_maxInfluences;
+	bool		_quantizeWeights;
+	int			_samplesPerJoint;
+	int			_sampleSeed;
+	int			_centersPerJoint;
+	double		_centerRadius;
+	MString		_cacheDir;
+	int			_cacheLimit;		// MB
+	MString		_bufferPath;		// file the prepared tables are written to, for rbfDeform -b
+	MString		_sharedName;		// name the prepared scene is published as, for a deform worker
+	MString		_editJoint;			// joint the selected vertices are moved to, on the prepared scene
 
 	MStatus		nodeFromName(MString name, MObject & obj) const;
+	MStatus		assignSelectedPoints() const;
 	void		readSceneStartEnd();
 	MStatus		parseArgs( const MArgList& args);
 	int			intArg(const MArgList& args, unsigned int &indx, int & res);
 };
 
-implicitSkinningPrep::implicitSkinningPrep():_startFrame(0), _endFrame(0), _byFrame(1){}
+implicitSkinningPrep::implicitSkinningPrep():_startFrame(0), _endFrame(0), _byFrame(1), _gridResolution(0), _order(ORDER_MAYA), _maxInfluences(sparseWeights::maxSlots), _quantizeWeights(false),
+	_samplesPerJoint(1000), _sampleSeed(0), _centersPerJoint(250), _centerRadius(0.0), _cacheDir(), _cacheLimit(0), _bufferPath(), _sharedName(), _editJoint(){}
 
 
 implicitSkinningPrep::~implicitSkinningPrep() {}
@@ -82,6 +103,40 @@ MStatus implicitSkinningPrep::nodeFromName(MString name, MObject & obj) const
 	return MS::kFailure;
 }
 
+MStatus implicitSkinningPrep::assignSelectedPoints() const
+{
+	jointData * joint = sceneData::findJoint(std::string(_editJoint.asChar()));
+	if (!joint)
+		return MS::kFailure;
+
+	MSelectionList sl;
+	MStatus stat = MGlobal::getActiveSelectionList(sl);
+	if (MStatus::kSuccess != stat)
+		return stat;
+
+	// the selected vertices of each prepared mesh
+	MItSelectionList iter(sl, MFn::kMeshVertComponent, &stat);
+	for ( ; !iter.isDone(); iter.next() ) {
+		MDagPath meshPath;
+		MObject component;
+		iter.getDagPath(meshPath, component);
+		meshPath.extendToShape();
+		int meshIdx = sceneData::findMesh(meshPath.fullPathName().asChar());
+		if (meshIdx < 0 || component.isNull())
+			continue;
+
+		MIntArray elements;
+		MFnSingleIndexedComponent(component).getElements(elements);
+		std::vector<unsigned int> pointIdxs(elements.length());
+		for (unsigned int k = 0; k < elements.length(); k++)
+			pointIdxs[k] = (unsigned int)elements[k];
+		if (!sceneData::assignPoints((std::size_t)meshIdx, pointIdxs, (unsigned int)joint->_index))
+			return MS::kFailure;
+	}
+	return MS::kSuccess;
+}
+
+
 void implicitSkinningPrep::readSceneStartEnd()
 {
 	MTime startFrame;
@@ -156,6 +211,37 @@ MStatus implicitSkinningPrep::parseArgs( const MArgList& args )
 			intArg(args, i, _endFrame);
 		else if (MATCH(arg, "-by", "-byFrame"))
 			intArg(args, i, _byFrame);
+		else if (MATCH(arg, "-g", "-grid"))
+			intArg(args, i, _gridResolution);
+		else if (MATCH(arg, "-r", "-reorder") && i + 1 < args.length()){
+			str = args.asString( ++i, &stat );
+			if (stat != MS::kSuccess || !getPointOrder(str.asChar(), _order)){
+				fprintf(stderr, "Unknown point order '%s'\n", str.asChar());
+				fflush(stderr);
+			}
+		}
+		else if (MATCH(arg, "-k", "-influences"))
+			intArg(args, i, _maxInfluences);
+		else if (MATCH(arg, "-q", "-quantize"))
+			_quantizeWeights = true;
+		else if (MATCH(arg, "-n", "-samples"))
+			intArg(args, i, _samplesPerJoint);
+		else if (MATCH(arg, "-sd", "-seed"))
+			intArg(args, i, _sampleSeed);
+		else if (MATCH(arg, "-c", "-centers"))
+			intArg(args, i, _centersPerJoint);
+		else if (MATCH(arg, "-cr", "-centerRadius") && i + 1 < args.length())
+			_centerRadius = args.asDouble( ++i, &stat );
+		else if (MATCH(arg, "-cd", "-cacheDir") && i + 1 < args.length())
+			_cacheDir = args.asString( ++i, &stat );
+		else if (MATCH(arg, "-cl", "-cacheLimit"))
+			intArg(args, i, _cacheLimit);
+		else if (MATCH(arg, "-b", "-buffer") && i + 1 < args.length())
+			_bufferPath = args.asString( ++i, &stat );
+		else if (MATCH(arg, "-sm", "-sharedMemory") && i + 1 < args.length())
+			_sharedName = args.asString( ++i, &stat );
+		else if (MATCH(arg, "-ed", "-edit") && i + 1 < args.length())
+			_editJoint = args.asString( ++i, &stat );
 		else{
 			fprintf(stderr, "Unknown argument '%s'\n", arg.asChar());
 			fflush(stderr);
@@ -163,6 +249,13 @@ MStatus implicitSkinningPrep::parseArgs( const MArgList& args )
 	}
 
 	if (_byFrame<=0) _byFrame = 1;
+	if (_gridResolution<0) _gridResolution = 0;
+	if (_samplesPerJoint<0) _samplesPerJoint = 0;
+	if (_centersPerJoint<0) _centersPerJoint = 0;
+	if (_centerRadius<0.0) _centerRadius = 0.0;
+	if (_cacheLimit<0) _cacheLimit = 0;
+	if (_maxInfluences<1) _maxInfluences = 1;
+	if (_maxInfluences>(int)sparseWeights::maxSlots) _maxInfluences = sparseWeights::maxSlots;
 
 	return MS::kSuccess;
 }
@@ -180,74 +273,52 @@ MStatus implicitSkinningPrep::doIt( const MArgList& args )
 	// Remember the frame the scene was at so we can restore it later.
 	MTime currentFrame = MAnimControl::currentTime();
 
-	// move to start frame to get the skeleton matrix at rest pose
-	MGlobal::viewFrame(-_startFrame);
-
-
-	// allocate memory by IPC
-
-
-	// create one sceneData instance for the entire scene
-	sceneData *scene = sceneData::getInstance();
-	mayaSceneParser::setScenePtr(scene);
-
-	// Iterate through all selected skinCluster nodes
-	MSelectionList sl;
-	stat = MGlobal::getActiveSelectionList(sl);
-	MCheckStatus(stat,"ERROR select none objects");
-
-	MItSelectionList iter(sl, MFn::kSkinClusterFilter, &stat);
-	MCheckStatus(stat,"ERROR filter kSkinClusterFilter objects");
+	// -edit regroups the selected vertices of the scene prepared before, only the joints touched are redone
+	bool editing = _editJoint.length() > 0;
+	if ( editing && (sceneData::_meshTables.empty() || assignSelectedPoints() != MS::kSuccess) ){
+		displayError("ERROR assigning the selected vertices to " + _editJoint);
+		return MS::kFailure;
+	}
 
-	// loop through the skinCluster nodes in the scene
-	for ( ; !iter.isDone(); iter.next() ) {
-		MObject object;
-		iter.getDependNode(object);
-
-		// For each skinCluster node, get the list of joints
-		MFnSkinCluster	skinCluster(object);
-		MDagPathArray	jointArray;
-		unsigned int	numJoints = skinCluster.influenceObjects(jointArray, &stat);
-		assert (numJoints != 0);
-
-		// set up the joint linear tree representation for current skinCluster node
-		for (unsigned int i = 0; i < numJoints; i++) {
-			MFnIkJoint fnJoint(jointArray[i]);
-			// parse the joint data and insert joint into the scene and set the parent index
-			mayaSceneParser::insertJoint(fnJoint);
+	if ( !editing ){
+		// move to start frame to get the skeleton matrix at rest pose
+		MGlobal::viewFrame(-_startFrame);
+
+		// create one sceneData instance for the entire scene
+		sceneData *scene = sceneData::getInstance();
+
+		// read every selected skinCluster into the scene first, the maya api is single threaded. the prep then runs
+		// the clusters of meshes which share no joint concurrently
+		sceneData::_params.gridResolution = (unsigned int)_gridResolution;
+		sceneData::_params.order = _order;
+		sceneData::_params.maxInfluences = (unsigned int)_maxInfluences;
+		sceneData::_params.quantizeWeights = _quantizeWeights;
+		sceneData::_params.samplesPerJoint = (unsigned int)_samplesPerJoint;
+		sceneData::_params.sampleSeed = (unsigned int)_sampleSeed;
+		sceneData::_params.centersPerJoint = (unsigned int)_centersPerJoint;
+		sceneData::_params.centerRadius = (float)_centerRadius;
+		sceneData::_params.cacheDir = _cacheDir.asChar();
+		sceneData::_params.cacheLimit = (std::size_t)_cacheLimit << 20;
+		sceneData::_params.bufferPath = _bufferPath.asChar();
+		mayaSceneParser parser;
+		if ( !scene->loadScene(parser) ){
+			MGlobal::viewFrame (currentFrame);
+			displayError("ERROR parsing the selected skinCluster nodes");
+			return MS::kFailure;
 		}
-			
-
-		// loop through the geometries of current skinCluster
-		unsigned int nGeoms = skinCluster.numOutputConnections();
-		for (unsigned int i = 0; i < nGeoms; ++i) {	
 
-			// push the skin-mesh and skinCluster pair into scene
-			unsigned int index = skinCluster.indexForOutputConnection(i, &stat);
-			MCheckStatus(stat,"Error getting geometry index.");
-
-			// get the geometry mesh
-			MDagPath skinPath;
-			stat = skinCluster.getPathAtIndex(index,skinPath);
-			MCheckStatus(stat,"Error getting geometry path.");
-
-			// insert vertices' info into meshData. 
-			mayaSceneParser::insertMesh(skinCluster, skinPath);
-			
-		} // loop through the geometries of current skinCluster
-
-	} // loop through the skinCluster nodes in the scene 
-
-	sceneData::processNeighbours();
-	sceneData::processSamples();
+		// reopening a scene finds its tables in the cache
+		if ( !sceneData::prepScene() ){
+			MGlobal::viewFrame (currentFrame);
+			displayError("ERROR preparing the selected skinCluster nodes");
+			return MS::kFailure;
+		}
+	}
 
-	// let user to adjust selection interactively
+	// the vertices regrouped by -edit
 	while ( sceneData::modifyMeshNodeGroup() ){	// user modified 
-		// mark the mesh-joint pairs modified
-
-		// overload function to handle only modified parts
-		sceneData::processNeighbours();
-		sceneData::processSamples();
+		// only the modified meshes and joints are redone
+		sceneData::updateModified();
 	}
 
 	// finishe preparation by generate the RBD object for collision and other things 
@@ -255,7 +326,12 @@ MStatus implicitSkinningPrep::doIt( const MArgList& args )
 
 	}
 
-	sceneData::writeToBuffer();
+	if ( !sceneData::writeToBuffer() )
+		displayWarning("could not write the scene buffer " + _bufferPath);
+
+	// published once, the worker maps the tables and then only the poses and the points go through the channel
+	if ( _sharedName.length() > 0 && !hostChannel.publish(_sharedName.asChar()) )
+		displayWarning("could not publish the scene as " + _sharedName);
 
 	// Restore back to the frame we were at before we ran command
 	MGlobal::viewFrame (currentFrame);
@@ -287,8 +363,15 @@ public:
 	MStatus     undoIt ();
 	bool        isUndoable() const;
 	static      void* creator();
+
+private:
+	static rbfDeformer	_deformer;	// keeps its buffers from one frame to the next
+	static MString		_bufferPath;	// scene buffer the tables were last mapped from
 };
 
+rbfDeformer rbfDeform::_deformer;
+MString rbfDeform::_bufferPath;
+
 void* rbfDeform::creator()
 {
 	return new rbfDeform;
@@ -316,32 +399,52 @@ MStatus rbfDeform::doIt( const MArgList& args ){
 
 	MTime currentFrame = MAnimControl::currentTime();
 
-	// read data from the shared memory or file
-	// boost::interprocess::managed_shared_memory ipcMemo(boost::interprocess::open_read_only, "sceneMemory");
-	// 
-
-
-	// update the joint matrix
-	
-
-	// update the local coord
-	
-
-
-	// filter the vertices of each mesh which is inside of the intersection region of adjacent joints
-
-
-
-	// get the position of these vertices
-	
-
-
-	// calculate the position for each vertex ( project and relax )
-
+	// -sm hands the pose to the worker of the scene published by implicitSkinningPrep -sm and sets the latest
+	// points it sent back, it never waits for the worker so the points may be of an earlier frame.
+	// -b <file> deforms with the tables of the scene buffer written by implicitSkinningPrep -b, mapped once
+	// and used in place, the pages are shared with the other processes mapping the same file. a prep since
+	// replaced the mapped tables by its own ones, the file is mapped again
+	MString bufferPath;
+	bool shared = false;
+	for (unsigned int i = 0; i < args.length(); i++){
+		MString arg = args.asString( i, &status );
+		if (status != MS::kSuccess)
+			continue;
+		if (MATCH(arg, "-b", "-buffer") && i + 1 < args.length())
+			bufferPath = args.asString( ++i, &status );
+		else if (MATCH(arg, "-sm", "-sharedMemory"))
+			shared = true;
+	}
 
+	mayaSceneParser parser;
+	if (shared){
+		int frame = (int) currentFrame.asUnits(MTime::uiUnit()), pointsFrame = 0;
+		if ( !hostChannel.isOpen() || !parser.loadPose(sceneData::getInstance()) || !hostChannel.sendPose(frame) ){
+			displayError("ERROR sending the pose, run implicitSkinningPrep -sm first");
+			return MS::kFailure;
+		}
+		if ( hostChannel.receivePoints(pointsFrame) && !parser.writeMeshes(sceneData::getInstance()) ){
+			displayError("ERROR setting the points of the worker");
+			return MS::kFailure;
+		}
+		setResult(pointsFrame);
+		return status;
+	}
 
-	// set the final position for each mesh object
+	bool mapped = !sceneData::_meshTables.empty() && sceneData::_meshTables[0]->pointIdxTable.isView();
+	if (bufferPath.length() > 0 && (bufferPath != _bufferPath || !mapped)){
+		if ( (sceneData::_meshes.empty() && !sceneData::loadScene(parser)) || !sceneData::readFromBuffer(bufferPath.asChar()) ){
+			displayError("ERROR mapping the scene buffer " + bufferPath);
+			return MS::kFailure;
+		}
+		_bufferPath = bufferPath;
+	}
 
+	// deform the prepared scene to the current pose and set the final position for each mesh object
+	if ( !_deformer.deform(parser) ){
+		displayError("ERROR deforming the scene, run implicitSkinningPrep first");
+		return MS::kFailure;
+	}
 
 
 	// display result
@@ -355,6 +458,12 @@ MStatus rbfDeform::doIt( const MArgList& args ){
 }
 
 
+static void displayLog(const char * msg)
+{
+	MGlobal::displayInfo(msg);
+}
+
+
 MStatus initializePlugin( MObject obj )
 {
 	MStatus   status = MStatus::kSuccess;
@@ -372,6 +481,8 @@ MStatus initializePlugin( MObject obj )
 		return status;
 	}
 
+	setLogCallback(displayLog);
+
 	return status;
 }
 
@@ -381,6 +492,10 @@ MStatus uninitializePlugin( MObject obj )
 	MStatus   status;
 	MFnPlugin plugin( obj );
 
+	setLogCallback(nullptr);
+	hostChannel.close();
+	threadController::stopPool();	// no thread may run the code of the plugin once it is unloaded
+
 	status = plugin.deregisterCommand( "implicitSkinningPrep" );
 	if (!status) {
 		status.perror("deregisterCommand");
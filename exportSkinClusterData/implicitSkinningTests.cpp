@@ -0,0 +1,1285 @@
+///////////////////////////////////////////////////////
+//
+// DESCRIPTION:  behaviour checks of the core stages,
+//				 run without maya, exits with 1 on a failure
+//
+///////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <list>
+#include <thread>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#include "sceneData.h"
+#include "fileSceneParser.h"
+#include "rbfDeformer.h"
+#include "fieldProjector.h"
+#include "relaxSolver.h"
+#include "fieldGrid.h"
+#include "computeController.h"
+#include "hrbf.h"
+#include "hrbfFit.h"
+#include "parallelPrimitives.h"
+#include "surfaceSampler.h"
+#include "pcaFrame.h"
+#include "skinTable.h"
+#include "prepCache.h"
+#include "sharedScene.h"
+#include "logger.h"
+
+static unsigned int numChecks = 0, numFailed = 0;
+
+#define CHECK(cond, ...) \
+	do{ \
+		numChecks++; \
+		if (!(cond)){ \
+			numFailed++; \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+		} \
+	} while (0)
+
+static void quietLog(const char *){}
+
+// the messages of the stages, for the checks of what a stage did
+static std::vector<std::string> logLines;
+
+static void recordLog(const char * msg){
+	logLines.push_back(msg);
+}
+
+static bool logged(const char * prefix){
+	for (std::size_t i = 0; i < logLines.size(); i++){
+		if (logLines[i].compare(0, strlen(prefix), prefix) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+// fibonacci sphere of count points and their normals, radius 1 around the origin
+static void spherePoints(unsigned int count, std::vector<float> & points, std::vector<float> & normals){
+	points.resize(count * 3);
+	normals.resize(count * 3);
+	for (unsigned int i = 0; i < count; i++){
+		float z = 1.0f - 2.0f * (i + 0.5f) / count, r = sqrtf(1.0f - z * z);
+		float a = 2.39996323f * i;
+		normals[i * 3] = points[i * 3] = r * cosf(a);
+		normals[i * 3 + 1] = points[i * 3 + 1] = r * sinf(a);
+		normals[i * 3 + 2] = points[i * 3 + 2] = z;
+	}
+}
+
+static bool fitSphere(hrbfField & field){
+	std::vector<float> points, normals, posParams, normalParams;
+	spherePoints(200, points, normals);
+	hrbfFitReport report;
+	if (!fitHrbf(points, normals, 1e-6, posParams, normalParams, report))
+		return false;
+	field.init(posParams, normalParams, 0.5f);
+	return true;
+}
+
+
+// the trilinear lookup follows the hrbf it was baked from, and outside of the box pulls back to it
+static void testGridLookup(){
+	hrbfField field;
+	if (!fitSphere(field)){
+		CHECK(false, "fit of the sphere");
+		return;
+	}
+	localCoord coord;
+	coord._axisX = Vector(1.0f, 0.0f, 0.0f);
+	coord._axisY = Vector(0.0f, 1.0f, 0.0f);
+	coord._axisZ = Vector(0.0f, 0.0f, 1.0f);
+	coord.bbox.first = Vector(-1.0f, -1.0f, -1.0f);
+	coord.bbox.second = Vector(1.0f, 1.0f, 1.0f);
+	fieldGrid grid;
+	computeController controller;
+	grid.bake(field, coord, 48, controller);
+
+	// random points over the box, the grid covers the bbox grown by the field radius
+	const unsigned int count = 4096;
+	std::vector<float> px(count), py(count), pz(count);
+	counterRng rng(7);
+	for (unsigned int i = 0; i < count; i++){
+		float u[4];
+		rng.uniform2(2 * i, u[0], u[1]);
+		rng.uniform2(2 * i + 1, u[2], u[3]);
+		px[i] = 2.8f * u[0] - 1.4f; py[i] = 2.8f * u[1] - 1.4f; pz[i] = 2.8f * u[2] - 1.4f;
+	}
+	std::vector<float> f(count), gx(count), gy(count), gz(count), lf(count), lgx(count), lgy(count), lgz(count);
+	field.eval(&px[0], &py[0], &pz[0], count, &f[0], &gx[0], &gy[0], &gz[0]);
+	Transform identity;
+	grid.lookup(identity, &px[0], &py[0], &pz[0], count, &lf[0], &lgx[0], &lgy[0], &lgz[0]);
+
+	float maxError = 0.0f, minCos = 1.0f;
+	for (unsigned int i = 0; i < count; i++){
+		maxError = std::max(maxError, fabsf(lf[i] - f[i]));
+		float g = sqrtf(gx[i] * gx[i] + gy[i] * gy[i] + gz[i] * gz[i]);
+		float lg = sqrtf(lgx[i] * lgx[i] + lgy[i] * lgy[i] + lgz[i] * lgz[i]);
+		if (g > 0.5f)
+			minCos = std::min(minCos, (gx[i] * lgx[i] + gy[i] * lgy[i] + gz[i] * lgz[i]) / (g * lg));
+	}
+	CHECK(maxError < 0.02f, "grid value off the hrbf by %g", maxError);
+	CHECK(minCos > 0.95f, "grid gradient off the hrbf by acos %g", minCos);
+
+	// beyond the box on x the field is below its value on the box and its gradient points back
+	float x[2] = { 1.5f, 4.0f }, y[2] = { 0.0f, 0.0f }, z[2] = { 0.0f, 0.0f };
+	grid.lookup(identity, x, y, z, 2, &lf[0], &lgx[0], &lgy[0], &lgz[0]);
+	CHECK(lf[1] < lf[0], "field %g outside of the box, %g on it", lf[1], lf[0]);
+	CHECK(lgx[1] < 0.0f && fabsf(lgy[1]) < 1e-6f && fabsf(lgz[1]) < 1e-6f, "gradient ( %g, %g, %g ) outside of the box",
+		lgx[1], lgy[1], lgz[1]);
+
+	// and the gradient is the slope of that falloff, which the newton step and the step bound rely on
+	const float outside[3][3] = { { 3.0f, 0.0f, 0.0f }, { 2.5f, 2.0f, 0.3f }, { -0.2f, -3.0f, 2.2f } };
+	const float eps = 1e-2f;
+	for (unsigned int o = 0; o < 3; o++){
+		float fx[6], fy[6], fz[6], ff[6], gx6[6], gy6[6], gz6[6], fo, g[3];
+		for (unsigned int a = 0; a < 6; a++){
+			fx[a] = outside[o][0]; fy[a] = outside[o][1]; fz[a] = outside[o][2];
+		}
+		for (unsigned int a = 0; a < 3; a++){
+			float * c[3] = { fx, fy, fz };
+			c[a][2 * a] += eps;
+			c[a][2 * a + 1] -= eps;
+		}
+		grid.lookup(identity, fx, fy, fz, 6, ff, gx6, gy6, gz6);
+		grid.lookup(identity, &outside[o][0], &outside[o][1], &outside[o][2], 1, &fo, &g[0], &g[1], &g[2]);
+		float maxError = 0.0f, slope = 0.0f;
+		for (unsigned int a = 0; a < 3; a++){
+			float diff = (ff[2 * a] - ff[2 * a + 1]) / (2.0f * eps);
+			maxError = std::max(maxError, fabsf(diff - g[a]));
+			slope += diff * diff;
+		}
+		CHECK(maxError < 0.01f * sqrtf(slope), "gradient ( %g, %g, %g ) at ( %g, %g, %g ) off the slope %g of the field by %g",
+			g[0], g[1], g[2], outside[o][0], outside[o][1], outside[o][2], sqrtf(slope), maxError);
+	}
+
+	float pos[3] = { 4.0f, 0.25f, 0.0f };
+	CHECK(grid.clamp(identity, pos), "point outside of the box not clamped");
+	CHECK(fabsf(pos[0] - 1.5f) < 0.05f && fabsf(pos[1] - 0.25f) < 1e-5f, "point clamped to ( %g, %g, %g )", pos[0], pos[1], pos[2]);
+	CHECK(!grid.clamp(identity, pos), "point on the box clamped again");
+}
+
+
+// scene file of a tube of radius 0.3 along y, 3 long, over the joints root ( y = 0 ), mid ( y = 1 ) and tip ( y = 2 ).
+// the poses 0, 1 and 2 bend mid by 0, 0.5 and 1 radians about z
+static const float tubeRadius = 0.3f;
+static const float tubeAngles[3] = { 0.0f, 0.5f, 1.0f };
+
+static void tubeWeights(float y, float w[3]){
+	w[0] = w[1] = w[2] = 0.0f;
+	if (y < 1.0f)
+		w[0] = 1.0f;
+	else if (y < 2.0f){
+		w[0] = 2.0f - y;
+		w[1] = y - 1.0f;
+	}
+	else {
+		float t = std::min(1.0f, y - 2.0f);
+		w[1] = 1.0f - t;
+		w[2] = t;
+	}
+}
+
+static bool writeTube(const std::string & fileName){
+	const unsigned int rings = 40, segments = 24;
+	FILE * file = fopen(fileName.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "joint root - 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1\n");
+	fprintf(file, "joint mid root 1 0 0 0 0 1 0 1 0 0 1 0 0 0 0 1\n");
+	fprintf(file, "joint tip mid 1 0 0 0 0 1 0 1 0 0 1 0 0 0 0 1\n");
+	fprintf(file, "mesh tube %u %u 3\n", (rings + 1) * segments, rings * segments);
+	fprintf(file, "influences root mid tip\n");
+	for (unsigned int r = 0; r <= rings; r++){
+		for (unsigned int s = 0; s < segments; s++){
+			float a = 2.0f * 3.14159265f * s / segments;
+			fprintf(file, "v %f %f %f\n", tubeRadius * cosf(a), 3.0f * r / rings, tubeRadius * sinf(a));
+		}
+	}
+	for (unsigned int r = 0; r < rings; r++){
+		for (unsigned int s = 0; s < segments; s++){
+			unsigned int a = r * segments + s, b = r * segments + (s + 1) % segments;
+			fprintf(file, "f 4 %u %u %u %u\n", a, b, b + segments, a + segments);
+		}
+	}
+	for (unsigned int r = 0; r <= rings; r++){
+		float w[3];
+		tubeWeights(3.0f * r / rings, w);
+		for (unsigned int s = 0; s < segments; s++)
+			fprintf(file, "w %f %f %f\n", w[0], w[1], w[2]);
+	}
+	for (unsigned int p = 0; p < 3; p++){
+		float c = cosf(tubeAngles[p]), s = sinf(tubeAngles[p]);
+		fprintf(file, "pose %u\np mid %f %f 0 0 %f %f 0 1 0 0 1 0 0 0 0 1\n", p, c, -s, s, c);
+	}
+	fclose(file);
+	return true;
+}
+
+// load the tube into sceneData
+static bool loadTube(fileSceneParser & parser){
+	const std::string fileName = "implicitSkinningTests.tube.txt";
+	bool ok = writeTube(fileName) && parser.readFile(fileName);
+	remove(fileName.c_str());
+	return ok && sceneData::loadScene(parser);
+}
+
+// load and prepare the tube with the current prep parameters
+static bool prepTube(fileSceneParser & parser){
+	return loadTube(parser) && sceneData::prepScene();
+}
+
+// points of the mesh table ( x, y, z ) in maya order
+static std::vector<float> tablePoints(const meshTable & mTable){
+	std::vector<float> points(mTable.pointIdxTable.size() * 3);
+	for (std::size_t i = 0; i < mTable.pointIdxTable.size(); i++){
+		for (unsigned int a = 0; a < 3; a++)
+			points[mTable.pointIdxTable[i] * 3 + a] = mTable.pointPosTable[i * mTable._numElems + a];
+	}
+	return points;
+}
+
+static float maxDistance(const std::vector<float> & a, const std::vector<float> & b){
+	float maxDist = 0.0f;
+	for (std::size_t i = 0; i + 2 < a.size(); i += 3){
+		float dx = a[i] - b[i], dy = a[i + 1] - b[i + 1], dz = a[i + 2] - b[i + 2];
+		maxDist = std::max(maxDist, sqrtf(dx * dx + dy * dy + dz * dz));
+	}
+	return maxDist;
+}
+
+
+// the projected tube stays within its radius of the linear blend skinning, and the points end on their iso surface
+static void testProjection(unsigned int gridResolution){
+	sceneData::_params = prepParams();
+	sceneData::_params.gridResolution = gridResolution;
+	fileSceneParser parser;
+	if (!prepTube(parser)){
+		CHECK(false, "prep of the tube, grid %u", gridResolution);
+		return;
+	}
+
+	rbfDeformer skinning, deformer;
+	skinning.params().maxIterations = 0;
+	skinning.params().relaxSweeps = 0;
+	deformer.params().relaxSweeps = 0;
+	for (int frame = 1; frame < 3; frame++){
+		parser.setFrame(frame);
+		CHECK(skinning.deform(parser), "skinning of frame %d", frame);
+		std::vector<float> lbs = tablePoints(*sceneData::_meshTables[0]);
+		CHECK(deformer.deform(parser), "deform of frame %d", frame);
+		const meshTable & mTable = *sceneData::_meshTables[0];
+		std::vector<float> projected = tablePoints(mTable);
+
+		float maxDist = maxDistance(lbs, projected);
+		CHECK(maxDist < tubeRadius, "grid %u frame %d: a point is %g from its skinned position", gridResolution, frame, maxDist);
+
+		// the field at the projected points, composed the way the projector does
+		std::vector<jointData *> joints(sceneData::_jointNum, nullptr);
+		std::list<sceneData::jointPtr>::const_iterator iter = sceneData::_joints.begin();
+		for (; iter != sceneData::_joints.end(); iter++)
+			joints[(*iter)->_index] = iter->get();
+		std::vector<Transform> toRest(sceneData::_jointTables.size());
+		for (std::size_t t = 0; t < toRest.size(); t++){
+			const jointTable & jTable = *sceneData::_jointTables[t];
+			toRest[t] = Transform(jTable.matrix) * Inverse(joints[jTable.jointIdx]->_transform);
+		}
+		fieldProjector projector;
+		projector.init();
+		std::size_t nPoints = mTable.pointIdxTable.size(), numSkinned = 0, numProjected = 0;
+		double skinnedError = 0.0, projectedError = 0.0;
+		for (std::size_t i = 0; i < nPoints; i++){
+			const float * p = &mTable.pointPosTable[i * mTable._numElems];
+			const float * l = &lbs[mTable.pointIdxTable[i] * 3];
+			float f, lf, gx, gy, gz;
+			projector.evalComposed(mTable.ptJointIdxTable[i], toRest, &p[0], &p[1], &p[2], 1, &f, &gx, &gy, &gz);
+			projector.evalComposed(mTable.ptJointIdxTable[i], toRest, &l[0], &l[1], &l[2], 1, &lf, &gx, &gy, &gz);
+			numProjected += fabsf(f - p[3]) < 0.01f;
+			numSkinned += fabsf(lf - p[3]) < 0.01f;
+			projectedError += fabsf(f - p[3]);
+			skinnedError += fabsf(lf - p[3]);
+		}
+		CHECK(numProjected > numSkinned && projectedError < skinnedError, "grid %u frame %d: %u points on their iso surface, "
+			"error %g, against %u, %g after the skinning", gridResolution, frame, (unsigned int)numProjected, projectedError,
+			(unsigned int)numSkinned, skinnedError);
+
+		// the points left off their iso surface are stopped at the bend, by the contact or the step bound,
+		// the coarser the grid the more of them
+		if (gridResolution == 0)
+			CHECK(numProjected >= nPoints * 9 / 10, "frame %d: %u of %u points on their iso surface", frame,
+				(unsigned int)numProjected, (unsigned int)nPoints);
+	}
+	sceneData::clear();
+}
+
+
+// the interior points of a flat patch are at the average of their neighbours and stay, the border slides in the plane.
+// the mapped positions are copied once, then the two owned buffers are swapped
+static void testRelaxFlatPatch(){
+	const unsigned int n = 16, nPoints = n * n;
+	meshTable mTable(4);
+	std::shared_ptr<float> mapped(new float[nPoints * 4], std::default_delete<float[]>());
+	mTable.pointIdxTable.resize(nPoints);
+	mTable.offsetTable.assign(1, 0);
+	for (unsigned int j = 0; j < n; j++){
+		for (unsigned int i = 0; i < n; i++){
+			unsigned int p = j * n + i;
+			mTable.pointIdxTable[p] = p;
+			float * pos = mapped.get() + p * 4;
+			pos[0] = (float)i; pos[1] = (float)j; pos[2] = 0.0f; pos[3] = 0.5f;
+
+			std::vector<unsigned int> adj;
+			if (i > 0) adj.push_back(p - 1);
+			if (i + 1 < n) adj.push_back(p + 1);
+			if (j > 0) adj.push_back(p - n);
+			if (j + 1 < n) adj.push_back(p + n);
+			for (std::size_t k = 0; k < adj.size(); k++){
+				mTable.adjPtIdxTable.push_back(adj[k]);
+				mTable.relaxWeightTable.push_back(1.0f / adj.size());
+			}
+			mTable.offsetTable.push_back((unsigned int)mTable.adjPtIdxTable.size());
+		}
+	}
+	mTable.pointPosTable.view(mapped.get(), nPoints * 4, mapped);
+
+	std::vector<float> normals(nPoints * 3, 0.0f), deviations(nPoints, 1.0f);
+	for (unsigned int p = 0; p < nPoints; p++)
+		normals[p * 3 + 2] = 1.0f;
+
+	relaxSolver solver;
+	threadController controller(4);
+	std::vector<const float *> buffers;
+	for (unsigned int frame = 0; frame < 4; frame++){
+		solver.relax(mTable, &normals[0], &deviations[0], 1, 1.0f, controller);
+		if (std::find(buffers.begin(), buffers.end(), mTable.pointPosTable.data()) == buffers.end())
+			buffers.push_back(mTable.pointPosTable.data());
+	}
+	CHECK(!mTable.pointPosTable.isView(), "positions still mapped");
+	CHECK(buffers.size() == 2, "%u position buffers over 4 frames", (unsigned int)buffers.size());
+
+	// the border moves in by a ring each sweep
+	float interiorMove = 0.0f, maxZ = 0.0f, maxIso = 0.0f;
+	for (unsigned int j = 0; j < n; j++){
+		for (unsigned int i = 0; i < n; i++){
+			const float * pos = &mTable.pointPosTable[(j * n + i) * 4];
+			maxZ = std::max(maxZ, fabsf(pos[2]));
+			maxIso = std::max(maxIso, fabsf(pos[3] - 0.5f));
+			if (i > 4 && j > 4 && i + 5 < n && j + 5 < n)
+				interiorMove = std::max(interiorMove, fabsf(pos[0] - i) + fabsf(pos[1] - j));
+		}
+	}
+	CHECK(interiorMove < 1e-5f, "interior point moved by %g", interiorMove);
+	CHECK(maxZ == 0.0f, "point moved off the plane by %g", maxZ);
+	CHECK(maxIso == 0.0f, "iso value changed by %g", maxIso);
+	CHECK(mapped.get()[(n + 1) * 4] == 1.0f, "mapped positions written");
+}
+
+
+// the frequencies of the alias table draws follow the weights
+static void testAliasTable(){
+	const double weights[6] = { 1.0, 2.0, 3.0, 4.0, 0.0, 10.0 };
+	aliasTable table;
+	CHECK(table.init(weights, 6), "alias table of positive weights");
+	const unsigned int numDraws = 200000;
+	std::vector<unsigned int> counts(6, 0);
+	counterRng rng(11);
+	for (unsigned int i = 0; i < numDraws; i++){
+		float u1, u2;
+		rng.uniform2(i, u1, u2);
+		counts[table.sample(u1, u2)]++;
+	}
+	for (unsigned int k = 0; k < 6; k++){
+		double expected = weights[k] / 20.0, freq = (double)counts[k] / numDraws;
+		CHECK(fabs(freq - expected) < 0.005, "index %u drawn %g of the time for %g", k, freq, expected);
+	}
+	CHECK(counts[4] == 0, "index of weight 0 drawn %u times", counts[4]);
+
+	const double zeros[3] = { 0.0, 0.0, 0.0 };
+	CHECK(!table.init(zeros, 3), "alias table of zero weights");
+}
+
+
+// no two kept points closer than the radius, and every dropped point within the radius of a kept one
+static void testPoissonDisk(){
+	const unsigned int count = 4000;
+	const float radius = 0.08f;
+	std::vector<float> pos(count * 3);
+	counterRng rng(3);
+	for (unsigned int i = 0; i < count; i++){
+		float u[4];
+		rng.uniform2(2 * i, u[0], u[1]);
+		rng.uniform2(2 * i + 1, u[2], u[3]);
+		pos[i * 3] = u[0]; pos[i * 3 + 1] = u[1]; pos[i * 3 + 2] = u[2];
+	}
+	std::vector<unsigned int> keep;
+	poissonDiskSelect(&pos[0], count, radius, keep);
+	CHECK(!keep.empty() && keep.size() < count, "%u of %u points kept", (unsigned int)keep.size(), count);
+
+	auto dist2 = [&](unsigned int a, unsigned int b){
+		float dx = pos[a * 3] - pos[b * 3], dy = pos[a * 3 + 1] - pos[b * 3 + 1], dz = pos[a * 3 + 2] - pos[b * 3 + 2];
+		return dx * dx + dy * dy + dz * dz;
+	};
+	float minDist2 = 1e30f;
+	for (std::size_t a = 0; a < keep.size(); a++){
+		for (std::size_t b = a + 1; b < keep.size(); b++)
+			minDist2 = std::min(minDist2, dist2(keep[a], keep[b]));
+	}
+	CHECK(sqrtf(minDist2) >= radius, "kept points %g apart", sqrtf(minDist2));
+	CHECK(std::is_sorted(keep.begin(), keep.end()), "kept indices not increasing");
+
+	std::vector<unsigned char> kept(count, 0);
+	for (std::size_t k = 0; k < keep.size(); k++)
+		kept[keep[k]] = 1;
+	unsigned int numUncovered = 0;
+	for (unsigned int i = 0; i < count; i++){
+		if (kept[i])
+			continue;
+		bool covered = false;
+		for (std::size_t k = 0; k < keep.size() && !covered; k++)
+			covered = dist2(i, keep[k]) < radius * radius;
+		numUncovered += !covered;
+	}
+	CHECK(numUncovered == 0, "%u dropped points far from every kept point", numUncovered);
+}
+
+
+// the fitted field is on its iso value 0.5 at its centers, inside the surface above it, outside of the support 0
+static void testHrbfFit(){
+	std::vector<float> points, normals;
+	spherePoints(200, points, normals);
+	hrbfField field;
+	CHECK(fitSphere(field), "fit of the sphere");
+	CHECK(field.size() == 200, "%u centers fitted", field.size());
+
+	std::vector<float> px(200), py(200), pz(200), f(200), gx(200), gy(200), gz(200);
+	for (unsigned int i = 0; i < 200; i++){
+		px[i] = points[i * 3]; py[i] = points[i * 3 + 1]; pz[i] = points[i * 3 + 2];
+	}
+	field.eval(&px[0], &py[0], &pz[0], 200, &f[0], &gx[0], &gy[0], &gz[0]);
+	float maxError = 0.0f;
+	for (unsigned int i = 0; i < 200; i++)
+		maxError = std::max(maxError, fabsf(f[i] - 0.5f));
+	CHECK(maxError < 1e-3f, "field off its iso value by %g at a center", maxError);
+
+	float x[2] = { 0.0f, 3.0f }, y[2] = { 0.2f, 0.0f }, z[2] = { 0.0f, 0.0f };
+	field.eval(x, y, z, 2, &f[0], &gx[0], &gy[0], &gz[0]);
+	CHECK(f[0] > 0.5f, "field %g inside the sphere", f[0]);
+	CHECK(f[1] == 0.0f, "field %g outside of the support", f[1]);
+}
+
+
+static const jointTable * tableOf(unsigned int jointIdx){
+	for (std::size_t t = 0; t < sceneData::_jointTables.size(); t++){
+		if (sceneData::_jointTables[t]->jointIdx == jointIdx)
+			return sceneData::_jointTables[t].get();
+	}
+	return nullptr;
+}
+
+static bool sameCoord(const localCoord & a, const localCoord & b){
+	if (memcmp(&a._center, &b._center, sizeof(Point)) != 0)
+		return false;
+	const Vector * va[5] = { &a._axisX, &a._axisY, &a._axisZ, &a.bbox.first, &a.bbox.second };
+	const Vector * vb[5] = { &b._axisX, &b._axisY, &b._axisZ, &b.bbox.first, &b.bbox.second };
+	for (unsigned int k = 0; k < 5; k++){
+		if (memcmp(va[k], vb[k], sizeof(Vector)) != 0)
+			return false;
+	}
+	return true;
+}
+
+// points moved to another joint refit that joint and their old one only, to the tables a refit of every joint gives,
+// after a deform as well
+static void testPartitionEdit(){
+	sceneData::_params = prepParams();
+	fileSceneParser parser;
+	if (!prepTube(parser)){
+		CHECK(false, "prep of the tube");
+		return;
+	}
+	unsigned int root = (unsigned int)sceneData::findJoint("root")->_index;
+	unsigned int mid = (unsigned int)sceneData::findJoint("mid")->_index;
+	unsigned int tip = (unsigned int)sceneData::findJoint("tip")->_index;
+	std::vector<std::shared_ptr<jointTable>> before(sceneData::_jointNum);
+	for (std::size_t t = 0; t < sceneData::_jointTables.size(); t++)
+		before[sceneData::_jointTables[t]->jointIdx] = sceneData::_jointTables[t];
+
+	// edited after a deform, as in maya, the iso values are still those of the rest pose
+	rbfDeformer deformer;
+	parser.setFrame(1);
+	CHECK(deformer.deform(parser), "deform of frame 1");
+
+	// the last rings of the root, below the mid joint
+	std::vector<unsigned int> points;
+	for (unsigned int p = 11 * 24; p < 14 * 24; p++)
+		points.push_back(p);
+	CHECK(sceneData::assignPoints(0, points, mid), "assign the points");
+	CHECK(sceneData::modifyMeshNodeGroup(), "no edit pending");
+	CHECK(sceneData::_dirtyJoints[root] && sceneData::_dirtyJoints[mid] && !sceneData::_dirtyJoints[tip], "joints marked");
+	while (sceneData::modifyMeshNodeGroup())
+		sceneData::updateModified();
+
+	CHECK(tableOf(root) != before[root].get() && tableOf(mid) != before[mid].get(), "the edited joints kept their tables");
+	CHECK(tableOf(tip) == before[tip].get(), "the table of an untouched joint was redone");
+	const meshTable & mTable = *sceneData::_meshTables[0];
+	unsigned int numMoved = 0;
+	for (std::size_t i = 0; i < mTable.pointIdxTable.size(); i++)
+		numMoved += mTable.pointIdxTable[i] >= points.front() && mTable.pointIdxTable[i] <= points.back() && mTable.ptJointIdxTable[i] == mid;
+	CHECK(numMoved == points.size(), "%u of %u points in the partition of the joint", numMoved, (unsigned int)points.size());
+
+	std::vector<std::shared_ptr<jointTable>> edited(sceneData::_jointNum);
+	for (std::size_t t = 0; t < sceneData::_jointTables.size(); t++)
+		edited[sceneData::_jointTables[t]->jointIdx] = sceneData::_jointTables[t];
+	std::vector<float> editedIso(mTable.pointIdxTable.size());
+	for (std::size_t i = 0; i < editedIso.size(); i++)
+		editedIso[i] = mTable.pointPosTable[i * mTable._numElems + 3];
+
+	// every joint refitted on the same partitions
+	sceneData::_dirtyJoints.assign(sceneData::_jointNum, 1);
+	sceneData::_dirtyMeshes.assign(sceneData::_meshTables.size(), 0);
+	sceneData::updateModified();
+	for (unsigned int j = 0; j < sceneData::_jointNum; j++){
+		const jointTable * full = tableOf(j);
+		if (!edited[j] || !full){
+			CHECK(!edited[j] && !full, "joint %u has a table in one prep only", j);
+			continue;
+		}
+		CHECK(edited[j]->rbfPosParams == full->rbfPosParams && edited[j]->rbfNormalParams == full->rbfNormalParams,
+			"joint %u fitted otherwise", j);
+		CHECK(sameCoord(edited[j]->coord, full->coord), "joint %u has another frame", j);
+	}
+	bool sameIso = true;
+	for (std::size_t i = 0; i < editedIso.size(); i++)
+		sameIso = sameIso && editedIso[i] == mTable.pointPosTable[i * mTable._numElems + 3];
+	CHECK(sameIso, "iso values differ from the full refit");
+
+	// the same edit on a fresh prep, never deformed
+	sceneData::clear();
+	fileSceneParser freshParser;
+	if (!prepTube(freshParser) || !sceneData::assignPoints(0, points, mid)){
+		CHECK(false, "edit of a fresh prep");
+		return;
+	}
+	sceneData::updateModified();
+	const meshTable & fresh = *sceneData::_meshTables[0];
+	unsigned int numDiffer = 0;
+	for (std::size_t i = 0; i < editedIso.size(); i++)
+		numDiffer += editedIso[i] != fresh.pointPosTable[i * fresh._numElems + 3];
+	CHECK(numDiffer == 0, "%u iso values differ from the edit of a fresh prep", numDiffer);
+	sceneData::clear();
+}
+
+
+// scans and the radix sort against the standard library, over several blocks and on the thread pool
+template<class computeController>
+static void checkScanAndSort(std::size_t count, computeController & controller){
+	std::vector<unsigned int> in(count), out(count), expected(count);
+	counterRng rng(count);
+	for (std::size_t i = 0; i < count; i++){
+		float u1, u2;
+		rng.uniform2(i, u1, u2);
+		in[i] = (unsigned int)(u1 * 1000.0f);
+	}
+
+	if (count > 0){
+		std::partial_sum(in.begin(), in.end(), expected.begin());
+		unsigned int total = inclusiveScan(&in[0], &out[0], count, controller);
+		CHECK(out == expected && total == expected.back(), "inclusive scan of %u items", (unsigned int)count);
+		total = exclusiveScan(&in[0], &out[0], count, controller, 5u);
+		bool ok = total == expected.back() + 5;
+		for (std::size_t i = 0; i < count; i++)
+			ok = ok && out[i] == (i > 0 ? expected[i - 1] : 0) + 5;
+		CHECK(ok, "exclusive scan of %u items", (unsigned int)count);
+	}
+
+	// values are the original positions, so the sort is stable when they increase within a key
+	std::vector<unsigned int> keys(in), values(count);
+	for (std::size_t i = 0; i < count; i++)
+		values[i] = (unsigned int)i;
+	std::vector<std::pair<unsigned int, unsigned int>> pairs(count);
+	for (std::size_t i = 0; i < count; i++)
+		pairs[i] = std::make_pair(keys[i], values[i]);
+	std::sort(pairs.begin(), pairs.end());
+	if (count > 0)
+		radixSort(&keys[0], &values[0], count, controller, keyBitsOf(1000));
+	bool ok = true;
+	for (std::size_t i = 0; i < count; i++)
+		ok = ok && keys[i] == pairs[i].first && values[i] == pairs[i].second;
+	CHECK(ok, "radix sort of %u items", (unsigned int)count);
+}
+
+static void testScanAndSort(){
+	const std::size_t counts[] = { 0, 1, 1000, 3 * scanBlockSize + 17, 2 * sortBlockSize + 5 };
+	computeController serial;
+	threadController pool(4);
+	for (std::size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++){
+		checkScanAndSort(counts[c], serial);
+		checkScanAndSort(counts[c], pool);
+	}
+}
+
+
+// the deterministic reduction gives the same bits over any number of threads, the other one exact integer sums,
+// nested calls included
+static void testParallelReduce(){
+	const std::size_t count = 50 * threadController::reduceBlockSize + 17;
+	std::vector<float> values(count);
+	counterRng rng(5);
+	for (std::size_t i = 0; i < count; i++){
+		float u1, u2;
+		rng.uniform2(i, u1, u2);
+		values[i] = (u1 - 0.5f) * powf(10.0f, 6.0f * u2);
+	}
+	auto value = [&](std::size_t i){ return values[i]; };
+	auto add = [](float a, float b){ return a + b; };
+
+	std::vector<float> points(3 * 200003);
+	for (std::size_t i = 0; i < points.size(); i++){
+		float u1, u2;
+		rng.uniform2(count + i, u1, u2);
+		points[i] = 100.0f + u1 * u2;
+	}
+	pointMoments serial;
+	serial.add(&points[0], points.size() / 3);
+
+	const unsigned int threads[4] = { 1, 2, 4, 8 };
+	float sums[4];
+	pointMoments moments[4];
+	for (unsigned int t = 0; t < 4; t++){
+		threadController controller(threads[t], true);
+		sums[t] = controller.parallelReduce(count, 0.0f, value, add);
+		moments[t].add(&points[0], points.size() / 3, 3, controller);
+	}
+	for (unsigned int t = 1; t < 4; t++){
+		CHECK(memcmp(&sums[t], &sums[0], sizeof(float)) == 0, "sum of %u threads %.9g, of 1 thread %.9g", threads[t], sums[t], sums[0]);
+		CHECK(moments[t].count == moments[0].count && memcmp(moments[t].mean, moments[0].mean, sizeof(moments[0].mean)) == 0 &&
+			memcmp(moments[t].scatter, moments[0].scatter, sizeof(moments[0].scatter)) == 0, "moments of %u threads differ", threads[t]);
+	}
+	double maxError = 0.0;
+	for (unsigned int a = 0; a < 3; a++)
+		maxError = std::max(maxError, fabs(moments[0].mean[a] - serial.mean[a]));
+	for (unsigned int e = 0; e < 6; e++)
+		maxError = std::max(maxError, fabs(moments[0].scatter[e] - serial.scatter[e]) / serial.count);
+	CHECK(moments[0].count == serial.count && maxError < 1e-9, "moments off the serial ones by %g", maxError);
+
+	threadController controller(4);
+	unsigned long long total = controller.parallelReduce(count, 0ull, [](std::size_t i){ return (unsigned long long)i * i; },
+		[](unsigned long long a, unsigned long long b){ return a + b; });
+	unsigned long long expected = 0;
+	for (std::size_t i = 0; i < count; i++)
+		expected += (unsigned long long)i * i;
+	CHECK(total == expected, "sum of squares %llu for %llu", total, expected);
+
+	const std::size_t outer = 64, inner = 5000;
+	unsigned long long nested = controller.parallelReduce(outer, 0ull, [&](std::size_t i){
+		return controller.parallelReduce(inner, 0ull, [&](std::size_t k){ return (unsigned long long)(i * inner + k); },
+			[](unsigned long long a, unsigned long long b){ return a + b; });
+	}, [](unsigned long long a, unsigned long long b){ return a + b; });
+	unsigned long long n = outer * inner;
+	CHECK(nested == n * (n - 1) / 2, "nested sum %llu for %llu", nested, n * (n - 1) / 2);
+}
+
+
+// the simd levels of this cpu above scalar, each kernel of them is checked against the scalar one
+static std::vector<simdLevel> simdLevels(){
+	std::vector<simdLevel> levels;
+	for (int l = SIMD_SSE4; l <= getMaxSimdLevel(); l++)
+		levels.push_back((simdLevel)l);
+	return levels;
+}
+
+// largest difference of a and b over count values, relative to the largest of b
+static float relativeError(const float * a, const float * b, std::size_t count){
+	float maxDiff = 0.0f, maxValue = 1e-6f;
+	for (std::size_t i = 0; i < count; i++){
+		maxDiff = std::max(maxDiff, fabsf(a[i] - b[i]));
+		maxValue = std::max(maxValue, fabsf(b[i]));
+	}
+	return maxDiff / maxValue;
+}
+
+
+// the block evaluation of each level follows the scalar one, on counts with tails shorter than any vector
+static void testHrbfLevels(){
+	hrbfField field;
+	if (!fitSphere(field)){
+		CHECK(false, "fit of the sphere");
+		return;
+	}
+	const simdLevel level = getSimdLevel();
+	const unsigned int counts[] = { 1, 3, 7, 15, 16, 203 };
+	counterRng rng(13);
+	for (std::size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++){
+		unsigned int n = counts[c];
+		std::vector<float> p(3 * n), ref(4 * n), out(4 * n);
+		for (unsigned int i = 0; i < 3 * n; i++){
+			float u1, u2;
+			rng.uniform2(c * 1000 + i, u1, u2);
+			p[i] = 3.0f * u1 - 1.5f;
+		}
+		setSimdLevel(SIMD_SCALAR);
+		field.evalRaw(&p[0], &p[n], &p[2 * n], n, &ref[0], &ref[n], &ref[2 * n], &ref[3 * n]);
+		std::vector<simdLevel> levels = simdLevels();
+		for (std::size_t l = 0; l < levels.size(); l++){
+			setSimdLevel(levels[l]);
+			field.evalRaw(&p[0], &p[n], &p[2 * n], n, &out[0], &out[n], &out[2 * n], &out[3 * n]);
+			float error = relativeError(&out[0], &ref[0], 4 * n);
+			CHECK(error < 1e-5f, "%s hrbf of %u points off the scalar one by %g", getSimdLevelName(levels[l]), n, error);
+		}
+	}
+	setSimdLevel(level);
+}
+
+
+// uniform floats of a counter rng, drawn one after another
+class uniformStream{
+public:
+	uniformStream(uint64_t key):_rng(key), _counter(0){}
+	float next(float lo, float hi){
+		float u1, u2;
+		_rng.uniform2(_counter++, u1, u2);
+		return lo + (hi - lo) * u1;
+	}
+private:
+	counterRng _rng;
+	uint64_t _counter;
+};
+
+// skin of count random points on up to 4 of numJoints joints, with normalized weights
+static void randomSkin(skinTable & skin, std::size_t count, unsigned int numJoints, skinMethod method, uniformStream & random){
+	skin._method = method;
+	skin._numPoints = count;
+	skin._numPadded = (count + skinTable::blockSize - 1) / skinTable::blockSize * skinTable::blockSize;
+	skin._numSlots = 4;
+	skin._restX.assign(skin._numPadded, 0.0f);
+	skin._restY.assign(skin._numPadded, 0.0f);
+	skin._restZ.assign(skin._numPadded, 0.0f);
+	skin._joints.assign(skin._numPadded * 4, 0);
+	skin._weights.assign(skin._numPadded * 4, 0.0f);
+	for (std::size_t i = 0; i < count; i++){
+		skin._restX[i] = random.next(-1.0f, 1.0f);
+		skin._restY[i] = random.next(-1.0f, 1.0f);
+		skin._restZ[i] = random.next(-1.0f, 1.0f);
+		// every fifth point has no weight and stays at rest
+		unsigned int numUsed = (unsigned int)i % 5;
+		float sum = 0.0f;
+		for (unsigned int k = 0; k < numUsed; k++){
+			skin._joints[k * skin._numPadded + i] = (int)random.next(0.0f, (float)numJoints) % numJoints;
+			sum += skin._weights[k * skin._numPadded + i] = random.next(0.05f, 1.0f);
+		}
+		for (unsigned int k = 0; k < numUsed; k++)
+			skin._weights[k * skin._numPadded + i] /= sum;
+	}
+}
+
+// the points of no weight must come out of a skinning exactly at rest
+static void checkUnweightedAtRest(const skinTable & skin, const float * x, const float * y, const float * z,
+	const char * level, const char * method){
+	std::size_t n = skin.numPadded(), moved = 0;
+	for (std::size_t i = 0; i < skin._numPoints; i++){
+		float sum = 0.0f;
+		for (unsigned int k = 0; k < skin._numSlots; k++)
+			sum += skin._weights[k * n + i];
+		if (sum == 0.0f && (x[i] != skin._restX[i] || y[i] != skin._restY[i] || z[i] != skin._restZ[i]))
+			moved++;
+	}
+	CHECK(moved == 0, "%s %s skinning moved %u points of no weight", level, method, (unsigned int)moved);
+}
+
+// skin the points of each level, in two calls to start one of them past the first block, against the scalar path
+static void checkSkinLevels(const skinTable & skin, const skinPalette & palette, const char * method){
+	const simdLevel level = getSimdLevel();
+	std::size_t n = skin.numPadded();
+	alignedFloats ref(3 * n), out(3 * n);
+	setSimdLevel(SIMD_SCALAR);
+	skin.skin(palette, 0, n, &ref[0], &ref[n], &ref[2 * n]);
+	checkUnweightedAtRest(skin, &ref[0], &ref[n], &ref[2 * n], getSimdLevelName(SIMD_SCALAR), method);
+	std::vector<simdLevel> levels = simdLevels();
+	for (std::size_t l = 0; l < levels.size(); l++){
+		setSimdLevel(levels[l]);
+		std::size_t split = std::min<std::size_t>(skinTable::blockSize, n);
+		skin.skin(palette, 0, split, &out[0], &out[n], &out[2 * n]);
+		skin.skin(palette, split, n, &out[0], &out[n], &out[2 * n]);
+		float error = 0.0f;
+		for (unsigned int a = 0; a < 3; a++)
+			error = std::max(error, relativeError(&out[a * n], &ref[a * n], skin._numPoints));
+		CHECK(error < 1e-5f, "%s %s skinning of %u points off the scalar one by %g", getSimdLevelName(levels[l]), method,
+			(unsigned int)skin._numPoints, error);
+		checkUnweightedAtRest(skin, &out[0], &out[n], &out[2 * n], getSimdLevelName(levels[l]), method);
+	}
+	setSimdLevel(level);
+}
+
+
+// linear blend skinning of each level against the scalar one, on point counts padded to a block
+static void testLinearSkinLevels(){
+	const unsigned int numJoints = 7;
+	uniformStream random(17);
+	std::vector<float> matrices(12 * numJoints);
+	for (std::size_t e = 0; e < matrices.size(); e++)
+		matrices[e] = random.next(-2.0f, 2.0f);
+	skinPalette palette;
+	palette.matrices = &matrices[0];
+	palette.dualQuats = nullptr;
+	palette.numJoints = numJoints;
+
+	const std::size_t counts[] = { 1, 17, 37, 100 };
+	for (std::size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++){
+		skinTable skin;
+		randomSkin(skin, counts[c], numJoints, SKIN_LINEAR, random);
+		checkSkinLevels(skin, palette, "linear");
+	}
+}
+
+
+// dual quaternion skinning of each level against the scalar one, with joints of both hemispheres
+static void testDualQuatSkinLevels(){
+	const unsigned int numJoints = 7;
+	uniformStream random(19);
+	std::vector<float> dualQuats(8 * numJoints);
+	for (unsigned int j = 0; j < numJoints; j++){
+		// unit rotation r, translation t, dual part t * r / 2, the odd joints negated
+		float r[4], t[3], len = 0.0f;
+		for (unsigned int e = 0; e < 4; e++){
+			r[e] = random.next(-1.0f, 1.0f);
+			len += r[e] * r[e];
+		}
+		for (unsigned int e = 0; e < 4; e++)
+			r[e] /= sqrtf(len);
+		for (unsigned int e = 0; e < 3; e++)
+			t[e] = random.next(-2.0f, 2.0f);
+		float d[4] = {
+			0.5f * (r[3] * t[0] + t[1] * r[2] - t[2] * r[1]),
+			0.5f * (r[3] * t[1] + t[2] * r[0] - t[0] * r[2]),
+			0.5f * (r[3] * t[2] + t[0] * r[1] - t[1] * r[0]),
+			-0.5f * (t[0] * r[0] + t[1] * r[1] + t[2] * r[2]) };
+		float sign = j % 2 ? -1.0f : 1.0f;
+		for (unsigned int e = 0; e < 4; e++){
+			dualQuats[e * numJoints + j] = sign * r[e];
+			dualQuats[(e + 4) * numJoints + j] = sign * d[e];
+		}
+	}
+	skinPalette palette;
+	palette.matrices = nullptr;
+	palette.dualQuats = &dualQuats[0];
+	palette.numJoints = numJoints;
+
+	const std::size_t counts[] = { 1, 17, 37, 100 };
+	for (std::size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++){
+		skinTable skin;
+		randomSkin(skin, counts[c], numJoints, SKIN_DUAL_QUATERNION, random);
+		checkSkinLevels(skin, palette, "dual quaternion");
+	}
+}
+
+
+// random matrix near 3 * identity, so it is well conditioned, with the last row ( 0, 0, 0, 1 ) when affine
+static Matrix4x4 randomMatrix(uniformStream & random, bool affine){
+	Matrix4x4 m;
+	for (unsigned int r = 0; r < 4; r++){
+		for (unsigned int c = 0; c < 4; c++)
+			m.m[r][c] = (r == c ? 3.0f : 0.0f) + random.next(-1.0f, 1.0f);
+	}
+	if (affine){
+		m.m[3][0] = m.m[3][1] = m.m[3][2] = 0.0f;
+		m.m[3][3] = 1.0f;
+	}
+	else {
+		// small projective row, w stays away from 0 over the points
+		for (unsigned int c = 0; c < 3; c++)
+			m.m[3][c] *= 0.1f;
+	}
+	return m;
+}
+
+static float matrixError(const Matrix4x4 & a, const Matrix4x4 & b){
+	return relativeError(&a.m[0][0], &b.m[0][0], 16);
+}
+
+
+// the batch transforms of each level against the scalar path, the inverses against gauss-jordan
+static void testTransformLevels(){
+	const simdLevel level = getSimdLevel();
+	uniformStream random(23);
+	const unsigned int counts[] = { 1, 3, 7, 15, 16, 37 };
+	const char * kinds[3] = { "points", "vectors", "normals" };
+	for (unsigned int t = 0; t < 2; t++){
+		Transform xf(randomMatrix(random, t == 0));
+		for (std::size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++){
+			unsigned int n = counts[c];
+			std::vector<float> p(3 * n), ref(3 * n), out(3 * n);
+			for (unsigned int i = 0; i < 3 * n; i++)
+				p[i] = random.next(-2.0f, 2.0f);
+			std::vector<simdLevel> levels = simdLevels();
+			for (unsigned int k = 0; k < 3; k++){
+				auto apply = [&](std::vector<float> & o){
+					if (k == 0)
+						xf.TransformPoints(&p[0], &p[n], &p[2 * n], n, &o[0], &o[n], &o[2 * n]);
+					else if (k == 1)
+						xf.TransformVectors(&p[0], &p[n], &p[2 * n], n, &o[0], &o[n], &o[2 * n]);
+					else
+						xf.TransformNormals(&p[0], &p[n], &p[2 * n], n, &o[0], &o[n], &o[2 * n]);
+				};
+				setSimdLevel(SIMD_SCALAR);
+				apply(ref);
+				for (std::size_t l = 0; l < levels.size(); l++){
+					setSimdLevel(levels[l]);
+					apply(out);
+					float error = relativeError(&out[0], &ref[0], 3 * n);
+					CHECK(error < 1e-5f, "%s %s transform of %u %s off the scalar one by %g", getSimdLevelName(levels[l]),
+						t == 0 ? "affine" : "projective", n, kinds[k], error);
+				}
+			}
+		}
+	}
+	setSimdLevel(level);
+
+	float affineError = 0.0f, blockError = 0.0f;
+	for (unsigned int i = 0; i < 50; i++){
+		Matrix4x4 affine = randomMatrix(random, true), projective = randomMatrix(random, false);
+		affineError = std::max(affineError, matrixError(AffineInverse(affine), GaussJordanInverse(affine)));
+		affineError = std::max(affineError, matrixError(Inverse(affine), GaussJordanInverse(affine)));
+		blockError = std::max(blockError, matrixError(Inverse(projective), GaussJordanInverse(projective)));
+	}
+	CHECK(affineError < 1e-5f, "affine inverse off gauss-jordan by %g", affineError);
+	CHECK(blockError < 1e-5f, "block inverse off gauss-jordan by %g", blockError);
+}
+
+
+static std::string cacheEntryPath(const std::string & dir, uint64_t key){
+	char name[32];
+	sprintf(name, "%016llx.iskc", (unsigned long long)key);
+	return dir + "/" + name;
+}
+
+static bool fileExists(const std::string & path){
+	struct stat info;
+	return stat(path.c_str(), &info) == 0;
+}
+
+static std::size_t fileSize(const std::string & path){
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 ? (std::size_t)info.st_size : 0;
+}
+
+static void setFileTime(const std::string & path, time_t time){
+#if defined(_WIN32)
+	_utimbuf times = { time, time };
+	_utime(path.c_str(), &times);
+#else
+	utimbuf times = { time, time };
+	utime(path.c_str(), &times);
+#endif
+}
+
+
+// a second prep of the tube is a hit on the entry of the first, a parameter changes the key, a corrupted entry is
+// removed and prepared again, and the entries past the size limit go least recently used first
+static void testPrepCache(){
+	const std::string dir = "implicitSkinningTests.cache";
+	sceneData::_params = prepParams();
+	sceneData::_params.cacheDir = dir;
+	setLogCallback(recordLog);
+
+	fileSceneParser parser;
+	logLines.clear();
+	CHECK(prepTube(parser), "prep of the tube");
+	uint64_t key = prepCache::sceneKey();
+	const std::string path = cacheEntryPath(dir, key);
+	CHECK(logged("prep cache: stored") && fileExists(path), "the prep stored no entry");
+	std::vector<float> prepared = sceneData::_meshTables.empty() ? std::vector<float>() : tablePoints(*sceneData::_meshTables[0]);
+	std::size_t numJointTables = sceneData::_jointTables.size();
+	sceneData::clear();
+
+	logLines.clear();
+	CHECK(prepTube(parser), "prep of the tube from the cache");
+	CHECK(logged("prep cache: hit") && !logged("prep cache: stored"), "the second prep missed the cache");
+	CHECK(!sceneData::_meshTables.empty() && tablePoints(*sceneData::_meshTables[0]) == prepared
+		&& sceneData::_jointTables.size() == numJointTables, "the cached tables differ from the prepared ones");
+	sceneData::clear();
+
+	// another parameter, another entry next to the first
+	sceneData::_params.centersPerJoint = 40;
+	logLines.clear();
+	CHECK(prepTube(parser), "prep of the tube with fewer centers");
+	uint64_t otherKey = prepCache::sceneKey();
+	const std::string otherPath = cacheEntryPath(dir, otherKey);
+	CHECK(otherKey != key && logged("prep cache: stored") && !logged("prep cache: hit") && fileExists(otherPath),
+		"the parameter did not change the entry");
+	CHECK(fileExists(path), "the first entry is gone");
+	sceneData::clear();
+
+	// a byte flipped in the payload fails the checksum, the entry is removed then prepared again
+	FILE * file = fopen(path.c_str(), "r+b");
+	CHECK(file != nullptr, "open of %s", path.c_str());
+	if (file){
+		unsigned char byte = 0;
+		fseek(file, -1, SEEK_END);
+		fread(&byte, 1, 1, file);
+		byte ^= 0xFF;
+		fseek(file, -1, SEEK_END);
+		fwrite(&byte, 1, 1, file);
+		fclose(file);
+	}
+	sceneData::_params.centersPerJoint = prepParams().centersPerJoint;
+	CHECK(loadTube(parser), "load of the tube");
+	prepCache cache(dir, 0);
+	logLines.clear();
+	CHECK(!cache.load(key) && logged("prep cache: removed the bad entry") && !fileExists(path), "the corrupted entry was kept");
+	logLines.clear();
+	CHECK(sceneData::prepScene() && logged("prep cache: stored") && fileExists(path), "the corrupted entry was not prepared again");
+	CHECK(!sceneData::_meshTables.empty() && tablePoints(*sceneData::_meshTables[0]) == prepared, "the new entry differs");
+
+	// the hit on the older entry makes the other one the least recently used
+	time_t now = time(nullptr);
+	setFileTime(path, now - 200);
+	setFileTime(otherPath, now - 100);
+	CHECK(cache.load(key), "hit on the first entry");
+	prepCache limited(dir, fileSize(path) + fileSize(otherPath) - 1);
+	limited.evict();
+	CHECK(fileExists(path) && !fileExists(otherPath), "the eviction kept the least recently used entry");
+	sceneData::clear();
+
+	remove(path.c_str());
+	remove(otherPath.c_str());
+#if defined(_WIN32)
+	_rmdir(dir.c_str());
+#else
+	rmdir(dir.c_str());
+#endif
+	setLogCallback(quietLog);
+	sceneData::_params = prepParams();
+}
+
+
+// the first bytes of the file at path written to truncatedPath
+static bool truncateFile(const std::string & path, const std::string & truncatedPath, std::size_t bytes){
+	std::vector<unsigned char> data(bytes);
+	FILE * in = fopen(path.c_str(), "rb");
+	if (!in)
+		return false;
+	bool ok = fread(&data[0], 1, bytes, in) == bytes;
+	fclose(in);
+	FILE * out = fopen(truncatedPath.c_str(), "wb");
+	if (!out)
+		return false;
+	ok = fwrite(&data[0], 1, bytes, out) == bytes && ok;
+	return fclose(out) == 0 && ok;
+}
+
+
+// the tables mapped from the scene buffer of a prep deform the tube exactly as the tables of the prep, and a buffer
+// of another scene, a truncated one or tables with a grid of one node on an axis are rejected
+static void testSceneBuffer(){
+	const std::string path = "implicitSkinningTests.buffer", truncatedPath = "implicitSkinningTests.truncated";
+	sceneData::_params = prepParams();
+	sceneData::_params.gridResolution = 8;
+	sceneData::_params.bufferPath = path;
+
+	fileSceneParser parser;
+	if (!prepTube(parser)){
+		CHECK(false, "prep of the tube");
+		return;
+	}
+	CHECK(sceneData::writeToBuffer() && fileExists(path), "write of %s", path.c_str());
+
+	// a grid the lookup can not interpolate on
+	std::vector<sceneData::jointTablePtr> jointTables = sceneData::_jointTables;
+	CHECK(sceneData::checkTables(sceneData::_meshTables, jointTables), "the tables of the prep are rejected");
+	for (std::size_t t = 0; t < jointTables.size(); t++){
+		if (!jointTables[t]->grid)
+			continue;
+		jointTables[t] = std::make_shared<jointTable>(*jointTables[t]);
+		std::shared_ptr<fieldGrid> grid = std::make_shared<fieldGrid>(*jointTables[t]->grid);
+		grid->_res[0] = 1;
+		grid->_nodes.resize((std::size_t)grid->_res[1] * grid->_res[2] * 4);
+		jointTables[t]->grid = grid;
+		CHECK(!sceneData::checkTables(sceneData::_meshTables, jointTables), "a grid of one node on an axis is accepted");
+		break;
+	}
+
+	rbfDeformer deformer;
+	parser.setFrame(1);
+	CHECK(deformer.deform(parser), "deform of the prepared tables");
+	std::vector<float> prepared = tablePoints(*sceneData::_meshTables[0]);
+	sceneData::clear();
+
+	CHECK(loadTube(parser) && sceneData::readFromBuffer(path), "map of %s", path.c_str());
+	if (!sceneData::_meshTables.empty()){
+		rbfDeformer mappedDeformer;
+		parser.setFrame(1);
+		CHECK(mappedDeformer.deform(parser), "deform of the mapped tables");
+		float maxDist = maxDistance(prepared, tablePoints(*sceneData::_meshTables[0]));
+		CHECK(maxDist == 0.0f, "the mapped tables deform %g away from the prepared ones", maxDist);
+	}
+	sceneData::clear();
+
+	// the rest pose of another scene
+	CHECK(loadTube(parser), "load of the tube");
+	sceneData::_meshes.front()->_posPtr[0] += 1.0f;
+	CHECK(!sceneData::readFromBuffer(path) && sceneData::_meshTables.empty(), "the buffer of another scene is mapped");
+	sceneData::clear();
+
+	std::size_t size = fileSize(path);
+	const std::size_t truncatedSizes[] = { size - 1, size / 2, 16 };
+	for (std::size_t t = 0; t < sizeof(truncatedSizes) / sizeof(truncatedSizes[0]); t++){
+		CHECK(truncateFile(path, truncatedPath, truncatedSizes[t]), "truncation of %s", path.c_str());
+		CHECK(loadTube(parser), "load of the tube");
+		CHECK(!sceneData::readFromBuffer(truncatedPath) && sceneData::_meshTables.empty(), "the buffer truncated to %u bytes is mapped",
+			(unsigned int)truncatedSizes[t]);
+		sceneData::clear();
+	}
+
+	remove(path.c_str());
+	remove(truncatedPath.c_str());
+	sceneData::_params = prepParams();
+}
+
+
+static void fillSlot(unsigned char * slot, std::size_t slotBytes, uint32_t value){
+	uint32_t * words = (uint32_t *)slot;
+	for (std::size_t w = 0; w < slotBytes / sizeof(uint32_t); w++)
+		words[w] = value;
+}
+
+// the value all the words of the slot hold, 0 when they differ
+static uint32_t slotValue(const unsigned char * slot, std::size_t slotBytes){
+	const uint32_t * words = (const uint32_t *)slot;
+	for (std::size_t w = 1; w < slotBytes / sizeof(uint32_t); w++){
+		if (words[w] != words[0])
+			return 0;
+	}
+	return words[0];
+}
+
+
+// a triple buffer in a shared segment, the producer and the consumer on two mappings of it: the consumer gets the
+// latest slot once, skips the ones it was too slow for, keeps its slot while the producer goes on, and never sees
+// a slot the producer is writing
+static void testTripleBuffer(){
+#if defined(_WIN32)
+	const std::string name = "Local\\implicitSkinningTests.frames";
+#else
+	const std::string name = "/implicitSkinningTests.frames";
+#endif
+	const std::size_t slotBytes = 4096;
+	sharedSegment hostSegment, workerSegment;
+	if (!hostSegment.create(name, tripleBuffer::memorySize(slotBytes)) || !workerSegment.open(name, false)){
+		CHECK(false, "shared segment %s", name.c_str());
+		return;
+	}
+	tripleBuffer producer, consumer, other;
+	producer.init(hostSegment.data(), slotBytes);
+	CHECK(consumer.attach(workerSegment.data(), slotBytes), "attach of the buffer");
+	CHECK(!other.attach(workerSegment.data(), slotBytes * 2), "attach with another slot size");
+
+	CHECK(consumer.readLatest() == nullptr, "a slot read before any publish");
+	fillSlot(producer.writeSlot(), slotBytes, 1);
+	producer.publish();
+	const unsigned char * slot = consumer.readLatest();
+	CHECK(slot && slotValue(slot, slotBytes) == 1, "the published slot was not read");
+	CHECK(consumer.readLatest() == nullptr, "a slot read twice");
+
+	for (uint32_t v = 2; v <= 4; v++){
+		fillSlot(producer.writeSlot(), slotBytes, v);
+		producer.publish();
+	}
+	slot = consumer.readLatest();
+	CHECK(slot && slotValue(slot, slotBytes) == 4, "the latest slot was not read");
+
+	// the slot read stays while the producer fills and publishes the two others
+	for (uint32_t v = 5; v <= 10; v++){
+		CHECK(producer.writeSlot() != slot - workerSegment.data() + hostSegment.data(), "the producer writes the slot being read");
+		fillSlot(producer.writeSlot(), slotBytes, v);
+		producer.publish();
+	}
+	CHECK(slotValue(slot, slotBytes) == 4, "the slot being read changed to %u", slotValue(slot, slotBytes));
+	slot = consumer.readLatest();
+	CHECK(slot && slotValue(slot, slotBytes) == 10, "the latest slot was not read");
+
+	// concurrently, each slot read is whole and newer than the one before
+	const uint32_t first = 11, last = 20000;
+	std::thread producerThread([&]{
+		for (uint32_t v = first; v <= last; v++){
+			fillSlot(producer.writeSlot(), slotBytes, v);
+			producer.publish();
+		}
+	});
+	uint32_t previous = 10, numRead = 0, numTorn = 0, numOlder = 0;
+	while (previous != last){
+		slot = consumer.readLatest();
+		if (!slot)
+			continue;
+		uint32_t value = slotValue(slot, slotBytes);
+		numTorn += value == 0;
+		numOlder += value != 0 && value <= previous;
+		if (value > previous)
+			previous = value;
+		numRead++;
+		if (value == 0)
+			break;
+	}
+	producerThread.join();
+	CHECK(numTorn == 0 && numOlder == 0, "%u torn and %u older slots of %u read", numTorn, numOlder, numRead);
+	CHECK(previous == last, "the last slot read is %u", previous);
+
+	workerSegment.close();
+	hostSegment.close();
+	CHECK(!workerSegment.open(name, false), "the segment outlived its creator");
+}
+
+
+int main(int argc, char ** argv){
+	setLogCallback(quietLog);
+	const char * only = argc > 1 ? argv[1] : nullptr;
+	struct namedTest{ const char * name; void (*run)(); };
+	const namedTest tests[] = {
+		{ "gridLookup", testGridLookup },
+		{ "projection", []{ testProjection(0); } },
+		{ "projectionGrid", []{ testProjection(32); testProjection(8); } },
+		{ "relax", testRelaxFlatPatch },
+		{ "aliasTable", testAliasTable },
+		{ "poissonDisk", testPoissonDisk },
+		{ "hrbfFit", testHrbfFit },
+		{ "partitionEdit", testPartitionEdit },
+		{ "scanAndSort", testScanAndSort },
+		{ "parallelReduce", testParallelReduce },
+		{ "hrbfLevels", testHrbfLevels },
+		{ "linearSkinLevels", testLinearSkinLevels },
+		{ "dualQuatSkinLevels", testDualQuatSkinLevels },
+		{ "transformLevels", testTransformLevels },
+		{ "prepCache", testPrepCache },
+		{ "sceneBuffer", testSceneBuffer },
+		{ "tripleBuffer", testTripleBuffer },
+	};
+	for (std::size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); t++){
+		if (only && strcmp(only, tests[t].name) != 0)
+			continue;
+		unsigned int failedBefore = numFailed;
+		tests[t].run();
+		printf("%-20s %s\n", tests[t].name, numFailed == failedBefore ? "ok" : "FAILED");
+	}
+	printf("%u checks, %u failed\n", numChecks, numFailed);
+	return numFailed > 0 ? 1 : 0;
+}
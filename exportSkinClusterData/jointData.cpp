@@ -1,107 +1,48 @@
-#include "jointData.h"
-
-//#include "Eigen"
-
-bool jointData::getLocalCoord(const segData& seg){
-	//using namespace Eigen;
-
-	//unsigned int m = 3;   // dimension of each point
-	//unsigned int n = samplePoints.length();  // number of points 
-	//// matrix (n x m)
-	//MatrixXd DataPoints(n, m);  
-
-	//// fill the data
-	//std::shared_ptr<MFloatPointArray> pts = node->points;
-	//unsigned int nPoints = pts->length();
-	//for(unsigned int i = 0; i < nPoints; i++) {
-	//	float* ptPtr = &(*pts)[i].x;
-	//	for(unsigned int j=0; j<3; j++) {
-	//		DataPoints(i,j) = ptPtr[j];
-	//	}
-	//}
-
-	//// calculate mean value for each dimension
-	//double mean; RowVectorXd meanRow(m);
-	//for (int j = 0; j < DataPoints.cols(); j++){
-	//	mean = (DataPoints.col(j).sum())/n;		//compute mean
-	//	meanRow(j) = mean;
-	//}
-
-	////   center each point with the mean value
-	//for (int i = 0; i < DataPoints.rows(); i++){
-	//	DataPoints.row(i) -= meanRow;
-	//}
-
-	//// get the covariance matrix
-	//MatrixXd Covariance = MatrixXd::Zero(m, m);
-	//Covariance = (1 / (double) n) * DataPoints.transpose() * DataPoints;
-	////  std::cout << Covariance ;	
-
-	//// compute the eigenvalue on the covariance Matrix
-	//EigenSolver<MatrixXd> m_solve(Covariance);
-	//VectorXd eigenvalues = VectorXd::Zero(m);
-	//eigenvalues = m_solve.eigenvalues().real();
-
-	//MatrixXd eigenVectors = MatrixXd::Zero(n, m);  // matrix (n x m) (points, dims)
-	//eigenVectors = m_solve.eigenvectors().real();	
+#include <algorithm>
+#include <math.h>
 
-	//// sort and get the permutation indices
-	//typedef std::pair<double, int> valueIndex;
-	//typedef std::vector<valueIndex> PermutationIndices;	
-
-	//PermutationIndices eigenValueInOrder;
-	//for (unsigned int i = 0 ; i < m; i++)
-	//	eigenValueInOrder.push_back(std::make_pair(eigenvalues(i), i));
-
-	//sort(eigenValueInOrder.begin(), eigenValueInOrder.end());
-
-	//// get the local axis x, y, z, with x as the length axis
-	//Vector3d axisX = eigenVectors.col(eigenValueInOrder[m-1].second);
-	//Vector3d axisY, axisZ;
-	//double y[3] = {0.0, 0.0, 0.0};double z[3] = {0.0, 0.0, 0.0};
-	//if (fabs(axisX.x()) > fabs(axisX.y())){
-	//	double invLen = 1.0 / sqrt(axisX.x() * axisX.x() + axisX.z() * axisX.z());
-	//	y[0] = - axisX.z() * invLen; y[1] = 0.0; y[2] = axisX.x() * invLen;
-	//	axisY = Vector3d(y);
-	//}else {
-	//	double invLen = 1.0 / sqrt(axisX.y() * axisX.y() + axisX.z() * axisX.z());
-	//	y[0] = 0.0; y[1] = axisX.z() * invLen; y[2] = - axisX.y() * invLen;
-	//	axisY = Vector3d(y);
-	//}
-	//axisZ = axisX.cross(axisY);
-
-	//// get the local coord' center
-	//Vector3d center = meanRow.transpose();
-
-	//// get the size of bbox
-	//MatrixXd rowFeatureVector = MatrixXd::Zero(m, m);
-	//for (unsigned int i = 0; i < m; i++){
-	//	rowFeatureVector.row(i) = eigenVectors.col(eigenValueInOrder[m-1-i].second).transpose();
-	//}
-
-	//MatrixXd finalData = MatrixXd::Zero(m, n);  // matrix ( m * n ) 
-	//finalData = rowFeatureVector * DataPoints.transpose();
-
-	//Vector3d bbox;
-	//std::vector<double> vals;
-	//for (unsigned int j = 0; j < m; j++){
-	//	for (unsigned int i = 0 ; i < n; i++)
-	//		vals.push_back(finalData(j,i));
-	//	sort(vals.begin(), vals.end());
-	//	bbox(j) = std::max(fabs(vals[0]), fabs(vals[n-1]));
-	//	vals.clear();
-	//}
-
-	//// set the tree node' coord member
-	//node->coord->axisX->x = axisX.x(); node->coord->axisX->y = axisX.y(); node->coord->axisX->z = axisX.z();
-	//node->coord->axisY->x = axisY.x(); node->coord->axisY->y = axisY.y(); node->coord->axisY->z = axisY.z();
-	//node->coord->axisZ->x = axisZ.x(); node->coord->axisZ->y = axisZ.y(); node->coord->axisZ->z = axisZ.z();
-
-	//// set the tree node's center
-	//node->coord->center->x = center.x(); node->coord->center->y = center.y(); node->coord->center->z = center.z(); 
+#include "jointData.h"
 
-	//// set the tree node's bbox
-	//node->coord->bbox->x = bbox.x(); node->coord->bbox->y = bbox.y(); node->coord->bbox->z = bbox.z(); 
+bool jointData::getLocalCoord(const std::vector<float> & points, const pointMoments & moments, localCoord & coord) const{
+	std::size_t n = points.size() / 3;  // number of points
+	if (n == 0)
+		return false;
+
+	double covariance[6], values[3], vectors[3][3];
+	moments.covariance(covariance);
+	symmetricEigen3(covariance, values, vectors);
+
+	// get the local axis x, y, z, with x as the length axis
+	double axes[3][3];
+	const double * axisX = vectors[0];
+	double * axisY = axes[1], * axisZ = axes[2];
+	std::copy(axisX, axisX + 3, axes[0]);
+	if (fabs(axisX[0]) > fabs(axisX[1])){
+		double invLen = 1.0 / sqrt(axisX[0] * axisX[0] + axisX[2] * axisX[2]);
+		axisY[0] = - axisX[2] * invLen; axisY[1] = 0.0; axisY[2] = axisX[0] * invLen;
+	}else {
+		double invLen = 1.0 / sqrt(axisX[1] * axisX[1] + axisX[2] * axisX[2]);
+		axisY[0] = 0.0; axisY[1] = axisX[2] * invLen; axisY[2] = - axisX[1] * invLen;
+	}
+	axisZ[0] = axisX[1] * axisY[2] - axisX[2] * axisY[1];
+	axisZ[1] = axisX[2] * axisY[0] - axisX[0] * axisY[2];
+	axisZ[2] = axisX[0] * axisY[1] - axisX[1] * axisY[0];
+
+	// get the size of bbox in the local frame
+	double bboxMin[3], bboxMax[3];
+	projectedBounds(&points[0], n, 3, moments.mean, axes, bboxMin, bboxMax);
+
+	// set the coord member
+	coord._axisX = ::Vector((float)axes[0][0], (float)axes[0][1], (float)axes[0][2]);
+	coord._axisY = ::Vector((float)axisY[0], (float)axisY[1], (float)axisY[2]);
+	coord._axisZ = ::Vector((float)axisZ[0], (float)axisZ[1], (float)axisZ[2]);
+
+	// set the center
+	coord._center = Point((float)moments.mean[0], (float)moments.mean[1], (float)moments.mean[2]);
+
+	// set the bbox
+	coord.bbox.first  = ::Vector((float)bboxMin[0], (float)bboxMin[1], (float)bboxMin[2]);
+	coord.bbox.second = ::Vector((float)bboxMax[0], (float)bboxMax[1], (float)bboxMax[2]);
 
 	return true;
-}
\ No newline at end of file
+}
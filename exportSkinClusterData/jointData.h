@@ -2,21 +2,28 @@
 #define JOINTDATA_H
 
 #include <vector>
+#include <string>
 #include "meshData.h"
-#include "transform.h"
+#include "Transform.h"
+#include "localCoord.h"
+#include "pcaFrame.h"
 
 class jointData {
 public:
-	jointData():_segDataList(nullptr), _transform(){}
+	jointData():_segDataList(nullptr), _transform(), _localTransform(), _bindTransform(), _parentPos(-1), _index(0), _hashCode(0){}
 	~jointData(){}
-	bool getLocalCoord(const segData& seg);
+	// pca frame of the points ( x, y, z ), moments are the ones of the points
+	bool getLocalCoord(const std::vector<float> & points, const pointMoments & moments, localCoord & coord) const;
 
 public:
 	std::unique_ptr<std::vector<segData>> _segDataList;
-	Transform	_transform;
+	Transform	_transform;			// global transform at current frame
+	Transform	_localTransform;	// transform relative to the parent joint at current frame
+	Transform	_bindTransform;		// global transform at rest pose
 	int			_parentPos;
 	int			_index;
 	std::size_t	_hashCode;
+	std::string	_name;
 };
 
-#endif
\ No newline at end of file
+#endif
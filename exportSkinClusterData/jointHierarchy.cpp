@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "jointHierarchy.h"
+
+bool jointHierarchy::build(const std::list<std::unique_ptr<jointData>> & joints){
+	std::size_t numJoints = joints.size();
+	std::vector<const jointData *> byIndex(numJoints, nullptr);
+	std::list<std::unique_ptr<jointData>>::const_iterator iter = joints.begin();
+	for (; iter != joints.end(); iter++){
+		int idx = (*iter)->_index;
+		if (idx < 0 || (std::size_t)idx >= numJoints || byIndex[idx])
+			return false;
+		byIndex[idx] = iter->get();
+	}
+
+	// children lists, then breadth first from the roots
+	std::vector<std::vector<int>> children(numJoints);
+	_jointIdxs.clear();
+	for (std::size_t j = 0; j < numJoints; j++){
+		int parent = byIndex[j]->_parentPos;
+		if (parent >= (int)numJoints)
+			return false;
+		if (parent < 0)
+			_jointIdxs.push_back((int)j);
+		else
+			children[parent].push_back((int)j);
+	}
+	for (std::size_t head = 0; head < _jointIdxs.size(); head++){
+		const std::vector<int> & c = children[_jointIdxs[head]];
+		_jointIdxs.insert(_jointIdxs.end(), c.begin(), c.end());
+	}
+	if (_jointIdxs.size() != numJoints)
+		return false;	// the joints left out are on a cycle
+
+	_flatPos.assign(numJoints, -1);
+	for (std::size_t i = 0; i < numJoints; i++)
+		_flatPos[_jointIdxs[i]] = (int)i;
+	_parents.resize(numJoints);
+	for (std::size_t i = 0; i < numJoints; i++){
+		int parent = byIndex[_jointIdxs[i]]->_parentPos;
+		_parents[i] = parent < 0 ? -1 : _flatPos[parent];
+	}
+	return true;
+}
+
+
+void jointHierarchy::compose(const float * locals, float * globals, std::size_t numPoses) const{
+	const std::size_t numJoints = _jointIdxs.size();
+	for (std::size_t p = 0; p < numPoses; p++){
+		const float * l = locals + p * numJoints * 16;
+		float * g = globals + p * numJoints * 16;
+		for (std::size_t i = 0; i < numJoints; i++){
+			if (_parents[i] < 0)
+				memcpy(g + i * 16, l + i * 16, 16 * sizeof(float));
+			else
+				Matrix4x4::Mul(g + _parents[i] * 16, l + i * 16, g + i * 16);
+		}
+	}
+}
+
+
+void jointHierarchy::composeInverse(const float * localInvs, float * globalInvs, std::size_t numPoses) const{
+	const std::size_t numJoints = _jointIdxs.size();
+	for (std::size_t p = 0; p < numPoses; p++){
+		const float * l = localInvs + p * numJoints * 16;
+		float * g = globalInvs + p * numJoints * 16;
+		for (std::size_t i = 0; i < numJoints; i++){
+			if (_parents[i] < 0)
+				memcpy(g + i * 16, l + i * 16, 16 * sizeof(float));
+			else
+				Matrix4x4::Mul(l + i * 16, g + _parents[i] * 16, g + i * 16);
+		}
+	}
+}
+
+
+void jointHierarchy::update(const std::list<std::unique_ptr<jointData>> & joints){
+	const std::size_t numJoints = _jointIdxs.size();
+	if (numJoints == 0)
+		return;
+	_locals.resize(numJoints * 16);
+	_localInvs.resize(numJoints * 16);
+	_globals.resize(numJoints * 16);
+	_globalInvs.resize(numJoints * 16);
+
+	std::list<std::unique_ptr<jointData>>::const_iterator iter = joints.begin();
+	for (; iter != joints.end(); iter++){
+		std::size_t i = _flatPos[(*iter)->_index];
+		memcpy(&_locals[i * 16], (*iter)->_localTransform.GetMatrix().m, 16 * sizeof(float));
+		memcpy(&_localInvs[i * 16], (*iter)->_localTransform.GetInverseMatrix().m, 16 * sizeof(float));
+	}
+
+	compose(&_locals[0], &_globals[0]);
+	composeInverse(&_localInvs[0], &_globalInvs[0]);
+
+	for (iter = joints.begin(); iter != joints.end(); iter++){
+		std::size_t i = _flatPos[(*iter)->_index];
+		Matrix4x4 m, mInv;
+		memcpy(m.m, &_globals[i * 16], 16 * sizeof(float));
+		memcpy(mInv.m, &_globalInvs[i * 16], 16 * sizeof(float));
+		(*iter)->_transform = Transform(m, mInv);
+	}
+}
@@ -0,0 +1,59 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef JOINTHIERARCHY_H
+#define JOINTHIERARCHY_H
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "simd.h"
+#include "jointData.h"
+#include "computeController.h"
+
+// the joints flattened parents before children, so the global matrices are composed in one linear loop.
+// matrices are 16 floats row major ( same as Matrix4x4 ), one 64 bytes aligned matrix after another in flat order,
+// a pose is numJoints matrices and poses of several frames or characters follow each other
+class jointHierarchy{
+public:
+	jointHierarchy(){}
+
+	// order the joints, false if the hierarchy has a cycle or a parent out of range
+	bool build(const std::list<std::unique_ptr<jointData>> & joints);
+
+	// globals = parent global * local, for numPoses poses
+	void compose(const float * locals, float * globals, std::size_t numPoses = 1) const;
+
+	// the inverse of the globals from the inverse of the locals, inverse global = inverse local * parent inverse global
+	void composeInverse(const float * localInvs, float * globalInvs, std::size_t numPoses = 1) const;
+
+	// the poses spread over the controller' workers
+	template<class computeController>
+	void compose(const float * locals, float * globals, std::size_t numPoses, computeController & controller) const;
+
+	// read the local transforms of the joints, compose, and write their global transforms
+	void update(const std::list<std::unique_ptr<jointData>> & joints);
+
+	inline std::size_t size() const { return _jointIdxs.size(); }
+
+	std::vector<int>			_jointIdxs;	// jointData::_index of each flat position
+	std::vector<int>			_parents;	// flat position of the parent of each flat position, -1 for roots
+	std::vector<int>			_flatPos;	// flat position of each jointData::_index
+
+private:
+	// scratch of update
+	alignedFloats				_locals, _localInvs, _globals, _globalInvs;
+};
+
+
+template<class computeController>
+void jointHierarchy::compose(const float * locals, float * globals, std::size_t numPoses, computeController & controller) const{
+	const std::size_t poseSize = _jointIdxs.size() * 16;
+	controller.parallelFor(numPoses, [&](std::size_t p){
+		compose(locals + p * poseSize, globals + p * poseSize, 1);
+	});
+}
+
+#endif
@@ -1,17 +1,18 @@
-#ifndef JOINTDATA_H
-#define JOINTDATA_H
+#ifndef LOCALCOORD_H
+#define LOCALCOORD_H
 
-#include "vector.h"
+#include <utility>
+#include "Vector.h"
 
 class localCoord{
 public:
-	localCoord():_center(), _axisX(), _axisY(), _axisZ(), _bbox() {};
+	localCoord():_center(), _axisX(), _axisY(), _axisZ(), bbox() {};
 
-	MPoint	_center;
-	MVector _axisX;
-	MVector _axisY;
-	MVector _axisZ;
-	std::pair<MVector, MVector> bbox;
+	Point	_center;
+	Vector	_axisX;
+	Vector	_axisY;
+	Vector	_axisZ;
+	std::pair<Vector, Vector> bbox;	// min and max corner in the local frame
 };
 
-#endif
\ No newline at end of file
+#endif
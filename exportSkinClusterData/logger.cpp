@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "logger.h"
+
+static logCallback _callback = nullptr;
+
+void setLogCallback(logCallback callback){
+	_callback = callback;
+}
+
+void logInfo(const char * format, ...){
+	char msg[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(msg, sizeof(msg), format, args);
+	va_end(args);
+
+	if (_callback){
+		_callback(msg);
+	} else {
+		fputs(msg, stdout);
+		fputc('\n', stdout);
+	}
+}
@@ -0,0 +1,14 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+// report of the prep and deform stages, printed to stdout unless the host installs its own callback
+typedef void (*logCallback)(const char * msg);
+
+void setLogCallback(logCallback callback);
+void logInfo(const char * format, ...);
+
+#endif
@@ -2,34 +2,155 @@
 
 sceneData* mayaSceneParser::_scene = nullptr;
 
+bool mayaSceneParser::loadScene(sceneData * scene){
+	MStatus stat;
+	setScenePtr(scene);
+
+	// Iterate through all selected skinCluster nodes
+	MSelectionList sl;
+	stat = MGlobal::getActiveSelectionList(sl);
+	if (MStatus::kSuccess != stat){
+		cerr << "ERROR select none objects" << "\n";
+		return false;
+	}
+
+	MItSelectionList iter(sl, MFn::kSkinClusterFilter, &stat);
+	if (MStatus::kSuccess != stat){
+		cerr << "ERROR filter kSkinClusterFilter objects" << "\n";
+		return false;
+	}
+
+	// loop through the skinCluster nodes in the scene
+	for ( ; !iter.isDone(); iter.next() ) {
+		MObject object;
+		iter.getDependNode(object);
+
+		// For each skinCluster node, get the list of joints
+		MFnSkinCluster	skinCluster(object);
+		MDagPathArray	jointArray;
+		unsigned int	numJoints = skinCluster.influenceObjects(jointArray, &stat);
+		assert (numJoints != 0);
+
+		// set up the joint linear tree representation for current skinCluster node
+		for (unsigned int i = 0; i < numJoints; i++) {
+			MFnIkJoint fnJoint(jointArray[i]);
+			// parse the joint data and insert joint into the scene and set the parent index
+			if (insertJoint(fnJoint) != MStatus::kSuccess)
+				return false;
+		}
+
+		// loop through the geometries of current skinCluster
+		unsigned int nGeoms = skinCluster.numOutputConnections();
+		for (unsigned int i = 0; i < nGeoms; ++i) {
+
+			// push the skin-mesh and skinCluster pair into scene
+			unsigned int index = skinCluster.indexForOutputConnection(i, &stat);
+			if (MStatus::kSuccess != stat){
+				cerr << "Error getting geometry index." << "\n";
+				return false;
+			}
+
+			// get the geometry mesh
+			MDagPath skinPath;
+			stat = skinCluster.getPathAtIndex(index,skinPath);
+			if (MStatus::kSuccess != stat){
+				cerr << "Error getting geometry path." << "\n";
+				return false;
+			}
+
+			// insert vertices' info into meshData.
+			if (insertMesh(skinCluster, skinPath) != MStatus::kSuccess)
+				return false;
+
+		} // loop through the geometries of current skinCluster
+
+	} // loop through the skinCluster nodes in the scene
+
+	return true;
+}
+
+
+bool mayaSceneParser::loadPose(sceneData * scene){
+	std::list<sceneData::jointPtr>::iterator iter = scene->_joints.begin();
+	for (; iter != scene->_joints.end(); iter++){
+		MSelectionList sl;
+		MDagPath jointPath;
+		if (sl.add((*iter)->_name.c_str()) != MStatus::kSuccess || sl.getDagPath(0, jointPath) != MStatus::kSuccess){
+			cerr << "Error: joint " << (*iter)->_name.c_str() << " not found." << "\n";
+			return false;
+		}
+		MFnIkJoint fnJoint(jointPath);
+		(*iter)->_localTransform = getLocalTransform(fnJoint, (*iter)->_parentPos < 0);
+	}
+	return true;
+}
+
+
+bool mayaSceneParser::writeMeshes(const sceneData * scene){
+	MStatus stat;
+	std::list<sceneData::meshPtr>::const_iterator iter = scene->_meshes.begin();
+	for (std::size_t m = 0; iter != scene->_meshes.end(); iter++, m++){
+		MSelectionList sl;
+		MDagPath meshPath;
+		if (sl.add((*iter)->_name.c_str()) != MStatus::kSuccess || sl.getDagPath(0, meshPath) != MStatus::kSuccess){
+			cerr << "Error: mesh " << (*iter)->_name.c_str() << " not found." << "\n";
+			return false;
+		}
+
+		// the points are written back in their original order
+		const meshTable & mTable = *scene->_meshTables[m];
+		MFloatPointArray pts((*iter)->_numPoints);
+		for (std::size_t i = 0; i < mTable.pointIdxTable.size(); i++){
+			const float * pos = &mTable.pointPosTable[i * mTable._numElems];
+			pts[mTable.pointIdxTable[i]] = MFloatPoint(pos[0], pos[1], pos[2]);
+		}
+
+		MFnMesh fnMesh(meshPath, &stat);
+		if (MStatus::kSuccess != stat || fnMesh.setPoints(pts) != MStatus::kSuccess){
+			cerr << "Error setting the points of " << (*iter)->_name.c_str() << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+
 MStatus mayaSceneParser::insertJoint(const MFnIkJoint& fnJoint){
 	MStatus stat = MStatus::kSuccess;
-	jDataPtr jData = std::move(insertJointData(fnJoint));
+
+	// the joint may be shared by several skinClusters, or inserted already as a parent
+	std::string jointName	= fnJoint.fullPathName().asChar();
+	if (_scene->findJoint(getHashCode(jointName)))
+		return stat;
 
 	// find fnJoint' parent
 	if( fnJoint.parentCount() ) { // it is child joint
 		// assume any joint can have only one parent
-		MFnIkJoint fnParent(fnJoint.parent(0));
+		MObject parent = fnJoint.parent(0);
 
-		std::string parentName	= fnParent.fullPathName().asChar();
-
-		// TODO exclude world joint
+		// exclude world joint and the non-joint transforms above the skeleton
+		if ( !parent.hasFn(MFn::kJoint) ){
+			insertJointData(fnJoint, true);
+			return stat;
+		}
 
+		MFnIkJoint fnParent(parent);
+		std::string parentName	= fnParent.fullPathName().asChar();
 		std::size_t parentCode	= getHashCode(parentName);
-		std::list<sceneData::jointPtr>::const_iterator iter = _scene->_joints.begin();
-		for (;iter != _scene->_joints.end(); iter++){
-			if ((*iter)->_hashCode == parentCode ){
-				jData->_parentPos = (*iter)->_index;
-				break;
-			}
+
+		// parent joint does not exist in the list, insert its parent first
+		jointData * pData = _scene->findJoint(parentCode);
+		if ( !pData ){
+			stat = insertJoint(fnParent);
+			MCheckStatus(stat,"Error: inserting parent joint.");
+			pData = _scene->findJoint(parentCode);
 		}
 
-		// parent joint does not exist in the list, insert its parent 
-		if ( iter == _scene->_joints.end() ){
-			insertJointData(fnParent);		
-		}	
+		jointData * jData = insertJointData(fnJoint, false);
+		jData->_parentPos = pData->_index;
 
 	} else {
+		stat = MStatus::kFailure;
 		MCheckStatus(stat,"Error: joint has no parent found.");
 	}
 
@@ -40,33 +161,32 @@ MStatus mayaSceneParser::insertJoint(const MFnIkJoint& fnJoint){
 MStatus mayaSceneParser::insertMesh(const MFnSkinCluster& skinCluster, const MDagPath& skinPath){
 	MStatus stat;
 	meshPtr mPtr(new meshData());
+	mPtr->_name = skinPath.fullPathName().asChar();
+
+	MFnMesh fnMesh(skinPath, &stat);
+	MCheckStatus(stat,"Error getting fnMesh component.");
 
 	//  insert vertices index on each polymesh into meshData
-	MItMeshPolygon polyIter(skinPath, MObject::kNullObj, &stat); 
-	MCheckStatus(stat,"Error getting geometry MItMeshPolygon.");
-	int faceNum = polyIter.count();
-	meshData::intVecPtr tmpNeightPtr(new int[faceNum]);
-	{
-		int count = 0;
-		for ( ; !polyIter.isDone(); polyIter.next()){
-			MIntArray vtxlist;
-			polyIter.getVertices(vtxlist);
-
-			int length = vtxlist.length();
-			for (int i = 0; i < length; i++){
-				tmpNeightPtr[count++] = vtxlist[i];
-			}
-		}
-	}
+	MIntArray vertexCount, vertexList;
+	stat = fnMesh.getVertices(vertexCount, vertexList);
+	MCheckStatus(stat,"Error getting the face vertices.");
+	mPtr->_numFaces		= vertexCount.length();
+	mPtr->_numFaceVerts	= vertexList.length();
+
+	meshData::intVecPtr tmpSizePtr(new int[mPtr->_numFaces]);
+	vertexCount.get(tmpSizePtr.get());
+	mPtr->_faceSizePtr = std::move(tmpSizePtr);
+
+	meshData::intVecPtr tmpNeightPtr(new int[mPtr->_numFaceVerts]);
+	vertexList.get(tmpNeightPtr.get());
 	mPtr->_neighbourPtr = std::move(tmpNeightPtr);
 
 
 	// get the number of vertices
-	MFnMesh fnMesh(skinPath, &stat);
-	MCheckStatus(stat,"Error getting fnMesh component.");
 	MFloatPointArray pts;
 	fnMesh.getPoints(pts);
 	unsigned int nPoints = pts.length();
+	mPtr->_numPoints = nPoints;
 
 
 	//  insert vertices's positions into meshData
@@ -76,54 +196,122 @@ MStatus mayaSceneParser::insertMesh(const MFnSkinCluster& skinCluster, const MDa
 	// guaranteed to be aligned on 16 byte boundary.
 	for(unsigned int i=0; i < nPoints; i++) {
 		float* ptPtr = &pts[i].x;
-		for(unsigned int j=0; j<4; j++) {
+		for(unsigned int j=0; j<3; j++) {
 			tmpPosPtr[i * 3 + j] = ptPtr[j];
 		}
 	}
 	mPtr->_posPtr = std::move(tmpPosPtr);
 
 
-	//  insert vertices's weights into meshData
-	MItMeshVertex vertIter(skinPath);
+	//  map the influence objects to the scene joints
 	MDagPathArray jointArray;
 	unsigned int numJoints = skinCluster.influenceObjects(jointArray, &stat);
+	mPtr->_numInfluences = numJoints;
+
+	meshData::intVecPtr tmpJointPtr(new int[numJoints]);
+	for (unsigned int j = 0; j < numJoints; j++) {
+		jointData * jData = _scene->findJoint(getHashCode(jointArray[j].fullPathName().asChar()));
+		if (!jData) {
+			stat = MStatus::kFailure;
+			MCheckStatus(stat,"Error: influence object is not a joint.");
+		}
+		tmpJointPtr[j] = jData->_index;
+	}
+	mPtr->_jointIdxPtr = std::move(tmpJointPtr);
 
-	unsigned int wLen = nPoints * numJoints;
-	meshData::floatVecPtr tmpWPtr(new float[wLen]);
 
-	for (unsigned int i = 0; i < nPoints; i++) {
-		unsigned int tmp;
-		int preIndex;
+	//  insert vertices's weights into meshData, read from the sparse weightList plugs of the skinCluster
+	//  so only the non zero weights of each point are visited
+	std::vector<int> influenceOf;	// logical index of the weights plug -> influence index
+	for (unsigned int j = 0; j < numJoints; j++) {
+		unsigned int logicalIdx = skinCluster.indexForInfluenceObject(jointArray[j], &stat);
+		MCheckStatus(stat,"Error getting the influence index.");
+		if (logicalIdx >= influenceOf.size())
+			influenceOf.resize(logicalIdx + 1, -1);
+		influenceOf[logicalIdx] = j;
+	}
 
-		CHECK_MSTATUS ( vertIter.setIndex( i, preIndex) );
-		MObject vertex = vertIter.currentItem(&stat);
+	unsigned int geomIdx = skinCluster.indexForOutputShape(skinPath.node(), &stat);
+	MCheckStatus(stat,"Error getting the geometry index.");
+	MPlug weightListPlug = skinCluster.findPlug("weightList", &stat);
+	MCheckStatus(stat,"Error getting the weightList plug.");
 
-		MDoubleArray wts;
-		CHECK_MSTATUS ( skinCluster.getWeights(skinPath, vertex, wts, tmp) );
+	mPtr->_weights.init(nPoints, sceneData::_params.maxInfluences, sceneData::_params.quantizeWeights);
+	if (geomIdx > 0) {
+		// weightList only holds the first geometry, the others are read through getWeights
+		MItMeshVertex vertIter(skinPath);
+		std::vector<float> wts(numJoints);
+		for (unsigned int i = 0; i < nPoints; i++) {
+			unsigned int tmp;
+			int preIndex;
+			CHECK_MSTATUS ( vertIter.setIndex( i, preIndex) );
+			MDoubleArray dWts;
+			CHECK_MSTATUS ( skinCluster.getWeights(skinPath, vertIter.currentItem(), dWts, tmp) );
+			for (unsigned int j = 0; j < numJoints; j++)
+				wts[j] = (float)dWts[j];
+			mPtr->_weights.setPoint(i, &wts[0], numJoints);
+		}
+	} else {
+		MIntArray logicalIdxs;
+		std::vector<unsigned int> infs;
+		std::vector<float> wts;
+		for (unsigned int i = 0; i < nPoints; i++) {
+			MPlug weightsPlug = weightListPlug.elementByLogicalIndex(i).child(0);
+			weightsPlug.getExistingArrayAttributeIndices(logicalIdxs);
 
-		for (unsigned int j = 0; j < numJoints; j++) {
-			tmpWPtr[i * numJoints + j] = (float)wts[j];
-		} 
-	} // loop over all points
-	mPtr->_weightsPtr = std::move(tmpWPtr);
+			infs.clear();
+			wts.clear();
+			for (unsigned int k = 0; k < logicalIdxs.length(); k++) {
+				int logicalIdx = logicalIdxs[k];
+				if (logicalIdx < 0 || logicalIdx >= (int)influenceOf.size() || influenceOf[logicalIdx] < 0)
+					continue;
+				infs.push_back(influenceOf[logicalIdx]);
+				wts.push_back((float)weightsPlug.elementByLogicalIndex(logicalIdx).asDouble());
+			}
+			if (!infs.empty())
+				mPtr->_weights.setPoint(i, &infs[0], &wts[0], (unsigned int)infs.size());
+		} // loop over all points
+	}
+
+	//  skinningMethod: 0 classic linear, 1 dual quaternion, 2 weight blended ( starts from linear )
+	MPlug methodPlug = skinCluster.findPlug("skinningMethod", &stat);
+	if (stat == MStatus::kSuccess && methodPlug.asInt() == 1)
+		mPtr->_skinMethod = SKIN_DUAL_QUATERNION;
+	stat = MStatus::kSuccess;
 
 	_scene->_meshes.push_back(std::move(mPtr));
 	return stat;
 }
 
-mayaSceneParser::jDataPtr mayaSceneParser::insertJointData(const MFnIkJoint& joint){
+
+jointData * mayaSceneParser::insertJointData(const MFnIkJoint& joint, bool isRoot){
 	jDataPtr jData(new jointData());
 	jData->_index			= _scene->_jointNum++;
 	jData->_parentPos		= -1;
 
 	std::string jointName	= joint.fullPathName().asChar();
+	jData->_name			= jointName;
 	jData->_hashCode		= getHashCode(jointName);
+	jData->_localTransform	= getLocalTransform(joint, isRoot);
+
+	jointData * result = jData.get();
+	_scene->_joints.push_back(std::move(jData));
+	return result;
+}
+
 
-	MMatrix matrix			= joint.transformation().asMatrix().transpose();
+Transform mayaSceneParser::getLocalTransform(const MFnIkJoint& joint, bool isRoot){
+	MMatrix matrix			= joint.transformation().asMatrix();
+
+	// a root joint also carries the transforms of the non-joint nodes above it
+	if (isRoot){
+		MDagPath jointPath;
+		if (joint.getPath(jointPath) == MStatus::kSuccess)
+			matrix *= jointPath.exclusiveMatrix();
+	}
+
+	matrix = matrix.transpose();
 	float fMatrix[4][4];
 	matrix.get(fMatrix);
-	jData->_transform = Transform(fMatrix);
-
-	_scene->_joints.push_back(std::move(jData));
-	return jData;
-}
\ No newline at end of file
+	return Transform(fMatrix);
+}
@@ -4,14 +4,20 @@
 #include <boost/functional/hash.hpp>
 #include "common.h"
 #include "sceneData.h"
+#include "sceneSource.h"
 
-class mayaSceneParser {
+// scene source reading the selected skinCluster nodes of the maya scene
+class mayaSceneParser : public sceneSource {
 public:
 	typedef std::unique_ptr<jointData> jDataPtr;
 	typedef std::unique_ptr<meshData>  meshPtr;
 
 	mayaSceneParser(){}
 
+	virtual bool loadScene(sceneData * scene);
+	virtual bool loadPose(sceneData * scene);
+	virtual bool writeMeshes(const sceneData * scene);
+
 	static void setScenePtr(sceneData* scene){ _scene = scene;}
 
 	static MStatus insertJoint(const MFnIkJoint& fnJoint);
@@ -24,10 +30,12 @@ private:
 		return string_hash(jointName);
 	}
 
-	static jDataPtr insertJointData(const MFnIkJoint& joint);
+	static jointData * insertJointData(const MFnIkJoint& joint, bool isRoot);
+
+	static Transform getLocalTransform(const MFnIkJoint& joint, bool isRoot);
 
 	static sceneData* _scene;
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,17 @@
 #define MESHDATA_H
 
 #include <vector>
+#include <memory>
+#include <string>
+
+#include "sparseWeights.h"
+
+// geometric skinning the projection of a mesh starts from
+enum skinMethod{
+	SKIN_LINEAR = 0,			// linear blend of the joint matrices
+	SKIN_DUAL_QUATERNION		// blend of the joint dual quaternions, keeps the volume around twisting joints
+};
+
 
 class segData{
 public:
@@ -18,14 +29,23 @@ public:
 	typedef std::unique_ptr<int[]> intVecPtr;
 	typedef std::unique_ptr<float[]> floatVecPtr;
 
-	meshData():/*_segListPtr(nullptr), */ _neighbourPtr(nullptr), _weightsPtr(nullptr), _posPtr(nullptr) {}
+	meshData():/*_segListPtr(nullptr), */ _neighbourPtr(nullptr), _faceSizePtr(nullptr), _posPtr(nullptr),
+		_jointIdxPtr(nullptr), _numPoints(0), _numFaces(0), _numFaceVerts(0), _numInfluences(0), _skinMethod(SKIN_LINEAR) {}
 
 	//segListPtr		_segListPtr;
-	intVecPtr		_neighbourPtr;
-	floatVecPtr		_weightsPtr;
-	floatVecPtr		_posPtr;
-
+	intVecPtr		_neighbourPtr;	// flat face-vertex list, faces are stored one after another
+	intVecPtr		_faceSizePtr;	// vertex count of each face in _neighbourPtr
+	floatVecPtr		_posPtr;		// rest pose positions ( x, y, z )
+	intVecPtr		_jointIdxPtr;	// influence index to the scene joint index
+	sparseWeights	_weights;		// top influences of each point
+
+	std::string		_name;
+	unsigned int	_numPoints;
+	unsigned int	_numFaces;
+	unsigned int	_numFaceVerts;
+	unsigned int	_numInfluences;
+	skinMethod		_skinMethod;
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,189 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PARALLELPRIMITIVES_H
+#define PARALLELPRIMITIVES_H
+
+#include <algorithm>
+#include <vector>
+
+#include "computeController.h"
+
+// scans and radix sort spread over the controller' workers, the grouping steps of the prep are built on them.
+// the work is cut in fixed size blocks, so the results do not depend on the number of workers
+
+const std::size_t scanBlockSize = 1 << 14;
+const std::size_t sortBlockSize = 1 << 16;
+
+
+// scan of the blocks: sum of each block, serial scan of the sums, then each block scanned from its offset
+template<class T, class computeController>
+T blockScan(const T * in, T * out, std::size_t count, computeController & controller, T init, bool inclusive){
+	std::size_t numBlocks = (count + scanBlockSize - 1) / scanBlockSize;
+	std::vector<T> blockSums(numBlocks, T());
+	controller.parallelFor(numBlocks, [&](std::size_t b){
+		std::size_t end = std::min(count, (b + 1) * scanBlockSize);
+		T sum = T();
+		for (std::size_t i = b * scanBlockSize; i < end; i++)
+			sum += in[i];
+		blockSums[b] = sum;
+	});
+
+	T total = init;
+	for (std::size_t b = 0; b < numBlocks; b++){
+		T sum = blockSums[b];
+		blockSums[b] = total;
+		total += sum;
+	}
+
+	controller.parallelFor(numBlocks, [&](std::size_t b){
+		std::size_t end = std::min(count, (b + 1) * scanBlockSize);
+		T run = blockSums[b];
+		for (std::size_t i = b * scanBlockSize; i < end; i++){
+			T v = in[i];
+			if (inclusive)
+				run += v;
+			out[i] = run;
+			if (!inclusive)
+				run += v;
+		}
+	});
+	return total;
+}
+
+
+// out[i] = init + in[0] + ... + in[i - 1], returns the total. out may be in
+template<class T, class computeController>
+T exclusiveScan(const T * in, T * out, std::size_t count, computeController & controller, T init = T()){
+	return blockScan(in, out, count, controller, init, false);
+}
+
+
+// out[i] = init + in[0] + ... + in[i], returns the total. out may be in
+template<class T, class computeController>
+T inclusiveScan(const T * in, T * out, std::size_t count, computeController & controller, T init = T()){
+	return blockScan(in, out, count, controller, init, true);
+}
+
+
+// stable lsd radix sort of count keys, 8 bits a pass over the low keyBits bits, values ( may be null ) follow their keys.
+// each pass histograms the blocks in parallel, scans the ( digit, block ) counts digit major, and scatters the blocks in parallel
+template<class computeController>
+void radixSort(unsigned int * keys, unsigned int * values, std::size_t count, computeController & controller, unsigned int keyBits = 32){
+	const unsigned int radixBits = 8, numBuckets = 1 << radixBits;
+	if (count < 2)
+		return;
+
+	std::size_t numBlocks = (count + sortBlockSize - 1) / sortBlockSize;
+	std::vector<unsigned int> keyBuffer(count), valueBuffer(values ? count : 0);
+	std::vector<std::size_t> offsets(numBuckets * numBlocks);
+	unsigned int * srcKeys = keys, * dstKeys = &keyBuffer[0];
+	unsigned int * srcValues = values, * dstValues = values ? &valueBuffer[0] : nullptr;
+
+	for (unsigned int shift = 0; shift < keyBits && shift < 32; shift += radixBits){
+		controller.parallelFor(numBlocks, [&](std::size_t b){
+			std::size_t counts[numBuckets] = {};
+			std::size_t end = std::min(count, (b + 1) * sortBlockSize);
+			for (std::size_t i = b * sortBlockSize; i < end; i++)
+				counts[(srcKeys[i] >> shift) & (numBuckets - 1)]++;
+			for (unsigned int d = 0; d < numBuckets; d++)
+				offsets[d * numBlocks + b] = counts[d];
+		});
+
+		// every key has the same digit, the pass would not move anything
+		bool skip = false;
+		for (unsigned int d = 0; d < numBuckets && !skip; d++){
+			std::size_t total = 0;
+			for (std::size_t b = 0; b < numBlocks; b++)
+				total += offsets[d * numBlocks + b];
+			skip = (total == count);
+		}
+		if (skip)
+			continue;
+
+		exclusiveScan(&offsets[0], &offsets[0], offsets.size(), controller);
+
+		controller.parallelFor(numBlocks, [&](std::size_t b){
+			std::size_t pos[numBuckets];
+			for (unsigned int d = 0; d < numBuckets; d++)
+				pos[d] = offsets[d * numBlocks + b];
+			std::size_t end = std::min(count, (b + 1) * sortBlockSize);
+			for (std::size_t i = b * sortBlockSize; i < end; i++){
+				std::size_t dst = pos[(srcKeys[i] >> shift) & (numBuckets - 1)]++;
+				dstKeys[dst] = srcKeys[i];
+				if (srcValues)
+					dstValues[dst] = srcValues[i];
+			}
+		});
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+	}
+
+	// an odd number of passes leaves the result in the buffers
+	if (srcKeys != keys){
+		controller.parallelFor(numBlocks, [&](std::size_t b){
+			std::size_t start = b * sortBlockSize, end = std::min(count, start + sortBlockSize);
+			std::copy(srcKeys + start, srcKeys + end, keys + start);
+			if (values)
+				std::copy(srcValues + start, srcValues + end, values + start);
+		});
+	}
+}
+
+
+// number of bits of the keys in [0, numKeys), to limit the passes of radixSort
+inline unsigned int keyBitsOf(std::size_t numKeys){
+	unsigned int bits = 0;
+	while (bits < 32 && numKeys > 1 && ((numKeys - 1) >> bits) != 0)
+		bits++;
+	return bits;
+}
+
+
+// group count pairs ( keys[i], values[i] ) by key into a compressed row table: the values of the key k are
+// out[offsets[k], offsets[k + 1]), increasing and without repeats, offsets has numKeys + 1 entries.
+// a pair with the same key and value is dropped when dropLoops. keys and values are sorted in place
+template<class computeController, class Array>
+void buildCsr(unsigned int * keys, unsigned int * values, std::size_t count, std::size_t numKeys, std::size_t numValues, bool dropLoops,
+	Array & offsets, Array & out, computeController & controller){
+	offsets.assign(numKeys + 1, 0);
+	out.clear();
+	if (count == 0)
+		return;
+
+	// by value then, stable, by key, so the pairs are sorted by ( key, value )
+	radixSort(values, keys, count, controller, keyBitsOf(numValues));
+	radixSort(keys, values, count, controller, keyBitsOf(numKeys));
+
+	// a pair is kept when it differs from the one before, its slot is the scan of the kept flags
+	std::size_t numBlocks = (count + scanBlockSize - 1) / scanBlockSize;
+	std::vector<unsigned int> slots(count);
+	controller.parallelFor(numBlocks, [&](std::size_t b){
+		std::size_t end = std::min(count, (b + 1) * scanBlockSize);
+		for (std::size_t i = b * scanBlockSize; i < end; i++){
+			bool repeat = i > 0 && keys[i] == keys[i - 1] && values[i] == values[i - 1];
+			slots[i] = !repeat && !(dropLoops && keys[i] == values[i]);
+		}
+	});
+	unsigned int total = exclusiveScan(&slots[0], &slots[0], count, controller);
+	out.resize(total);
+
+	// the first pair of a key sets the offsets of the keys since the key before, which have no pairs
+	controller.parallelFor(numBlocks, [&](std::size_t b){
+		std::size_t end = std::min(count, (b + 1) * scanBlockSize);
+		for (std::size_t i = b * scanBlockSize; i < end; i++){
+			bool kept = (i + 1 < count) ? slots[i + 1] != slots[i] : slots[i] != total;
+			if (kept)
+				out[slots[i]] = values[i];
+			if (i == 0 || keys[i] != keys[i - 1]){
+				for (std::size_t k = (i == 0) ? 0 : keys[i - 1] + 1; k <= keys[i]; k++)
+					offsets[k] = slots[i];
+			}
+		}
+	});
+	for (std::size_t k = keys[count - 1] + 1; k <= numKeys; k++)
+		offsets[k] = total;
+}
+
+#endif
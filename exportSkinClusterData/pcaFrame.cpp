@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <math.h>
+
+#include "pcaFrame.h"
+#include "simd.h"
+
+const std::size_t pointMoments::blockSize;
+
+// sums of the shifted points ( x, y, z, xx, xy, xz, yy, yz, zz ) over [start, count), added to sums
+static void momentsScalar(const float * points, std::size_t start, std::size_t count, unsigned int stride,
+	const double shift[3], double sums[9]){
+	for (std::size_t i = start; i < count; i++){
+		const float * p = &points[i * stride];
+		double x = p[0] - shift[0], y = p[1] - shift[1], z = p[2] - shift[2];
+		sums[0] += x;		sums[1] += y;		sums[2] += z;
+		sums[3] += x * x;	sums[4] += x * y;	sums[5] += x * z;
+		sums[6] += y * y;	sums[7] += y * z;	sums[8] += z * z;
+	}
+}
+
+// the kernels return the number of points they summed, the scalar loop does the rest
+typedef std::size_t (*momentsFn)(const float * points, std::size_t count, unsigned int stride, const double shift[3], double sums[9]);
+
+
+// x, y or z of 4 points, the stride floats apart
+SIMD_TARGET_SSE4 static inline __m128 gather4(const float * p, unsigned int stride){
+	return _mm_set_ps(p[3 * stride], p[2 * stride], p[stride], p[0]);
+}
+
+
+SIMD_TARGET_SSE4 static std::size_t momentsSse(const float * points, std::size_t count, unsigned int stride,
+	const double shift[3], double sums[9]){
+	std::size_t n = count & ~(std::size_t)3;
+	__m128d acc[9];
+	for (unsigned int s = 0; s < 9; s++)
+		acc[s] = _mm_setzero_pd();
+	const __m128d sx = _mm_set1_pd(shift[0]), sy = _mm_set1_pd(shift[1]), sz = _mm_set1_pd(shift[2]);
+	for (std::size_t i = 0; i < n; i += 4){
+		const float * p = &points[i * stride];
+		__m128 x4 = gather4(p, stride), y4 = gather4(p + 1, stride), z4 = gather4(p + 2, stride);
+		for (unsigned int h = 0; h < 2; h++){
+			__m128d x = _mm_sub_pd(_mm_cvtps_pd(x4), sx);
+			__m128d y = _mm_sub_pd(_mm_cvtps_pd(y4), sy);
+			__m128d z = _mm_sub_pd(_mm_cvtps_pd(z4), sz);
+			acc[0] = _mm_add_pd(acc[0], x);
+			acc[1] = _mm_add_pd(acc[1], y);
+			acc[2] = _mm_add_pd(acc[2], z);
+			acc[3] = _mm_add_pd(acc[3], _mm_mul_pd(x, x));
+			acc[4] = _mm_add_pd(acc[4], _mm_mul_pd(x, y));
+			acc[5] = _mm_add_pd(acc[5], _mm_mul_pd(x, z));
+			acc[6] = _mm_add_pd(acc[6], _mm_mul_pd(y, y));
+			acc[7] = _mm_add_pd(acc[7], _mm_mul_pd(y, z));
+			acc[8] = _mm_add_pd(acc[8], _mm_mul_pd(z, z));
+			x4 = _mm_movehl_ps(x4, x4);
+			y4 = _mm_movehl_ps(y4, y4);
+			z4 = _mm_movehl_ps(z4, z4);
+		}
+	}
+	for (unsigned int s = 0; s < 9; s++){
+		double lanes[2];
+		_mm_storeu_pd(lanes, acc[s]);
+		sums[s] += lanes[0] + lanes[1];
+	}
+	return n;
+}
+
+
+SIMD_TARGET_AVX2 static std::size_t momentsAvx2(const float * points, std::size_t count, unsigned int stride,
+	const double shift[3], double sums[9]){
+	std::size_t n = count & ~(std::size_t)3;
+	__m256d acc[9];
+	for (unsigned int s = 0; s < 9; s++)
+		acc[s] = _mm256_setzero_pd();
+	const __m256d sx = _mm256_set1_pd(shift[0]), sy = _mm256_set1_pd(shift[1]), sz = _mm256_set1_pd(shift[2]);
+	for (std::size_t i = 0; i < n; i += 4){
+		const float * p = &points[i * stride];
+		__m256d x = _mm256_sub_pd(_mm256_cvtps_pd(_mm_set_ps(p[3 * stride], p[2 * stride], p[stride], p[0])), sx);
+		__m256d y = _mm256_sub_pd(_mm256_cvtps_pd(_mm_set_ps(p[3 * stride + 1], p[2 * stride + 1], p[stride + 1], p[1])), sy);
+		__m256d z = _mm256_sub_pd(_mm256_cvtps_pd(_mm_set_ps(p[3 * stride + 2], p[2 * stride + 2], p[stride + 2], p[2])), sz);
+		acc[0] = _mm256_add_pd(acc[0], x);
+		acc[1] = _mm256_add_pd(acc[1], y);
+		acc[2] = _mm256_add_pd(acc[2], z);
+		acc[3] = _mm256_fmadd_pd(x, x, acc[3]);
+		acc[4] = _mm256_fmadd_pd(x, y, acc[4]);
+		acc[5] = _mm256_fmadd_pd(x, z, acc[5]);
+		acc[6] = _mm256_fmadd_pd(y, y, acc[6]);
+		acc[7] = _mm256_fmadd_pd(y, z, acc[7]);
+		acc[8] = _mm256_fmadd_pd(z, z, acc[8]);
+	}
+	for (unsigned int s = 0; s < 9; s++){
+		double lanes[4];
+		_mm256_storeu_pd(lanes, acc[s]);
+		sums[s] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+	return n;
+}
+
+
+// avx512 runs the avx2 kernel, the strided loads and not the arithmetic bound it
+static momentsFn selectMoments(){
+	switch (getSimdLevel()){
+	case SIMD_AVX512:
+	case SIMD_AVX2:		return momentsAvx2;
+	case SIMD_SSE4:		return momentsSse;
+	default:			return nullptr;
+	}
+}
+
+
+void pointMoments::add(const float * points, std::size_t count, unsigned int stride){
+	const momentsFn fn = selectMoments();
+	for (std::size_t start = 0; start < count; start += blockSize){
+		const float * block = &points[start * stride];
+		std::size_t n = std::min(blockSize, count - start);
+		double shift[3] = { block[0], block[1], block[2] };
+		double sums[9] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		std::size_t done = fn ? fn(block, n, stride, shift, sums) : 0;
+		momentsScalar(block, done, n, stride, shift, sums);
+
+		// the block' own moments, then merged in
+		pointMoments blockMoments;
+		blockMoments.count = (double)n;
+		double d[3] = { sums[0] / n, sums[1] / n, sums[2] / n };
+		for (unsigned int a = 0; a < 3; a++)
+			blockMoments.mean[a] = shift[a] + d[a];
+		blockMoments.scatter[0] = sums[3] - n * d[0] * d[0];
+		blockMoments.scatter[1] = sums[4] - n * d[0] * d[1];
+		blockMoments.scatter[2] = sums[5] - n * d[0] * d[2];
+		blockMoments.scatter[3] = sums[6] - n * d[1] * d[1];
+		blockMoments.scatter[4] = sums[7] - n * d[1] * d[2];
+		blockMoments.scatter[5] = sums[8] - n * d[2] * d[2];
+		merge(blockMoments);
+	}
+}
+
+
+void pointMoments::merge(const pointMoments & other){
+	if (other.count == 0.0)
+		return;
+	if (count == 0.0){
+		*this = other;
+		return;
+	}
+
+	// chan et al., the scatter gains the outer product of the difference of the means
+	double total = count + other.count;
+	double d[3] = { other.mean[0] - mean[0], other.mean[1] - mean[1], other.mean[2] - mean[2] };
+	double w = count * other.count / total;
+	scatter[0] += other.scatter[0] + w * d[0] * d[0];
+	scatter[1] += other.scatter[1] + w * d[0] * d[1];
+	scatter[2] += other.scatter[2] + w * d[0] * d[2];
+	scatter[3] += other.scatter[3] + w * d[1] * d[1];
+	scatter[4] += other.scatter[4] + w * d[1] * d[2];
+	scatter[5] += other.scatter[5] + w * d[2] * d[2];
+	for (unsigned int a = 0; a < 3; a++)
+		mean[a] += d[a] * other.count / total;
+	count = total;
+}
+
+
+void pointMoments::covariance(double cov[6]) const{
+	for (unsigned int e = 0; e < 6; e++)
+		cov[e] = count > 0.0 ? scatter[e] / count : 0.0;
+}
+
+
+static inline void cross3(const double a[3], const double b[3], double c[3]){
+	c[0] = a[1] * b[2] - a[2] * b[1];
+	c[1] = a[2] * b[0] - a[0] * b[2];
+	c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double dot3(const double a[3], const double b[3]){
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// u and v complete the unit w to a right handed orthonormal frame
+static void orthogonalComplement(const double w[3], double u[3], double v[3]){
+	if (fabs(w[0]) > fabs(w[1])){
+		double invLen = 1.0 / sqrt(w[0] * w[0] + w[2] * w[2]);
+		u[0] = -w[2] * invLen; u[1] = 0.0; u[2] = w[0] * invLen;
+	}
+	else {
+		double invLen = 1.0 / sqrt(w[1] * w[1] + w[2] * w[2]);
+		u[0] = 0.0; u[1] = w[2] * invLen; u[2] = -w[1] * invLen;
+	}
+	cross3(w, u, v);
+}
+
+// unit eigen vector of the simple eigen value e: the rows of A - e I span a plane, their largest cross product is normal to it
+static void simpleEigenVector(const double a[6], double e, double v[3]){
+	double r0[3] = { a[0] - e, a[1], a[2] };
+	double r1[3] = { a[1], a[3] - e, a[4] };
+	double r2[3] = { a[2], a[4], a[5] - e };
+	double c[3][3];
+	cross3(r0, r1, c[0]);
+	cross3(r0, r2, c[1]);
+	cross3(r1, r2, c[2]);
+	double len[3] = { dot3(c[0], c[0]), dot3(c[1], c[1]), dot3(c[2], c[2]) };
+	unsigned int best = (len[0] >= len[1] && len[0] >= len[2]) ? 0 : (len[1] >= len[2] ? 1 : 2);
+	if (len[best] > 0.0){
+		double invLen = 1.0 / sqrt(len[best]);
+		for (unsigned int k = 0; k < 3; k++)
+			v[k] = c[best][k] * invLen;
+	}
+	else {
+		v[0] = 1.0; v[1] = 0.0; v[2] = 0.0;
+	}
+}
+
+// unit eigen vector of e orthogonal to the eigen vector w, from the 2x2 restriction of A - e I to the complement of w
+static void complementEigenVector(const double a[6], const double w[3], double e, double v[3]){
+	double u0[3], u1[3];
+	orthogonalComplement(w, u0, u1);
+	double au0[3] = { a[0] * u0[0] + a[1] * u0[1] + a[2] * u0[2], a[1] * u0[0] + a[3] * u0[1] + a[4] * u0[2], a[2] * u0[0] + a[4] * u0[1] + a[5] * u0[2] };
+	double au1[3] = { a[0] * u1[0] + a[1] * u1[1] + a[2] * u1[2], a[1] * u1[0] + a[3] * u1[1] + a[4] * u1[2], a[2] * u1[0] + a[4] * u1[1] + a[5] * u1[2] };
+	double m00 = dot3(u0, au0) - e, m01 = dot3(u0, au1), m11 = dot3(u1, au1) - e;
+
+	// the null direction ( s, t ) of the 2x2 matrix is normal to its row of the larger entry, any is when both are 0
+	double s = 1.0, t = 0.0;
+	if (std::max(fabs(m00), fabs(m01)) >= std::max(fabs(m11), fabs(m01))){
+		if (std::max(fabs(m00), fabs(m01)) > 0.0){ s = -m01; t = m00; }
+	}
+	else { s = m11; t = -m01; }
+	double invLen = 1.0 / sqrt(s * s + t * t);
+	for (unsigned int k = 0; k < 3; k++)
+		v[k] = (s * u0[k] + t * u1[k]) * invLen;
+}
+
+
+void symmetricEigen3(const double in[6], double values[3], double vectors[3][3]){
+	// scaled by the largest entry, so the cubic does not over or underflow
+	double scale = 0.0;
+	for (unsigned int e = 0; e < 6; e++)
+		scale = std::max(scale, fabs(in[e]));
+	double a[6];
+	for (unsigned int e = 0; e < 6; e++)
+		a[e] = scale > 0.0 ? in[e] / scale : 0.0;
+
+	double offDiag = a[1] * a[1] + a[2] * a[2] + a[4] * a[4];
+	if (offDiag == 0.0){
+		// diagonal, the axes sorted by their entry
+		unsigned int order[3] = { 0, 1, 2 };
+		const double diag[3] = { a[0], a[3], a[5] };
+		std::sort(order, order + 3, [&](unsigned int i, unsigned int j){ return diag[i] > diag[j]; });
+		for (unsigned int i = 0; i < 3; i++){
+			values[i] = diag[order[i]] * scale;
+			for (unsigned int k = 0; k < 3; k++)
+				vectors[i][k] = (k == order[i]) ? 1.0 : 0.0;
+		}
+		cross3(vectors[0], vectors[1], vectors[2]);
+		return;
+	}
+
+	// roots of the characteristic cubic, a = q I + p B with the eigen values of B 2 cos( phi + 2 k pi / 3 )
+	double q = (a[0] + a[3] + a[5]) / 3.0;
+	double b00 = a[0] - q, b11 = a[3] - q, b22 = a[5] - q;
+	double p = sqrt((b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * offDiag) / 6.0);
+	double halfDet = (b00 * (b11 * b22 - a[4] * a[4]) - a[1] * (a[1] * b22 - a[4] * a[2]) + a[2] * (a[1] * a[4] - b11 * a[2]))
+		/ (2.0 * p * p * p);
+	halfDet = std::min(1.0, std::max(-1.0, halfDet));
+	double phi = acos(halfDet) / 3.0;
+	const double twoThirdsPi = 2.0943951023931954923;
+	double e0 = q + 2.0 * p * cos(phi);
+	double e2 = q + 2.0 * p * cos(phi + twoThirdsPi);
+	double e1 = 3.0 * q - e0 - e2;
+
+	// the root the farthest from the other two is simple, its vector is solved first
+	if (halfDet >= 0.0){
+		simpleEigenVector(a, e0, vectors[0]);
+		complementEigenVector(a, vectors[0], e1, vectors[1]);
+		cross3(vectors[0], vectors[1], vectors[2]);
+	}
+	else {
+		simpleEigenVector(a, e2, vectors[2]);
+		complementEigenVector(a, vectors[2], e1, vectors[1]);
+		cross3(vectors[1], vectors[2], vectors[0]);
+	}
+	values[0] = e0 * scale;
+	values[1] = e1 * scale;
+	values[2] = e2 * scale;
+}
+
+
+void projectedBounds(const float * points, std::size_t count, unsigned int stride, const double center[3], const double axes[3][3],
+	double lo[3], double hi[3]){
+	for (unsigned int i = 0; i < 3; i++){
+		lo[i] = count ? 1e300 : 0.0;
+		hi[i] = count ? -1e300 : 0.0;
+	}
+	for (std::size_t n = 0; n < count; n++){
+		const float * p = &points[n * stride];
+		double d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+		for (unsigned int i = 0; i < 3; i++){
+			double v = dot3(d, axes[i]);
+			lo[i] = std::min(lo[i], v);
+			hi[i] = std::max(hi[i], v);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PCAFRAME_H
+#define PCAFRAME_H
+
+#include <cstddef>
+
+// count, mean and scatter ( sum of the centered outer products ) of a point set, accumulated in one pass.
+// two accumulators of disjoint point sets merge into the one of their union, so the points can be split over threads
+class pointMoments{
+public:
+	pointMoments():count(0.0){
+		for (unsigned int a = 0; a < 3; a++)
+			mean[a] = 0.0;
+		for (unsigned int e = 0; e < 6; e++)
+			scatter[e] = 0.0;
+	}
+
+	// count points, the stride floats apart ( x, y, z first )
+	void add(const float * points, std::size_t count, unsigned int stride = 3);
+	// the same with the blocks of points reduced on the controller, see parallelReduce
+	template<class computeController>
+	void add(const float * points, std::size_t count, unsigned int stride, computeController & controller);
+	void merge(const pointMoments & other);
+
+	// covariance ( xx, xy, xz, yy, yz, zz ) of the points added so far
+	void covariance(double cov[6]) const;
+
+	double count;
+	double mean[3];
+	double scatter[6];	// xx, xy, xz, yy, yz, zz
+
+	// the sums of a block are taken around its first point, so they stay small next to the coordinates
+	static const std::size_t blockSize = 4096;
+};
+
+
+template<class computeController>
+void pointMoments::add(const float * points, std::size_t count, unsigned int stride, computeController & controller){
+	std::size_t numBlocks = (count + blockSize - 1) / blockSize;
+	merge(controller.parallelReduce(numBlocks, pointMoments(), [&](std::size_t b){
+		pointMoments block;
+		std::size_t start = b * blockSize;
+		block.add(&points[start * stride], count - start < blockSize ? count - start : blockSize, stride);
+		return block;
+	}, [](pointMoments a, const pointMoments & b){
+		a.merge(b);
+		return a;
+	}));
+}
+
+
+// eigen decomposition of the symmetric 3x3 matrix ( xx, xy, xz, yy, yz, zz ) in closed form,
+// values in decreasing order, vectors[i] the unit eigen vector of values[i], a right handed frame
+void symmetricEigen3(const double a[6], double values[3], double vectors[3][3]);
+
+// min and max of the points ( stride floats apart ) projected on the 3 unit axes, relative to center
+void projectedBounds(const float * points, std::size_t count, unsigned int stride, const double center[3], const double axes[3][3],
+	double lo[3], double hi[3]);
+
+#endif
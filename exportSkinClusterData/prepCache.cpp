@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
+
+#include "prepCache.h"
+#include "sceneData.h"
+#include "surfaceSampler.h"
+#include "logger.h"
+
+// the payload layout is the one of the tables of this build, the version changes with it
+static const char entryMagic[4] = { 'I', 'S', 'K', 'C' };
+static const uint32_t entryVersion = 1;
+static const std::size_t headerSize = 4 + 4 + 8 + 8 + 8;	// magic, version, key, payload size, payload checksum
+
+
+// 64 bits hash of a byte stream, 8 bytes at a time through the splitmix64 finalizer.
+// the words run over the calls to add, so the hash only depends on the bytes and not on how they are cut
+class contentHash{
+public:
+	contentHash():_h(0x6A09E667F3BCC908ull), _pending(0), _numPending(0), _size(0){}
+
+	void add(const void * data, std::size_t bytes){
+		const unsigned char * p = (const unsigned char *)data;
+		_size += bytes;
+		for (; bytes > 0 && _numPending > 0; bytes--)
+			push(*p++);
+		for (; bytes >= 8; bytes -= 8, p += 8){
+			uint64_t w;
+			memcpy(&w, p, 8);
+			_h = counterRng::mix(_h ^ w);
+		}
+		for (; bytes > 0; bytes--)
+			push(*p++);
+	}
+
+	template<class T>
+	void value(const T & v){ add(&v, sizeof(T)); }
+
+	template<class T, class A>
+	void vector(const std::vector<T, A> & v){
+		value((uint64_t)v.size());
+		if (!v.empty())
+			add(&v[0], v.size() * sizeof(T));
+	}
+
+	inline uint64_t digest() const { return counterRng::mix(counterRng::mix(_h ^ _pending) ^ _size); }
+
+private:
+	inline void push(unsigned char byte){
+		_pending |= (uint64_t)byte << (8 * _numPending);
+		if (++_numPending == 8){
+			_h = counterRng::mix(_h ^ _pending);
+			_pending = 0;
+			_numPending = 0;
+		}
+	}
+
+	uint64_t		_h;
+	uint64_t		_pending;		// bytes of the word not complete yet
+	unsigned int	_numPending;
+	uint64_t		_size;
+};
+
+
+// the hierarchy, the bind pose, and the rest points, topology and skinning of each mesh, with its weights or not
+static void hashScene(contentHash & hash, bool withWeights){
+	hash.value(sceneData::_jointNum);
+	std::list<sceneData::jointPtr>::const_iterator jIter = sceneData::_joints.begin();
+	for (; jIter != sceneData::_joints.end(); jIter++){
+		hash.value((*jIter)->_index);
+		hash.value((*jIter)->_parentPos);
+		hash.value((*jIter)->_bindTransform.GetMatrix().m);
+	}
+
+	std::list<sceneData::meshPtr>::const_iterator mIter = sceneData::_meshes.begin();
+	for (; mIter != sceneData::_meshes.end(); mIter++){
+		const meshData & mesh = **mIter;
+		hash.value(mesh._numPoints);
+		hash.value(mesh._numFaces);
+		hash.value(mesh._numFaceVerts);
+		hash.value(mesh._numInfluences);
+		hash.value((int)mesh._skinMethod);
+		hash.add(mesh._posPtr.get(), mesh._numPoints * 3 * sizeof(float));
+		hash.add(mesh._faceSizePtr.get(), mesh._numFaces * sizeof(int));
+		hash.add(mesh._neighbourPtr.get(), mesh._numFaceVerts * sizeof(int));
+		hash.add(mesh._jointIdxPtr.get(), mesh._numInfluences * sizeof(int));
+		if (!withWeights)
+			continue;
+		hash.value(mesh._weights._numSlots);
+		hash.value(mesh._weights._quantized);
+		hash.vector(mesh._weights._influences);
+		hash.vector(mesh._weights._weights);
+		hash.vector(mesh._weights._qWeights);
+	}
+}
+
+
+uint64_t prepCache::sceneKey(){
+	contentHash hash;
+	hash.value(entryVersion);
+
+	// the prep parameters
+	const prepParams & params = sceneData::_params;
+	hash.value(params.gridResolution);
+	hash.value((int)params.order);
+	hash.value(params.maxInfluences);
+	hash.value(params.quantizeWeights);
+	hash.value(params.samplesPerJoint);
+	hash.value(params.sampleSeed);
+	hash.value(params.centersPerJoint);
+	hash.value(params.centerRadius);
+	hash.value(params.fieldRadius);
+
+	hashScene(hash, true);
+	return hash.digest();
+}
+
+
+uint64_t prepCache::contentKey(){
+	contentHash hash;
+	hashScene(hash, false);
+	return hash.digest();
+}
+
+
+// payload written to a file, hashed on the way for the checksum of the header
+class entryWriter{
+public:
+	static const bool reading = false;
+
+	entryWriter(FILE * file):_file(file), _size(0), _ok(true){}
+
+	void bytes(const void * data, std::size_t size){
+		if (size == 0)
+			return;
+		_ok = _ok && fwrite(data, 1, size, _file) == size;
+		_hash.add(data, size);
+		_size += size;
+	}
+
+	template<class T>
+	void value(const T & v){ bytes(&v, sizeof(T)); }
+
+	template<class Array>
+	void vector(const Array & v){
+		value((uint64_t)v.size());
+		if (!v.empty())
+			bytes(&v[0], v.size() * sizeof(v[0]));
+	}
+
+	inline uint64_t size() const { return _size; }
+	inline uint64_t checksum() const { return _hash.digest(); }
+	inline bool ok() const { return _ok; }
+
+private:
+	FILE *		_file;
+	contentHash	_hash;
+	uint64_t	_size;
+	bool		_ok;
+};
+
+
+// payload read back from memory, every read is bounds checked
+class entryReader{
+public:
+	static const bool reading = true;
+
+	entryReader(const unsigned char * data, std::size_t size):_pos(data), _end(data + size), _ok(true){}
+
+	void bytes(void * data, std::size_t size){
+		if (!_ok || (std::size_t)(_end - _pos) < size){
+			_ok = false;
+			return;
+		}
+		if (size)
+			memcpy(data, _pos, size);
+		_pos += size;
+	}
+
+	template<class T>
+	void value(T & v){ bytes(&v, sizeof(T)); }
+
+	template<class Array>
+	void vector(Array & v){
+		typedef typename Array::value_type T;
+		uint64_t count = 0;
+		value(count);
+		if (!_ok || count > (uint64_t)(_end - _pos) / sizeof(T)){
+			_ok = false;
+			return;
+		}
+		v.resize((std::size_t)count);
+		if (count)
+			bytes(&v[0], (std::size_t)count * sizeof(T));
+	}
+
+	inline bool ok() const { return _ok; }
+	inline bool done() const { return _ok && _pos == _end; }
+
+private:
+	const unsigned char *	_pos;
+	const unsigned char *	_end;
+	bool					_ok;
+};
+
+
+// the same function writes and reads a table, so the two can not drift apart
+template<class Archive>
+static void transfer(Archive & ar, Vector & v){
+	ar.value(v.x);
+	ar.value(v.y);
+	ar.value(v.z);
+}
+
+template<class Archive>
+static void transfer(Archive & ar, meshTable & mTable){
+	ar.value(mTable._numElems);
+	ar.vector(mTable.pointPosTable);
+	ar.vector(mTable.pointIdxTable);
+	ar.vector(mTable.offsetTable);
+	ar.vector(mTable.adjPtIdxTable);
+	ar.vector(mTable.relaxWeightTable);
+	ar.vector(mTable.faceOffsetTable);
+	ar.vector(mTable.adjFaceIdxTable);
+	ar.vector(mTable.ptJointIdxTable);
+	ar.vector(mTable.jointOffsetTable);
+
+	skinTable & skin = mTable.skin;
+	ar.value(skin._numPoints);
+	ar.value(skin._numPadded);
+	ar.value(skin._numSlots);
+	ar.value(skin._method);
+	ar.vector(skin._restX);
+	ar.vector(skin._restY);
+	ar.vector(skin._restZ);
+	ar.vector(skin._joints);
+	ar.vector(skin._weights);
+}
+
+template<class Archive>
+static void transfer(Archive & ar, jointTable & jTable){
+	ar.value(jTable.jointIdx);
+	ar.value(jTable.matrix.m);
+	ar.value(jTable.coord._center.x);
+	ar.value(jTable.coord._center.y);
+	ar.value(jTable.coord._center.z);
+	transfer(ar, jTable.coord._axisX);
+	transfer(ar, jTable.coord._axisY);
+	transfer(ar, jTable.coord._axisZ);
+	transfer(ar, jTable.coord.bbox.first);
+	transfer(ar, jTable.coord.bbox.second);
+	ar.vector(jTable.samplePosTable);
+	ar.vector(jTable.sampleNormalTable);
+	ar.value(jTable.sampleArea);
+	ar.vector(jTable.rbfPosParams);
+	ar.vector(jTable.rbfNormalParams);
+
+	// the SoA field is rebuilt from the params once they are checked, see prepCache::load
+	ar.value(jTable.field._radius);
+
+	unsigned char hasGrid = jTable.grid ? 1 : 0;
+	ar.value(hasGrid);
+	if (!hasGrid)
+		return;
+	if (Archive::reading)
+		jTable.grid = std::make_shared<fieldGrid>();
+	ar.value(jTable.grid->_toGrid);
+	ar.value(jTable.grid->_res);
+	ar.vector(jTable.grid->_nodes);
+}
+
+
+std::string prepCache::entryPath(uint64_t key) const{
+	char name[32];
+	sprintf(name, "%016llx.iskc", (unsigned long long)key);
+	return _dir + "/" + name;
+}
+
+
+bool prepCache::load(uint64_t key) const{
+	std::string path = entryPath(key);
+	FILE * file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	// header, then the whole payload checked against its checksum before it is parsed
+	char magic[4] = {};
+	uint32_t version = 0;
+	uint64_t entryKey = 0, payloadSize = 0, checksum = 0;
+	bool ok = fread(magic, 1, 4, file) == 4 && fread(&version, 4, 1, file) == 1 && fread(&entryKey, 8, 1, file) == 1
+		&& fread(&payloadSize, 8, 1, file) == 1 && fread(&checksum, 8, 1, file) == 1;
+	ok = ok && memcmp(magic, entryMagic, 4) == 0 && version == entryVersion && entryKey == key;
+
+	std::vector<unsigned char> payload;
+	if (ok){
+		fseek(file, 0, SEEK_END);
+		long fileSize = ftell(file);
+		ok = fileSize >= 0 && (uint64_t)fileSize == headerSize + payloadSize;
+		if (ok){
+			payload.resize((std::size_t)payloadSize);
+			fseek(file, (long)headerSize, SEEK_SET);
+			ok = payload.empty() || fread(&payload[0], 1, payload.size(), file) == payload.size();
+		}
+	}
+	fclose(file);
+
+	if (ok){
+		contentHash hash;
+		if (!payload.empty())
+			hash.add(&payload[0], payload.size());
+		ok = hash.digest() == checksum;
+	}
+
+	std::vector<sceneData::meshTablePtr> meshTables;
+	std::vector<sceneData::jointTablePtr> jointTables;
+	if (ok){
+		entryReader reader(payload.empty() ? nullptr : &payload[0], payload.size());
+		uint32_t numMeshes = 0, numJointTables = 0;
+		reader.value(numMeshes);
+		for (uint32_t m = 0; m < numMeshes && reader.ok() && m <= sceneData::_meshes.size(); m++){
+			meshTables.push_back(std::make_shared<meshTable>(4));
+			transfer(reader, *meshTables.back());
+		}
+		reader.value(numJointTables);
+		for (uint32_t j = 0; j < numJointTables && reader.ok() && j <= sceneData::_jointNum; j++){
+			jointTables.push_back(std::make_shared<jointTable>());
+			transfer(reader, *jointTables.back());
+		}
+		ok = reader.done() && numMeshes == meshTables.size() && numJointTables == jointTables.size() && sceneData::checkTables(meshTables, jointTables);
+	}
+
+	if (!ok){
+		logInfo("prep cache: removed the bad entry %s", path.c_str());
+		remove(path.c_str());
+		return false;
+	}
+
+	for (std::size_t j = 0; j < jointTables.size(); j++){
+		jointTable & jTable = *jointTables[j];
+		if (!jTable.rbfPosParams.empty())
+			jTable.field.init(jTable.rbfPosParams, jTable.rbfNormalParams, jTable.field.radius());
+	}
+	sceneData::_meshTables.swap(meshTables);
+	sceneData::_jointTables.swap(jointTables);
+	sceneData::_dirtyJoints.assign(sceneData::_jointNum, 0);
+	sceneData::_dirtyMeshes.assign(sceneData::_meshes.size(), 0);
+
+	// used now, the last one to be evicted
+#if defined(_WIN32)
+	_utime(path.c_str(), nullptr);
+#else
+	utime(path.c_str(), nullptr);
+#endif
+	return true;
+}
+
+
+bool prepCache::store(uint64_t key) const{
+#if defined(_WIN32)
+	_mkdir(_dir.c_str());
+#else
+	mkdir(_dir.c_str(), 0755);
+#endif
+
+	// written aside then renamed, a reader never sees a partial entry
+	std::string path = entryPath(key), tmpPath = path + ".tmp";
+	FILE * file = fopen(tmpPath.c_str(), "wb");
+	if (!file)
+		return false;
+
+	uint64_t zero = 0;
+	uint32_t version = entryVersion;
+	bool ok = fwrite(entryMagic, 1, 4, file) == 4 && fwrite(&version, 4, 1, file) == 1 && fwrite(&key, 8, 1, file) == 1
+		&& fwrite(&zero, 8, 1, file) == 1 && fwrite(&zero, 8, 1, file) == 1;
+
+	entryWriter writer(file);
+	writer.value((uint32_t)sceneData::_meshTables.size());
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++)
+		transfer(writer, *sceneData::_meshTables[m]);
+	writer.value((uint32_t)sceneData::_jointTables.size());
+	for (std::size_t j = 0; j < sceneData::_jointTables.size(); j++)
+		transfer(writer, *sceneData::_jointTables[j]);
+
+	uint64_t payloadSize = writer.size(), checksum = writer.checksum();
+	ok = ok && writer.ok() && fseek(file, 16, SEEK_SET) == 0 && fwrite(&payloadSize, 8, 1, file) == 1 && fwrite(&checksum, 8, 1, file) == 1;
+	ok = (fclose(file) == 0) && ok;
+
+	remove(path.c_str());
+	if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0){
+		remove(tmpPath.c_str());
+		return false;
+	}
+	evict(path);
+	return true;
+}
+
+
+struct cacheEntry{
+	std::string	path;
+	uint64_t	size;
+	int64_t		time;	// last write, updated on each hit
+};
+
+static void listEntries(const std::string & dir, std::vector<cacheEntry> & entries){
+	entries.clear();
+#if defined(_WIN32)
+	_finddata64_t data;
+	intptr_t handle = _findfirst64((dir + "/*.iskc").c_str(), &data);
+	if (handle == -1)
+		return;
+	do {
+		cacheEntry entry = { dir + "/" + data.name, (uint64_t)data.size, (int64_t)data.time_write };
+		entries.push_back(entry);
+	} while (_findnext64(handle, &data) == 0);
+	_findclose(handle);
+#else
+	DIR * handle = opendir(dir.c_str());
+	if (!handle)
+		return;
+	while (dirent * item = readdir(handle)){
+		std::string name(item->d_name);
+		struct stat info;
+		if (name.size() < 5 || name.compare(name.size() - 5, 5, ".iskc") != 0 || stat((dir + "/" + name).c_str(), &info) != 0)
+			continue;
+		cacheEntry entry = { dir + "/" + name, (uint64_t)info.st_size, (int64_t)info.st_mtime };
+		entries.push_back(entry);
+	}
+	closedir(handle);
+#endif
+}
+
+
+void prepCache::evict(const std::string & keepPath) const{
+	if (_maxBytes == 0)
+		return;
+	std::vector<cacheEntry> entries;
+	listEntries(_dir, entries);
+
+	uint64_t total = 0;
+	for (std::size_t i = 0; i < entries.size(); i++)
+		total += entries[i].size;
+	std::sort(entries.begin(), entries.end(), [](const cacheEntry & a, const cacheEntry & b){ return a.time < b.time; });
+
+	for (std::size_t i = 0; i < entries.size() && total > _maxBytes; i++){
+		if (entries[i].path != keepPath && remove(entries[i].path.c_str()) == 0){
+			total -= entries[i].size;
+			logInfo("prep cache: evicted %s", entries[i].path.c_str());
+		}
+	}
+}
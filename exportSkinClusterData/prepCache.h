@@ -0,0 +1,44 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PREPCACHE_H
+#define PREPCACHE_H
+
+#include <stdint.h>
+#include <string>
+
+// on disk cache of the prepared scene: the mesh tables, and the joint tables with their frames, hrbf params and grids.
+// an entry is keyed by a hash of everything the prep reads ( rest points, topology, weights, joint hierarchy and bind
+// pose, prep parameters ), so a changed scene or parameter never finds a stale entry.
+// an entry is the file <key>.iskc in the cache directory, written to a temporary file then renamed. it is checked
+// ( magic, version, key, size, checksum of the payload, table sizes against the scene ) before anything is loaded,
+// and removed when the check fails. the least recently used entries are removed past the size limit of the directory
+class prepCache{
+public:
+	prepCache(const std::string & dir, std::size_t maxBytes):_dir(dir), _maxBytes(maxBytes){}
+
+	// hash of the scene loaded in sceneData and of sceneData::_params
+	static uint64_t sceneKey();
+
+	// hash of the scene loaded in sceneData without its weights, which depend on the load parameters ( maxInfluences,
+	// quantizeWeights ): the scene a scene buffer was prepared for, whatever the parameters it is loaded with
+	static uint64_t contentKey();
+
+	// fill the tables of sceneData from the entry of key, false when there is none or it is not valid
+	bool load(uint64_t key) const;
+
+	// write the tables of sceneData as the entry of key, then evict
+	bool store(uint64_t key) const;
+
+	// remove the least recently used entries until the directory is within maxBytes ( 0 is no limit ), but keepPath
+	void evict(const std::string & keepPath = std::string()) const;
+
+private:
+	std::string entryPath(uint64_t key) const;
+
+	std::string	_dir;
+	std::size_t	_maxBytes;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <algorithm>
+
+#include "rbfDeformer.h"
+#include "Quaternion.h"
+
+bool rbfDeformer::deform(sceneSource & source){
+	// read the joints' local transforms at the current pose
+	if (!source.loadPose(sceneData::getInstance()))
+		return false;
+
+	// update the joint matrix
+	if (!sceneData::updateJoints())
+		return false;
+
+	// update the local coord and the skinning matrices
+	if (!updateLocalCoords() || !updatePalette())
+		return false;
+
+
+	// filter the vertices of each mesh which is inside of the intersection region of adjacent joints
+
+
+
+	bool deformed = false;
+	withController([&](auto & controller){
+		deformed = deformMeshes(controller);
+	});
+	if (!deformed)
+		return false;
+
+
+	// set the final position for each mesh object
+	return source.writeMeshes(sceneData::getInstance());
+}
+
+
+template<class computeController>
+bool rbfDeformer::deformMeshes(computeController & controller){
+	// get the position of these vertices, skinned
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++){
+		if (!updateMesh(*sceneData::_meshTables[m], controller))
+			return false;
+	}
+
+
+	// calculate the position for each vertex ( project and relax )
+	_projector.init();
+	_numSteps = 0;
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++){
+		meshTable & mTable = *sceneData::_meshTables[m];
+		_numSteps += _projector.project(mTable, _toRest, _params, controller);
+		if (_params.relaxSweeps == 0)
+			continue;
+
+		// the relaxation moves the points off their iso surface a little, they are projected once more
+		const std::vector<float> & normals = _projector.gradients();
+		const std::vector<float> & deviations = _projector.deviations();
+		if (normals.empty())
+			continue;
+		_relaxer.relax(mTable, &normals[0], &deviations[0], _params.relaxSweeps, _params.relaxStrength, controller);
+		_numSteps += _projector.project(mTable, _toRest, _params, controller);
+	}
+	return true;
+}
+
+
+bool rbfDeformer::updateLocalCoords(){
+	_jointPtrs.assign(sceneData::_jointNum, nullptr);
+	std::list<sceneData::jointPtr>::const_iterator iter = sceneData::_joints.begin();
+	for (; iter != sceneData::_joints.end(); iter++)
+		_jointPtrs[(*iter)->_index] = iter->get();
+
+	// the fields and their grids stay in the rest pose, the points are moved to them
+	_toRest.resize(sceneData::_jointTables.size());
+	for (std::size_t i = 0; i < sceneData::_jointTables.size(); i++){
+		const jointTable & jTable = *sceneData::_jointTables[i];
+		if (jTable.jointIdx >= _jointPtrs.size() || !_jointPtrs[jTable.jointIdx])
+			return false;
+		_toRest[i] = Transform(jTable.matrix) * Inverse(_jointPtrs[jTable.jointIdx]->_transform);
+	}
+	return true;
+}
+
+
+bool rbfDeformer::updatePalette(){
+	// skinning matrix of each scene joint, current global * inverse bind, the 3 rows SoA over the joints,
+	// and the same transform as a dual quaternion
+	unsigned int numJoints = (unsigned int)_jointPtrs.size();
+	_palette.resize(12 * numJoints);
+	_dqPalette.resize(8 * numJoints);
+	for (unsigned int j = 0; j < numJoints; j++){
+		if (!_jointPtrs[j])
+			return false;
+		Transform skinning = _jointPtrs[j]->_transform * Inverse(_jointPtrs[j]->_bindTransform);
+		const Matrix4x4 & m = skinning.GetMatrix();
+		for (unsigned int r = 0; r < 3; r++){
+			for (unsigned int c = 0; c < 4; c++)
+				_palette[(r * 4 + c) * numJoints + j] = m.m[r][c];
+		}
+
+		DualQuaternion dq(skinning);
+		const float elems[8] = { dq.q0.v.x, dq.q0.v.y, dq.q0.v.z, dq.q0.w, dq.qe.v.x, dq.qe.v.y, dq.qe.v.z, dq.qe.w };
+		for (unsigned int e = 0; e < 8; e++)
+			_dqPalette[e * numJoints + j] = elems[e];
+	}
+	return true;
+}
+
+
+template<class computeController>
+bool rbfDeformer::updateMesh(meshTable & mTable, computeController & controller){
+	// skinning of the rest points with the method of the mesh, the field value (w) of each point is kept
+	const skinTable & skin = mTable.skin;
+	std::size_t numPadded = skin.numPadded();
+	if (skin._numPoints != mTable.pointIdxTable.size())
+		return false;
+	_skinX.resize(numPadded);
+	_skinY.resize(numPadded);
+	_skinZ.resize(numPadded);
+
+	const std::size_t pointsPerTask = 4096;
+	skinPalette palette;
+	palette.matrices	= &_palette[0];
+	palette.dualQuats	= &_dqPalette[0];
+	palette.numJoints	= (unsigned int)_jointPtrs.size();
+	controller.parallelRange(numPadded, pointsPerTask, [&](std::size_t start, std::size_t end){
+		skin.skin(palette, start, end, &_skinX[0], &_skinY[0], &_skinZ[0]);
+	});
+
+	std::size_t nPoints = mTable.pointIdxTable.size();
+	for (std::size_t i = 0; i < nPoints; i++){
+		float * dst = &mTable.pointPosTable[i * mTable._numElems];
+		dst[0] = _skinX[i];
+		dst[1] = _skinY[i];
+		dst[2] = _skinZ[i];
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef RBFDEFORMER_H
+#define RBFDEFORMER_H
+
+#include "sceneData.h"
+#include "sceneSource.h"
+#include "fieldProjector.h"
+#include "relaxSolver.h"
+#include "computeController.h"
+
+#include <vector>
+
+// maya free body of the rbfDeform command, deform the prepared scene to the source' current pose
+class rbfDeformer{
+public:
+	rbfDeformer():_numSteps(0){}
+
+	bool deform(sceneSource & source);
+
+	inline projectParams & params() { return _params; }
+	inline std::size_t numProjectionSteps() const { return _numSteps; }	// newton steps of the last frame, over all the points
+
+	// compact field of the joint table at points of the current pose, value and gradient, see jointTable::evalField
+	inline void evalField(std::size_t tableIdx, const float * px, const float * py, const float * pz, unsigned int count,
+		float * f, float * gx, float * gy, float * gz) const {
+		sceneData::_jointTables[tableIdx]->evalField(_toRest[tableIdx], px, py, pz, count, f, gx, gy, gz);
+	}
+
+private:
+	bool updateLocalCoords();
+	bool updatePalette();
+	// skin, project and relax the meshes on the controller of getControllerSettings
+	template<class computeController>
+	bool deformMeshes(computeController & controller);
+	template<class computeController>
+	bool updateMesh(meshTable & mTable, computeController & controller);
+
+	std::vector<Transform>	_toRest;		// current pose to rest pose of each joint table' joint
+	std::vector<jointData *> _jointPtrs;	// scene joints by index
+	alignedFloats			_palette;		// skinning matrices, see skinPalette
+	alignedFloats			_dqPalette;		// skinning dual quaternions
+	alignedFloats			_skinX, _skinY, _skinZ;	// skinned points of the current mesh
+
+	projectParams		_params;
+	fieldProjector		_projector;
+	relaxSolver			_relaxer;
+	std::size_t			_numSteps;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <xmmintrin.h>
+
+#include "relaxSolver.h"
+
+const unsigned int relaxSolver::blockSize;
+
+void relaxSolver::relaxRange(const meshTable & mTable, float * dst, const float * normals, std::size_t start, std::size_t end) const{
+	const float * src = &mTable.pointPosTable[0];
+	const unsigned int * offsets = &mTable.offsetTable[0];
+	const unsigned int * adj = mTable.adjPtIdxTable.empty() ? nullptr : &mTable.adjPtIdxTable[0];
+	const float * weights = mTable.relaxWeightTable.empty() ? nullptr : &mTable.relaxWeightTable[0];
+	const unsigned int numElems = mTable._numElems;
+	assert(numElems == 4);	// a point is one simd load, the tables are checked for it when loaded
+
+	for (std::size_t i = start; i < end; i++){
+		__m128 p = _mm_loadu_ps(src + i * numElems);		// x, y, z, iso
+		float mu = _mu[i];
+		if (mu <= 0.0f || offsets[i] == offsets[i + 1]){
+			_mm_storeu_ps(dst + i * numElems, p);
+			continue;
+		}
+
+		// weighted average of the adj points, one point ( x, y, z, w ) per simd gather
+		__m128 avg = _mm_setzero_ps();
+		for (unsigned int k = offsets[i]; k < offsets[i + 1]; k++)
+			avg = _mm_add_ps(avg, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(src + adj[k] * numElems)));
+
+		// keep the tangential part of the move only
+		float d[4];
+		_mm_storeu_ps(d, _mm_sub_ps(avg, p));
+		const float * n = normals + i * 3;
+		float n2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+		if (n2 > 1e-12f){
+			float s = (d[0] * n[0] + d[1] * n[1] + d[2] * n[2]) / n2;
+			d[0] -= s * n[0]; d[1] -= s * n[1]; d[2] -= s * n[2];
+		}
+		d[3] = 0.0f;	// the iso value stays
+
+		_mm_storeu_ps(dst + i * numElems, _mm_add_ps(p, _mm_mul_ps(_mm_set1_ps(mu), _mm_loadu_ps(d))));
+	}
+}
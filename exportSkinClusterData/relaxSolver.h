@@ -0,0 +1,65 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef RELAXSOLVER_H
+#define RELAXSOLVER_H
+
+#include <vector>
+
+#include "computeController.h"
+#include "Table.h"
+
+// tangential relaxation of the projected points over the CSR adjacency of meshTable ( offsetTable, adjPtIdxTable ).
+// jacobi sweeps: each sweep reads pointPosTable and writes a second buffer which is then swapped in,
+// so the ranges of points are independent and run in parallel. the points on their iso surface do not move,
+// the cost of a range varies and the ranges are split while there are idle workers
+class relaxSolver{
+public:
+	relaxSolver(){}
+
+	// normals ( x, y, z per point, not normalized ) give the tangent plane, a point moves by strength * mu( deviation )
+	// of the way to the weighted average of its adj points, mu is 0 for a point which was on its iso surface
+	template<class computeController>
+	void relax(meshTable & mTable, const float * normals, const float * deviations, unsigned int sweeps, float strength,
+		computeController & controller);
+
+private:
+	static const unsigned int blockSize = 1024;	// smallest range of points
+
+	void relaxRange(const meshTable & mTable, float * dst, const float * normals, std::size_t start, std::size_t end) const;
+
+	tableArray<float> _buffer;		// the other position buffer, same layout as pointPosTable
+	std::vector<float> _mu;			// step of each point, computed once per frame
+};
+
+
+template<class computeController>
+void relaxSolver::relax(meshTable & mTable, const float * normals, const float * deviations, unsigned int sweeps, float strength,
+	computeController & controller){
+	std::size_t nPoints = mTable.pointIdxTable.size();
+	if (sweeps == 0 || nPoints == 0)
+		return;
+
+	// both buffers owned, a mapped pointPosTable is copied the first time only, then the sweeps swap owned arrays
+	mTable.pointPosTable.own();
+	_buffer.resize(mTable.pointPosTable.size());
+	_mu.resize(nPoints);
+	controller.parallelRange(nPoints, blockSize, [&](std::size_t start, std::size_t end){
+		for (std::size_t i = start; i < end; i++){
+			float t = deviations[i] - 1.0f, t2 = t * t;
+			float mu = 1.0f - t2 * t2;
+			_mu[i] = strength * (mu > 0.0f ? mu : 0.0f);
+		}
+	});
+
+	for (unsigned int s = 0; s < sweeps; s++){
+		float * dst = &_buffer[0];
+		controller.parallelRange(nPoints, blockSize, [&](std::size_t start, std::size_t end){
+			relaxRange(mTable, dst, normals, start, end);
+		});
+		mTable.pointPosTable.swap(_buffer);
+	}
+}
+
+#endif
@@ -0,0 +1,554 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "sceneBuffer.h"
+#include "sceneData.h"
+#include "prepCache.h"
+#include "logger.h"
+
+static const char bufferMagic[4] = { 'I', 'S', 'K', 'B' };
+static const uint32_t bufferByteOrder = 0x01020304;	// reads back the same on a machine of the same byte order
+
+struct bufferHeader{
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	byteOrder;
+	uint32_t	numSections;
+	uint64_t	fileSize;
+	uint32_t	numMeshes;
+	uint32_t	numJointTables;
+	uint32_t	numJoints;
+	uint32_t	pad;
+	uint64_t	sceneKey;	// prepCache::contentKey of the scene the tables were prepared for
+};
+
+// the directory follows the header, an entry for each section
+struct sectionEntry{
+	uint32_t	kind;
+	uint32_t	owner;		// index of the mesh table or of the joint table
+	uint32_t	elemSize;	// bytes of an element, a layout change is caught here when the version is not bumped
+	uint32_t	pad;
+	uint64_t	offset;		// from the start of the file, a multiple of SIMD_ALIGN
+	uint64_t	count;		// elements
+};
+
+enum sectionKind{
+	// one of each for each mesh table
+	MESH_RECORD = 0,
+	MESH_POINT_POS,
+	MESH_POINT_IDX,
+	MESH_OFFSET,
+	MESH_ADJ_PT,
+	MESH_RELAX_WEIGHT,
+	MESH_FACE_OFFSET,
+	MESH_ADJ_FACE,
+	MESH_PT_JOINT,
+	MESH_JOINT_OFFSET,
+	SKIN_REST_X,
+	SKIN_REST_Y,
+	SKIN_REST_Z,
+	SKIN_JOINTS,
+	SKIN_WEIGHTS,
+	// one of each for each joint table, GRID_NODES when it has a grid
+	JOINT_RECORD,
+	JOINT_SAMPLE_POS,
+	JOINT_SAMPLE_NORMAL,
+	JOINT_RBF_POS,
+	JOINT_RBF_NORMAL,
+	FIELD_CX,
+	FIELD_CY,
+	FIELD_CZ,
+	FIELD_ALPHA,
+	FIELD_BX,
+	FIELD_BY,
+	FIELD_BZ,
+	GRID_NODES,
+	NUM_SECTION_KINDS
+};
+
+// the fields of a mesh table which are not arrays
+struct meshRecord{
+	uint32_t	numElems;
+	uint32_t	numSlots;
+	uint32_t	method;
+	uint32_t	pad;
+	uint64_t	numPoints;
+	uint64_t	numPadded;
+};
+
+// the fields of a joint table which are not arrays
+struct jointRecord{
+	uint32_t	jointIdx;
+	uint32_t	numCenters;
+	float		radius;
+	uint32_t	hasGrid;
+	double		sampleArea;
+	float		matrix[4][4];
+	float		center[3];
+	float		axes[3][3];
+	float		bboxMin[3];
+	float		bboxMax[3];
+	float		toGrid[3][4];
+	uint32_t	res[3];
+	uint32_t	pad;
+};
+
+static inline uint64_t alignUp(uint64_t offset){
+	return (offset + SIMD_ALIGN - 1) / SIMD_ALIGN * SIMD_ALIGN;
+}
+
+
+// a file mapped copy on write, unmapped with the last view of its tables
+class mappedFile{
+public:
+#if defined(_WIN32)
+	mappedFile():_data(nullptr), _size(0), _mapping(NULL){}
+	~mappedFile(){
+		if (_data)
+			UnmapViewOfFile(_data);
+		if (_mapping)
+			CloseHandle(_mapping);
+	}
+
+	bool open(const std::string & path){
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+			_mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		CloseHandle(file);
+		if (!_mapping)
+			return false;
+		_data = (unsigned char *)MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0);
+		_size = _data ? (std::size_t)size.QuadPart : 0;
+		return _data != nullptr;
+	}
+#else
+	mappedFile():_data(nullptr), _size(0){}
+	~mappedFile(){
+		if (_data)
+			munmap(_data, _size);
+	}
+
+	bool open(const std::string & path){
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		if (fstat(file, &info) == 0 && info.st_size > 0){
+			void * data = mmap(nullptr, (std::size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			if (data != MAP_FAILED){
+				_data = (unsigned char *)data;
+				_size = (std::size_t)info.st_size;
+			}
+		}
+		::close(file);
+		return _data != nullptr;
+	}
+#endif
+
+	inline unsigned char * data() const { return _data; }
+	inline std::size_t size() const { return _size; }
+
+private:
+	unsigned char *	_data;
+	std::size_t		_size;
+#if defined(_WIN32)
+	HANDLE			_mapping;
+#endif
+};
+
+
+// the buffer goes to a file or to memory
+class fileSink{
+public:
+	fileSink(FILE * file):_file(file){}
+	inline bool bytes(const void * data, std::size_t size){ return fwrite(data, 1, size, _file) == size; }
+
+private:
+	FILE *	_file;
+};
+
+class memorySink{
+public:
+	memorySink(unsigned char * data, std::size_t size):_pos(data), _end(data + size){}
+	inline bool bytes(const void * data, std::size_t size){
+		if ((std::size_t)(_end - _pos) < size)
+			return false;
+		memcpy(_pos, data, size);
+		_pos += size;
+		return true;
+	}
+
+private:
+	unsigned char *	_pos;
+	unsigned char *	_end;
+};
+
+
+// sections of the tables of sceneData, in file order, and the header and directory laid out for them.
+// the arrays are written from the tables, the records from copies kept here
+class bufferImage{
+public:
+	bufferImage();
+
+	inline std::size_t size() const { return (std::size_t)_header.fileSize; }
+
+	template<class Sink>
+	bool write(Sink & sink) const {
+		bool ok = sink.bytes(&_header, sizeof(_header));
+		if (!_entries.empty())
+			ok = ok && sink.bytes(&_entries[0], _entries.size() * sizeof(sectionEntry));
+		uint64_t pos = sizeof(bufferHeader) + _entries.size() * sizeof(sectionEntry);
+		for (std::size_t s = 0; s < _entries.size() && ok; s++){
+			ok = pad(sink, _entries[s].offset - pos);
+			std::size_t bytes = (std::size_t)(_entries[s].count * _entries[s].elemSize);
+			ok = ok && (bytes == 0 || sink.bytes(_data[s], bytes));
+			pos = _entries[s].offset + bytes;
+		}
+		return ok && pad(sink, _header.fileSize - pos);
+	}
+
+private:
+	template<class T>
+	void record(sectionKind kind, uint32_t owner, const T & rec){ add(kind, owner, &rec, sizeof(T), 1); }
+
+	template<class Array>
+	void array(sectionKind kind, uint32_t owner, const Array & a){
+		add(kind, owner, a.empty() ? nullptr : &a[0], sizeof(a[0]), a.size());
+	}
+
+	void add(sectionKind kind, uint32_t owner, const void * data, std::size_t elemSize, std::size_t count){
+		sectionEntry entry = { (uint32_t)kind, owner, (uint32_t)elemSize, 0, 0, (uint64_t)count };
+		_entries.push_back(entry);
+		_data.push_back(data);
+	}
+
+	template<class Sink>
+	static bool pad(Sink & sink, uint64_t bytes){
+		static const char zeros[SIMD_ALIGN] = {};
+		return bytes == 0 || sink.bytes(zeros, (std::size_t)bytes);
+	}
+
+	bufferHeader				_header;
+	std::vector<sectionEntry>	_entries;
+	std::vector<const void *>	_data;
+	std::vector<meshRecord>		_meshRecs;
+	std::vector<jointRecord>	_jointRecs;
+};
+
+
+// sections of a buffer in memory, each one checked to be in the buffer once
+class bufferReader{
+public:
+	bufferReader(unsigned char * data, std::size_t size, const std::shared_ptr<void> & keep):_data(data), _size(size), _keep(keep), _ok(false){}
+
+	bool open(const bufferHeader & header){
+		std::size_t numOwners = std::max(header.numMeshes, header.numJointTables);
+		_sections.assign(numOwners * NUM_SECTION_KINDS, nullptr);
+		const sectionEntry * entries = (const sectionEntry *)(_data + sizeof(bufferHeader));
+		for (uint32_t s = 0; s < header.numSections; s++){
+			const sectionEntry & entry = entries[s];
+			bool meshKind = entry.kind < JOINT_RECORD;
+			if (entry.kind >= NUM_SECTION_KINDS || entry.owner >= (meshKind ? header.numMeshes : header.numJointTables)
+				|| entry.offset % SIMD_ALIGN != 0 || entry.offset > _size || entry.elemSize == 0
+				|| entry.count > (_size - entry.offset) / entry.elemSize)
+				return false;
+			_sections[entry.owner * NUM_SECTION_KINDS + entry.kind] = &entry;
+		}
+		return _ok = true;
+	}
+
+	template<class T>
+	const T * record(sectionKind kind, uint32_t owner){
+		const sectionEntry * entry = find(kind, owner, sizeof(T));
+		if (!entry || entry->count != 1){
+			_ok = false;
+			return nullptr;
+		}
+		return (const T *)(_data + entry->offset);
+	}
+
+	// the array is a view of the section, of count elements unless count is -1
+	template<class T>
+	void view(tableArray<T> & a, sectionKind kind, uint32_t owner, std::size_t count = (std::size_t)-1){
+		const sectionEntry * entry = find(kind, owner, sizeof(T));
+		if (!entry || (count != (std::size_t)-1 && entry->count != count)){
+			_ok = false;
+			return;
+		}
+		a.view((T *)(_data + entry->offset), (std::size_t)entry->count, _keep);
+	}
+
+	template<class T>
+	void copy(std::vector<T> & v, sectionKind kind, uint32_t owner){
+		const sectionEntry * entry = find(kind, owner, sizeof(T));
+		if (!entry){
+			_ok = false;
+			return;
+		}
+		const T * data = (const T *)(_data + entry->offset);
+		v.assign(data, data + entry->count);
+	}
+
+	inline bool ok() const { return _ok; }
+
+private:
+	const sectionEntry * find(sectionKind kind, uint32_t owner, std::size_t elemSize) const {
+		std::size_t s = (std::size_t)owner * NUM_SECTION_KINDS + kind;
+		if (!_ok || s >= _sections.size() || !_sections[s] || _sections[s]->elemSize != elemSize)
+			return nullptr;
+		return _sections[s];
+	}
+
+	unsigned char *						_data;
+	std::size_t							_size;
+	std::shared_ptr<void>				_keep;
+	std::vector<const sectionEntry *>	_sections;	// by owner then kind
+	bool								_ok;
+};
+
+
+bufferImage::bufferImage():_meshRecs(sceneData::_meshTables.size()), _jointRecs(sceneData::_jointTables.size()){
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++){
+		const meshTable & mTable = *sceneData::_meshTables[m];
+		const skinTable & skin = mTable.skin;
+		uint32_t owner = (uint32_t)m;
+		meshRecord & rec = _meshRecs[m];
+		meshRecord fields = { (uint32_t)mTable._numElems, skin._numSlots, (uint32_t)skin._method, 0, skin._numPoints, skin._numPadded };
+		rec = fields;
+		record(MESH_RECORD, owner, rec);
+		array(MESH_POINT_POS, owner, mTable.pointPosTable);
+		array(MESH_POINT_IDX, owner, mTable.pointIdxTable);
+		array(MESH_OFFSET, owner, mTable.offsetTable);
+		array(MESH_ADJ_PT, owner, mTable.adjPtIdxTable);
+		array(MESH_RELAX_WEIGHT, owner, mTable.relaxWeightTable);
+		array(MESH_FACE_OFFSET, owner, mTable.faceOffsetTable);
+		array(MESH_ADJ_FACE, owner, mTable.adjFaceIdxTable);
+		array(MESH_PT_JOINT, owner, mTable.ptJointIdxTable);
+		array(MESH_JOINT_OFFSET, owner, mTable.jointOffsetTable);
+		array(SKIN_REST_X, owner, skin._restX);
+		array(SKIN_REST_Y, owner, skin._restY);
+		array(SKIN_REST_Z, owner, skin._restZ);
+		array(SKIN_JOINTS, owner, skin._joints);
+		array(SKIN_WEIGHTS, owner, skin._weights);
+	}
+
+	for (std::size_t j = 0; j < sceneData::_jointTables.size(); j++){
+		const jointTable & jTable = *sceneData::_jointTables[j];
+		const localCoord & coord = jTable.coord;
+		const hrbfField & field = jTable.field;
+		uint32_t owner = (uint32_t)j;
+
+		jointRecord & rec = _jointRecs[j];
+		memset(&rec, 0, sizeof(rec));
+		rec.jointIdx = jTable.jointIdx;
+		rec.numCenters = field._numCenters;
+		rec.radius = field._radius;
+		rec.hasGrid = jTable.grid ? 1 : 0;
+		rec.sampleArea = jTable.sampleArea;
+		memcpy(rec.matrix, jTable.matrix.m, sizeof(rec.matrix));
+		const Vector * axes[3] = { &coord._axisX, &coord._axisY, &coord._axisZ };
+		for (unsigned int a = 0; a < 3; a++){
+			rec.center[a] = coord._center[a];
+			rec.bboxMin[a] = coord.bbox.first[a];
+			rec.bboxMax[a] = coord.bbox.second[a];
+			for (unsigned int c = 0; c < 3; c++)
+				rec.axes[a][c] = (*axes[a])[c];
+		}
+		if (jTable.grid){
+			memcpy(rec.toGrid, jTable.grid->_toGrid, sizeof(rec.toGrid));
+			memcpy(rec.res, jTable.grid->_res, sizeof(rec.res));
+		}
+
+		record(JOINT_RECORD, owner, rec);
+		array(JOINT_SAMPLE_POS, owner, jTable.samplePosTable);
+		array(JOINT_SAMPLE_NORMAL, owner, jTable.sampleNormalTable);
+		array(JOINT_RBF_POS, owner, jTable.rbfPosParams);
+		array(JOINT_RBF_NORMAL, owner, jTable.rbfNormalParams);
+		array(FIELD_CX, owner, field._cx);
+		array(FIELD_CY, owner, field._cy);
+		array(FIELD_CZ, owner, field._cz);
+		array(FIELD_ALPHA, owner, field._alpha);
+		array(FIELD_BX, owner, field._bx);
+		array(FIELD_BY, owner, field._by);
+		array(FIELD_BZ, owner, field._bz);
+		if (jTable.grid)
+			array(GRID_NODES, owner, jTable.grid->_nodes);
+	}
+
+	memset(&_header, 0, sizeof(_header));
+	memcpy(_header.magic, bufferMagic, 4);
+	_header.version = sceneBuffer::version;
+	_header.byteOrder = bufferByteOrder;
+	_header.numMeshes = (uint32_t)sceneData::_meshTables.size();
+	_header.numJointTables = (uint32_t)sceneData::_jointTables.size();
+	_header.numJoints = sceneData::_jointNum;
+	_header.sceneKey = prepCache::contentKey();
+
+	_header.numSections = (uint32_t)_entries.size();
+
+	uint64_t offset = alignUp(sizeof(bufferHeader) + _entries.size() * sizeof(sectionEntry));
+	for (std::size_t s = 0; s < _entries.size(); s++){
+		_entries[s].offset = offset;
+		offset = alignUp(offset + _entries[s].count * _entries[s].elemSize);
+	}
+	_header.fileSize = offset;
+}
+
+
+bool sceneBuffer::write(const std::string & path){
+	bufferImage image;
+
+	// written aside then renamed, the file mapped by a process stays as it was
+	std::string tmpPath = path + ".tmp";
+	FILE * file = fopen(tmpPath.c_str(), "wb");
+	if (!file)
+		return false;
+	fileSink sink(file);
+	bool ok = image.write(sink);
+	ok = (fclose(file) == 0) && ok;
+
+	remove(path.c_str());
+	if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0){
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+std::size_t sceneBuffer::size(){
+	return bufferImage().size();
+}
+
+
+bool sceneBuffer::write(unsigned char * data, std::size_t size){
+	bufferImage image;
+	memorySink sink(data, size);
+	return image.size() == size && image.write(sink);
+}
+
+
+bool sceneBuffer::read(const std::string & path){
+	std::shared_ptr<mappedFile> file = std::make_shared<mappedFile>();
+	return file->open(path) && read(file->data(), file->size(), file, prepCache::contentKey());
+}
+
+
+bool sceneBuffer::read(unsigned char * data, std::size_t size, const std::shared_ptr<void> & keep, uint64_t sceneKey){
+	bufferHeader header;
+	if (size < sizeof(header) || (uintptr_t)data % SIMD_ALIGN != 0)
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, bufferMagic, 4) != 0 || header.version != version || header.byteOrder != bufferByteOrder
+		|| header.fileSize != size || header.numSections > (size - sizeof(header)) / sizeof(sectionEntry)
+		|| header.numMeshes != sceneData::_meshes.size() || header.numJoints != sceneData::_jointNum || header.numJointTables > header.numJoints
+		|| header.sceneKey != sceneKey)
+		return false;
+
+	bufferReader reader(data, size, keep);
+	if (!reader.open(header))
+		return false;
+
+	std::vector<sceneData::meshTablePtr> meshTables;
+	std::list<sceneData::meshPtr>::const_iterator mIter = sceneData::_meshes.begin();
+	for (uint32_t m = 0; m < header.numMeshes && reader.ok(); m++, mIter++){
+		const meshRecord * rec = reader.record<meshRecord>(MESH_RECORD, m);
+		std::size_t nPoints = (*mIter)->_numPoints;
+		if (!rec || rec->numPoints != nPoints || rec->numElems != 4 || rec->numPadded < nPoints || rec->numPadded % skinTable::blockSize != 0)
+			return false;
+
+		meshTables.push_back(std::make_shared<meshTable>(rec->numElems));
+		meshTable & mTable = *meshTables.back();
+		reader.view(mTable.pointPosTable, MESH_POINT_POS, m, nPoints * rec->numElems);
+		reader.view(mTable.pointIdxTable, MESH_POINT_IDX, m, nPoints);
+		reader.view(mTable.offsetTable, MESH_OFFSET, m, nPoints + 1);
+		reader.view(mTable.adjPtIdxTable, MESH_ADJ_PT, m);
+		reader.view(mTable.relaxWeightTable, MESH_RELAX_WEIGHT, m, mTable.adjPtIdxTable.size());
+		reader.view(mTable.faceOffsetTable, MESH_FACE_OFFSET, m, nPoints + 1);
+		reader.view(mTable.adjFaceIdxTable, MESH_ADJ_FACE, m);
+		reader.view(mTable.ptJointIdxTable, MESH_PT_JOINT, m, nPoints);
+		reader.view(mTable.jointOffsetTable, MESH_JOINT_OFFSET, m);
+
+		skinTable & skin = mTable.skin;
+		skin._numPoints = nPoints;
+		skin._numPadded = (std::size_t)rec->numPadded;
+		skin._numSlots = rec->numSlots;
+		skin._method = (skinMethod)rec->method;
+		reader.view(skin._restX, SKIN_REST_X, m, skin._numPadded);
+		reader.view(skin._restY, SKIN_REST_Y, m, skin._numPadded);
+		reader.view(skin._restZ, SKIN_REST_Z, m, skin._numPadded);
+		reader.view(skin._joints, SKIN_JOINTS, m, skin._numPadded * skin._numSlots);
+		reader.view(skin._weights, SKIN_WEIGHTS, m, skin._numPadded * skin._numSlots);
+	}
+
+	std::vector<sceneData::jointTablePtr> jointTables;
+	for (uint32_t j = 0; j < header.numJointTables && reader.ok(); j++){
+		const jointRecord * rec = reader.record<jointRecord>(JOINT_RECORD, j);
+		if (!rec || rec->jointIdx >= sceneData::_jointNum)
+			return false;
+
+		jointTables.push_back(std::make_shared<jointTable>(rec->jointIdx));
+		jointTable & jTable = *jointTables.back();
+		jTable.sampleArea = rec->sampleArea;
+		memcpy(jTable.matrix.m, rec->matrix, sizeof(rec->matrix));
+		localCoord & coord = jTable.coord;
+		Vector * axes[3] = { &coord._axisX, &coord._axisY, &coord._axisZ };
+		for (unsigned int a = 0; a < 3; a++){
+			coord._center[a] = rec->center[a];
+			coord.bbox.first[a] = rec->bboxMin[a];
+			coord.bbox.second[a] = rec->bboxMax[a];
+			for (unsigned int c = 0; c < 3; c++)
+				(*axes[a])[c] = rec->axes[a][c];
+		}
+
+		reader.copy(jTable.samplePosTable, JOINT_SAMPLE_POS, j);
+		reader.copy(jTable.sampleNormalTable, JOINT_SAMPLE_NORMAL, j);
+		reader.copy(jTable.rbfPosParams, JOINT_RBF_POS, j);
+		reader.copy(jTable.rbfNormalParams, JOINT_RBF_NORMAL, j);
+
+		hrbfField & field = jTable.field;
+		field._numCenters = rec->numCenters;
+		field._radius = rec->radius;
+		reader.view(field._cx, FIELD_CX, j, field._numCenters);
+		reader.view(field._cy, FIELD_CY, j, field._numCenters);
+		reader.view(field._cz, FIELD_CZ, j, field._numCenters);
+		reader.view(field._alpha, FIELD_ALPHA, j, field._numCenters);
+		reader.view(field._bx, FIELD_BX, j, field._numCenters);
+		reader.view(field._by, FIELD_BY, j, field._numCenters);
+		reader.view(field._bz, FIELD_BZ, j, field._numCenters);
+
+		if (rec->hasGrid){
+			jTable.grid = std::make_shared<fieldGrid>();
+			fieldGrid & grid = *jTable.grid;
+			memcpy(grid._toGrid, rec->toGrid, sizeof(rec->toGrid));
+			memcpy(grid._res, rec->res, sizeof(rec->res));
+			reader.view(grid._nodes, GRID_NODES, j, (std::size_t)grid._res[0] * grid._res[1] * grid._res[2] * 4);
+		}
+	}
+	// the indices the deformer follows, a stale or damaged file must not read out of the tables
+	if (!reader.ok() || !sceneData::checkTables(meshTables, jointTables))
+		return false;
+
+	sceneData::_meshTables.swap(meshTables);
+	sceneData::_jointTables.swap(jointTables);
+	sceneData::_dirtyJoints.assign(sceneData::_jointNum, 0);
+	sceneData::_dirtyMeshes.assign(sceneData::_meshes.size(), 0);
+	return true;
+}
@@ -0,0 +1,40 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef SCENEBUFFER_H
+#define SCENEBUFFER_H
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+// file of the prepared scene for rbfDeform and the headless tools: the mesh tables, and the joint tables with their
+// local coords, hrbf fields and grids. it is a header, a directory of sections, then the sections, each one array
+// of a table starting on a cache line at the offset given by the directory, in the layout of the tables in memory.
+// reading maps the file and the arrays of the tables are views of the mapping ( see tableArray ), nothing is parsed
+// or copied but the samples and hrbf params of the joints, which only a new prep reads. the mapping is copy on write:
+// the processes deforming the same file share its pages, and a table written ( pointPosTable ) gets private pages
+class sceneBuffer{
+public:
+	static const unsigned int version = 2;	// changes with the layout of the tables
+
+	// write the tables of sceneData to path, through a temporary file renamed at the end so a process
+	// mapping the file before keeps its pages
+	static bool write(const std::string & path);
+
+	// the same in memory, size() bytes at data
+	static std::size_t size();
+	static bool write(unsigned char * data, std::size_t size);
+
+	// replace the tables of sceneData by the ones of the file at path, false when it is not a scene buffer of this
+	// version, was prepared for another scene than the one loaded in sceneData ( see prepCache::contentKey ), or its
+	// tables fail sceneData::checkTables
+	static bool read(const std::string & path);
+
+	// the same from size bytes at data, cache line aligned and mapped copy on write, which keep holds. the buffer is
+	// to be prepared for the scene of sceneKey, the contentKey of a scene the reader only has the rig of
+	static bool read(unsigned char * data, std::size_t size, const std::shared_ptr<void> & keep, uint64_t sceneKey);
+};
+
+#endif
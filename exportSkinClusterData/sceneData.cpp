@@ -1,33 +1,719 @@
+#include <algorithm>
+#include <chrono>
+
 #include "sceneData.h"
+#include "logger.h"
+#include "fieldProjector.h"
+#include "hrbfFit.h"
+#include "prepCache.h"
+#include "sceneBuffer.h"
+#include "taskGraph.h"
 
-sceneData *sceneData::_instance = 0; 
+sceneData *sceneData::_instance = 0;
 
 unsigned int sceneData::_meshNum = 0;
 unsigned int sceneData::_jointNum = 0;
+prepParams sceneData::_params = prepParams();
+jointHierarchy sceneData::_hierarchy = jointHierarchy();
 
 std::list<sceneData::jointPtr> sceneData::_joints = std::list<sceneData::jointPtr>();
 std::list<sceneData::meshPtr> sceneData::_meshes = std::list<sceneData::meshPtr>();
 
+std::vector<sceneData::meshTablePtr> sceneData::_meshTables = std::vector<sceneData::meshTablePtr>();
+std::vector<sceneData::jointTablePtr> sceneData::_jointTables = std::vector<sceneData::jointTablePtr>();
+std::vector<unsigned char> sceneData::_dirtyJoints = std::vector<unsigned char>();
+std::vector<unsigned char> sceneData::_dirtyMeshes = std::vector<unsigned char>();
+
+
+bool sceneData::loadScene(sceneSource & source){
+	clear();
+	if (!source.loadScene(getInstance()))
+		return false;
+	_meshNum = (unsigned int)_meshes.size();
+
+	std::size_t numPoints = 0, memory = 0;
+	std::list<meshPtr>::const_iterator mIter = _meshes.begin();
+	for (; mIter != _meshes.end(); mIter++){
+		numPoints += (*mIter)->_numPoints;
+		memory += (*mIter)->_weights.memorySize();
+	}
+	logInfo("weights: %lu points, %u influences per point%s, %.2f MB", (unsigned long)numPoints, _params.maxInfluences,
+		_params.quantizeWeights ? " quantized" : "", memory / (1024.0 * 1024.0));
+
+	// the pose read at load time is the rest pose
+	if (!_hierarchy.build(_joints) || !updateJoints())
+		return false;
+	std::list<jointPtr>::iterator iter = _joints.begin();
+	for (; iter != _joints.end(); iter++)
+		(*iter)->_bindTransform = (*iter)->_transform;
+
+	return true;
+}
+
+
+bool sceneData::updateJoints(){
+	// joints are indexed by _index, but a child may be inserted before its parent
+	if (_hierarchy.size() != _jointNum && !_hierarchy.build(_joints))
+		return false;	// cycle in the hierarchy
+	_hierarchy.update(_joints);
+	return true;
+}
+
+
+bool sceneData::prepScene(){
+	if (_params.cacheDir.empty())
+		return processSamples();
 
-bool sceneData::processNeighbours(){
-	
+	typedef std::chrono::steady_clock cacheClock;
+	cacheClock::time_point start = cacheClock::now();
+	prepCache cache(_params.cacheDir, _params.cacheLimit);
+	uint64_t key = prepCache::sceneKey();
+	if (cache.load(key)){
+		double ms = std::chrono::duration<double, std::milli>(cacheClock::now() - start).count();
+		logInfo("prep cache: hit %016llx, %u mesh tables, %u joint tables, %.3f ms", (unsigned long long)key,
+			(unsigned int)_meshTables.size(), (unsigned int)_jointTables.size(), ms);
+		return true;
+	}
+
+	if (!processSamples())
+		return false;
+	if (!cache.store(key))
+		logInfo("prep cache: could not write to %s", _params.cacheDir.c_str());
+	else
+		logInfo("prep cache: stored %016llx", (unsigned long long)key);
 	return true;
 }
 
 
+sceneData::meshTablePtr sceneData::buildMeshTable(const meshData & mesh){
+	meshTableFactory factory(mesh._numInfluences);
+	const std::vector<int> * ranks = (_hierarchy._flatPos.size() == _jointNum) ? &_hierarchy._flatPos : nullptr;
+	factory.meshInit(mesh);
+	withController([&](auto & controller){
+		factory.buildAdjacency(mesh, controller);
+		factory.processWeights(controller, ranks);
+		factory.reorder(_params.order);
+		factory.groupByJoint(_jointNum, controller);
+	});
+	factory.skinInit(mesh);
+	return factory.getMeshTable();
+}
+
+
 bool sceneData::processSamples(){
-	
+	// every mesh and every partition is redone
+	_meshTables.assign(_meshes.size(), meshTablePtr());
+	_jointTables.clear();
+	_dirtyMeshes.assign(_meshes.size(), 1);
+	_dirtyJoints.assign(_jointNum, 1);
+	return updateModified();
+}
+
+
+// meshes sharing no joint are prepared apart from each other: the samples, the fit and the grid of a joint only
+// read the meshes with points on it. a cluster keeps its new tables until all the clusters are done
+class sceneData::prepCluster{
+public:
+	prepCluster():numSamples(0), sampleMs(0.0), fitMs(0.0), bakeMs(0.0){}
+
+	std::vector<std::size_t>		meshes;		// scene order
+	std::vector<const meshData *>	meshPtrs;
+	std::vector<jointTablePtr>		tables;		// new tables, in the order the meshes made them
+	std::vector<std::size_t>		tableMesh;	// the first mesh of each table, the one which made it
+	std::vector<hrbfFitReport>		reports;	// of each table
+	std::size_t		numSamples;
+	double			sampleMs, fitMs, bakeMs;
+};
+
+
+bool sceneData::updateModified(){
+	typedef std::chrono::steady_clock prepClock;
+	prepClock::time_point start = prepClock::now();
+	_meshTables.resize(_meshes.size());
+	_dirtyJoints.resize(_jointNum, 1);
+	_dirtyMeshes.resize(_meshes.size(), 1);
+
+	// the modified meshes are re-segmented, the joints of their points before and after are redone
+	std::vector<const meshData *> meshPtrs;
+	std::list<meshPtr>::const_iterator iter = _meshes.begin();
+	for (std::size_t m = 0; iter != _meshes.end(); iter++, m++){
+		meshPtrs.push_back(iter->get());
+		if (!_meshTables[m])
+			_dirtyMeshes[m] = 1;
+		else if (_dirtyMeshes[m])
+			markJoints(*_meshTables[m]);
+	}
+
+	std::vector<prepCluster> clusters;
+	findClusters(clusters);
+
+	// each cluster is a chain of stages after the segmentation of its meshes, the chains run concurrently and
+	// each stage spreads its joints on the controller as well. then the tables are merged, and the iso values
+	// need the merged fields of the parents and children
+	std::vector<double> segmentMs(_meshes.size(), 0.0);
+	std::vector<unsigned char> affected;
+	taskGraph graph;
+	unsigned int merge = graph.add([&]{
+		mergeClusters(clusters);
+		affectedJoints(affected);
+	});
+	for (std::size_t c = 0; c < clusters.size(); c++){
+		unsigned int sample = graph.add([&, c]{ sampleCluster(clusters[c]); });
+		for (std::size_t k = 0; k < clusters[c].meshes.size(); k++){
+			std::size_t m = clusters[c].meshes[k];
+			if (!_dirtyMeshes[m])
+				continue;
+			unsigned int segment = graph.add([&, m]{
+				prepClock::time_point segmentStart = prepClock::now();
+				_meshTables[m] = buildMeshTable(*meshPtrs[m]);
+				segmentMs[m] = std::chrono::duration<double, std::milli>(prepClock::now() - segmentStart).count();
+			});
+			graph.addDependency(sample, segment);
+		}
+		unsigned int coords = graph.add([&, c]{ processLocalCoords(clusters[c]); });
+		unsigned int fit = graph.add([&, c]{ fitFields(clusters[c]); });
+		unsigned int bake = graph.add([&, c]{ bakeFields(clusters[c]); });
+		graph.addDependency(coords, sample);
+		graph.addDependency(fit, coords);
+		graph.addDependency(bake, fit);
+		graph.addDependency(merge, bake);
+	}
+	for (std::size_t m = 0; m < _meshTables.size(); m++){
+		unsigned int iso = graph.add([&, m]{ processIsoValues(m, affected); });
+		graph.addDependency(iso, merge);
+	}
+
+	unsigned int numWorkers = 1;
+	withController([&](auto & controller){
+		numWorkers = controller.numWorkers();
+		graph.run(controller);
+	});
+
+	// the times of the stages are summed over the clusters, which ran concurrently
+	std::size_t numSegmented = 0, numEdges = 0, numCorners = 0;
+	double ms = 0.0;
+	for (std::size_t m = 0; m < _meshTables.size(); m++){
+		if (!_dirtyMeshes[m])
+			continue;
+		numSegmented++;
+		numEdges += _meshTables[m]->adjPtIdxTable.size() / 2;
+		numCorners += _meshTables[m]->adjFaceIdxTable.size();
+		ms += segmentMs[m];
+	}
+	logInfo("neighbours: %u meshes, %lu edges, %lu face corners, %.3f ms", (unsigned int)numSegmented,
+		(unsigned long)numEdges, (unsigned long)numCorners, ms);
+
+	std::size_t numTables = 0, numSamples = 0, numCenters = 0;
+	ms = 0.0;
+	for (std::size_t c = 0; c < clusters.size(); c++){
+		numTables += clusters[c].tables.size();
+		numSamples += clusters[c].numSamples;
+		for (std::size_t i = 0; i < clusters[c].tables.size(); i++)
+			numCenters += clusters[c].tables[i]->samplePosTable.size() / 3;
+		ms += clusters[c].sampleMs;
+	}
+	logInfo("sample surfaces: %u joints, %lu samples, %lu centers, %.3f ms", (unsigned int)numTables,
+		(unsigned long)numSamples, (unsigned long)numCenters, ms);
+
+	// the biggest systems first, as they were solved
+	std::vector<const hrbfFitReport *> reportOf(_jointNum, nullptr);
+	ms = 0.0;
+	for (std::size_t c = 0; c < clusters.size(); c++){
+		for (std::size_t i = 0; i < clusters[c].tables.size(); i++)
+			reportOf[clusters[c].tables[i]->jointIdx] = &clusters[c].reports[i];
+		ms += clusters[c].fitMs;
+	}
+	std::vector<std::size_t> order;
+	for (std::size_t i = 0; i < _jointTables.size(); i++){
+		if (_dirtyJoints[_jointTables[i]->jointIdx])
+			order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [](std::size_t a, std::size_t b){
+		return _jointTables[a]->samplePosTable.size() > _jointTables[b]->samplePosTable.size();
+	});
+	unsigned int numFailed = 0, numRegularized = 0;
+	for (std::size_t k = 0; k < order.size(); k++){
+		const jointTable & jTable = *_jointTables[order[k]];
+		const hrbfFitReport & report = *reportOf[jTable.jointIdx];
+		logInfo("fit joint %u: %u centers, %.3f ms, residual %.2e%s%s", jTable.jointIdx, report.numCenters, report.ms,
+			report.residual, report.regularized ? ", regularized" : "", report.ok ? "" : ", failed");
+		numFailed += !report.ok;
+		numRegularized += report.regularized;
+	}
+	logInfo("fit fields: %u joints, %u regularized, %u failed, %u threads, %.3f ms", (unsigned int)order.size(),
+		numRegularized, numFailed, numWorkers, ms);
+
+	if (_params.gridResolution > 0){
+		std::size_t numGrids = 0, memory = 0, numNodes = 0;
+		ms = 0.0;
+		for (std::size_t c = 0; c < clusters.size(); c++){
+			for (std::size_t i = 0; i < clusters[c].tables.size(); i++){
+				const jointTable & jTable = *clusters[c].tables[i];
+				if (!jTable.grid)
+					continue;
+				numGrids++;
+				memory += jTable.grid->memorySize();
+				numNodes += jTable.grid->numNodes();
+			}
+			ms += clusters[c].bakeMs;
+		}
+		logInfo("bake fields: %u joints, resolution %u, %lu nodes, %.2f MB, %.3f ms", (unsigned int)numGrids,
+			_params.gridResolution, (unsigned long)numNodes, memory / (1024.0 * 1024.0), ms);
+	}
+
+	ms = std::chrono::duration<double, std::milli>(prepClock::now() - start).count();
+	logInfo("prep: %u clusters, %u tasks, %u threads, %.3f ms", (unsigned int)clusters.size(), (unsigned int)graph.size(),
+		numWorkers, ms);
+
+	_dirtyJoints.assign(_jointNum, 0);
+	_dirtyMeshes.assign(_meshes.size(), 0);
 	return true;
 }
 
 
+void sceneData::findClusters(std::vector<prepCluster> & clusters){
+	// union find over the joints: a mesh joins the joints it is skinned to and the joints its points are assigned to
+	std::vector<unsigned int> parent(_jointNum);
+	for (unsigned int j = 0; j < _jointNum; j++)
+		parent[j] = j;
+	auto find = [&](unsigned int j){
+		while (parent[j] != j){
+			parent[j] = parent[parent[j]];
+			j = parent[j];
+		}
+		return j;
+	};
+
+	std::vector<int> firstJoint(_meshes.size(), -1);
+	std::list<meshPtr>::const_iterator iter = _meshes.begin();
+	for (std::size_t m = 0; iter != _meshes.end(); iter++, m++){
+		const meshData & mesh = **iter;
+		auto join = [&](int j){
+			if (j < 0 || (unsigned int)j >= _jointNum)
+				return;
+			if (firstJoint[m] < 0)
+				firstJoint[m] = j;
+			else
+				parent[find((unsigned int)j)] = find((unsigned int)firstJoint[m]);
+		};
+		for (unsigned int i = 0; i < mesh._numInfluences; i++)
+			join(mesh._jointIdxPtr[i]);
+		if (!_dirtyMeshes[m]){
+			const meshTable & mTable = *_meshTables[m];
+			for (std::size_t i = 0; i < mTable.ptJointIdxTable.size(); i++)
+				join((int)mTable.ptJointIdxTable[i]);
+		}
+	}
+
+	// a cluster for each set of joints, in the order of their first mesh. a mesh without joints is one on its own
+	std::vector<int> clusterOf(_jointNum, -1);
+	iter = _meshes.begin();
+	for (std::size_t m = 0; iter != _meshes.end(); iter++, m++){
+		int c = -1;
+		if (firstJoint[m] >= 0)
+			c = clusterOf[find((unsigned int)firstJoint[m])];
+		if (c < 0){
+			c = (int)clusters.size();
+			clusters.push_back(prepCluster());
+			if (firstJoint[m] >= 0)
+				clusterOf[find((unsigned int)firstJoint[m])] = c;
+		}
+		clusters[c].meshes.push_back(m);
+		clusters[c].meshPtrs.push_back(iter->get());
+	}
+}
+
+
+void sceneData::sampleCluster(prepCluster & cluster){
+	typedef std::chrono::steady_clock sampleClock;
+	sampleClock::time_point start = sampleClock::now();
+
+	// the joints of the points of the re-segmented meshes are redone, and they are all in this cluster
+	for (std::size_t m = 0; m < cluster.meshes.size(); m++){
+		if (_dirtyMeshes[cluster.meshes[m]])
+			markJoints(*_meshTables[cluster.meshes[m]]);
+	}
+
+	// faces of each mesh in the partition of each modified joint, and their area
+	std::size_t numMeshes = cluster.meshes.size();
+	std::vector<std::vector<std::vector<unsigned int>>> faceIdxs(numMeshes, std::vector<std::vector<unsigned int>>(_jointNum));
+	std::vector<std::vector<std::vector<double>>> faceAreas(numMeshes, std::vector<std::vector<double>>(_jointNum));
+	std::vector<double> jointAreas(_jointNum, 0.0);
+
+	for (std::size_t m = 0; m < numMeshes; m++){
+		const meshData & mesh = *cluster.meshPtrs[m];
+		const meshTable & mTable = *_meshTables[cluster.meshes[m]];
+
+		// the faces hold maya indices, the tables may be reordered
+		std::vector<unsigned int> ptJointIdxs(mesh._numPoints);
+		for (std::size_t i = 0; i < mTable.pointIdxTable.size(); i++)
+			ptJointIdxs[mTable.pointIdxTable[i]] = mTable.ptJointIdxTable[i];
+
+		// group the faces by the joint most of its vertices belong to
+		unsigned int faceStart = 0;
+		for (unsigned int f = 0; f < mesh._numFaces; f++){
+			unsigned int faceSize = mesh._faceSizePtr[f];
+			const int * face = &mesh._neighbourPtr[faceStart];
+			faceStart += faceSize;
+			if (faceSize < 3)
+				continue;
+
+			unsigned int jointIdx = 0, maxCount = 0;
+			for (unsigned int k = 0; k < faceSize; k++){
+				unsigned int j = ptJointIdxs[face[k]], count = 0;
+				for (unsigned int l = 0; l < faceSize; l++)
+					count += (ptJointIdxs[face[l]] == j);
+				if (count > maxCount){
+					maxCount = count;
+					jointIdx = j;
+				}
+			}
+			if (!_dirtyJoints[jointIdx])
+				continue;
+
+			// area of the triangle fan
+			const float * p0 = &mesh._posPtr[face[0] * 3];
+			double area = 0.0;
+			for (unsigned int k = 1; k + 1 < faceSize; k++){
+				const float * p1 = &mesh._posPtr[face[k] * 3];
+				const float * p2 = &mesh._posPtr[face[k + 1] * 3];
+				Vector e1(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+				Vector e2(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+				area += 0.5 * Cross(e1, e2).Length();
+			}
+			faceIdxs[m][jointIdx].push_back(f);
+			faceAreas[m][jointIdx].push_back(area);
+			jointAreas[jointIdx] += area;
+		}
+	}
+
+	// the samples of a joint are shared by its meshes by area
+	jointsTableFactory factory(_jointNum, _params.sampleSeed);
+	std::vector<unsigned char> made(_jointNum, 0);
+	withController([&](auto & controller){
+		for (std::size_t m = 0; m < numMeshes; m++){
+			std::vector<unsigned int> joints, counts;
+			for (unsigned int j = 0; j < _jointNum; j++){
+				if (faceIdxs[m][j].empty() || !(jointAreas[j] > 0.0))
+					continue;
+				double meshArea = 0.0;
+				for (std::size_t f = 0; f < faceAreas[m][j].size(); f++)
+					meshArea += faceAreas[m][j][f];
+				joints.push_back(j);
+				counts.push_back((unsigned int)(_params.samplesPerJoint * meshArea / jointAreas[j] + 0.5));
+				cluster.numSamples += counts.back();
+				if (!made[j]){
+					made[j] = 1;
+					cluster.tableMesh.push_back(cluster.meshes[m]);
+				}
+			}
+			factory.addJointTables(*cluster.meshPtrs[m], joints, counts, faceIdxs[m], faceAreas[m], controller);
+		}
+
+		// the uniform samples cluster, a blue noise subset fits as well with fewer centers
+		factory.selectCenters(_params.centersPerJoint, _params.centerRadius, controller);
+	});
+	cluster.tables = factory.getJointTable();
+
+	// the tables keep the rest pose matrix of their joint
+	std::list<jointPtr>::const_iterator jIter = _joints.begin();
+	for (; jIter != _joints.end(); jIter++){
+		for (std::size_t i = 0; i < cluster.tables.size(); i++){
+			if (cluster.tables[i]->jointIdx == (unsigned int)(*jIter)->_index)
+				cluster.tables[i]->matrix = (*jIter)->_bindTransform.GetMatrix();
+		}
+	}
+	cluster.sampleMs = std::chrono::duration<double, std::milli>(sampleClock::now() - start).count();
+}
+
+
+void sceneData::processLocalCoords(prepCluster & cluster){
+	// gather the points of each joint' partition over the meshes of the cluster
+	std::vector<std::vector<float>> points(_jointNum);
+	for (std::size_t m = 0; m < cluster.meshes.size(); m++){
+		const meshTable & mTable = *_meshTables[cluster.meshes[m]];
+		for (std::size_t i = 0; i < mTable.ptJointIdxTable.size(); i++){
+			if (!_dirtyJoints[mTable.ptJointIdxTable[i]])
+				continue;
+			const float * pos = &cluster.meshPtrs[m]->_posPtr[mTable.pointIdxTable[i] * 3];
+			points[mTable.ptJointIdxTable[i]].insert(points[mTable.ptJointIdxTable[i]].end(), pos, pos + 3);
+		}
+	}
+
+	// the frame of each new table, the joints in parallel
+	std::vector<const jointData *> jointPtrs(_jointNum, nullptr);
+	std::list<jointPtr>::const_iterator jIter = _joints.begin();
+	for (; jIter != _joints.end(); jIter++)
+		jointPtrs[(*jIter)->_index] = jIter->get();
+
+	std::vector<jointTable *> tables;
+	for (std::size_t i = 0; i < cluster.tables.size(); i++){
+		unsigned int jointIdx = cluster.tables[i]->jointIdx;
+		if (jointIdx < _jointNum && jointPtrs[jointIdx])
+			tables.push_back(cluster.tables[i].get());
+	}
+
+	// the mean and covariance of a big partition are reduced over the threads as well
+	withController([&](auto & controller){
+		controller.parallelFor(tables.size(), [&](std::size_t t){
+			jointTable & jTable = *tables[t];
+			const std::vector<float> & jointPoints = points[jTable.jointIdx];
+			pointMoments moments;
+			if (!jointPoints.empty())
+				moments.add(&jointPoints[0], jointPoints.size() / 3, 3, controller);
+			jointPtrs[jTable.jointIdx]->getLocalCoord(jointPoints, moments, jTable.coord);
+		});
+	});
+}
+
+
+void sceneData::fitFields(prepCluster & cluster){
+	const double tolerance = 1e-6;
+	typedef std::chrono::steady_clock fitClock;
+	fitClock::time_point start = fitClock::now();
+
+	// the biggest systems first, so the last ones to finish are small
+	std::vector<std::size_t> order(cluster.tables.size());
+	for (std::size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){
+		return cluster.tables[a]->samplePosTable.size() > cluster.tables[b]->samplePosTable.size();
+	});
+
+	cluster.reports.assign(cluster.tables.size(), hrbfFitReport());
+	withController([&](auto & controller){
+		controller.parallelFor(order.size(), [&](std::size_t k){
+			jointTable & jTable = *cluster.tables[order[k]];
+			if (!fitHrbf(jTable.samplePosTable, jTable.sampleNormalTable, tolerance, jTable.rbfPosParams, jTable.rbfNormalParams, cluster.reports[order[k]]))
+				return;
+
+			Vector diagonal = jTable.coord.bbox.second - jTable.coord.bbox.first;
+			float radius = _params.fieldRadius * diagonal.Length();
+			jTable.field.init(jTable.rbfPosParams, jTable.rbfNormalParams, radius > 0.0f ? radius : 1.0f);
+		});
+	});
+	cluster.fitMs = std::chrono::duration<double, std::milli>(fitClock::now() - start).count();
+}
+
+
+void sceneData::bakeFields(prepCluster & cluster){
+	if (_params.gridResolution == 0)
+		return;
+
+	typedef std::chrono::steady_clock bakeClock;
+	bakeClock::time_point start = bakeClock::now();
+
+	std::vector<jointTable *> tables;
+	for (std::size_t i = 0; i < cluster.tables.size(); i++){
+		if (cluster.tables[i]->field.size() > 0)
+			tables.push_back(cluster.tables[i].get());
+	}
+
+	// the joints in parallel, and the rows of each grid nested: the threads done with the small joints take rows
+	// of the big ones
+	withController([&](auto & controller){
+		controller.parallelFor(tables.size(), [&](std::size_t t){
+			std::shared_ptr<fieldGrid> grid = std::make_shared<fieldGrid>();
+			grid->bake(tables[t]->field, tables[t]->coord, _params.gridResolution, controller);
+			tables[t]->grid = grid;
+		});
+	});
+	cluster.bakeMs = std::chrono::duration<double, std::milli>(bakeClock::now() - start).count();
+}
+
+
+void sceneData::mergeClusters(std::vector<prepCluster> & clusters){
+	// the tables of the modified joints are replaced, a joint left without faces loses its table
+	std::size_t kept = 0;
+	for (std::size_t i = 0; i < _jointTables.size(); i++){
+		if (!_dirtyJoints[_jointTables[i]->jointIdx])
+			_jointTables[kept++] = _jointTables[i];
+	}
+	_jointTables.resize(kept);
+
+	// the new tables by the mesh which made them then by joint, the order of the meshes prepared one after another
+	std::vector<std::pair<std::size_t, jointTablePtr>> made;
+	for (std::size_t c = 0; c < clusters.size(); c++){
+		for (std::size_t i = 0; i < clusters[c].tables.size(); i++)
+			made.push_back(std::make_pair(clusters[c].tableMesh[i], clusters[c].tables[i]));
+	}
+	std::sort(made.begin(), made.end(), [](const std::pair<std::size_t, jointTablePtr> & a, const std::pair<std::size_t, jointTablePtr> & b){
+		return a.first != b.first ? a.first < b.first : a.second->jointIdx < b.second->jointIdx;
+	});
+	for (std::size_t i = 0; i < made.size(); i++)
+		_jointTables.push_back(made[i].second);
+}
+
+
+void sceneData::affectedJoints(std::vector<unsigned char> & affected){
+	// a point composes the fields of its joint, the joint' parent and children, any of them modified changes its iso value
+	affected = _dirtyJoints;
+	std::list<jointPtr>::const_iterator iter = _joints.begin();
+	for (; iter != _joints.end(); iter++){
+		int jointIdx = (*iter)->_index, parentIdx = (*iter)->_parentPos;
+		if (parentIdx >= 0 && (_dirtyJoints[jointIdx] || _dirtyJoints[parentIdx]))
+			affected[jointIdx] = affected[parentIdx] = 1;
+	}
+}
+
+
+void sceneData::processIsoValues(std::size_t meshIdx, const std::vector<unsigned char> & affected){
+	// sampled through the same path as the deformer, so a point at rest is already converged
+	fieldProjector projector;
+	projector.init();
+	projector.sampleIso(*_meshTables[meshIdx], &affected);
+}
+
+
 bool sceneData::modifyMeshNodeGroup(){
+	for (std::size_t m = 0; m < _dirtyMeshes.size(); m++){
+		if (_dirtyMeshes[m])
+			return true;
+	}
+	for (std::size_t j = 0; j < _dirtyJoints.size(); j++){
+		if (_dirtyJoints[j])
+			return true;
+	}
+	return false;
+}
+
+
+bool sceneData::assignPoints(std::size_t meshIdx, const std::vector<unsigned int> & pointIdxs, unsigned int jointIdx){
+	if (meshIdx >= _meshTables.size() || jointIdx >= _jointNum)
+		return false;
+	meshTable & mTable = *_meshTables[meshIdx];
+
+	// maya index to table slot
+	std::vector<int> slots(mTable.pointIdxTable.size(), -1);
+	for (std::size_t i = 0; i < mTable.pointIdxTable.size(); i++){
+		if (mTable.pointIdxTable[i] < slots.size())
+			slots[mTable.pointIdxTable[i]] = (int)i;
+	}
 
+	_dirtyJoints.resize(_jointNum, 0);
+	for (std::size_t k = 0; k < pointIdxs.size(); k++){
+		if (pointIdxs[k] >= slots.size() || slots[pointIdxs[k]] < 0)
+			return false;
+		unsigned int & ptJoint = mTable.ptJointIdxTable[slots[pointIdxs[k]]];
+		if (ptJoint == jointIdx)
+			continue;
+		_dirtyJoints[ptJoint] = 1;
+		_dirtyJoints[jointIdx] = 1;
+		ptJoint = jointIdx;
+		mTable.jointOffsetTable.clear();	// no longer grouped
+	}
+	return true;
+}
+
+
+void sceneData::markMeshModified(std::size_t meshIdx){
+	_dirtyMeshes.resize(_meshes.size(), 0);
+	if (meshIdx < _dirtyMeshes.size())
+		_dirtyMeshes[meshIdx] = 1;
+}
+
+
+void sceneData::markJoints(const meshTable & mTable){
+	// _dirtyJoints is sized by updateModified before, the cluster tasks each write the entries of their joints only
+	for (std::size_t i = 0; i < mTable.ptJointIdxTable.size(); i++)
+		_dirtyJoints[mTable.ptJointIdxTable[i]] = 1;
+}
+
+
+bool sceneData::checkTables(const std::vector<meshTablePtr> & meshTables, const std::vector<jointTablePtr> & jointTables){
+	if (meshTables.size() != _meshes.size())
+		return false;
+
+	std::list<meshPtr>::const_iterator mIter = _meshes.begin();
+	for (std::size_t m = 0; mIter != _meshes.end(); mIter++, m++){
+		const meshTable & mTable = *meshTables[m];
+		std::size_t nPoints = (*mIter)->_numPoints, nFaces = (*mIter)->_numFaces;
+		if (mTable._numElems != 4 || mTable.pointIdxTable.size() != nPoints || mTable.pointPosTable.size() != nPoints * 4
+			|| mTable.ptJointIdxTable.size() != nPoints || mTable.offsetTable.size() != nPoints + 1
+			|| mTable.offsetTable[0] != 0 || mTable.offsetTable.back() != mTable.adjPtIdxTable.size()
+			|| mTable.relaxWeightTable.size() != mTable.adjPtIdxTable.size()
+			|| mTable.faceOffsetTable.size() != nPoints + 1 || mTable.faceOffsetTable[0] != 0
+			|| mTable.faceOffsetTable.back() != mTable.adjFaceIdxTable.size()
+			|| !(mTable.jointOffsetTable.empty() || mTable.jointOffsetTable.size() == _jointNum + 1))
+			return false;
+		for (std::size_t i = 0; i < nPoints; i++){
+			if (mTable.pointIdxTable[i] >= nPoints || mTable.ptJointIdxTable[i] >= _jointNum
+				|| mTable.offsetTable[i] > mTable.offsetTable[i + 1] || mTable.faceOffsetTable[i] > mTable.faceOffsetTable[i + 1])
+				return false;
+		}
+		for (std::size_t k = 0; k < mTable.adjPtIdxTable.size(); k++){
+			if (mTable.adjPtIdxTable[k] >= nPoints)
+				return false;
+		}
+		for (std::size_t k = 0; k < mTable.adjFaceIdxTable.size(); k++){
+			if (mTable.adjFaceIdxTable[k] >= nFaces)
+				return false;
+		}
+		if (!mTable.jointOffsetTable.empty()){
+			if (mTable.jointOffsetTable[0] != 0 || mTable.jointOffsetTable.back() != nPoints)
+				return false;
+			for (std::size_t j = 0; j < _jointNum; j++){
+				if (mTable.jointOffsetTable[j] > mTable.jointOffsetTable[j + 1])
+					return false;
+			}
+		}
+
+		const skinTable & skin = mTable.skin;
+		std::size_t numWeights = skin._numPadded * skin._numSlots;
+		if (skin._numPoints != nPoints || skin._numPadded < nPoints || skin._numPadded % skinTable::blockSize != 0
+			|| skin._restX.size() != skin._numPadded || skin._restY.size() != skin._numPadded || skin._restZ.size() != skin._numPadded
+			|| skin._joints.size() != numWeights || skin._weights.size() != numWeights)
+			return false;
+		for (std::size_t k = 0; k < numWeights; k++){
+			if (skin._joints[k] < 0 || (unsigned int)skin._joints[k] >= _jointNum)
+				return false;
+		}
+	}
+
+	for (std::size_t i = 0; i < jointTables.size(); i++){
+		const jointTable & jTable = *jointTables[i];
+		std::size_t numCenters = jTable.rbfPosParams.size() / 4;
+		if (jTable.jointIdx >= _jointNum || jTable.rbfPosParams.size() != numCenters * 4 || jTable.rbfNormalParams.size() != numCenters * 3
+			|| jTable.samplePosTable.size() != jTable.sampleNormalTable.size())
+			return false;
+		if (jTable.grid){
+			// the lookup interpolates between two nodes on each axis
+			const fieldGrid & grid = *jTable.grid;
+			if (grid._res[0] < 2 || grid._res[1] < 2 || grid._res[2] < 2
+				|| grid._nodes.size() != (std::size_t)grid._res[0] * grid._res[1] * grid._res[2] * 4)
+				return false;
+		}
+	}
 	return true;
 }
 
 
 bool sceneData::writeToBuffer(){
+	if (_params.bufferPath.empty())
+		return true;
+
+	typedef std::chrono::steady_clock bufferClock;
+	bufferClock::time_point start = bufferClock::now();
+	if (!sceneBuffer::write(_params.bufferPath)){
+		logInfo("scene buffer: could not write %s", _params.bufferPath.c_str());
+		return false;
+	}
+	double ms = std::chrono::duration<double, std::milli>(bufferClock::now() - start).count();
+	logInfo("scene buffer: wrote %s, %.3f ms", _params.bufferPath.c_str(), ms);
+	return true;
+}
+
+
+bool sceneData::readFromBuffer(const std::string & path){
+	typedef std::chrono::steady_clock bufferClock;
+	bufferClock::time_point start = bufferClock::now();
+	if (!sceneBuffer::read(path)){
+		logInfo("scene buffer: %s is not a scene buffer of the loaded scene", path.c_str());
+		return false;
+	}
+	double ms = std::chrono::duration<double, std::milli>(bufferClock::now() - start).count();
+	logInfo("scene buffer: mapped %s, %u mesh tables, %u joint tables, %.3f ms", path.c_str(),
+		(unsigned int)_meshTables.size(), (unsigned int)_jointTables.size(), ms);
 	return true;
 }
 
@@ -37,4 +723,43 @@ bool sceneData::fininalPrep(){
 }
 
 
+void sceneData::clear(){
+	_joints.clear();
+	_meshes.clear();
+	_meshTables.clear();
+	_jointTables.clear();
+	_dirtyJoints.clear();
+	_dirtyMeshes.clear();
+	_jointNum = 0;
+	_meshNum = 0;
+}
+
 
+jointData * sceneData::findJoint(std::size_t hashCode){
+	std::list<jointPtr>::const_iterator iter = _joints.begin();
+	for (; iter != _joints.end(); iter++){
+		if ((*iter)->_hashCode == hashCode)
+			return iter->get();
+	}
+	return nullptr;
+}
+
+
+jointData * sceneData::findJoint(const std::string & name){
+	std::list<jointPtr>::const_iterator iter = _joints.begin();
+	for (; iter != _joints.end(); iter++){
+		if ((*iter)->_name == name)
+			return iter->get();
+	}
+	return nullptr;
+}
+
+
+int sceneData::findMesh(const std::string & name){
+	std::list<meshPtr>::const_iterator iter = _meshes.begin();
+	for (int m = 0; iter != _meshes.end(); iter++, m++){
+		if ((*iter)->_name == name)
+			return m;
+	}
+	return -1;
+}
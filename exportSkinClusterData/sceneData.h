@@ -2,40 +2,107 @@
 #define SCENEDATA_H
 
 #include <list>
+#include <string>
+#include <vector>
+#include <memory>
 
-#include "common.h"
 #include "meshData.h"
 #include "jointData.h"
+#include "jointHierarchy.h"
+#include "Table.h"
+#include "sceneSource.h"
 
-class sceneData { 
-public: 
+// user parameters of the prep stages
+class prepParams{
+public:
+	prepParams():gridResolution(0), order(ORDER_MAYA), maxInfluences(sparseWeights::maxSlots), quantizeWeights(false),
+		samplesPerJoint(1000), sampleSeed(0), centersPerJoint(250), centerRadius(0.0f),
+		fieldRadius(0.25f), cacheDir(), cacheLimit(0), bufferPath(){}
+
+	unsigned int gridResolution;	// nodes along the longest axis of the baked joint fields, 0 evaluates the hrbf directly
+	pointOrder order;				// order of the points in the mesh tables
+	unsigned int maxInfluences;		// influences kept for each point, at most sparseWeights::maxSlots
+	bool quantizeWeights;			// store the kept weights in 16 bits
+	unsigned int samplesPerJoint;	// surface samples drawn on the partition of each joint, over all the meshes
+	unsigned int sampleSeed;		// the samples only depend on the seed, not on the number of threads
+	unsigned int centersPerJoint;	// hrbf centers kept of the samples of each joint by sample elimination, 0 keeps them all
+	float centerRadius;				// when > 0, poisson disk selection of the centers with this radius instead
+	float fieldRadius;				// support of the compact field outside the surface, fraction of the joint' partition bbox diagonal
+	std::string cacheDir;			// directory of the prep cache, empty disables it
+	std::size_t cacheLimit;			// bytes kept in the cache directory, the least recently used entries go first, 0 is no limit
+	std::string bufferPath;			// file writeToBuffer writes the prepared tables to for rbfDeform, empty writes none
+};
+
+
+class sceneData {
+public:
 	typedef std::unique_ptr<jointData> jointPtr;
 	typedef std::unique_ptr<meshData> meshPtr;
+	typedef std::shared_ptr<meshTable> meshTablePtr;
+	typedef std::shared_ptr<jointTable> jointTablePtr;
 
 public:
-	static sceneData *getInstance (){ 
-		if (0 == _instance) { 
-			_instance = new sceneData; 
-		} 
-		return _instance; 
+	static sceneData *getInstance (){
+		if (0 == _instance) {
+			_instance = new sceneData;
+		}
+		return _instance;
 	}
 
-	static bool	processNeighbours();
-	static bool	processSamples();
-	static bool	modifyMeshNodeGroup();	// TODO modify the selection of vertices of some segmented mesh
-	static bool writeToBuffer();
+	static bool	loadScene(sceneSource & source);	// clear the scene and fill it from the source at rest pose
+	static bool	updateJoints();						// compose the joints' global transforms from the local ones
+	static bool	prepScene();						// the tables of the scene from the prep cache, or processSamples
+	static bool	processSamples();						// segment, sample, fit, bake and sample the iso values of every mesh and joint
+	static bool	updateModified();						// the same for the modified meshes and joints only, the clusters concurrently
+	static bool	modifyMeshNodeGroup();	// true while edits of assignPoints or markMeshModified wait for updateModified
+
+	// edits, picked up by the next updateModified. assignPoints moves points ( maya indices ) to the partition of a joint,
+	// markMeshModified re-segments a mesh whose weights changed, which drops the points assigned on it
+	static bool	assignPoints(std::size_t meshIdx, const std::vector<unsigned int> & pointIdxs, unsigned int jointIdx);
+	static void	markMeshModified(std::size_t meshIdx);
+	static bool writeToBuffer();						// the tables to _params.bufferPath, see sceneBuffer
+	static bool readFromBuffer(const std::string & path);	// the tables of the loaded scene mapped from a file of writeToBuffer
+	// tables read from a file fit the loaded scene: their sizes, and every index the prep and the deformer follow is in range
+	static bool checkTables(const std::vector<meshTablePtr> & meshTables, const std::vector<jointTablePtr> & jointTables);
 	static bool fininalPrep();
+	static void clear();
+
+	static jointData * findJoint(std::size_t hashCode);
+	static jointData * findJoint(const std::string & name);
+	static int findMesh(const std::string & name);	// index of the mesh in _meshes, -1 when there is none
 
 public:
 	static std::list<jointPtr> _joints;
 	static std::list<meshPtr> _meshes;
 	static unsigned int _jointNum;
 	static unsigned int _meshNum;
+	static prepParams _params;
+	static jointHierarchy _hierarchy;	// the joints parents first, built by loadScene
+
+	static std::vector<meshTablePtr> _meshTables;	// one table for each mesh in _meshes, same order
+	static std::vector<jointTablePtr> _jointTables;
+	static std::vector<unsigned char> _dirtyJoints;	// joints whose partition changed since their fields were fitted
+	static std::vector<unsigned char> _dirtyMeshes;	// meshes to re-segment
 
 private:
+	class prepCluster;	// meshes joined by their joints, see sceneData.cpp
+
+	static meshTablePtr buildMeshTable(const meshData & mesh);
+	static void markJoints(const meshTable & mTable);	// the joints of the points of the table are to be redone
+
+	// the stages of updateModified, the ones after findClusters are the tasks of its graph
+	static void findClusters(std::vector<prepCluster> & clusters);
+	static void sampleCluster(prepCluster & cluster);
+	static void processLocalCoords(prepCluster & cluster);
+	static void fitFields(prepCluster & cluster);		// solve the hrbf of each joint table from its centers, the joints in parallel
+	static void bakeFields(prepCluster & cluster);
+	static void mergeClusters(std::vector<prepCluster> & clusters);	// the new tables into _jointTables
+	static void affectedJoints(std::vector<unsigned char> & affected);	// the joints whose points get a new iso value
+	static void processIsoValues(std::size_t meshIdx, const std::vector<unsigned char> & affected);	// rest pose field value of each point
+
 	sceneData(){};
 	static sceneData *_instance;
-}; 
+};
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,25 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef SCENESOURCE_H
+#define SCENESOURCE_H
+
+class sceneData;
+
+// abstract class, the only place where the host application ( maya, file, ... ) talks to the scene
+class sceneSource{
+public:
+	virtual ~sceneSource(){}
+
+	// insert the joints, the skin meshes and their weights at rest pose into the scene
+	virtual bool loadScene(sceneData * scene) = 0;
+
+	// update the local transform of every joint in the scene to the current pose
+	virtual bool loadPose(sceneData * scene) = 0;
+
+	// write the deformed positions stored in the scene' mesh tables back to the host
+	virtual bool writeMeshes(const sceneData * scene) = 0;
+};
+
+#endif
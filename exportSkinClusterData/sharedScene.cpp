@@ -0,0 +1,524 @@
+#include <string.h>
+#include <new>
+#include <vector>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "sharedScene.h"
+#include "sceneBuffer.h"
+#include "prepCache.h"
+#include "sceneData.h"
+#include "logger.h"
+
+// the atomics are shared by processes, they must not hide a lock in the process which created them
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "the triple buffers need lock free atomics");
+
+static inline std::size_t alignUp(std::size_t offset){
+	return (offset + SIMD_ALIGN - 1) / SIMD_ALIGN * SIMD_ALIGN;
+}
+
+static uint32_t currentPid(){
+#if defined(_WIN32)
+	return (uint32_t)GetCurrentProcessId();
+#else
+	return (uint32_t)getpid();
+#endif
+}
+
+#if defined(_WIN32)
+static const unsigned int detachWaitMs = 2000;	// for the worker of an earlier publish to let its segments go
+#endif
+
+static std::string segmentName(const std::string & name, const char * part){
+#if defined(_WIN32)
+	return "Local\\implicitSkinning." + name + "." + part;
+#else
+	return "/implicitSkinning." + name + "." + part;
+#endif
+}
+
+
+bool sharedSegment::create(const std::string & name, std::size_t size){
+	close();
+#if defined(_WIN32)
+	// a name is only freed with the last handle. a worker still holding the segment of an earlier publish lets it
+	// go once it sees that publish closed, which the host did before creating the new one
+	HANDLE mapping = NULL;
+	for (unsigned int waited = 0; ; waited++){
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, name.c_str());
+		if (!mapping || GetLastError() != ERROR_ALREADY_EXISTS)
+			break;
+		CloseHandle(mapping);
+		mapping = NULL;
+		if (waited == detachWaitMs)
+			return false;
+		Sleep(1);
+	}
+	if (!mapping)
+		return false;
+	_data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size);
+	if (!_data){
+		CloseHandle(mapping);
+		return false;
+	}
+	_mapping = mapping;
+#else
+	shm_unlink(name.c_str());
+	int segment = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (segment < 0)
+		return false;
+	void * data = MAP_FAILED;
+	if (ftruncate(segment, (off_t)size) == 0)
+		data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0);
+	::close(segment);
+	if (data == MAP_FAILED){
+		shm_unlink(name.c_str());
+		return false;
+	}
+	_data = (unsigned char *)data;
+#endif
+	_size = size;
+	_name = name;
+	_owner = true;
+	return true;
+}
+
+
+bool sharedSegment::open(const std::string & name, bool copyOnWrite){
+	close();
+#if defined(_WIN32)
+	DWORD access = copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ | FILE_MAP_WRITE;
+	HANDLE mapping = OpenFileMappingA(access, FALSE, name.c_str());
+	if (!mapping)
+		return false;
+	_data = (unsigned char *)MapViewOfFile(mapping, access, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (!_data || VirtualQuery(_data, &info, sizeof(info)) == 0){
+		if (_data)
+			UnmapViewOfFile(_data);
+		_data = nullptr;
+		CloseHandle(mapping);
+		return false;
+	}
+	_mapping = mapping;
+	_size = info.RegionSize;
+#else
+	int segment = shm_open(name.c_str(), copyOnWrite ? O_RDONLY : O_RDWR, 0);
+	if (segment < 0)
+		return false;
+	struct stat info;
+	void * data = MAP_FAILED;
+	if (fstat(segment, &info) == 0 && info.st_size > 0)
+		data = mmap(nullptr, (std::size_t)info.st_size, PROT_READ | PROT_WRITE, copyOnWrite ? MAP_PRIVATE : MAP_SHARED, segment, 0);
+	::close(segment);
+	if (data == MAP_FAILED)
+		return false;
+	_data = (unsigned char *)data;
+	_size = (std::size_t)info.st_size;
+#endif
+	_name = name;
+	_owner = false;
+	return true;
+}
+
+
+void sharedSegment::close(){
+#if defined(_WIN32)
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle((HANDLE)_mapping);
+	_mapping = nullptr;
+#else
+	if (_data)
+		munmap(_data, _size);
+	if (_owner)
+		shm_unlink(_name.c_str());
+#endif
+	_data = nullptr;
+	_size = 0;
+	_owner = false;
+}
+
+
+std::size_t tripleBuffer::memorySize(std::size_t slotBytes){
+	return alignUp(sizeof(state)) + 3 * alignUp(slotBytes);
+}
+
+
+void tripleBuffer::init(unsigned char * memory, std::size_t slotBytes){
+	// the consumer reads slot 0, the producer fills slot 2, slot 1 is in the middle and not fresh
+	_state = new(memory) state;
+	_state->middle.store(1, std::memory_order_relaxed);
+	_state->back = 2;
+	_state->front = 0;
+	_state->slotBytes = slotBytes;
+	_slots = memory + alignUp(sizeof(state));
+	_slotBytes = alignUp(slotBytes);
+}
+
+
+bool tripleBuffer::attach(unsigned char * memory, std::size_t slotBytes){
+	_state = (state *)memory;
+	_slots = memory + alignUp(sizeof(state));
+	_slotBytes = alignUp(slotBytes);
+	return _state->slotBytes == slotBytes;
+}
+
+
+unsigned char * tripleBuffer::writeSlot() const{
+	return _slots + _state->back * _slotBytes;
+}
+
+
+void tripleBuffer::publish(){
+	// release: the slot is written before the consumer can get it
+	uint32_t old = _state->middle.exchange(_state->back | freshBit, std::memory_order_acq_rel);
+	_state->back = old & ~freshBit;
+}
+
+
+const unsigned char * tripleBuffer::readLatest(){
+	if (!(_state->middle.load(std::memory_order_acquire) & freshBit))
+		return nullptr;
+	uint32_t old = _state->middle.exchange(_state->front, std::memory_order_acq_rel);
+	_state->front = old & ~freshBit;
+	return _slots + _state->front * _slotBytes;
+}
+
+
+// layout of <name>.scene: the header, the joints, the meshes, then the scene buffer of the tables
+static const char sceneMagic[4] = { 'I', 'S', 'K', 'S' };
+static const char framesMagic[4] = { 'I', 'S', 'K', 'F' };
+static const uint32_t sharedVersion = 2;
+static const std::size_t nameSize = 64;
+static const std::size_t slotHeaderSize = SIMD_ALIGN;	// the frame number, the data starts on the next cache line
+
+struct sceneHeader{
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	numJoints;
+	uint32_t	numMeshes;
+	uint64_t	bufferOffset;
+	uint64_t	bufferSize;
+	uint64_t	sceneKey;		// prepCache::contentKey of the host' scene, which the worker can not hash
+};
+
+struct sharedJoint{
+	int32_t		index;
+	int32_t		parentPos;
+	uint64_t	hashCode;
+	float		bind[4][4];		// global transform at rest pose
+	char		name[nameSize];
+};
+
+struct sharedMesh{
+	uint32_t	numPoints;
+	uint32_t	numFaces;
+	uint32_t	method;
+	uint32_t	pad;
+	char		name[nameSize];
+};
+
+struct sharedScene::framesHeader{
+	char					magic[4];
+	uint32_t				version;
+	uint32_t				numJoints;
+	uint32_t				hostPid;	// the worker stops when this process is gone
+	uint64_t				numPoints;
+	uint64_t				posesOffset;
+	uint64_t				pointsOffset;
+	std::atomic<uint32_t>	closed;		// set by the host when the worker is to stop
+};
+
+static inline std::size_t poseSlotBytes(unsigned int numJoints){ return slotHeaderSize + numJoints * 16 * sizeof(float); }
+static inline std::size_t pointSlotBytes(std::size_t numPoints){ return slotHeaderSize + numPoints * 3 * sizeof(float); }
+
+
+bool sharedScene::publish(const std::string & name){
+	close();
+	_numJoints = sceneData::_jointNum;
+	_numPoints = 0;
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++)
+		_numPoints += sceneData::_meshTables[m]->pointIdxTable.size();
+
+	// the static data, written once
+	std::size_t rigBytes = sizeof(sceneHeader) + _numJoints * sizeof(sharedJoint) + sceneData::_meshes.size() * sizeof(sharedMesh);
+	std::size_t bufferOffset = alignUp(rigBytes), bufferSize = sceneBuffer::size();
+	_scene = std::make_shared<sharedSegment>();
+	if (!_scene->create(segmentName(name, "scene"), bufferOffset + bufferSize)){
+		_scene.reset();
+		return false;
+	}
+	unsigned char * data = _scene->data();
+	sceneHeader * header = (sceneHeader *)data;
+	memcpy(header->magic, sceneMagic, 4);
+	header->version = sharedVersion;
+	header->numJoints = _numJoints;
+	header->numMeshes = (uint32_t)sceneData::_meshes.size();
+	header->bufferOffset = bufferOffset;
+	header->bufferSize = bufferSize;
+	header->sceneKey = prepCache::contentKey();
+
+	sharedJoint * joints = (sharedJoint *)(data + sizeof(sceneHeader));
+	std::list<sceneData::jointPtr>::const_iterator jIter = sceneData::_joints.begin();
+	for (; jIter != sceneData::_joints.end(); jIter++){
+		const jointData & joint = **jIter;
+		sharedJoint & shared = joints[joint._index];
+		shared.index = joint._index;
+		shared.parentPos = joint._parentPos;
+		shared.hashCode = joint._hashCode;
+		memcpy(shared.bind, joint._bindTransform.GetMatrix().m, sizeof(shared.bind));
+		strncpy(shared.name, joint._name.c_str(), nameSize - 1);
+	}
+	sharedMesh * meshes = (sharedMesh *)(joints + _numJoints);
+	std::list<sceneData::meshPtr>::const_iterator mIter = sceneData::_meshes.begin();
+	for (; mIter != sceneData::_meshes.end(); mIter++, meshes++){
+		meshes->numPoints = (*mIter)->_numPoints;
+		meshes->numFaces = (*mIter)->_numFaces;
+		meshes->method = (uint32_t)(*mIter)->_skinMethod;
+		strncpy(meshes->name, (*mIter)->_name.c_str(), nameSize - 1);
+	}
+	if (!sceneBuffer::write(data + bufferOffset, bufferSize)){
+		close();
+		return false;
+	}
+
+	// the frames, a pose and a point triple buffer
+	std::size_t posesOffset = alignUp(sizeof(framesHeader));
+	std::size_t pointsOffset = posesOffset + tripleBuffer::memorySize(poseSlotBytes(_numJoints));
+	_framesSegment = std::make_shared<sharedSegment>();
+	if (!_framesSegment->create(segmentName(name, "frames"), pointsOffset + tripleBuffer::memorySize(pointSlotBytes(_numPoints)))){
+		close();
+		return false;
+	}
+	data = _framesSegment->data();
+	_frames = new(data) framesHeader;
+	memcpy(_frames->magic, framesMagic, 4);
+	_frames->version = sharedVersion;
+	_frames->numJoints = _numJoints;
+	_frames->hostPid = currentPid();
+	_frames->numPoints = _numPoints;
+	_frames->posesOffset = posesOffset;
+	_frames->pointsOffset = pointsOffset;
+	_frames->closed.store(0, std::memory_order_release);
+	_poses.init(data + posesOffset, poseSlotBytes(_numJoints));
+	_points.init(data + pointsOffset, pointSlotBytes(_numPoints));
+
+	logInfo("shared scene: published %s, %.2f MB of tables", name.c_str(), bufferSize / (1024.0 * 1024.0));
+	return true;
+}
+
+
+bool sharedScene::sendPose(int frame){
+	if (!_frames || sceneData::_jointNum != _numJoints)
+		return false;
+	unsigned char * slot = _poses.writeSlot();
+	*(int32_t *)slot = frame;
+	float * matrices = (float *)(slot + slotHeaderSize);
+	std::list<sceneData::jointPtr>::const_iterator iter = sceneData::_joints.begin();
+	for (; iter != sceneData::_joints.end(); iter++)
+		memcpy(&matrices[(*iter)->_index * 16], (*iter)->_localTransform.GetMatrix().m, 16 * sizeof(float));
+	_poses.publish();
+	return true;
+}
+
+
+bool sharedScene::receivePoints(int & frame){
+	if (!_frames)
+		return false;
+	const unsigned char * slot = _points.readLatest();
+	if (!slot)
+		return false;
+	frame = *(const int32_t *)slot;
+
+	const float * points = (const float *)(slot + slotHeaderSize);
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++){
+		meshTable & mTable = *sceneData::_meshTables[m];
+		std::size_t nPoints = mTable.pointIdxTable.size();
+		for (std::size_t i = 0; i < nPoints; i++, points += 3){
+			float * dst = &mTable.pointPosTable[i * mTable._numElems];
+			dst[0] = points[0];
+			dst[1] = points[1];
+			dst[2] = points[2];
+		}
+	}
+	return true;
+}
+
+
+void sharedScene::close(){
+	if (_frames && _frames->hostPid == currentPid())
+		_frames->closed.store(1, std::memory_order_release);
+	else if (_frames && hostExited()){
+		// nobody else removes the segments of a host which crashed
+		_scene->takeOwnership();
+		_framesSegment->takeOwnership();
+	}
+#if defined(_WIN32)
+	if (_host)
+		CloseHandle((HANDLE)_host);
+#endif
+	_host = nullptr;
+	_frames = nullptr;
+	_pose = nullptr;
+	_framesSegment.reset();
+	_scene.reset();
+}
+
+
+bool sharedScene::attach(const std::string & name){
+	_frames = nullptr;
+	_scene = std::make_shared<sharedSegment>();
+	_framesSegment = std::make_shared<sharedSegment>();
+	if (!_scene->open(segmentName(name, "scene"), true) || !_framesSegment->open(segmentName(name, "frames"), false))
+		return false;
+
+	// the scene, then its tables used in place in the segment
+	const sceneHeader * header = (const sceneHeader *)_scene->data();
+	if (_scene->size() < sizeof(sceneHeader) || memcmp(header->magic, sceneMagic, 4) != 0 || header->version != sharedVersion
+		|| header->bufferOffset < sizeof(sceneHeader) + header->numJoints * sizeof(sharedJoint) + header->numMeshes * sizeof(sharedMesh)
+		|| header->bufferOffset > _scene->size() || header->bufferSize > _scene->size() - header->bufferOffset)
+		return false;
+	if (!sceneData::loadScene(*this))
+		return false;
+	const sharedJoint * joints = (const sharedJoint *)(_scene->data() + sizeof(sceneHeader));
+	std::list<sceneData::jointPtr>::iterator jIter = sceneData::_joints.begin();
+	for (; jIter != sceneData::_joints.end(); jIter++)
+		(*jIter)->_bindTransform = Transform(joints[(*jIter)->_index].bind);	// as published, not recomposed
+	if (!sceneBuffer::read(_scene->data() + header->bufferOffset, (std::size_t)header->bufferSize, _scene, header->sceneKey))
+		return false;
+
+	// the frames
+	_numJoints = header->numJoints;
+	_numPoints = 0;
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++)
+		_numPoints += sceneData::_meshTables[m]->pointIdxTable.size();
+	framesHeader * frames = (framesHeader *)_framesSegment->data();
+	if (_framesSegment->size() < sizeof(framesHeader) || memcmp(frames->magic, framesMagic, 4) != 0 || frames->version != sharedVersion
+		|| frames->numJoints != _numJoints || frames->numPoints != _numPoints
+		|| frames->posesOffset + tripleBuffer::memorySize(poseSlotBytes(_numJoints)) > _framesSegment->size()
+		|| frames->pointsOffset + tripleBuffer::memorySize(pointSlotBytes(_numPoints)) > _framesSegment->size()
+		|| !_poses.attach(_framesSegment->data() + frames->posesOffset, poseSlotBytes(_numJoints))
+		|| !_points.attach(_framesSegment->data() + frames->pointsOffset, pointSlotBytes(_numPoints)))
+		return false;
+#if defined(_WIN32)
+	_host = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)frames->hostPid);
+	if (!_host)
+		return false;
+#endif
+	_frames = frames;
+	_pose = nullptr;
+	return true;
+}
+
+
+bool sharedScene::receivePose(int & frame){
+	if (!_frames)
+		return false;
+	const unsigned char * slot = _poses.readLatest();
+	if (!slot)
+		return false;
+	frame = _poseFrame = *(const int32_t *)slot;
+	_pose = (const float *)(slot + slotHeaderSize);
+	return true;
+}
+
+
+bool sharedScene::sendPoints(int frame){
+	if (!_frames)
+		return false;
+	unsigned char * slot = _points.writeSlot();
+	*(int32_t *)slot = frame;
+	float * points = (float *)(slot + slotHeaderSize);
+	std::size_t total = 0;
+	for (std::size_t m = 0; m < sceneData::_meshTables.size(); m++){
+		const meshTable & mTable = *sceneData::_meshTables[m];
+		std::size_t nPoints = mTable.pointIdxTable.size();
+		if ((total += nPoints) > _numPoints)
+			return false;
+		for (std::size_t i = 0; i < nPoints; i++, points += 3){
+			const float * pos = &mTable.pointPosTable[i * mTable._numElems];
+			points[0] = pos[0];
+			points[1] = pos[1];
+			points[2] = pos[2];
+		}
+	}
+	_points.publish();
+	return true;
+}
+
+
+bool sharedScene::closed() const{
+	return !_frames || _frames->closed.load(std::memory_order_acquire) != 0 || hostExited();
+}
+
+
+bool sharedScene::hostExited() const{
+#if defined(_WIN32)
+	return !_host || WaitForSingleObject((HANDLE)_host, 0) == WAIT_OBJECT_0;
+#else
+	return kill((pid_t)_frames->hostPid, 0) != 0 && errno == ESRCH;
+#endif
+}
+
+
+bool sharedScene::loadScene(sceneData * scene){
+	const sceneHeader * header = (const sceneHeader *)_scene->data();
+	const sharedJoint * joints = (const sharedJoint *)(_scene->data() + sizeof(sceneHeader));
+	const sharedMesh * meshes = (const sharedMesh *)(joints + header->numJoints);
+
+	// the rest local transforms, the scene composes them back into the bind pose
+	for (uint32_t j = 0; j < header->numJoints; j++){
+		const sharedJoint & shared = joints[j];
+		if (shared.index != (int32_t)j || shared.parentPos >= (int32_t)header->numJoints)
+			return false;
+		sceneData::jointPtr jData(new jointData());
+		jData->_index		= shared.index;
+		jData->_parentPos	= shared.parentPos;
+		jData->_hashCode	= (std::size_t)shared.hashCode;
+		jData->_name.assign(shared.name, strnlen(shared.name, nameSize));
+		Transform bind(shared.bind);
+		jData->_localTransform = shared.parentPos < 0 ? bind : Inverse(Transform(joints[shared.parentPos].bind)) * bind;
+		scene->_joints.push_back(std::move(jData));
+	}
+	scene->_jointNum = header->numJoints;
+
+	// the meshes are only their point and face counts, the tables hold everything the deformer reads
+	for (uint32_t m = 0; m < header->numMeshes; m++){
+		sceneData::meshPtr mPtr(new meshData());
+		mPtr->_name.assign(meshes[m].name, strnlen(meshes[m].name, nameSize));
+		mPtr->_numPoints = meshes[m].numPoints;
+		mPtr->_numFaces = meshes[m].numFaces;
+		mPtr->_skinMethod = (skinMethod)meshes[m].method;
+		scene->_meshes.push_back(std::move(mPtr));
+	}
+	return true;
+}
+
+
+bool sharedScene::loadPose(sceneData * scene){
+	if (!_pose)
+		return false;
+	std::list<sceneData::jointPtr>::iterator iter = scene->_joints.begin();
+	for (; iter != scene->_joints.end(); iter++){
+		const float (*matrix)[4] = (const float (*)[4])&_pose[(*iter)->_index * 16];
+		(*iter)->_localTransform = Transform(matrix);
+	}
+	return true;
+}
+
+
+bool sharedScene::writeMeshes(const sceneData *){
+	return sendPoints(_poseFrame);
+}
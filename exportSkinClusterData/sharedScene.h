@@ -0,0 +1,135 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef SHAREDSCENE_H
+#define SHAREDSCENE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "sceneSource.h"
+
+// named shared memory, removed when the process which created it closes it
+class sharedSegment{
+public:
+	sharedSegment():_data(nullptr), _size(0), _owner(false), _mapping(nullptr){}
+	~sharedSegment(){ close(); }
+
+	// a new segment of size bytes, zeroed, in place of the one of the same name. on windows the one of the same name
+	// has to be closed by every process first, create waits a while for them
+	bool create(const std::string & name, std::size_t size);
+
+	// the segment of name, its pages shared with the other processes or, copyOnWrite, copied on write
+	bool open(const std::string & name, bool copyOnWrite);
+
+	void close();
+
+	// the name is removed when this process closes the segment, for a worker whose host is gone
+	inline void takeOwnership(){ _owner = true; }
+
+	inline unsigned char * data() const { return _data; }
+	inline std::size_t size() const { return _size; }
+
+private:
+	sharedSegment(const sharedSegment &);
+	sharedSegment & operator=(const sharedSegment &);
+
+	unsigned char *	_data;
+	std::size_t		_size;
+	std::string		_name;
+	bool			_owner;
+	void *			_mapping;	// windows handle of the section
+};
+
+
+// control block of a single producer single consumer triple buffer of fixed size slots, in shared memory.
+// the producer fills the back slot then swaps it with the middle one, the consumer swaps its front slot with
+// the middle one when it is newer. neither ever waits for the other, the consumer gets the latest slot and
+// skips the ones it was too slow for
+class tripleBuffer{
+public:
+	static const uint32_t freshBit = 4;	// set on the middle slot index when it was published since the last read
+
+	// bytes of the control block and the slots
+	static std::size_t memorySize(std::size_t slotBytes);
+
+	tripleBuffer():_state(nullptr), _slots(nullptr), _slotBytes(0){}
+
+	// lay out the buffer in zeroed memory, by the process creating it
+	void init(unsigned char * memory, std::size_t slotBytes);
+	// use the buffer laid out in memory by init, false when it is not one of slotBytes
+	bool attach(unsigned char * memory, std::size_t slotBytes);
+
+	// producer, the slot to fill then publish
+	unsigned char * writeSlot() const;
+	void publish();
+
+	// consumer, the latest published slot, null when none was published since the last call
+	const unsigned char * readLatest();
+
+private:
+	struct state{
+		std::atomic<uint32_t>	middle;		// slot index | freshBit
+		uint32_t				back;		// written by the producer only
+		uint32_t				front;		// written by the consumer only
+		uint32_t				pad;
+		uint64_t				slotBytes;
+	};
+
+	state *			_state;
+	unsigned char *	_slots;
+	std::size_t		_slotBytes;
+};
+
+
+// transport between the host ( implicitSkinningPrep and rbfDeform ) and a deform worker process over two named
+// segments. <name>.scene holds the static data published once after the prep: the joints and meshes of the scene
+// and its tables as a scene buffer, which the worker maps copy on write and uses in place. <name>.frames holds
+// two triple buffers: the poses ( local matrix of each joint ) from the host to the worker, and the deformed
+// points ( table order, the meshes one after another ) back. the host never waits for the worker, the worker
+// stops when the host closes the channel or its process is gone, and then removes the segments it left
+class sharedScene : public sceneSource{
+public:
+	sharedScene():_numJoints(0), _numPoints(0), _frames(nullptr), _pose(nullptr), _poseFrame(0), _host(nullptr){}
+	~sharedScene(){ close(); }
+
+	// host side
+	bool publish(const std::string & name);	// the scene and tables of sceneData, replaces an earlier publish
+	bool sendPose(int frame);				// the local transforms of the joints of sceneData
+	bool receivePoints(int & frame);		// the latest deformed points into the mesh tables, false when none is new
+	void close();							// the worker stops, the segments are removed
+
+	// worker side, attach loads the scene and its tables into sceneData
+	bool attach(const std::string & name);
+	bool receivePose(int & frame);			// the latest pose, false when none is new
+	bool sendPoints(int frame);				// the points of the mesh tables
+	bool closed() const;					// the host closed, published again or exited
+
+	// sceneSource of the worker: the published scene, the received pose, and writeMeshes sends the points
+	virtual bool loadScene(sceneData * scene);
+	virtual bool loadPose(sceneData * scene);
+	virtual bool writeMeshes(const sceneData * scene);
+
+	inline bool isOpen() const { return _frames != nullptr; }
+
+private:
+	struct framesHeader;
+
+	bool hostExited() const;
+
+	std::shared_ptr<sharedSegment>	_scene;
+	std::shared_ptr<sharedSegment>	_framesSegment;
+	unsigned int	_numJoints;
+	std::size_t		_numPoints;
+	framesHeader *	_frames;
+	tripleBuffer	_poses;
+	tripleBuffer	_points;
+	const float *	_pose;		// local matrices of the last pose received
+	int				_poseFrame;
+	void *			_host;		// windows handle of the host process, of a worker
+};
+
+#endif
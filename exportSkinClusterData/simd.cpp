@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#include "simd.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static void cpuid(int info[4], int leaf, int subLeaf){ __cpuidex(info, leaf, subLeaf); }
+static unsigned long long xgetbv0(){ return _xgetbv(0); }
+#else
+#include <cpuid.h>
+static void cpuid(int info[4], int leaf, int subLeaf){ __cpuid_count(leaf, subLeaf, info[0], info[1], info[2], info[3]); }
+static unsigned long long xgetbv0(){
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+}
+#endif
+
+static simdLevel detectSimdLevel(){
+	int info[4];
+	cpuid(info, 0, 0);
+	int maxLeaf = info[0];
+
+	cpuid(info, 1, 0);
+	bool sse4	 = (info[2] & (1 << 19)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx	 = (info[2] & (1 << 28)) != 0;
+	bool fma	 = (info[2] & (1 << 12)) != 0;
+	if (!sse4)
+		return SIMD_SCALAR;
+
+	// the os has to save the ymm / zmm registers too
+	unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+	if (!avx || !fma || (xcr0 & 0x6) != 0x6 || maxLeaf < 7)
+		return SIMD_SSE4;
+
+	cpuid(info, 7, 0);
+	bool avx2	 = (info[1] & (1 << 5)) != 0;
+	bool avx512f = (info[1] & (1 << 16)) != 0;
+	if (!avx2)
+		return SIMD_SSE4;
+	if (!avx512f || (xcr0 & 0xE6) != 0xE6)
+		return SIMD_AVX2;
+	return SIMD_AVX512;
+}
+
+
+simdLevel getMaxSimdLevel(){
+	static const simdLevel level = detectSimdLevel();
+	return level;
+}
+
+
+static simdLevel initSimdLevel(){
+	simdLevel level = getMaxSimdLevel();
+
+	const char * env = getenv("IMPLICIT_SKINNING_SIMD");
+	if (env){
+		for (int l = SIMD_SCALAR; l <= SIMD_AVX512; l++){
+			if (strcmp(env, getSimdLevelName((simdLevel)l)) == 0 && l < level)
+				level = (simdLevel)l;
+		}
+	}
+	return level;
+}
+
+
+static std::atomic<int> & currentLevel(){
+	static std::atomic<int> level(initSimdLevel());
+	return level;
+}
+
+
+simdLevel getSimdLevel(){
+	return (simdLevel)currentLevel().load(std::memory_order_relaxed);
+}
+
+
+void setSimdLevel(simdLevel level){
+	currentLevel().store(std::min(level, getMaxSimdLevel()), std::memory_order_relaxed);
+}
+
+
+const char * getSimdLevelName(simdLevel level){
+	switch (level){
+	case SIMD_SSE4:		return "sse4";
+	case SIMD_AVX2:		return "avx2";
+	case SIMD_AVX512:	return "avx512";
+	default:			return "scalar";
+	}
+}
@@ -0,0 +1,79 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <immintrin.h>
+
+// instruction sets the kernels are compiled for, the best one supported by the cpu is picked at run time
+enum simdLevel{
+	SIMD_SCALAR = 0,
+	SIMD_SSE4,
+	SIMD_AVX2,		// avx2 + fma
+	SIMD_AVX512		// avx512f
+};
+
+// detect the cpu once, the IMPLICIT_SKINNING_SIMD environment variable ( scalar, sse4, avx2, avx512 )
+// can lower the level to benchmark the kernels against each other
+simdLevel getSimdLevel();
+const char * getSimdLevelName(simdLevel level);
+// the same at run time, to check the kernels against each other. a level above the cpu's gives the cpu's,
+// the kernels pick their level at each call, so change it between their runs only
+void setSimdLevel(simdLevel level);
+simdLevel getMaxSimdLevel();
+
+// msvc accepts any intrinsic in any function, gcc and clang need the target on the function using it
+#if defined(__GNUC__)
+#define SIMD_TARGET_SSE4	__attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2	__attribute__((target("avx2,fma")))
+#define SIMD_TARGET_AVX512	__attribute__((target("avx512f,avx2,fma")))
+#else
+#define SIMD_TARGET_SSE4
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#endif
+
+#define SIMD_ALIGN	64		// cache line, also the avx512 register width
+
+// allocator for the SoA tables read by the kernels, every array starts on a cache line
+template <class T>
+class alignedAllocator{
+public:
+	typedef T			value_type;
+	typedef T *			pointer;
+	typedef const T *	const_pointer;
+	typedef T &			reference;
+	typedef const T &	const_reference;
+	typedef size_t		size_type;
+	typedef ptrdiff_t	difference_type;
+
+	template <class U> struct rebind { typedef alignedAllocator<U> other; };
+
+	alignedAllocator(){}
+	template <class U> alignedAllocator(const alignedAllocator<U> &){}
+
+	pointer allocate(size_type n, const void * = 0){
+		void * p = _mm_malloc(n * sizeof(T), SIMD_ALIGN);
+		if (!p)
+			throw std::bad_alloc();
+		return static_cast<pointer>(p);
+	}
+	void deallocate(pointer p, size_type){ _mm_free(p); }
+
+	size_type max_size() const { return size_type(-1) / sizeof(T); }
+	void construct(pointer p, const T & val){ new((void *)p) T(val); }
+	void destroy(pointer p){ p->~T(); }
+
+	bool operator==(const alignedAllocator &) const { return true; }
+	bool operator!=(const alignedAllocator &) const { return false; }
+};
+
+typedef std::vector<float, alignedAllocator<float>>	alignedFloats;
+typedef std::vector<int, alignedAllocator<int>>		alignedInts;
+
+#endif
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "skinTable.h"
+#include "Table.h"
+
+const unsigned int skinTable::blockSize;
+
+typedef void (*skinFn)(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z);
+
+struct skinFns{
+	skinFn linear;
+	skinFn dualQuat;
+};
+
+
+bool getSkinMethod(const char * name, skinMethod & method){
+	if (strcmp(name, "linear") == 0)
+		method = SKIN_LINEAR;
+	else if (strcmp(name, "dualQuaternion") == 0)
+		method = SKIN_DUAL_QUATERNION;
+	else
+		return false;
+	return true;
+}
+
+
+void skinTable::init(const meshData & mesh, const meshTable & mTable, const int * jointIdxs){
+	const sparseWeights & weights = mesh._weights;
+	_method = mesh._skinMethod;
+	_numPoints = mTable.pointIdxTable.size();
+	_numPadded = (_numPoints + blockSize - 1) / blockSize * blockSize;
+
+	// the trailing slots no point uses are not gathered at all
+	_numSlots = 0;
+	for (std::size_t i = 0; i < _numPoints; i++){
+		for (unsigned int k = _numSlots; k < weights.numSlots(); k++){
+			if (weights.weight(mTable.pointIdxTable[i], k) > 0.0f)
+				_numSlots = k + 1;
+		}
+	}
+
+	_restX.assign(_numPadded, 0.0f);
+	_restY.assign(_numPadded, 0.0f);
+	_restZ.assign(_numPadded, 0.0f);
+	_joints.assign(_numPadded * _numSlots, 0);
+	_weights.assign(_numPadded * _numSlots, 0.0f);
+	for (std::size_t i = 0; i < _numPoints; i++){
+		unsigned int point = mTable.pointIdxTable[i];
+		_restX[i] = mesh._posPtr[point * 3];
+		_restY[i] = mesh._posPtr[point * 3 + 1];
+		_restZ[i] = mesh._posPtr[point * 3 + 2];
+		for (unsigned int k = 0; k < _numSlots; k++){
+			_joints[k * _numPadded + i] = jointIdxs[weights.influence(point, k)];
+			_weights[k * _numPadded + i] = weights.weight(point, k);
+		}
+	}
+}
+
+
+// a point whose weights sum to 0 stays at rest, as under the dual quaternions and in maya
+static void linearScalar(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z){
+	for (std::size_t i = start; i < end; i++){
+		float m[12] = { 0.0f }, sum = 0.0f;
+		for (unsigned int k = 0; k < t._numSlots; k++){
+			float w = t._weights[k * t._numPadded + i];
+			const float * mat = palette + t._joints[k * t._numPadded + i];
+			for (unsigned int e = 0; e < 12; e++)
+				m[e] += w * mat[e * numJoints];
+			sum += w;
+		}
+		float px = t._restX[i], py = t._restY[i], pz = t._restZ[i];
+		if (sum == 0.0f){
+			x[i] = px; y[i] = py; z[i] = pz;
+			continue;
+		}
+		x[i] = m[0] * px + m[1] * py + m[2]  * pz + m[3];
+		y[i] = m[4] * px + m[5] * py + m[6]  * pz + m[7];
+		z[i] = m[8] * px + m[9] * py + m[10] * pz + m[11];
+	}
+}
+
+
+// sse4 has no gather, the 4 matrices of a slot are read one element at a time
+SIMD_TARGET_SSE4 static void linearSse4(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z){
+	for (std::size_t i = start; i < end; i += 4){
+		__m128 m[12], sum = _mm_setzero_ps();
+		for (unsigned int e = 0; e < 12; e++)
+			m[e] = _mm_setzero_ps();
+		for (unsigned int k = 0; k < t._numSlots; k++){
+			const int * j = &t._joints[k * t._numPadded + i];
+			__m128 w = _mm_load_ps(&t._weights[k * t._numPadded + i]);
+			for (unsigned int e = 0; e < 12; e++){
+				const float * row = palette + e * numJoints;
+				m[e] = _mm_add_ps(m[e], _mm_mul_ps(w, _mm_setr_ps(row[j[0]], row[j[1]], row[j[2]], row[j[3]])));
+			}
+			sum = _mm_add_ps(sum, w);
+		}
+		__m128 px = _mm_load_ps(&t._restX[i]), py = _mm_load_ps(&t._restY[i]), pz = _mm_load_ps(&t._restZ[i]);
+		__m128 skinned = _mm_cmpneq_ps(sum, _mm_setzero_ps());
+		_mm_store_ps(x + i, _mm_blendv_ps(px, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], px), _mm_mul_ps(m[1], py)), _mm_add_ps(_mm_mul_ps(m[2], pz), m[3])), skinned));
+		_mm_store_ps(y + i, _mm_blendv_ps(py, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], px), _mm_mul_ps(m[5], py)), _mm_add_ps(_mm_mul_ps(m[6], pz), m[7])), skinned));
+		_mm_store_ps(z + i, _mm_blendv_ps(pz, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], px), _mm_mul_ps(m[9], py)), _mm_add_ps(_mm_mul_ps(m[10], pz), m[11])), skinned));
+	}
+}
+
+
+SIMD_TARGET_AVX2 static void linearAvx2(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z){
+	for (std::size_t i = start; i < end; i += 8){
+		__m256 m[12], sum = _mm256_setzero_ps();
+		for (unsigned int e = 0; e < 12; e++)
+			m[e] = _mm256_setzero_ps();
+		for (unsigned int k = 0; k < t._numSlots; k++){
+			__m256i j = _mm256_load_si256((const __m256i *)&t._joints[k * t._numPadded + i]);
+			__m256 w = _mm256_load_ps(&t._weights[k * t._numPadded + i]);
+			for (unsigned int e = 0; e < 12; e++)
+				m[e] = _mm256_fmadd_ps(w, _mm256_i32gather_ps(palette + e * numJoints, j, 4), m[e]);
+			sum = _mm256_add_ps(sum, w);
+		}
+		__m256 px = _mm256_load_ps(&t._restX[i]), py = _mm256_load_ps(&t._restY[i]), pz = _mm256_load_ps(&t._restZ[i]);
+		__m256 skinned = _mm256_cmp_ps(sum, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+		_mm256_store_ps(x + i, _mm256_blendv_ps(px, _mm256_fmadd_ps(m[0], px, _mm256_fmadd_ps(m[1], py, _mm256_fmadd_ps(m[2],  pz, m[3]))), skinned));
+		_mm256_store_ps(y + i, _mm256_blendv_ps(py, _mm256_fmadd_ps(m[4], px, _mm256_fmadd_ps(m[5], py, _mm256_fmadd_ps(m[6],  pz, m[7]))), skinned));
+		_mm256_store_ps(z + i, _mm256_blendv_ps(pz, _mm256_fmadd_ps(m[8], px, _mm256_fmadd_ps(m[9], py, _mm256_fmadd_ps(m[10], pz, m[11]))), skinned));
+	}
+}
+
+
+SIMD_TARGET_AVX512 static void linearAvx512(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z){
+	for (std::size_t i = start; i < end; i += 16){
+		__m512 m[12], sum = _mm512_setzero_ps();
+		for (unsigned int e = 0; e < 12; e++)
+			m[e] = _mm512_setzero_ps();
+		for (unsigned int k = 0; k < t._numSlots; k++){
+			__m512i j = _mm512_load_si512((const void *)&t._joints[k * t._numPadded + i]);
+			__m512 w = _mm512_load_ps(&t._weights[k * t._numPadded + i]);
+			for (unsigned int e = 0; e < 12; e++)
+				m[e] = _mm512_fmadd_ps(w, _mm512_i32gather_ps(j, palette + e * numJoints, 4), m[e]);
+			sum = _mm512_add_ps(sum, w);
+		}
+		__m512 px = _mm512_load_ps(&t._restX[i]), py = _mm512_load_ps(&t._restY[i]), pz = _mm512_load_ps(&t._restZ[i]);
+		__mmask16 skinned = _mm512_cmp_ps_mask(sum, _mm512_setzero_ps(), _CMP_NEQ_OQ);
+		_mm512_store_ps(x + i, _mm512_mask_blend_ps(skinned, px, _mm512_fmadd_ps(m[0], px, _mm512_fmadd_ps(m[1], py, _mm512_fmadd_ps(m[2],  pz, m[3])))));
+		_mm512_store_ps(y + i, _mm512_mask_blend_ps(skinned, py, _mm512_fmadd_ps(m[4], px, _mm512_fmadd_ps(m[5], py, _mm512_fmadd_ps(m[6],  pz, m[7])))));
+		_mm512_store_ps(z + i, _mm512_mask_blend_ps(skinned, pz, _mm512_fmadd_ps(m[8], px, _mm512_fmadd_ps(m[9], py, _mm512_fmadd_ps(m[10], pz, m[11])))));
+	}
+}
+
+
+// dual quaternion skinning, the dual quaternions of the slots are flipped to the hemisphere of the first slot,
+// blended, normalized and applied to the rest point:
+//	p' = p + 2 * r x ( r x p + w * p ) + 2 * ( w * d - dw * r + r x d ), with q0 = ( r, w ) and qe = ( d, dw )
+static void dualQuatScalar(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z){
+	for (std::size_t i = start; i < end; i++){
+		float q[8] = { 0.0f };
+		const float * first = palette + t._joints[i];
+		for (unsigned int k = 0; k < t._numSlots; k++){
+			float w = t._weights[k * t._numPadded + i];
+			const float * dq = palette + t._joints[k * t._numPadded + i];
+			float dot = dq[0] * first[0] + dq[numJoints] * first[numJoints] + dq[2 * numJoints] * first[2 * numJoints] + dq[3 * numJoints] * first[3 * numJoints];
+			if (dot < 0.0f)
+				w = -w;
+			for (unsigned int e = 0; e < 8; e++)
+				q[e] += w * dq[e * numJoints];
+		}
+		float len2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+		float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+		for (unsigned int e = 0; e < 8; e++)
+			q[e] *= inv;
+
+		float px = t._restX[i], py = t._restY[i], pz = t._restZ[i];
+		// c = r x p + w * p
+		float cx = q[1] * pz - q[2] * py + q[3] * px;
+		float cy = q[2] * px - q[0] * pz + q[3] * py;
+		float cz = q[0] * py - q[1] * px + q[3] * pz;
+		// translation 2 * ( w * d - dw * r + r x d )
+		float tx = q[3] * q[4] - q[7] * q[0] + q[1] * q[6] - q[2] * q[5];
+		float ty = q[3] * q[5] - q[7] * q[1] + q[2] * q[4] - q[0] * q[6];
+		float tz = q[3] * q[6] - q[7] * q[2] + q[0] * q[5] - q[1] * q[4];
+		x[i] = px + 2.0f * (q[1] * cz - q[2] * cy + tx);
+		y[i] = py + 2.0f * (q[2] * cx - q[0] * cz + ty);
+		z[i] = pz + 2.0f * (q[0] * cy - q[1] * cx + tz);
+	}
+}
+
+
+SIMD_TARGET_AVX2 static void dualQuatAvx2(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z){
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+	for (std::size_t i = start; i < end; i += 8){
+		__m256 q[8], f[4];
+		__m256i j0 = _mm256_load_si256((const __m256i *)&t._joints[i]);
+		for (unsigned int e = 0; e < 4; e++)
+			f[e] = _mm256_i32gather_ps(palette + e * numJoints, j0, 4);
+		for (unsigned int e = 0; e < 8; e++)
+			q[e] = zero;
+		for (unsigned int k = 0; k < t._numSlots; k++){
+			__m256i j = _mm256_load_si256((const __m256i *)&t._joints[k * t._numPadded + i]);
+			__m256 w = _mm256_load_ps(&t._weights[k * t._numPadded + i]);
+			__m256 r[4];
+			for (unsigned int e = 0; e < 4; e++)
+				r[e] = _mm256_i32gather_ps(palette + e * numJoints, j, 4);
+			__m256 dot = _mm256_fmadd_ps(r[0], f[0], _mm256_fmadd_ps(r[1], f[1], _mm256_fmadd_ps(r[2], f[2], _mm256_mul_ps(r[3], f[3]))));
+			w = _mm256_blendv_ps(w, _mm256_sub_ps(zero, w), _mm256_cmp_ps(dot, zero, _CMP_LT_OQ));
+			for (unsigned int e = 0; e < 4; e++)
+				q[e] = _mm256_fmadd_ps(w, r[e], q[e]);
+			for (unsigned int e = 4; e < 8; e++)
+				q[e] = _mm256_fmadd_ps(w, _mm256_i32gather_ps(palette + e * numJoints, j, 4), q[e]);
+		}
+		__m256 len2 = _mm256_fmadd_ps(q[0], q[0], _mm256_fmadd_ps(q[1], q[1], _mm256_fmadd_ps(q[2], q[2], _mm256_mul_ps(q[3], q[3]))));
+		__m256 inv = _mm256_and_ps(_mm256_div_ps(one, _mm256_sqrt_ps(len2)), _mm256_cmp_ps(len2, zero, _CMP_GT_OQ));
+		for (unsigned int e = 0; e < 8; e++)
+			q[e] = _mm256_mul_ps(q[e], inv);
+
+		__m256 px = _mm256_load_ps(&t._restX[i]), py = _mm256_load_ps(&t._restY[i]), pz = _mm256_load_ps(&t._restZ[i]);
+		__m256 cx = _mm256_fmadd_ps(q[3], px, _mm256_fmsub_ps(q[1], pz, _mm256_mul_ps(q[2], py)));
+		__m256 cy = _mm256_fmadd_ps(q[3], py, _mm256_fmsub_ps(q[2], px, _mm256_mul_ps(q[0], pz)));
+		__m256 cz = _mm256_fmadd_ps(q[3], pz, _mm256_fmsub_ps(q[0], py, _mm256_mul_ps(q[1], px)));
+		__m256 tx = _mm256_fmadd_ps(q[3], q[4], _mm256_fmsub_ps(q[1], q[6], _mm256_fmadd_ps(q[7], q[0], _mm256_mul_ps(q[2], q[5]))));
+		__m256 ty = _mm256_fmadd_ps(q[3], q[5], _mm256_fmsub_ps(q[2], q[4], _mm256_fmadd_ps(q[7], q[1], _mm256_mul_ps(q[0], q[6]))));
+		__m256 tz = _mm256_fmadd_ps(q[3], q[6], _mm256_fmsub_ps(q[0], q[5], _mm256_fmadd_ps(q[7], q[2], _mm256_mul_ps(q[1], q[4]))));
+		_mm256_store_ps(x + i, _mm256_fmadd_ps(two, _mm256_add_ps(_mm256_fmsub_ps(q[1], cz, _mm256_mul_ps(q[2], cy)), tx), px));
+		_mm256_store_ps(y + i, _mm256_fmadd_ps(two, _mm256_add_ps(_mm256_fmsub_ps(q[2], cx, _mm256_mul_ps(q[0], cz)), ty), py));
+		_mm256_store_ps(z + i, _mm256_fmadd_ps(two, _mm256_add_ps(_mm256_fmsub_ps(q[0], cy, _mm256_mul_ps(q[1], cx)), tz), pz));
+	}
+}
+
+
+SIMD_TARGET_AVX512 static void dualQuatAvx512(const skinTable & t, const float * palette, unsigned int numJoints, std::size_t start, std::size_t end,
+	float * x, float * y, float * z){
+	const __m512 zero = _mm512_setzero_ps(), two = _mm512_set1_ps(2.0f);
+	for (std::size_t i = start; i < end; i += 16){
+		__m512 q[8], f[4];
+		__m512i j0 = _mm512_load_si512((const void *)&t._joints[i]);
+		for (unsigned int e = 0; e < 4; e++)
+			f[e] = _mm512_i32gather_ps(j0, palette + e * numJoints, 4);
+		for (unsigned int e = 0; e < 8; e++)
+			q[e] = zero;
+		for (unsigned int k = 0; k < t._numSlots; k++){
+			__m512i j = _mm512_load_si512((const void *)&t._joints[k * t._numPadded + i]);
+			__m512 w = _mm512_load_ps(&t._weights[k * t._numPadded + i]);
+			__m512 r[4];
+			for (unsigned int e = 0; e < 4; e++)
+				r[e] = _mm512_i32gather_ps(j, palette + e * numJoints, 4);
+			__m512 dot = _mm512_fmadd_ps(r[0], f[0], _mm512_fmadd_ps(r[1], f[1], _mm512_fmadd_ps(r[2], f[2], _mm512_mul_ps(r[3], f[3]))));
+			w = _mm512_mask_sub_ps(w, _mm512_cmp_ps_mask(dot, zero, _CMP_LT_OQ), zero, w);
+			for (unsigned int e = 0; e < 4; e++)
+				q[e] = _mm512_fmadd_ps(w, r[e], q[e]);
+			for (unsigned int e = 4; e < 8; e++)
+				q[e] = _mm512_fmadd_ps(w, _mm512_i32gather_ps(j, palette + e * numJoints, 4), q[e]);
+		}
+		__m512 len2 = _mm512_fmadd_ps(q[0], q[0], _mm512_fmadd_ps(q[1], q[1], _mm512_fmadd_ps(q[2], q[2], _mm512_mul_ps(q[3], q[3]))));
+		__m512 inv = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(len2, zero, _CMP_GT_OQ), _mm512_set1_ps(1.0f), _mm512_sqrt_ps(len2));
+		for (unsigned int e = 0; e < 8; e++)
+			q[e] = _mm512_mul_ps(q[e], inv);
+
+		__m512 px = _mm512_load_ps(&t._restX[i]), py = _mm512_load_ps(&t._restY[i]), pz = _mm512_load_ps(&t._restZ[i]);
+		__m512 cx = _mm512_fmadd_ps(q[3], px, _mm512_fmsub_ps(q[1], pz, _mm512_mul_ps(q[2], py)));
+		__m512 cy = _mm512_fmadd_ps(q[3], py, _mm512_fmsub_ps(q[2], px, _mm512_mul_ps(q[0], pz)));
+		__m512 cz = _mm512_fmadd_ps(q[3], pz, _mm512_fmsub_ps(q[0], py, _mm512_mul_ps(q[1], px)));
+		__m512 tx = _mm512_fmadd_ps(q[3], q[4], _mm512_fmsub_ps(q[1], q[6], _mm512_fmadd_ps(q[7], q[0], _mm512_mul_ps(q[2], q[5]))));
+		__m512 ty = _mm512_fmadd_ps(q[3], q[5], _mm512_fmsub_ps(q[2], q[4], _mm512_fmadd_ps(q[7], q[1], _mm512_mul_ps(q[0], q[6]))));
+		__m512 tz = _mm512_fmadd_ps(q[3], q[6], _mm512_fmsub_ps(q[0], q[5], _mm512_fmadd_ps(q[7], q[2], _mm512_mul_ps(q[1], q[4]))));
+		_mm512_store_ps(x + i, _mm512_fmadd_ps(two, _mm512_add_ps(_mm512_fmsub_ps(q[1], cz, _mm512_mul_ps(q[2], cy)), tx), px));
+		_mm512_store_ps(y + i, _mm512_fmadd_ps(two, _mm512_add_ps(_mm512_fmsub_ps(q[2], cx, _mm512_mul_ps(q[0], cz)), ty), py));
+		_mm512_store_ps(z + i, _mm512_fmadd_ps(two, _mm512_add_ps(_mm512_fmsub_ps(q[0], cy, _mm512_mul_ps(q[1], cx)), tz), pz));
+	}
+}
+
+
+// sse4 has no gather, its dual quaternion blend is the scalar one
+static skinFns selectSkin(){
+	skinFns fns;
+	switch (getSimdLevel()){
+	case SIMD_AVX512:	fns.linear = linearAvx512;	fns.dualQuat = dualQuatAvx512;	break;
+	case SIMD_AVX2:		fns.linear = linearAvx2;	fns.dualQuat = dualQuatAvx2;	break;
+	case SIMD_SSE4:		fns.linear = linearSse4;	fns.dualQuat = dualQuatScalar;	break;
+	default:			fns.linear = linearScalar;	fns.dualQuat = dualQuatScalar;	break;
+	}
+	return fns;
+}
+
+
+void skinTable::skin(const skinPalette & palette, std::size_t start, std::size_t end, float * x, float * y, float * z) const{
+	const skinFns fns = selectSkin();
+	if (_numSlots == 0){
+		// no weight at all, and no joint to take the dual quaternion sign from: the points stay at rest
+		std::copy(_restX.begin() + start, _restX.begin() + end, x + start);
+		std::copy(_restY.begin() + start, _restY.begin() + end, y + start);
+		std::copy(_restZ.begin() + start, _restZ.begin() + end, z + start);
+	}
+	else if (_method == SKIN_DUAL_QUATERNION)
+		fns.dualQuat(*this, palette.dualQuats, palette.numJoints, start, end, x, y, z);
+	else
+		fns.linear(*this, palette.matrices, palette.numJoints, start, end, x, y, z);
+}
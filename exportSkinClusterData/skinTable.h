@@ -0,0 +1,51 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef SKINTABLE_H
+#define SKINTABLE_H
+
+#include "simd.h"
+#include "tableArray.h"
+#include "meshData.h"
+
+class meshTable;
+
+// "linear" or "dualQuaternion"
+bool getSkinMethod(const char * name, skinMethod & method);
+
+// per frame skinning data of the scene joints, each element SoA over the joints: element e of joint j at [e * numJoints + j]
+struct skinPalette{
+	const float *	matrices;		// 12 elements, the 3 x 4 skinning matrix ( current global * inverse bind )
+	const float *	dualQuats;		// 8 elements, real ( x, y, z, w ) then dual ( x, y, z, w ) part of the same transform
+	unsigned int	numJoints;
+};
+
+// linear blend or dual quaternion skinning of the rest points of a mesh, the geometric pose the projection starts from.
+// rest positions and weights are kept SoA in meshTable order, the weights slot major, and padded to
+// a multiple of blockSize points so the kernels never handle a tail. a point of no weight stays at rest with either method
+class skinTable{
+public:
+	static const unsigned int blockSize = 16;
+
+	skinTable():_numPoints(0), _numPadded(0), _numSlots(0), _method(SKIN_LINEAR){}
+
+	// lay out the rest positions and the sparse weights of the mesh in the order of its table
+	void init(const meshData & mesh, const meshTable & mTable, const int * jointIdxs);
+
+	// skin the points [start, end) into SoA x, y, z with the method of the mesh,
+	// start and end are multiples of blockSize or end is numPadded
+	void skin(const skinPalette & palette, std::size_t start, std::size_t end, float * x, float * y, float * z) const;
+
+	inline std::size_t numPadded() const { return _numPadded; }
+
+	std::size_t		_numPoints;
+	std::size_t		_numPadded;
+	unsigned int	_numSlots;		// slots used by at least one point
+	skinMethod		_method;
+	tableArray<float>	_restX, _restY, _restZ;
+	tableArray<int>		_joints;		// scene joint index of slot k of point i at k * numPadded + i
+	tableArray<float>	_weights;		// same layout, 0 for the unused slots
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <math.h>
+
+#include "sparseWeights.h"
+
+const unsigned int sparseWeights::maxSlots;
+
+void sparseWeights::init(unsigned int numPoints, unsigned int numSlots, bool quantize){
+	_numPoints	= numPoints;
+	_numSlots	= std::max(1u, std::min(numSlots, maxSlots));
+	_quantized	= quantize;
+
+	_influences.assign((std::size_t)numPoints * _numSlots, 0);
+	if (_quantized){
+		_qWeights.assign((std::size_t)numPoints * _numSlots, 0);
+		_weights.clear();
+	} else {
+		_weights.assign((std::size_t)numPoints * _numSlots, 0.0f);
+		_qWeights.clear();
+	}
+}
+
+
+// insertion into the slots sorted by decreasing weight, only the biggest numSlots are kept
+static inline void insertSlot(unsigned int * infs, float * wts, unsigned int & used, unsigned int numSlots, unsigned int inf, float w){
+	if (w <= 0.0f || (used == numSlots && w <= wts[used - 1]))
+		return;
+	unsigned int k = (used < numSlots) ? used++ : used - 1;
+	for (; k > 0 && wts[k - 1] < w; k--){
+		infs[k] = infs[k - 1];
+		wts[k] = wts[k - 1];
+	}
+	infs[k] = inf;
+	wts[k] = w;
+}
+
+
+void sparseWeights::setPoint(unsigned int point, const unsigned int * influences, const float * weights, unsigned int count){
+	unsigned int infs[maxSlots], used = 0;
+	float wts[maxSlots];
+	for (unsigned int i = 0; i < count; i++)
+		insertSlot(infs, wts, used, _numSlots, influences[i], weights[i]);
+	store(point, infs, wts, used);
+}
+
+
+void sparseWeights::setPoint(unsigned int point, const float * weights, unsigned int numInfluences){
+	unsigned int infs[maxSlots], used = 0;
+	float wts[maxSlots];
+	for (unsigned int j = 0; j < numInfluences; j++)
+		insertSlot(infs, wts, used, _numSlots, j, weights[j]);
+	store(point, infs, wts, used);
+}
+
+
+void sparseWeights::store(unsigned int point, const unsigned int * infs, const float * wts, unsigned int used){
+	float sum = 0.0f;
+	for (unsigned int k = 0; k < used; k++)
+		sum += wts[k];
+	float scale = sum > 0.0f ? 1.0f / sum : 0.0f;
+
+	std::size_t base = (std::size_t)point * _numSlots;
+	for (unsigned int k = 0; k < _numSlots; k++){
+		float w = k < used ? wts[k] * scale : 0.0f;
+		_influences[base + k] = (unsigned short)(k < used ? infs[k] : 0);
+		if (_quantized)
+			_qWeights[base + k] = (unsigned short)floorf(w * 65535.0f + 0.5f);
+		else
+			_weights[base + k] = w;
+	}
+}
+
+
+std::size_t sparseWeights::memorySize() const{
+	return _influences.size() * sizeof(unsigned short) + _weights.size() * sizeof(float) + _qWeights.size() * sizeof(unsigned short);
+}
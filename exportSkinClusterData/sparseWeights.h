@@ -0,0 +1,50 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef SPARSEWEIGHTS_H
+#define SPARSEWEIGHTS_H
+
+#include <vector>
+
+// skin weights of a mesh, the k biggest influences of each point in k slots, k <= 8.
+// the weights of a point are renormalized to sum to one, unused slots have influence 0 and weight 0.
+// quantized weights are stored as 16 bits fractions of one
+class sparseWeights{
+public:
+	static const unsigned int maxSlots = 8;
+
+	sparseWeights():_numPoints(0), _numSlots(0), _quantized(false){}
+
+	void init(unsigned int numPoints, unsigned int numSlots, bool quantize);
+
+	// set the weights of a point from count ( influence, weight ) pairs in any order, the smallest are dropped
+	void setPoint(unsigned int point, const unsigned int * influences, const float * weights, unsigned int count);
+
+	// set the weights of a point from the weights of all the influences
+	void setPoint(unsigned int point, const float * weights, unsigned int numInfluences);
+
+	inline unsigned int influence(unsigned int point, unsigned int slot) const {
+		return _influences[point * _numSlots + slot];
+	}
+	inline float weight(unsigned int point, unsigned int slot) const {
+		return _quantized ? _qWeights[point * _numSlots + slot] * (1.0f / 65535.0f) : _weights[point * _numSlots + slot];
+	}
+
+	inline unsigned int numSlots() const { return _numSlots; }
+	inline bool quantized() const { return _quantized; }
+	std::size_t memorySize() const;
+
+	unsigned int	_numPoints;
+	unsigned int	_numSlots;
+	bool			_quantized;
+
+	std::vector<unsigned short>	_influences;	// numSlots per point, influence index in the skinCluster
+	std::vector<float>			_weights;		// numSlots per point, empty when quantized
+	std::vector<unsigned short>	_qWeights;		// numSlots per point, empty unless quantized
+
+private:
+	void store(unsigned int point, const unsigned int * infs, const float * wts, unsigned int used);
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include <algorithm>
+
+#include "surfaceSampler.h"
+
+bool aliasTable::init(const double * weights, unsigned int count){
+	_prob.clear();
+	_alias.clear();
+
+	double sum = 0.0;
+	for (unsigned int i = 0; i < count; i++)
+		sum += weights[i];
+	if (!(sum > 0.0))
+		return false;
+
+	// scaled so the average column holds 1, then each small column is topped up by a large one
+	std::vector<double> scaled(count);
+	std::vector<unsigned int> small, large;
+	small.reserve(count);
+	large.reserve(count);
+	for (unsigned int i = 0; i < count; i++){
+		scaled[i] = weights[i] * count / sum;
+		if (scaled[i] < 1.0)
+			small.push_back(i);
+		else
+			large.push_back(i);
+	}
+
+	_prob.resize(count);
+	_alias.resize(count);
+	while (!small.empty() && !large.empty()){
+		unsigned int s = small.back(), l = large.back();
+		small.pop_back();
+		_prob[s] = (float)scaled[s];
+		_alias[s] = l;
+		scaled[l] -= 1.0 - scaled[s];
+		if (scaled[l] < 1.0){
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	// what is left holds 1 up to the rounding
+	for (std::size_t i = 0; i < large.size(); i++){
+		_prob[large[i]] = 1.0f;
+		_alias[large[i]] = large[i];
+	}
+	for (std::size_t i = 0; i < small.size(); i++){
+		_prob[small[i]] = 1.0f;
+		_alias[small[i]] = small[i];
+	}
+	return true;
+}
+
+
+const uint64_t spatialHash::emptyKey;
+
+void spatialHash::build(const float * pos, unsigned int count, float cellSize){
+	_cellSize = cellSize;
+	_invCellSize = 1.0f / cellSize;
+
+	// points sorted by cell, each run of a cell becomes one slot
+	std::vector<std::pair<uint64_t, uint32_t>> keyed(count);
+	for (unsigned int i = 0; i < count; i++){
+		int c[3];
+		cell(&pos[i * 3], c);
+		keyed[i] = std::make_pair(packKey(c[0], c[1], c[2]), (uint32_t)i);
+	}
+	std::sort(keyed.begin(), keyed.end());
+
+	unsigned int numCells = 0;
+	for (unsigned int i = 0; i < count; i++)
+		numCells += (i == 0 || keyed[i].first != keyed[i - 1].first);
+
+	// at most half full
+	uint32_t numSlots = 1;
+	while (numSlots < 2 * numCells)
+		numSlots <<= 1;
+	_mask = numSlots - 1;
+	_slotKeys.assign(numSlots, emptyKey);
+	_slotRanges.assign(numSlots, std::make_pair(0u, 0u));
+	_points.resize(count);
+
+	for (unsigned int i = 0; i < count;){
+		uint64_t key = keyed[i].first;
+		unsigned int end = i;
+		for (; end < count && keyed[end].first == key; end++)
+			_points[end] = keyed[end].second;
+
+		uint32_t b = hashKey(key) & _mask;
+		while (_slotKeys[b] != emptyKey)
+			b = (b + 1) & _mask;
+		_slotKeys[b] = key;
+		_slotRanges[b] = std::make_pair((uint32_t)i, (uint32_t)end);
+		i = end;
+	}
+}
+
+
+static inline float distance2(const float * a, const float * b){
+	float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+
+void poissonDiskSelect(const float * pos, unsigned int count, float radius, std::vector<unsigned int> & keep){
+	keep.clear();
+	if (!(radius > 0.0f)){
+		for (unsigned int i = 0; i < count; i++)
+			keep.push_back(i);
+		return;
+	}
+
+	spatialHash grid;
+	grid.build(pos, count, radius);
+	std::vector<unsigned char> kept(count, 0);
+	float radius2 = radius * radius;
+	for (unsigned int i = 0; i < count; i++){
+		bool free = true;
+		grid.forNeighbours(&pos[i * 3], [&](unsigned int j){
+			if (kept[j] && distance2(&pos[i * 3], &pos[j * 3]) < radius2)
+				free = false;
+		});
+		if (free){
+			kept[i] = 1;
+			keep.push_back(i);
+		}
+	}
+}
+
+
+// binary max heap of the point weights, with the heap position of each point so a weight can be lowered in place
+class weightHeap{
+public:
+	weightHeap(std::vector<float> & weights):_weights(weights), _heap(weights.size()), _pos(weights.size()){
+		for (std::size_t i = 0; i < _heap.size(); i++)
+			_heap[i] = _pos[i] = (unsigned int)i;
+		for (std::size_t i = _heap.size() / 2; i-- > 0;)
+			siftDown((unsigned int)i);
+	}
+
+	unsigned int pop(){
+		unsigned int top = _heap[0];
+		_heap[0] = _heap.back();
+		_pos[_heap[0]] = 0;
+		_heap.pop_back();
+		if (!_heap.empty())
+			siftDown(0);
+		return top;
+	}
+
+	// after _weights[point] was lowered
+	inline void lowered(unsigned int point){ siftDown(_pos[point]); }
+
+private:
+	void siftDown(unsigned int i){
+		unsigned int n = (unsigned int)_heap.size();
+		for (;;){
+			unsigned int largest = i, l = 2 * i + 1, r = l + 1;
+			if (l < n && _weights[_heap[l]] > _weights[_heap[largest]])
+				largest = l;
+			if (r < n && _weights[_heap[r]] > _weights[_heap[largest]])
+				largest = r;
+			if (largest == i)
+				return;
+			std::swap(_heap[i], _heap[largest]);
+			_pos[_heap[i]] = i;
+			_pos[_heap[largest]] = largest;
+			i = largest;
+		}
+	}
+
+	std::vector<float> &		_weights;
+	std::vector<unsigned int>	_heap;
+	std::vector<unsigned int>	_pos;
+};
+
+
+void eliminateSamples(const float * pos, unsigned int count, unsigned int target, double area, std::vector<unsigned int> & keep){
+	keep.clear();
+	if (target >= count || !(area > 0.0)){
+		for (unsigned int i = 0; i < std::min(count, target); i++)
+			keep.push_back(i);
+		return;
+	}
+
+	// radius of target points packed on the surface, the weights of points closer than the lower bound stop growing
+	// ( yuksel, sample elimination for generating poisson disk sample sets )
+	const float alpha = 8.0f, beta = 0.65f, gamma = 1.5f;
+	float rMax = (float)sqrt(area / (2.0 * sqrt(3.0) * target));
+	float rMin = rMax * (1.0f - powf((float)target / count, gamma)) * beta;
+	float dMax = 2.0f * rMax, dMin = 2.0f * rMin;
+
+	spatialHash grid;
+	grid.build(pos, count, dMax);
+
+	// neighbours of each point closer than dMax, and the weight they add to it
+	std::vector<unsigned int> nbrStart(count + 1, 0), nbrIdx;
+	std::vector<float> nbrWeight, weights(count, 0.0f);
+	for (unsigned int i = 0; i < count; i++){
+		grid.forNeighbours(&pos[i * 3], [&](unsigned int j){
+			float d2 = distance2(&pos[i * 3], &pos[j * 3]);
+			if (j == i || d2 >= dMax * dMax)
+				return;
+			float d = std::max(sqrtf(d2), dMin);
+			float w = powf(1.0f - d / dMax, alpha);
+			nbrIdx.push_back(j);
+			nbrWeight.push_back(w);
+			weights[i] += w;
+		});
+		nbrStart[i + 1] = (unsigned int)nbrIdx.size();
+	}
+
+	// remove the most crowded point, its neighbours lose its contribution
+	std::vector<unsigned char> removed(count, 0);
+	weightHeap heap(weights);
+	for (unsigned int left = count; left > target; left--){
+		unsigned int i = heap.pop();
+		removed[i] = 1;
+		for (unsigned int k = nbrStart[i]; k < nbrStart[i + 1]; k++){
+			unsigned int j = nbrIdx[k];
+			if (removed[j])
+				continue;
+			weights[j] -= nbrWeight[k];
+			heap.lowered(j);
+		}
+	}
+
+	for (unsigned int i = 0; i < count; i++){
+		if (!removed[i])
+			keep.push_back(i);
+	}
+}
@@ -0,0 +1,118 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef SURFACESAMPLER_H
+#define SURFACESAMPLER_H
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <math.h>
+
+// walker / vose alias table, draws an index with a probability proportional to its weight in O(1)
+class aliasTable{
+public:
+	aliasTable(){}
+
+	// weights may be any non negative values, returns false when they sum to 0
+	bool init(const double * weights, unsigned int count);
+
+	// u1 and u2 uniform in [0, 1)
+	inline unsigned int sample(float u1, float u2) const {
+		unsigned int column = (unsigned int)(u1 * _prob.size());
+		if (column >= _prob.size())
+			column = (unsigned int)_prob.size() - 1;
+		return (u2 < _prob[column]) ? column : _alias[column];
+	}
+
+	inline unsigned int size() const { return (unsigned int)_prob.size(); }
+
+private:
+	std::vector<float>			_prob;		// probability of keeping the column
+	std::vector<unsigned int>	_alias;		// index taken otherwise
+};
+
+
+// counter based random numbers, the value only depends on the key and the counter,
+// so a sample draws the same numbers whichever thread generates it
+class counterRng{
+public:
+	counterRng(uint64_t key):_key(key){}
+
+	// two uniform floats in [0, 1) for the counter
+	inline void uniform2(uint64_t counter, float & u1, float & u2) const {
+		uint64_t h = mix(_key + counter * 0x9E3779B97F4A7C15ull);
+		u1 = (uint32_t)(h >> 40) * (1.0f / 16777216.0f);
+		u2 = (uint32_t)(h & 0xFFFFFF) * (1.0f / 16777216.0f);
+	}
+
+	// splitmix64 finalizer
+	static inline uint64_t mix(uint64_t z){
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+private:
+	uint64_t _key;
+};
+
+
+
+// points ( x, y, z ) bucketed in cubic cells, a hash of the cell coordinates gives the range of the cell' points
+class spatialHash{
+public:
+	spatialHash():_cellSize(1.0f), _mask(0){}
+
+	void build(const float * pos, unsigned int count, float cellSize);
+
+	// call visit(j) for each point j in the 27 cells around p, the caller tests the distance
+	template<class Visit>
+	void forNeighbours(const float * p, const Visit & visit) const {
+		int c[3];
+		cell(p, c);
+		for (int dz = -1; dz <= 1; dz++)
+		for (int dy = -1; dy <= 1; dy++)
+		for (int dx = -1; dx <= 1; dx++){
+			uint64_t key = packKey(c[0] + dx, c[1] + dy, c[2] + dz);
+			for (uint32_t b = hashKey(key) & _mask; _slotKeys[b] != emptyKey; b = (b + 1) & _mask){
+				if (_slotKeys[b] != key)
+					continue;
+				for (uint32_t k = _slotRanges[b].first; k < _slotRanges[b].second; k++)
+					visit(_points[k]);
+				break;
+			}
+		}
+	}
+
+private:
+	static const uint64_t emptyKey = ~0ull;
+
+	inline void cell(const float * p, int * c) const {
+		for (int a = 0; a < 3; a++)
+			c[a] = (int)floorf(p[a] * _invCellSize);
+	}
+	static inline uint64_t packKey(int x, int y, int z){
+		return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) | (uint64_t)(z & 0x1FFFFF);
+	}
+	static inline uint32_t hashKey(uint64_t key){
+		return (uint32_t)(counterRng::mix(key) >> 32);
+	}
+
+	float	_cellSize, _invCellSize;
+	uint32_t _mask;
+	std::vector<uint64_t>	_slotKeys;		// open addressing over the occupied cells
+	std::vector<std::pair<uint32_t, uint32_t>> _slotRanges;	// range of the cell' points in _points
+	std::vector<uint32_t>	_points;		// point indices sorted by cell
+};
+
+
+// blue noise subsets of count points ( x, y, z ), the indices of the kept points are written to keep in increasing order.
+// poissonDiskSelect keeps the points in order when no kept point is closer than radius,
+// eliminateSamples removes the most crowded points until target are left ( weighted sample elimination ), area is the
+// area of the surface the points were drawn on
+void poissonDiskSelect(const float * pos, unsigned int count, float radius, std::vector<unsigned int> & keep);
+void eliminateSamples(const float * pos, unsigned int count, unsigned int target, double area, std::vector<unsigned int> & keep);
+
+#endif
@@ -0,0 +1,116 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef TABLEARRAY_H
+#define TABLEARRAY_H
+
+#include <stddef.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "simd.h"
+
+// array of a table, with the part of the std::vector interface the tables use. it owns its elements, cache line
+// aligned, or uses elements in place in a mapped file ( see sceneBuffer ). the pages of a mapped file are copied
+// on write, so the elements of a view can be written without changing the file. anything changing the size of a
+// view first copies its elements into an owned array
+template<class T>
+class tableArray{
+public:
+	typedef T			value_type;
+	typedef T *			iterator;
+	typedef const T *	const_iterator;
+	typedef std::vector<T, alignedAllocator<T>> storage;
+
+	tableArray():_data(nullptr), _size(0){}
+	// a copy owns its elements, of a view as well, so writing one of them never changes the other
+	tableArray(const tableArray & other):_own(other.begin(), other.end()), _data(nullptr), _size(0){ sync(); }
+	tableArray & operator=(const tableArray & other){
+		if (this != &other)
+			assign(other.begin(), other.end());
+		return *this;
+	}
+
+	// use count elements at data in place, keep holds the memory they are in
+	void view(T * data, std::size_t count, const std::shared_ptr<void> & keep){
+		storage().swap(_own);
+		_keep = keep;
+		_data = count ? data : nullptr;
+		_size = count;
+	}
+	inline bool isView() const { return _keep != nullptr; }
+
+	inline std::size_t size() const { return _size; }
+	inline bool empty() const { return _size == 0; }
+	inline T * data() { return _data; }
+	inline const T * data() const { return _data; }
+	inline T & operator[](std::size_t i) { return _data[i]; }
+	inline const T & operator[](std::size_t i) const { return _data[i]; }
+	inline T & back() { return _data[_size - 1]; }
+	inline const T & back() const { return _data[_size - 1]; }
+	inline iterator begin() { return _data; }
+	inline iterator end() { return _data + _size; }
+	inline const_iterator begin() const { return _data; }
+	inline const_iterator end() const { return _data + _size; }
+
+	void resize(std::size_t count){ own(); _own.resize(count); sync(); }
+	void resize(std::size_t count, const T & value){ own(); _own.resize(count, value); sync(); }
+	void reserve(std::size_t count){ own(); _own.reserve(count); sync(); }
+	void push_back(const T & value){ own(); _own.push_back(value); sync(); }
+	void clear(){ release(); sync(); }
+
+	void assign(std::size_t count, const T & value){
+		release();
+		_own.assign(count, value);
+		sync();
+	}
+	template<class Iter>
+	void assign(Iter first, Iter last){
+		storage elems(first, last);
+		release();
+		_own.swap(elems);
+		sync();
+	}
+	template<class Iter>
+	void insert(iterator pos, Iter first, Iter last){
+		std::size_t at = pos - _data;
+		own();
+		_own.insert(_own.begin() + at, first, last);
+		sync();
+	}
+
+	void swap(tableArray & other){
+		_own.swap(other._own);
+		_keep.swap(other._keep);
+		std::swap(_data, other._data);
+		std::swap(_size, other._size);
+	}
+
+	// the elements of a view copied into the owned array, nothing when they are owned already
+	void own(){
+		if (!_keep)
+			return;
+		storage elems(_data, _data + _size);
+		_own.swap(elems);
+		_keep.reset();
+	}
+
+private:
+	void release(){
+		_keep.reset();
+		storage().swap(_own);
+	}
+	inline void sync(){
+		_data = _own.empty() ? nullptr : &_own[0];
+		_size = _own.size();
+	}
+
+	storage					_own;
+	std::shared_ptr<void>	_keep;		// the mapping of a view, null when the elements are owned
+	T *						_data;
+	std::size_t				_size;
+};
+
+#endif
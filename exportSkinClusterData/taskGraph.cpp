@@ -0,0 +1,35 @@
+#include "taskGraph.h"
+
+
+unsigned int taskGraph::add(const taskFunc & func){
+	_tasks.push_back(task());
+	_tasks.back().func = func;
+	return (unsigned int)(_tasks.size() - 1);
+}
+
+
+void taskGraph::addDependency(unsigned int t, unsigned int before){
+	_tasks[before].next.push_back(t);
+	_tasks[t].numWaits++;
+}
+
+
+void taskGraph::start(){
+	_pending.reset(new std::atomic<unsigned int>[_tasks.size()]);
+	_roots.clear();
+	for (std::size_t t = 0; t < _tasks.size(); t++){
+		_pending[t].store(_tasks[t].numWaits, std::memory_order_relaxed);
+		if (_tasks[t].numWaits == 0)
+			_roots.push_back((unsigned int)t);
+	}
+}
+
+
+void taskGraph::finish(unsigned int t, std::vector<unsigned int> & ready){
+	// acq_rel, the last one done sees the results of all the others
+	const std::vector<unsigned int> & next = _tasks[t].next;
+	for (std::size_t k = 0; k < next.size(); k++){
+		if (_pending[next[k]].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			ready.push_back(next[k]);
+	}
+}
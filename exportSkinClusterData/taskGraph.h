@@ -0,0 +1,72 @@
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// tasks and the tasks each one waits for. run starts the tasks which wait for none on the controller, and the
+// last task a task waits for starts it when done: the tasks it made ready are a nested parallelFor, which the idle
+// workers steal from. so the chains of independent tasks run concurrently, each as soon as its inputs are done,
+// and a task may spread its own work on the controller as well
+class taskGraph{
+public:
+	typedef std::function<void()> taskFunc;
+
+	// index of the new task
+	unsigned int add(const taskFunc & func);
+	// t runs after before is done
+	void addDependency(unsigned int t, unsigned int before);
+
+	inline std::size_t size() const { return _tasks.size(); }
+
+	// every task once, the graph has no cycle
+	template<class computeController>
+	void run(computeController & controller);
+
+private:
+	class task{
+	public:
+		task():numWaits(0){}
+
+		taskFunc					func;
+		std::vector<unsigned int>	next;		// the tasks waiting for this one
+		unsigned int				numWaits;
+	};
+
+	template<class computeController>
+	void runTasks(const std::vector<unsigned int> & tasks, computeController & controller);
+
+	void start();	// the pending counts, and the tasks which wait for none
+	void finish(unsigned int t, std::vector<unsigned int> & ready);	// the tasks after t it made ready
+
+	std::vector<task>			_tasks;
+	std::unique_ptr<std::atomic<unsigned int>[]>	_pending;	// the tasks each task still waits for
+	std::vector<unsigned int>	_roots;
+};
+
+
+template<class computeController>
+void taskGraph::run(computeController & controller){
+	start();
+	runTasks(_roots, controller);
+}
+
+
+template<class computeController>
+void taskGraph::runTasks(const std::vector<unsigned int> & tasks, computeController & controller){
+	controller.parallelFor(tasks.size(), [&](std::size_t k){
+		_tasks[tasks[k]].func();
+		std::vector<unsigned int> ready;
+		finish(tasks[k], ready);
+		if (!ready.empty())
+			runTasks(ready, controller);
+	});
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "tree.h"
+#include "pcaFrame.h"
 
 bool binaryTree::iterativeInsert(std::shared_ptr<binaryTreeNode> root, std::shared_ptr<binaryTreeNode> node, std::string parentName){
 	if (root->name == parentName){
@@ -32,106 +33,74 @@ MStatus binaryTree::insertNode(std::shared_ptr<binaryTreeNode> node, std::string
 		return MStatus::kFailure;
 }
 
-MStatus setLocalCoordOp::operator()(std::shared_ptr<binaryTreeNode> node){
-	using namespace Eigen;
+void binaryTree::indexNodes(std::vector<nodeDepth> & table) const{
+	table.clear();
+	if (!root)
+		return;
+
+	// siblings share the depth, children are one deeper. the world root is not indexed
+	std::vector<nodeDepth> stack;
+	if (root->child)
+		stack.push_back(std::make_pair(root->child, 1u));
+	while (!stack.empty()){
+		nodeDepth current = stack.back();
+		stack.pop_back();
+		const std::shared_ptr<binaryTreeNode> & node = current.first;
+		if (node->index >= table.size())
+			table.resize(node->index + 1, std::make_pair(std::shared_ptr<binaryTreeNode>(), 0u));
+		table[node->index] = current;
+
+		if (node->sibling)
+			stack.push_back(std::make_pair(node->sibling, current.second));
+		if (node->child)
+			stack.push_back(std::make_pair(node->child, current.second + 1));
+	}
+}
 
-	unsigned int m = 3;   // dimension of each point
-	unsigned int n = node->points->length();  // number of points 
-	// matrix (n x m)
-	MatrixXd DataPoints(n, m);  
-	
-	// fill the data
+MStatus setLocalCoordOp::operator()(std::shared_ptr<binaryTreeNode> node){
 	std::shared_ptr<MFloatPointArray> pts = node->points;
 	unsigned int nPoints = pts->length();
-	for(unsigned int i = 0; i < nPoints; i++) {
-		float* ptPtr = &(*pts)[i].x;
-		for(unsigned int j=0; j<3; j++) {
-			DataPoints(i,j) = ptPtr[j];
-		}
-	}
-
-	// calculate mean value for each dimension
-	double mean; RowVectorXd meanRow(m);
-	for (int j = 0; j < DataPoints.cols(); j++){
-		mean = (DataPoints.col(j).sum())/n;		//compute mean
-		meanRow(j) = mean;
-	}
+	if (nPoints == 0)
+		return MStatus::kSuccess;	// no points, the coord is left as it is
+	const float * ptPtr = &(*pts)[0].x;		// x, y, z, w of each point
 
-	//   center each point with the mean value
-	for (int i = 0; i < DataPoints.rows(); i++){
-		DataPoints.row(i) -= meanRow;
-	}
-	
-	// get the covariance matrix
-	MatrixXd Covariance = MatrixXd::Zero(m, m);
-	Covariance = (1 / (double) n) * DataPoints.transpose() * DataPoints;
-	//  std::cout << Covariance ;	
-
-	// compute the eigenvalue on the covariance Matrix
-	EigenSolver<MatrixXd> m_solve(Covariance);
-	VectorXd eigenvalues = VectorXd::Zero(m);
-	eigenvalues = m_solve.eigenvalues().real();
-
-	MatrixXd eigenVectors = MatrixXd::Zero(n, m);  // matrix (n x m) (points, dims)
-	eigenVectors = m_solve.eigenvectors().real();	
-
-	// sort and get the permutation indices
-	typedef std::pair<double, int> valueIndex;
-	typedef std::vector<valueIndex> PermutationIndices;	
-
-	PermutationIndices eigenValueInOrder;
-	for (unsigned int i = 0 ; i < m; i++)
-		eigenValueInOrder.push_back(std::make_pair(eigenvalues(i), i));
-
-	sort(eigenValueInOrder.begin(), eigenValueInOrder.end());
+	// mean and covariance in one pass
+	pointMoments moments;
+	moments.add(ptPtr, nPoints, 4);
+	double covariance[6], values[3], eigenVectors[3][3];
+	moments.covariance(covariance);
+	symmetricEigen3(covariance, values, eigenVectors);
 
 	// get the local axis x, y, z, with x as the length axis
-	Vector3d axisX = eigenVectors.col(eigenValueInOrder[m-1].second);
-	Vector3d axisY, axisZ;
-	double y[3] = {0.0, 0.0, 0.0};double z[3] = {0.0, 0.0, 0.0};
-	if (fabs(axisX.x()) > fabs(axisX.y())){
-		double invLen = 1.0 / sqrt(axisX.x() * axisX.x() + axisX.z() * axisX.z());
-		y[0] = - axisX.z() * invLen; y[1] = 0.0; y[2] = axisX.x() * invLen;
-		axisY = Vector3d(y);
+	const double * axisX = eigenVectors[0];
+	double axisY[3], axisZ[3];
+	if (fabs(axisX[0]) > fabs(axisX[1])){
+		double invLen = 1.0 / sqrt(axisX[0] * axisX[0] + axisX[2] * axisX[2]);
+		axisY[0] = - axisX[2] * invLen; axisY[1] = 0.0; axisY[2] = axisX[0] * invLen;
 	}else {
-		double invLen = 1.0 / sqrt(axisX.y() * axisX.y() + axisX.z() * axisX.z());
-		y[0] = 0.0; y[1] = axisX.z() * invLen; y[2] = - axisX.y() * invLen;
-		axisY = Vector3d(y);
-	}
-	axisZ = axisX.cross(axisY);
-
-	// get the local coord' center
-	Vector3d center = meanRow.transpose();
-	
-	// get the size of bbox
-	MatrixXd rowFeatureVector = MatrixXd::Zero(m, m);
-	for (unsigned int i = 0; i < m; i++){
-		rowFeatureVector.row(i) = eigenVectors.col(eigenValueInOrder[m-1-i].second).transpose();
+		double invLen = 1.0 / sqrt(axisX[1] * axisX[1] + axisX[2] * axisX[2]);
+		axisY[0] = 0.0; axisY[1] = axisX[2] * invLen; axisY[2] = - axisX[1] * invLen;
 	}
+	axisZ[0] = axisX[1] * axisY[2] - axisX[2] * axisY[1];
+	axisZ[1] = axisX[2] * axisY[0] - axisX[0] * axisY[2];
+	axisZ[2] = axisX[0] * axisY[1] - axisX[1] * axisY[0];
 
-	MatrixXd finalData = MatrixXd::Zero(m, n);  // matrix ( m * n ) 
-	finalData = rowFeatureVector * DataPoints.transpose();
-	
-	Vector3d bbox;
-	std::vector<double> vals;
-	for (unsigned int j = 0; j < m; j++){
-		for (unsigned int i = 0 ; i < n; i++)
-			vals.push_back(finalData(j,i));
-		sort(vals.begin(), vals.end());
-		bbox(j) = std::max(fabs(vals[0]), fabs(vals[n-1]));
-		vals.clear();
-	}
+	// get the size of bbox along the eigen vectors, the largest extent on each side of the center
+	double bboxMin[3], bboxMax[3], bbox[3];
+	projectedBounds(ptPtr, nPoints, 4, moments.mean, eigenVectors, bboxMin, bboxMax);
+	for (unsigned int j = 0; j < 3; j++)
+		bbox[j] = std::max(fabs(bboxMin[j]), fabs(bboxMax[j]));
 
 	// set the tree node' coord member
-	node->coord->axisX->x = axisX.x(); node->coord->axisX->y = axisX.y(); node->coord->axisX->z = axisX.z();
-	node->coord->axisY->x = axisY.x(); node->coord->axisY->y = axisY.y(); node->coord->axisY->z = axisY.z();
-	node->coord->axisZ->x = axisZ.x(); node->coord->axisZ->y = axisZ.y(); node->coord->axisZ->z = axisZ.z();
+	node->coord->axisX->x = axisX[0]; node->coord->axisX->y = axisX[1]; node->coord->axisX->z = axisX[2];
+	node->coord->axisY->x = axisY[0]; node->coord->axisY->y = axisY[1]; node->coord->axisY->z = axisY[2];
+	node->coord->axisZ->x = axisZ[0]; node->coord->axisZ->y = axisZ[1]; node->coord->axisZ->z = axisZ[2];
 
 	// set the tree node's center
-	node->coord->center->x = center.x(); node->coord->center->y = center.y(); node->coord->center->z = center.z(); 
+	node->coord->center->x = moments.mean[0]; node->coord->center->y = moments.mean[1]; node->coord->center->z = moments.mean[2];
 
 	// set the tree node's bbox
-	node->coord->bbox->x = bbox.x(); node->coord->bbox->y = bbox.y(); node->coord->bbox->z = bbox.z(); 
+	node->coord->bbox->x = bbox[0]; node->coord->bbox->y = bbox[1]; node->coord->bbox->z = bbox[2];
 
 	return MStatus::kSuccess;
 }
\ No newline at end of file
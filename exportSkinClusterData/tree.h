@@ -17,9 +17,6 @@
 #include <maya/MIOStream.h>
 #include <maya/MUintArray.h>
 
-// include Eigen
-#include <Eigen/Core>
-#include <Eigen/Eigen>
 #include <algorithm>
 #include <math.h>
 
@@ -140,6 +137,9 @@ private:
 	FILE * file;
 };
 
+// a node and its depth in the tree, as counted by binaryTree::find
+typedef std::pair<std::shared_ptr<binaryTreeNode>, unsigned int> nodeDepth;
+
 class binaryTree {
 public:	
 	binaryTree():root(new binaryTreeNode(-1, std::string("world"))){
@@ -155,6 +155,9 @@ public:
 	template <class nodeOperator>
 	MStatus find(std::shared_ptr<binaryTreeNode> root, nodeOperator& ope, unsigned int & level, std::shared_ptr<binaryTreeNode> & result);
 
+	// node and depth of each node index in one pass, so a lookup does not search the tree
+	void indexNodes(std::vector<nodeDepth> & table) const;
+
 	std::shared_ptr<binaryTreeNode> root;
 private:
 	bool iterativeInsert(std::shared_ptr<binaryTreeNode> root, std::shared_ptr<binaryTreeNode> node, std::string parentName);